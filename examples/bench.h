@@ -0,0 +1,122 @@
+// Helpers shared by the benchmark examples.
+
+#ifndef __FRY__EXAMPLES__BENCH_H__
+#define __FRY__EXAMPLES__BENCH_H__
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+namespace bench {
+
+typedef std::chrono::steady_clock Clock;
+
+inline std::uint64_t now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    Clock::now().time_since_epoch()).count();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Histogram with logarithmic buckets, each power of two split into 32 linear
+// sub-buckets, so every recorded value is off by at most ~3%. Recording is
+// just an increment, so it can be done on every reply.
+class Histogram {
+public:
+  Histogram() : _counts(60 << sub_bits, 0), _total(0) {}
+
+  void record(std::uint64_t value) {
+    ++_counts[index(value)];
+    ++_total;
+  }
+
+  void merge(const Histogram& other) {
+    for (std::size_t i = 0; i < _counts.size(); ++i) {
+      _counts[i] += other._counts[i];
+    }
+
+    _total += other._total;
+  }
+
+  void clear() {
+    std::fill(_counts.begin(), _counts.end(), 0);
+    _total = 0;
+  }
+
+  std::uint64_t total() const {
+    return _total;
+  }
+
+  // Smallest value such that the fraction q of the recorded values is not
+  // larger than it.
+  std::uint64_t percentile(double q) const {
+    auto          rank = std::uint64_t(q * _total);
+    std::uint64_t seen = 0;
+
+    for (std::size_t i = 0; i < _counts.size(); ++i) {
+      seen += _counts[i];
+      if (seen > rank) return value(i);
+    }
+
+    return 0;
+  }
+
+private:
+  static const int sub_bits = 5;
+  static const int sub_size = 1 << sub_bits;
+
+  static std::size_t index(std::uint64_t value) {
+    if (value < sub_size) return value;
+
+    int msb   = 63 - __builtin_clzll(value);
+    int shift = msb - sub_bits;
+
+    return ((shift + 1) << sub_bits) + ((value >> shift) & (sub_size - 1));
+  }
+
+  static std::uint64_t value(std::size_t index) {
+    if (index < sub_size) return index;
+
+    int shift = int(index >> sub_bits) - 1;
+    return std::uint64_t(sub_size + (index & (sub_size - 1))) << shift;
+  }
+
+private:
+  std::vector<std::uint64_t> _counts;
+  std::uint64_t              _total;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Measurements of one run of a benchmark.
+struct Stats {
+  std::uint64_t num_lost;
+  Histogram     rtt;        // in nanoseconds
+
+  Stats() : num_lost(0) {}
+
+  void merge(const Stats& other) {
+    num_lost += other.num_lost;
+    rtt.merge(other.rtt);
+  }
+};
+
+inline void print_header() {
+  std::printf( "%10s %12s %10s %10s %10s %10s\n"
+             , "in flight", "pps", "p50 us", "p99 us", "p999 us", "lost");
+}
+
+inline void print_row(std::size_t in_flight, double seconds, const Stats& stats) {
+  std::printf( "%10zu %12.0f %10.1f %10.1f %10.1f %10llu\n"
+             , in_flight
+             , stats.rtt.total() / seconds
+             , stats.rtt.percentile(0.5)   / 1000.0
+             , stats.rtt.percentile(0.99)  / 1000.0
+             , stats.rtt.percentile(0.999) / 1000.0
+             , (unsigned long long) stats.num_lost);
+  std::fflush(stdout);
+}
+
+} // namespace bench
+
+#endif // __FRY__EXAMPLES__BENCH_H__
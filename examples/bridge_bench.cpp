@@ -0,0 +1,91 @@
+// Completions sent from worker threads back to an io_service loop: one
+// io_service::post per completion against LoopBridge::post, which wakes the
+// loop once for everything queued since its last wakeup.
+//
+// Every worker posts its share of the completions as fast as it can and the
+// loop counts them. Prints the throughput and, for the bridge, how many
+// completions came in with each wakeup.
+//
+//   ./examples/bridge_bench [completions] [threads]
+
+#include <cstdio>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <boost/asio.hpp>
+#include "fry.h"
+#include "fry/loop_bridge.h"
+#include "bench.h"
+
+using namespace boost::asio;
+using namespace fry;
+
+////////////////////////////////////////////////////////////////////////////////
+// Runs the loop on this thread while `threads` workers call post(done) `n`
+// times in total. Returns the elapsed seconds.
+template<typename Post>
+double run(io_service& io_service, std::size_t n, std::size_t threads, Post post) {
+  io_service::work work(io_service);
+  std::size_t      num_done = 0;
+
+  auto done = [&]() {
+    if (++num_done == n) io_service.stop();
+  };
+
+  auto start = bench::now_ns();
+
+  std::vector<std::thread> workers;
+
+  for (std::size_t t = 0; t < threads; ++t) {
+    auto share = n / threads + (t < n % threads ? 1 : 0);
+
+    workers.emplace_back([=]() {
+      for (std::size_t i = 0; i < share; ++i) post(done);
+    });
+  }
+
+  io_service.run();
+
+  auto seconds = (bench::now_ns() - start) / 1e9;
+
+  for (auto& worker : workers) worker.join();
+  return seconds;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+int main(int argc, char** argv) {
+  if (argc > 3) {
+    std::cerr << "Usage: bridge_bench [completions] [threads]\n";
+    return 1;
+  }
+
+  std::size_t n       = argc > 1 ? std::atoi(argv[1]) : 4000000;
+  std::size_t threads = argc > 2 ? std::atoi(argv[2]) : 4;
+
+  std::printf("%zu completions from %zu threads\n", n, threads);
+  std::printf("%10s %14s %14s\n", "", "completions/s", "per wakeup");
+
+  {
+    io_service io_service;
+
+    auto seconds = run(io_service, n, threads, [&](const std::function<void()>& done) {
+      io_service.post(done);
+    });
+
+    std::printf("%10s %14.0f %14s\n", "post", n / seconds, "1");
+  }
+
+  {
+    io_service       io_service;
+    asio::LoopBridge bridge(io_service);
+
+    auto seconds = run(io_service, n, threads, [&](const std::function<void()>& done) {
+      bridge.post(done);
+    });
+
+    std::printf( "%10s %14.0f %14.1f\n", "bridge", n / seconds
+               , double(bridge.num_posts()) / bridge.num_wakeups());
+  }
+
+  return 0;
+}
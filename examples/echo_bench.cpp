@@ -0,0 +1,246 @@
+// Load generator and latency benchmark for echo_server.
+//
+// Every socket keeps a fixed number of requests in flight: each reply is
+// answered with a new request right away. The run is repeated for increasing
+// numbers of requests in flight, and for each one the replies per second and
+// the percentiles of the round trip time are printed. A request with no reply
+// for a while is counted as lost and sent again.
+//
+// To see how much the futures add per operation, compare the two flavours of
+// the server:
+//
+//   ./examples/echo_server 9000 &
+//   ./examples/echo_bench 127.0.0.1 9000
+//
+//   ./examples/echo_server 9000 callback &
+//   ./examples/echo_bench 127.0.0.1 9000
+//
+// The batch flavour receives and sends with recvmmsg/sendmmsg, so it pays
+// off when many requests are in flight at once (use several sockets):
+//
+//   ./examples/echo_server 9000 batch &
+//   ./examples/echo_bench 127.0.0.1 9000 1 8
+//
+// The sharded flavour runs a server on every core, each with its own socket
+// on the same port. The kernel picks the socket by the address of the
+// client, so use several sockets (and client threads) to load all of them:
+//
+//   ./examples/echo_server 9000 sharded 4 &
+//   ./examples/echo_bench 127.0.0.1 9000 4 16
+//
+// reactor_echo_server is the same server on fry::Reactor, without asio:
+//
+//   ./examples/reactor_echo_server 9000 &
+//   ./examples/echo_bench 127.0.0.1 9000
+
+#include <cstring>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <boost/asio.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include "fry.h"
+#include "fry/asio.h"
+#include "bench.h"
+
+using namespace boost::asio;
+using namespace fry;
+using ip::udp;
+
+////////////////////////////////////////////////////////////////////////////////
+struct Packet {
+  std::uint32_t phase;
+  std::uint32_t slot;
+  std::uint64_t sent;
+};
+
+class Client {
+public:
+  Client( io_service& io_service, const udp::endpoint& server
+        , Recycler& memory)
+    : _memory(memory)
+    , _strand(io_service)
+    , _socket(io_service, udp::endpoint(udp::v4(), 0))
+    , _timer(io_service)
+    , _phase(0)
+    , _running(false)
+  {
+    _socket.connect(server);
+  }
+
+  // Starts a new run with `in_flight` requests outstanding at any time.
+  void start(std::uint32_t phase, std::size_t in_flight) {
+    _strand.dispatch([=]() {
+      auto first = _phase == 0;
+
+      _phase   = phase;
+      _running = true;
+      _stats   = bench::Stats();
+      _slots.assign(in_flight, Slot());
+
+      for (std::size_t i = 0; i < in_flight; ++i) send(i);
+
+      if (first) {
+        receive();
+        tick();
+      }
+    });
+  }
+
+  // Discards what was measured so far (used to skip the warmup).
+  void reset() {
+    _strand.dispatch([=]() { _stats = bench::Stats(); });
+  }
+
+  // Stops sending new requests. Returns what was measured.
+  Future<bench::Stats> stop() {
+    return make_ready_future().then_on(_strand, [=]() {
+      _running = false;
+      return _stats;
+    });
+  }
+
+private:
+  enum { payload_size = 32, timeout_ms = 200 };
+
+  struct Slot {
+    std::uint64_t sent;
+    char          data[payload_size];
+  };
+
+  void send(std::size_t index) {
+    auto& slot = _slots[index];
+
+    Packet packet = { _phase, std::uint32_t(index), bench::now_ns() };
+    std::memcpy(slot.data, &packet, sizeof(packet));
+    slot.sent = packet.sent;
+
+    _socket.async_send( buffer(slot.data, payload_size)
+                      , asio::use_future_on(_strand)[_memory]);
+  }
+
+  void receive() {
+    _socket.async_receive( buffer(_reply, sizeof(_reply))
+                         , asio::use_future_on(_strand)[_memory]
+    ).then([=](std::size_t length) {
+      if (length < sizeof(Packet)) return;
+
+      Packet packet;
+      std::memcpy(&packet, _reply, sizeof(packet));
+
+      // Late replies of requests that were already counted as lost, or that
+      // belong to a previous run, are ignored.
+      if (  !_running
+         || packet.phase != _phase
+         || packet.slot  >= _slots.size()
+         || packet.sent  != _slots[packet.slot].sent)
+      {
+        return;
+      }
+
+      _stats.rtt.record(bench::now_ns() - packet.sent);
+      send(packet.slot);
+    }).always([=]() {
+      receive();
+    });
+  }
+
+  void tick() {
+    _timer.expires_from_now(std::chrono::milliseconds(timeout_ms / 2));
+    _timer.async_wait(asio::use_future_on(_strand)).then([=]() {
+      auto limit = bench::now_ns() - timeout_ms * 1000000ull;
+
+      for (std::size_t i = 0; _running && i < _slots.size(); ++i) {
+        if (_slots[i].sent < limit) {
+          ++_stats.num_lost;
+          send(i);
+        }
+      }
+
+      tick();
+    });
+  }
+
+private:
+  Recycler&          _memory;
+  io_service::strand _strand;
+  udp::socket        _socket;
+  steady_timer       _timer;
+  char               _reply[payload_size];
+
+  std::uint32_t      _phase;
+  bool               _running;
+  std::vector<Slot>  _slots;
+  bench::Stats       _stats;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+int main(int argc, char** argv) {
+  if (argc < 3 || argc > 6) {
+    std::cerr << "Usage: echo_bench <host> <port> [threads] [sockets] [seconds]\n";
+    return 1;
+  }
+
+  auto num_threads = argc > 3 ? std::atoi(argv[3]) : 1;
+  auto num_sockets = argc > 4 ? std::atoi(argv[4]) : 1;
+  auto seconds     = argc > 5 ? std::atof(argv[5]) : 2.0;
+
+  // Operations still pending when the clients are destroyed release their
+  // memory only when the io_service is destroyed, so the recycler must
+  // outlive it.
+  Recycler         memory;
+  io_service       io_service;
+  io_service::work work(io_service);
+
+  udp::resolver resolver(io_service);
+  udp::endpoint server = *resolver.resolve({udp::v4(), argv[1], argv[2]});
+
+  std::vector<std::unique_ptr<Client>> clients;
+  for (int i = 0; i < num_sockets; ++i) {
+    clients.emplace_back(new Client(io_service, server, memory));
+  }
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < num_threads; ++i) {
+    threads.emplace_back([&]() { io_service.run(); });
+  }
+
+  std::cout << num_threads << " threads, "
+            << num_sockets << " sockets, "
+            << seconds     << " s per run\n";
+  bench::print_header();
+
+  std::uint32_t phase = 0;
+
+  for (std::size_t in_flight = 1; in_flight <= 256; in_flight *= 2) {
+    ++phase;
+
+    for (auto& client : clients) client->start(phase, in_flight);
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    for (auto& client : clients) client->reset();
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+
+    std::vector<Future<bench::Stats>> runs;
+    for (auto& client : clients) runs.push_back(client->stop());
+
+    std::promise<bench::Stats> done;
+
+    auto merge = [](bench::Stats acc, const bench::Stats& run) {
+      acc.merge(run);
+      return acc;
+    };
+
+    when_all_reduce(runs, bench::Stats(), merge).then([&](const bench::Stats& stats) {
+      done.set_value(stats);
+    });
+
+    bench::print_row(in_flight * num_sockets, seconds, done.get_future().get());
+  }
+
+  io_service.stop();
+  for (auto& thread : threads) thread.join();
+
+  return 0;
+}
@@ -1,63 +1,92 @@
+#include <cstring>
+#include <iostream>
 #include <boost/asio.hpp>
 #include "fry.h"
 #include "fry/asio.h"
+#include "fry/datagram.h"
+#include "fry/sharded_runtime.h"
+#include "fry/udp_batch.h"
 
 using namespace boost::asio;
 using namespace fry;
 using ip::udp;
 
 ////////////////////////////////////////////////////////////////////////////////
+// Binds a socket to the port. With reuse_port, several sockets (one per shard)
+// can bind the same port, and the kernel spreads the datagrams among them.
+udp::socket bind(io_service& io_service, short port, bool reuse_port = false) {
+  udp::socket socket(io_service, udp::v4());
 
+  if (reuse_port) socket.set_option(asio::reuse_port(true));
+  socket.bind(udp::endpoint(udp::v4(), port));
+
+  return socket;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Echo server using futures. Every receive gets its own buffer from the pool,
+// so several of them are pending at a time, and the buffer is sent back
+// without copying.
 class Server {
 public:
-  Server(io_service& io_service, short port)
-    : _socket(io_service, udp::endpoint(udp::v4(), port))
+  Server( io_service& io_service, short port, BufferPool& buffers
+        , Recycler& memory, bool reuse_port = false)
+    : _memory(memory)
+    , _buffers(buffers)
+    , _socket(bind(io_service, port, reuse_port))
   {
-    receive();
+    for (int i = 0; i < num_receives; ++i) receive();
   }
 
   void receive() {
-    _socket.async_receive_from(
-      buffer(_data, max_length), _sender_endpoint, asio::use_future
-    ).then([=](std::size_t length) {
-      if (length > 0) {
-        return _socket.async_send_to( buffer(_data, length)
-                                    , _sender_endpoint
-                                    , asio::use_future);
-      } else {
-        return asio::make_ready_future(std::size_t(0));
-      }
+    asio::async_receive_from(_socket, _buffers, asio::use_future[_memory])
+    .then([=](const asio::Datagram& datagram) {
+      return asio::async_send_to( _socket, datagram, datagram.sender
+                                , asio::use_future[_memory]);
     }).always([=]() {
       receive();
     });
   }
 
-  // void do_receive()
-  // {
-  //   _socket.async_receive_from(
-  //       boost::asio::buffer(_data, max_length), _sender_endpoint,
-  //       [this](boost::system::error_code ec, std::size_t bytes_recvd)
-  //       {
-  //         if (!ec && bytes_recvd > 0)
-  //         {
-  //           do_send(bytes_recvd);
-  //         }
-  //         else
-  //         {
-  //           do_receive();
-  //         }
-  //       });
-  // }
-
-  // void do_send(std::size_t length)
-  // {
-  //   _socket.async_send_to(
-  //       boost::asio::buffer(_data, length), _sender_endpoint,
-  //       [this](boost::system::error_code, std::size_t)
-  //       {
-  //         do_receive();
-  //       });
-  // }
+private:
+
+  enum { num_receives = 16 };
+
+  Recycler&     _memory;
+  BufferPool&   _buffers;
+  udp::socket   _socket;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// The same server written with plain callbacks, as a baseline for measuring
+// the overhead of the futures (see echo_bench).
+class CallbackServer {
+public:
+  CallbackServer(io_service& io_service, short port)
+    : _socket(io_service, udp::endpoint(udp::v4(), port))
+  {
+    do_receive();
+  }
+
+  void do_receive() {
+    _socket.async_receive_from(
+        buffer(_data, max_length), _sender_endpoint,
+        [this](boost::system::error_code ec, std::size_t bytes_recvd) {
+          if (!ec && bytes_recvd > 0) {
+            do_send(bytes_recvd);
+          } else {
+            do_receive();
+          }
+        });
+  }
+
+  void do_send(std::size_t length) {
+    _socket.async_send_to(
+        buffer(_data, length), _sender_endpoint,
+        [this](boost::system::error_code, std::size_t) {
+          do_receive();
+        });
+  }
 
 private:
 
@@ -68,15 +97,77 @@ private:
   char          _data[max_length];
 };
 
+////////////////////////////////////////////////////////////////////////////////
+// Echo server receiving and sending whole batches of datagrams, one syscall
+// per batch. The batch keeps the senders, so it is sent back as it is.
+class BatchServer {
+public:
+  BatchServer(io_service& io_service, short port, Recycler& memory)
+    : _memory(memory)
+    , _socket(io_service, udp::endpoint(udp::v4(), port))
+    , _batch(batch_size, max_length)
+  {
+    receive();
+  }
+
+  void receive() {
+    asio::async_receive_batch(_socket, _batch, asio::use_future[_memory])
+    .then([=](std::size_t) {
+      return asio::async_send_batch(_socket, _batch, asio::use_future[_memory]);
+    }).always([=]() {
+      receive();
+    });
+  }
+
+private:
+
+  enum { batch_size = 64, max_length = 1024 };
+
+  Recycler&   _memory;
+  udp::socket _socket;
+  asio::Batch _batch;
+};
+
+////////////////////////////////////////////////////////////////////////////////
 int main(int argc, char** argv) {
-  if (argc != 2) {
-    std::cerr << "Usage: echo_server <port>\n";
+  if (argc < 2 || argc > 4) {
+    std::cerr << "Usage: echo_server <port> [fry|callback|batch|sharded] [shards]\n";
     return 1;
   }
 
+  enum { max_length = 1024 };
+
+  // Slabs of the pending receives go back to the pool when the io_service is
+  // destroyed, so the pool must outlive it.
+  BufferPool buffers(max_length);
+  auto       port = std::atoi(argv[1]);
+
+  // One server per core, each on its own socket and io_service.
+  if (argc >= 3 && std::strcmp(argv[2], "sharded") == 0) {
+    ShardedRuntime runtime(argc == 4 ? std::atoi(argv[3]) : 0);
+
+    runtime.start([&](ShardedRuntime::Shard& shard) {
+      return std::make_shared<Server>( shard.io_service(), port, buffers
+                                     , shard.memory(), true);
+    });
+
+    runtime.join();
+    return 0;
+  }
+
+  Recycler   memory;     // must outlive the io_service
   io_service io_service;
-  Server server(io_service, std::atoi(argv[1]));
 
-  io_service.run();
+  if (argc == 3 && std::strcmp(argv[2], "callback") == 0) {
+    CallbackServer server(io_service, port);
+    io_service.run();
+  } else if (argc == 3 && std::strcmp(argv[2], "batch") == 0) {
+    BatchServer server(io_service, port, memory);
+    io_service.run();
+  } else {
+    Server server(io_service, port, buffers, memory);
+    io_service.run();
+  }
+
   return 0;
 }
@@ -0,0 +1,117 @@
+// Contended critical sections from continuations on a ThreadPool: std::mutex,
+// which blocks the worker until it gets the lock, against AsyncMutex, which
+// hands the lock over to the next waiter's continuation instead.
+//
+// A number of chains run at once, each a sequence of steps posted to the
+// pool one after another. Every step updates shared state under the lock.
+// Prints the steps per second for each mutex.
+//
+//   ./examples/mutex_bench [steps] [chains] [threads]
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+#include <iostream>
+#include <mutex>
+#include "fry.h"
+#include "fry/synchronization.h"
+#include "fry/thread_pool.h"
+#include "bench.h"
+
+using namespace fry;
+
+////////////////////////////////////////////////////////////////////////////////
+// The shared state, and the work done on it under the lock.
+struct Shared {
+  std::uint64_t values[16];
+
+  Shared() : values() {}
+
+  void update(std::uint64_t step) {
+    for (auto& value : values) value = value * 31 + step;
+  }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Runs `chains` chains of `steps / chains` steps each, where step(i, next)
+// does step i and then calls next() to post the following one. Returns the
+// elapsed seconds.
+template<typename Step>
+double run( ThreadPool& pool, std::size_t steps, std::size_t chains
+          , Step step)
+{
+  std::atomic<std::size_t> num_running(chains);
+  std::promise<void>       done;
+
+  std::function<void(std::size_t)> chain = [&](std::size_t left) {
+    if (left == 0) {
+      if (--num_running == 0) done.set_value();
+      return;
+    }
+
+    step(left, [&chain, left]() { chain(left - 1); });
+  };
+
+  auto start = bench::now_ns();
+
+  for (std::size_t i = 0; i < chains; ++i) {
+    pool.post([&]() { chain(steps / chains); });
+  }
+
+  done.get_future().get();
+
+  return (bench::now_ns() - start) / 1e9;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+int main(int argc, char** argv) {
+  if (argc > 4) {
+    std::cerr << "Usage: mutex_bench [steps] [chains] [threads]\n";
+    return 1;
+  }
+
+  std::size_t steps   = argc > 1 ? std::atoi(argv[1]) : 2000000;
+  std::size_t chains  = argc > 2 ? std::atoi(argv[2]) : 64;
+  std::size_t threads = argc > 3 ? std::atoi(argv[3]) : std::thread::hardware_concurrency();
+
+  steps -= steps % chains;
+
+  std::printf( "%zu steps in %zu chains on %zu threads\n"
+             , steps, chains, threads);
+  std::printf("%12s %14s\n", "", "steps/s");
+
+  {
+    Shared     shared;
+    std::mutex mutex;
+    ThreadPool pool(threads);
+
+    auto seconds = run(pool, steps, chains, [&](std::size_t i, std::function<void()> next) {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        shared.update(i);
+      }
+
+      pool.post(std::move(next));
+    });
+
+    std::printf("%12s %14.0f\n", "std::mutex", steps / seconds);
+  }
+
+  {
+    Shared     shared;
+    AsyncMutex mutex;
+    ThreadPool pool(threads);
+
+    auto seconds = run(pool, steps, chains, [&](std::size_t i, std::function<void()> next) {
+      mutex.lock().then([&, i, next](const AsyncMutex::Guard&) {
+        shared.update(i);
+        pool.post(next);
+      });
+    });
+
+    std::printf("%12s %14.0f\n", "AsyncMutex", steps / seconds);
+  }
+
+  return 0;
+}
@@ -0,0 +1,183 @@
+// Round trip time over UDP on the loopback interface with the io_services
+// run by io_service::run() against asio::run_polling() with a few policies.
+//
+// A client and an echo server, each on its own thread with its own
+// io_service, pass a single datagram back and forth. Prints the percentiles
+// of the round trip time, and how the client's loop spent its time.
+//
+// Busy polling only helps when both threads have a core to themselves; on a
+// machine with fewer cores they take the CPU from each other.
+//
+//   ./examples/polling_bench [round trips] [busy_poll microseconds]
+
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <boost/asio.hpp>
+#include "fry.h"
+#include "fry/asio.h"
+#include "fry/polling.h"
+#include "bench.h"
+
+using namespace boost::asio;
+using namespace fry;
+using ip::udp;
+
+enum { message_size = 32 };
+
+////////////////////////////////////////////////////////////////////////////////
+class Server {
+public:
+  Server(io_service& io_service, Recycler& memory)
+    : _memory(memory)
+    , _socket(io_service, udp::endpoint(ip::address_v4::loopback(), 0))
+  {
+    receive();
+  }
+
+  udp::socket& socket() {
+    return _socket;
+  }
+
+private:
+  void receive() {
+    _socket.async_receive_from( buffer(_data), _sender
+                              , asio::use_future[_memory])
+    .then([=](std::size_t size) {
+      return _socket.async_send_to( buffer(_data, size), _sender
+                                  , asio::use_future[_memory]);
+    }).always([=]() {
+      receive();
+    });
+  }
+
+private:
+  Recycler&     _memory;
+  udp::socket   _socket;
+  udp::endpoint _sender;
+  char          _data[message_size];
+};
+
+////////////////////////////////////////////////////////////////////////////////
+class Client {
+public:
+  Client( io_service& io_service, const udp::endpoint& server
+        , std::size_t num_round_trips, bench::Stats& stats, Recycler& memory)
+    : _memory(memory)
+    , _io_service(io_service)
+    , _socket(io_service, udp::endpoint(ip::address_v4::loopback(), 0))
+    , _num_left(num_round_trips)
+    , _stats(stats)
+  {
+    _socket.connect(server);
+    std::memset(_data, 0, sizeof(_data));
+  }
+
+  udp::socket& socket() {
+    return _socket;
+  }
+
+  void start() {
+    if (_num_left-- == 0) {
+      _io_service.stop();
+      return;
+    }
+
+    auto sent = bench::now_ns();
+
+    _socket.async_send(buffer(_data), asio::use_future[_memory])
+    .then([=](std::size_t) {
+      return _socket.async_receive(buffer(_data), asio::use_future[_memory]);
+    }).then([=](std::size_t) {
+      _stats.rtt.record(bench::now_ns() - sent);
+      start();
+    });
+  }
+
+private:
+  Recycler&     _memory;
+  io_service&   _io_service;
+  udp::socket   _socket;
+  std::size_t   _num_left;
+  bench::Stats& _stats;
+  char          _data[message_size];
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Runs the round trips with both loops run by `run`.
+template<typename Run>
+void measure(const char* name, std::size_t num_round_trips, int busy_poll, Run run) {
+  Recycler   server_memory;
+  Recycler   client_memory;
+  io_service server_service;
+  io_service client_service;
+
+  bench::Stats stats;
+
+  Server server(server_service, server_memory);
+  Client client( client_service, server.socket().local_endpoint()
+               , num_round_trips, stats, client_memory);
+
+  if (busy_poll > 0) {
+    boost::system::error_code error;
+
+    server.socket().set_option(asio::busy_poll(busy_poll), error);
+    client.socket().set_option(asio::busy_poll(busy_poll), error);
+
+    if (error) std::cerr << "SO_BUSY_POLL: " << error.message() << "\n";
+  }
+
+  std::thread server_thread([&]() { run(server_service); });
+
+  client.start();
+
+  auto start   = bench::now_ns();
+  auto polling = run(client_service);
+  auto seconds = (bench::now_ns() - start) / 1e9;
+
+  server_service.stop();
+  server_thread.join();
+
+  std::printf( "%10s %10.1f %10.1f %10.1f %10.0f %9.0f%%\n"
+             , name
+             , stats.rtt.percentile(0.5)   / 1000.0
+             , stats.rtt.percentile(0.99)  / 1000.0
+             , stats.rtt.percentile(0.999) / 1000.0
+             , stats.rtt.total() / seconds
+             , polling.utilization() * 100);
+  std::fflush(stdout);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+int main(int argc, char** argv) {
+  if (argc > 3) {
+    std::cerr << "Usage: polling_bench [round trips] [busy_poll microseconds]\n";
+    return 1;
+  }
+
+  std::size_t num_round_trips = argc > 1 ? std::atoi(argv[1]) : 100000;
+  int         busy_poll       = argc > 2 ? std::atoi(argv[2]) : 0;
+
+  std::printf( "%10s %10s %10s %10s %10s %10s\n"
+             , "", "p50 us", "p99 us", "p999 us", "rtt/s", "busy");
+
+  measure("run", num_round_trips, busy_poll, [](io_service& io_service) {
+    io_service.run();
+    return asio::PollingStats();
+  });
+
+  measure("poll 50us", num_round_trips, busy_poll, [](io_service& io_service) {
+    return asio::run_polling(io_service);
+  });
+
+  measure("yield 1ms", num_round_trips, busy_poll, [](io_service& io_service) {
+    return asio::run_polling(io_service, asio::PollingPolicy(
+      std::chrono::nanoseconds(0), std::chrono::milliseconds(1)));
+  });
+
+  measure("busy", num_round_trips, busy_poll, [](io_service& io_service) {
+    return asio::run_polling(io_service, asio::PollingPolicy::busy());
+  });
+
+  return 0;
+}
@@ -0,0 +1,213 @@
+// Request/response over a ConnectionPool under contention: many concurrent
+// requests share a few pooled connections to an echo server on the loopback
+// interface, against opening a new connection for every request.
+//
+// Each request acquires a connection, writes a message, reads the echo back
+// and releases the connection. The latency is measured from the acquire, so
+// it includes the time spent waiting for a free connection.
+//
+//   ./examples/pool_bench [requests] [connections]
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <boost/asio.hpp>
+#include "fry.h"
+#include "fry/asio.h"
+#include "fry/connection_pool.h"
+#include "bench.h"
+
+using namespace boost::asio;
+using namespace fry;
+using ip::tcp;
+
+typedef asio::ConnectionPool<> Pool;
+
+enum { message_size = 64 };
+
+////////////////////////////////////////////////////////////////////////////////
+// Echoes everything back on every accepted connection.
+class Server {
+public:
+  explicit Server(io_service& io_service)
+    : _io_service(io_service)
+    , _acceptor(io_service, tcp::endpoint(ip::address_v4::loopback(), 0))
+  {
+    accept();
+  }
+
+  tcp::endpoint endpoint() const {
+    return _acceptor.local_endpoint();
+  }
+
+private:
+  struct Connection {
+    tcp::socket socket;
+    char        data[message_size];
+
+    explicit Connection(io_service& io_service) : socket(io_service) {}
+  };
+
+  void accept() {
+    auto connection = std::make_shared<Connection>(_io_service);
+
+    _acceptor.async_accept(connection->socket, [=](const boost::system::error_code& error) {
+      if (error) return;
+
+      connection->socket.set_option(tcp::no_delay(true));
+
+      echo(connection);
+      accept();
+    });
+  }
+
+  void echo(std::shared_ptr<Connection> connection) {
+    connection->socket.async_read_some(buffer(connection->data), [=](
+      const boost::system::error_code& error, std::size_t size)
+    {
+      if (error) return;
+
+      async_write(connection->socket, buffer(connection->data, size), [=](
+        const boost::system::error_code& error, std::size_t)
+      {
+        if (!error) echo(connection);
+      });
+    });
+  }
+
+private:
+  io_service&   _io_service;
+  tcp::acceptor _acceptor;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Keeps `in_flight` requests going until `n` are done.
+class Client {
+public:
+  Client(Pool& pool, const tcp::endpoint& server, std::size_t n, bool reuse)
+    : _pool(pool)
+    , _server(server)
+    , _num_left(n)
+    , _num_failed(0)
+    , _reuse(reuse)
+  {}
+
+  void start(std::size_t in_flight) {
+    _replies.resize(in_flight);
+    for (std::size_t i = 0; i < in_flight; ++i) request(i);
+  }
+
+  std::size_t num_done() const {
+    return _stats.rtt.total() + _num_failed;
+  }
+
+  const bench::Stats& stats() const {
+    return _stats;
+  }
+
+private:
+  void request(std::size_t slot) {
+    if (_num_left == 0) return;
+    --_num_left;
+
+    auto start = bench::now_ns();
+
+    _pool.acquire(_server).then([=](const Pool::Lease& lease) {
+      if (!_reuse) {
+        // Reset instead of leaving thousands of connections in TIME_WAIT.
+        lease->set_option(socket_base::linger(true, 0));
+        lease.discard();
+      }
+
+      lease->set_option(tcp::no_delay(true));
+
+      return asio::async_write(lease.socket(), buffer(_message), asio::use_future)
+        .then([=](std::size_t) {
+          return asio::async_read( lease.socket(), buffer(_replies[slot].data)
+                                 , asio::use_future);
+        }).then([lease](std::size_t size) {
+          // Holds the connection until the reply is in.
+          return size;
+        });
+    }).then([=](const Result<std::size_t, boost::system::error_code>& result) {
+      if (result) {
+        _stats.rtt.record(bench::now_ns() - start);
+      } else {
+        ++_stats.num_lost;
+        ++_num_failed;
+      }
+
+      request(slot);
+    });
+  }
+
+private:
+  struct Reply {
+    char data[message_size];
+  };
+
+  Pool&              _pool;
+  tcp::endpoint      _server;
+  std::size_t        _num_left;
+  std::size_t        _num_failed;
+  bool               _reuse;
+  char               _message[message_size] = {};
+  std::vector<Reply> _replies;
+  bench::Stats       _stats;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Runs n requests, in_flight at a time, over at most `connections`
+// connections and prints the results.
+void run( std::size_t n, std::size_t in_flight, std::size_t connections
+        , bool reuse)
+{
+  io_service io_service;
+  Server     server(io_service);
+
+  Pool::Options options;
+  options.max_per_endpoint = connections;
+
+  Pool   pool(io_service, options);
+  Client client(pool, server.endpoint(), n, reuse);
+
+  auto start = bench::now_ns();
+
+  client.start(in_flight);
+  while (client.num_done() < n && io_service.run_one());
+
+  auto seconds = (bench::now_ns() - start) / 1e9;
+
+  bench::print_row(in_flight, seconds, client.stats());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+int main(int argc, char** argv) {
+  if (argc > 3) {
+    std::cerr << "Usage: pool_bench [requests] [connections]\n";
+    return 1;
+  }
+
+  std::size_t n           = argc > 1 ? std::atoi(argv[1]) : 100000;
+  std::size_t connections = argc > 2 ? std::atoi(argv[2]) : 8;
+
+  std::vector<std::size_t> levels = { connections
+                                    , 8  * connections
+                                    , 64 * connections };
+
+  std::printf( "%zu requests of %d bytes, pool of %zu connections\n"
+             , n, message_size, connections);
+
+  std::printf("\npooled:\n");
+  bench::print_header();
+  for (auto in_flight : levels) run(n, in_flight, connections, true);
+
+  // As many connections as requests in flight, each used once.
+  std::printf("\nnew connection per request:\n");
+  bench::print_header();
+  for (auto in_flight : levels) run(n, in_flight, in_flight, false);
+
+  return 0;
+}
@@ -0,0 +1,88 @@
+// UDP echo server on fry::Reactor, without Boost.Asio. Answers the same
+// requests as echo_server, so echo_bench measures both:
+//
+//   ./examples/reactor_echo_server 9000 &
+//   ./examples/echo_bench 127.0.0.1 9000
+//
+// The server reads until the socket has nothing more, echoing every
+// datagram right away, and only then waits for it to become readable again.
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "fry/future.h"
+#include "fry/reactor.h"
+
+using namespace fry;
+
+////////////////////////////////////////////////////////////////////////////////
+class Server {
+public:
+  Server(Reactor& reactor, int port)
+    : _reactor(reactor)
+    , _socket(::socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0))
+  {
+    sockaddr_in address = {};
+    address.sin_family      = AF_INET;
+    address.sin_port        = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+
+    if (::bind(_socket, (sockaddr*) &address, sizeof(address)) < 0) {
+      std::perror("bind");
+      std::exit(1);
+    }
+
+    receive();
+  }
+
+  ~Server() {
+    _reactor.remove(_socket);
+    ::close(_socket);
+  }
+
+private:
+  enum { max_length = 1024 };
+
+  void receive() {
+    for (;;) {
+      sockaddr_storage sender;
+      socklen_t        sender_size = sizeof(sender);
+
+      auto size = ::recvfrom( _socket, _data, max_length, 0
+                            , (sockaddr*) &sender, &sender_size);
+
+      if (size < 0) {
+        if (errno == EINTR) continue;
+        break;
+      }
+
+      // A reply that does not fit into the socket buffer is dropped, as any
+      // datagram may be.
+      ::sendto(_socket, _data, size, 0, (sockaddr*) &sender, sender_size);
+    }
+
+    _reactor.readable(_socket).then([=]() { receive(); });
+  }
+
+private:
+  Reactor& _reactor;
+  int      _socket;
+  char     _data[max_length];
+};
+
+////////////////////////////////////////////////////////////////////////////////
+int main(int argc, char** argv) {
+  if (argc != 2) {
+    std::cerr << "Usage: reactor_echo_server <port>\n";
+    return 1;
+  }
+
+  Reactor reactor;
+  Server  server(reactor, std::atoi(argv[1]));
+
+  reactor.run();
+  return 0;
+}
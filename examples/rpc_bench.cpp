@@ -0,0 +1,232 @@
+// Request/response over UDP on the loopback interface, with a PendingTable
+// matching the responses to the requests.
+//
+// All the requests are expected up front, so the table holds all of them
+// (1M by default) while they are sent out, a window at a time, and answered
+// by the server. Prints how fast the table takes the requests in, and then
+// the throughput and round trip times of the whole run.
+//
+//   ./examples/rpc_bench [requests] [window]
+
+#include <cstring>
+#include <iostream>
+#include <boost/asio.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include "fry.h"
+#include "fry/asio.h"
+#include "fry/pending_table.h"
+#include "fry/udp_batch.h"
+#include "bench.h"
+
+using namespace boost::asio;
+using namespace fry;
+using ip::udp;
+
+struct Message {
+  std::uint64_t id;
+  std::uint64_t sent;
+};
+
+typedef PendingTable<std::uint64_t, std::uint64_t> Table;
+
+////////////////////////////////////////////////////////////////////////////////
+// Answers every request with the request itself.
+class Server {
+public:
+  Server(io_service& io_service, Recycler& memory)
+    : _memory(memory)
+    , _socket(io_service, udp::endpoint(ip::address_v4::loopback(), 0))
+    , _batch(batch_size, sizeof(Message))
+  {
+    _socket.set_option(socket_base::receive_buffer_size(8 << 20));
+    receive();
+  }
+
+  udp::endpoint endpoint() const {
+    return _socket.local_endpoint();
+  }
+
+private:
+  enum { batch_size = 64 };
+
+  void receive() {
+    asio::async_receive_batch(_socket, _batch, asio::use_future[_memory])
+    .then([=](std::size_t) {
+      return asio::async_send_batch(_socket, _batch, asio::use_future[_memory]);
+    }).always([=]() {
+      receive();
+    });
+  }
+
+private:
+  Recycler&   _memory;
+  udp::socket _socket;
+  asio::Batch _batch;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Sends the requests, at most `window` of them unanswered at a time, and
+// fulfils them in the table as the responses arrive.
+class Client {
+public:
+  Client( io_service& io_service, const udp::endpoint& server
+        , Table& table, std::uint64_t num_requests, std::size_t window
+        , Recycler& memory)
+    : _memory(memory)
+    , _table(table)
+    , _socket(io_service, udp::endpoint(ip::address_v4::loopback(), 0))
+    , _server(server)
+    , _requests(batch_size, sizeof(Message))
+    , _responses(batch_size, sizeof(Message))
+    , _num_requests(num_requests)
+    , _window(window)
+    , _next(0)
+    , _on_wire(0)
+    , _sending(false)
+  {
+    _socket.set_option(socket_base::receive_buffer_size(8 << 20));
+  }
+
+  void start() {
+    send();
+    receive();
+  }
+
+  // Called for a request that expired.
+  void lost(std::uint64_t id) {
+    if (id < _next) --_on_wire;
+    send();
+  }
+
+private:
+  enum { batch_size = 64 };
+
+  void send() {
+    if (_sending || _next == _num_requests) return;
+
+    _requests.clear();
+
+    while (  !_requests.full()
+          && _next < _num_requests
+          && _on_wire < _window)
+    {
+      Message message = { _next++, bench::now_ns() };
+      _requests.push_back(buffer(&message, sizeof(message)), _server);
+      ++_on_wire;
+    }
+
+    if (_requests.empty()) return;
+
+    _sending = true;
+
+    asio::async_send_batch(_socket, _requests, asio::use_future[_memory])
+    .always([=]() {
+      _sending = false;
+      send();
+    });
+  }
+
+  void receive() {
+    asio::async_receive_batch(_socket, _responses, asio::use_future[_memory])
+    .then([=](std::size_t size) {
+      for (std::size_t i = 0; i < size; ++i) {
+        Message message;
+        std::memcpy(&message, buffer_cast<const char*>(_responses[i]), sizeof(message));
+
+        if (_table.fulfil(message.id, message.sent)) --_on_wire;
+      }
+
+      send();
+    }).always([=]() {
+      receive();
+    });
+  }
+
+private:
+  Recycler&     _memory;
+  Table&        _table;
+  udp::socket   _socket;
+  udp::endpoint _server;
+  asio::Batch   _requests;
+  asio::Batch   _responses;
+
+  std::uint64_t _num_requests;
+  std::size_t   _window;
+  std::uint64_t _next;
+  std::size_t   _on_wire;
+  bool          _sending;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+int main(int argc, char** argv) {
+  if (argc > 3) {
+    std::cerr << "Usage: rpc_bench [requests] [window]\n";
+    return 1;
+  }
+
+  std::uint64_t num_requests = argc > 1 ? std::atoll(argv[1]) : 1000000;
+  std::size_t   window       = argc > 2 ? std::atoi(argv[2])  : 256;
+
+  Recycler         memory;
+  io_service       io_service;
+  Table            table(num_requests);
+
+  Server server(io_service, memory);
+  Client client(io_service, server.endpoint(), table, num_requests, window, memory);
+
+  bench::Stats  stats;
+  std::uint64_t num_done = 0;
+
+  auto done = [&]() {
+    if (++num_done == num_requests) io_service.stop();
+  };
+
+  // Expect all of the requests.
+  auto start = bench::now_ns();
+
+  for (std::uint64_t id = 0; id < num_requests; ++id) {
+    table.expect(id, std::chrono::seconds(10)).then([&, id](const Table::Value& value) {
+      value.match(
+          [&](std::uint64_t sent) {
+            stats.rtt.record(bench::now_ns() - sent);
+          }
+        , [&](const std::error_code&) {
+            ++stats.num_lost;
+            client.lost(id);
+          });
+
+      done();
+    });
+  }
+
+  auto expected = bench::now_ns();
+
+  std::printf( "expected %llu requests in %.1f ms (%.0f ns each), %zu pending\n"
+             , (unsigned long long) num_requests
+             , (expected - start) / 1e6
+             , double(expected - start) / num_requests
+             , table.size());
+
+  // Fail the requests that got no response in time.
+  steady_timer timer(io_service);
+
+  std::function<void()> tick = [&]() {
+    timer.expires_from_now(std::chrono::milliseconds(100));
+    timer.async_wait(asio::use_future).then([&]() {
+      table.expire();
+      tick();
+    });
+  };
+
+  tick();
+  client.start();
+  io_service.run();
+
+  auto seconds = (bench::now_ns() - expected) / 1e9;
+
+  std::printf("answered in %.2f s, window %zu\n", seconds, window);
+  bench::print_header();
+  bench::print_row(window, seconds, stats);
+
+  return 0;
+}
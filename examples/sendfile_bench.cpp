@@ -0,0 +1,145 @@
+// Throughput of sending a file over a TCP connection on the loopback
+// interface: async_sendfile and async_splice (no copies through user space)
+// against reading the file into a buffer and writing that with async_write.
+//
+// The file has just been written, so all of the runs send it from the
+// page cache. The receiving end reads and discards on its own thread.
+//
+//   ./examples/sendfile_bench [megabytes] [runs]
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include <boost/asio.hpp>
+#include "fry.h"
+#include "fry/asio.h"
+#include "fry/sendfile.h"
+#include "bench.h"
+
+using namespace boost::asio;
+using namespace fry;
+using ip::tcp;
+
+////////////////////////////////////////////////////////////////////////////////
+// Sends the file by reading it in chunks and writing each one.
+class Copy {
+public:
+  Copy(tcp::socket& socket, int file, std::size_t size)
+    : _socket(socket)
+    , _file(file)
+    , _size(size)
+    , _offset(0)
+    , _buffer(chunk_size)
+  {}
+
+  asio::Future<std::size_t> start() {
+    auto length = std::min<std::size_t>(chunk_size, _size - _offset);
+    auto result = ::pread(_file, &_buffer[0], length, _offset);
+
+    if (result <= 0) {
+      return asio::make_ready_future<std::size_t>(
+        boost::system::error_code(errno, boost::system::system_category()));
+    }
+
+    return asio::async_write(_socket, buffer(&_buffer[0], result))
+    .then([=](std::size_t written) {
+      _offset += written;
+
+      if (_offset == _size) return asio::make_ready_future(_size);
+      return start();
+    });
+  }
+
+private:
+  enum { chunk_size = 64 << 10 };
+
+  tcp::socket&      _socket;
+  int               _file;
+  std::size_t       _size;
+  std::size_t       _offset;
+  std::vector<char> _buffer;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+template<typename Send>
+void run(const char* name, std::size_t size, int file, int runs, Send send) {
+  io_service    io_service;
+  tcp::acceptor acceptor(io_service, tcp::endpoint(ip::address_v4::loopback(), 0));
+  tcp::socket   sender(io_service);
+  tcp::socket   receiver(io_service);
+
+  sender.connect(acceptor.local_endpoint());
+  acceptor.accept(receiver);
+
+  // Drains the connection until the sender closes it.
+  std::thread drain([&]() {
+    std::vector<char>         buffer(1 << 20);
+    boost::system::error_code error;
+
+    while (!error) receiver.read_some(boost::asio::buffer(buffer), error);
+  });
+
+  double best = 0;
+
+  for (int i = 0; i < runs; ++i) {
+    auto start = bench::now_ns();
+
+    send(sender, file, size).then([&](const boost::system::error_code& error) {
+      std::cerr << name << ": " << error.message() << "\n";
+    });
+
+    io_service.run();
+    io_service.reset();
+
+    auto seconds = (bench::now_ns() - start) / 1e9;
+    best = std::max(best, size / seconds / (1 << 20));
+  }
+
+  sender.shutdown(tcp::socket::shutdown_send);
+  drain.join();
+
+  std::printf("%10s %12.0f MB/s\n", name, best);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+int main(int argc, char** argv) {
+  if (argc > 3) {
+    std::cerr << "Usage: sendfile_bench [megabytes] [runs]\n";
+    return 1;
+  }
+
+  std::size_t size = (argc > 1 ? std::atoi(argv[1]) : 256) << 20;
+  int         runs = argc > 2 ? std::atoi(argv[2]) : 5;
+
+  char path[] = "/tmp/fry_sendfile_bench_XXXXXX";
+  int  file   = ::mkstemp(path);
+  ::unlink(path);
+
+  {
+    std::vector<char> block(1 << 20, 'x');
+    for (std::size_t i = 0; i < size; i += block.size()) {
+      if (::write(file, block.data(), block.size()) < 0) return 1;
+    }
+  }
+
+  std::printf("%zu MB, best of %d runs\n", size >> 20, runs);
+
+  run("sendfile", size, file, runs, [](tcp::socket& socket, int file, std::size_t size) {
+    return asio::async_sendfile(socket, file, 0, size);
+  });
+
+  run("splice", size, file, runs, [](tcp::socket& socket, int file, std::size_t size) {
+    return asio::async_splice(socket, file, 0, size);
+  });
+
+  run("copy", size, file, runs, [](tcp::socket& socket, int file, std::size_t size) {
+    auto copy = std::make_shared<Copy>(socket, file, size);
+    return copy->start().then([copy](std::size_t size) { return size; });
+  });
+
+  ::close(file);
+  return 0;
+}
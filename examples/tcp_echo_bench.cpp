@@ -0,0 +1,196 @@
+// Load generator and latency benchmark for tcp_echo_server.
+//
+// Like echo_bench, but every connection pipelines its requests: it keeps a
+// fixed number of them in flight, and sends a new one as soon as a reply
+// arrives. Requests that pile up while a write is in progress go out together
+// in the next write.
+//
+//   ./examples/tcp_echo_server 9000 &
+//   ./examples/tcp_echo_bench 127.0.0.1 9000
+
+#include <cstring>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <boost/asio.hpp>
+#include "fry.h"
+#include "fry/asio.h"
+#include "fry/frame_reader.h"
+#include "bench.h"
+
+using namespace boost::asio;
+using namespace fry;
+using ip::tcp;
+
+////////////////////////////////////////////////////////////////////////////////
+class Connection : public std::enable_shared_from_this<Connection> {
+public:
+  Connection( io_service& io_service, const tcp::endpoint& server
+            , Recycler& memory)
+    : _memory(memory)
+    , _strand(io_service)
+    , _socket(io_service)
+    , _reader(_socket, asio::use_future_on(_strand)[memory])
+    , _writing(false)
+    , _running(true)
+  {
+    _socket.connect(server);
+    _socket.set_option(tcp::no_delay(true));
+  }
+
+  // Sends `in_flight` requests and starts answering the replies.
+  void start(std::size_t in_flight) {
+    auto self = shared_from_this();
+
+    _strand.dispatch([=]() {
+      for (std::size_t i = 0; i < in_flight; ++i) self->request();
+      self->flush();
+      self->receive();
+    });
+  }
+
+  // Discards what was measured so far (used to skip the warmup).
+  void reset() {
+    _strand.dispatch([=]() { _stats = bench::Stats(); });
+  }
+
+  // Closes the connection. Returns what was measured.
+  Future<bench::Stats> stop() {
+    return make_ready_future().then_on(_strand, [=]() {
+      _running = false;
+      _socket.close();
+      return _stats;
+    });
+  }
+
+private:
+  enum { request_size = 8 };
+
+  // Queues a request holding the time it was sent.
+  void request() {
+    asio::FrameHeader header(request_size);
+    auto              now = bench::now_ns();
+    auto              h   = buffer_cast<const char*>(header.buffer());
+
+    _queued.insert(_queued.end(), h, h + asio::frame_header_size);
+    _queued.insert( _queued.end()
+                  , reinterpret_cast<const char*>(&now)
+                  , reinterpret_cast<const char*>(&now) + request_size);
+  }
+
+  // Writes the queued requests, unless a write is in progress already.
+  void flush() {
+    if (_writing || _queued.empty() || !_running) return;
+
+    _writing = true;
+    _sending.swap(_queued);
+
+    auto self = shared_from_this();
+
+    asio::async_write( _socket, buffer(_sending)
+                     , asio::use_future_on(_strand)[_memory]
+    ).then([=](std::size_t) {
+      self->_writing = false;
+      self->_sending.clear();
+      self->flush();
+    });
+  }
+
+  void receive() {
+    auto self = shared_from_this();
+
+    _reader.read().then([=](const const_buffer& body) {
+      if (!_running || buffer_size(body) != request_size) return;
+
+      std::uint64_t sent;
+      std::memcpy(&sent, buffer_cast<const char*>(body), request_size);
+
+      _stats.rtt.record(bench::now_ns() - sent);
+
+      request();
+      flush();
+      self->receive();
+    });
+  }
+
+private:
+  typedef asio::UseFutureOn<io_service::strand> Token;
+
+  Recycler&                             _memory;
+  io_service::strand                    _strand;
+  tcp::socket                           _socket;
+  asio::FrameReader<tcp::socket, Token> _reader;
+
+  std::vector<char>                     _queued;
+  std::vector<char>                     _sending;
+  bool                                  _writing;
+  bool                                  _running;
+  bench::Stats                          _stats;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+int main(int argc, char** argv) {
+  if (argc < 3 || argc > 6) {
+    std::cerr << "Usage: tcp_echo_bench <host> <port> [threads] [connections] [seconds]\n";
+    return 1;
+  }
+
+  auto num_threads     = argc > 3 ? std::atoi(argv[3]) : 1;
+  auto num_connections = argc > 4 ? std::atoi(argv[4]) : 1;
+  auto seconds         = argc > 5 ? std::atof(argv[5]) : 2.0;
+
+  // The connections go away before their last operations complete, so the
+  // memory of the operations is shared, and must outlive the io_service.
+  Recycler         memory;
+  io_service       io_service;
+  io_service::work work(io_service);
+
+  tcp::resolver resolver(io_service);
+  tcp::endpoint server = *resolver.resolve({tcp::v4(), argv[1], argv[2]});
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < num_threads; ++i) {
+    threads.emplace_back([&]() { io_service.run(); });
+  }
+
+  std::cout << num_threads     << " threads, "
+            << num_connections << " connections, "
+            << seconds         << " s per run\n";
+  bench::print_header();
+
+  for (std::size_t in_flight = 1; in_flight <= 256; in_flight *= 2) {
+    std::vector<std::shared_ptr<Connection>> connections;
+
+    for (int i = 0; i < num_connections; ++i) {
+      connections.push_back(std::make_shared<Connection>(io_service, server, memory));
+      connections.back()->start(in_flight);
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    for (auto& connection : connections) connection->reset();
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+
+    std::vector<Future<bench::Stats>> runs;
+    for (auto& connection : connections) runs.push_back(connection->stop());
+
+    std::promise<bench::Stats> done;
+
+    auto merge = [](bench::Stats acc, const bench::Stats& run) {
+      acc.merge(run);
+      return acc;
+    };
+
+    when_all_reduce(runs, bench::Stats(), merge).then([&](const bench::Stats& stats) {
+      done.set_value(stats);
+    });
+
+    bench::print_row(in_flight * num_connections, seconds, done.get_future().get());
+  }
+
+  io_service.stop();
+  for (auto& thread : threads) thread.join();
+
+  return 0;
+}
@@ -0,0 +1,90 @@
+#include <iostream>
+#include <memory>
+#include <boost/asio.hpp>
+#include "fry.h"
+#include "fry/asio.h"
+#include "fry/frame_reader.h"
+#include "fry/write_queue.h"
+
+using namespace boost::asio;
+using namespace fry;
+using ip::tcp;
+
+////////////////////////////////////////////////////////////////////////////////
+// Echoes length-prefixed frames back. Clients may send many frames without
+// waiting for the replies: the reader pulls in as many of them as are
+// available at a time, and the replies queued while a write is in flight go
+// out together in the next one. Reading does not wait for the writes.
+class Session : public std::enable_shared_from_this<Session> {
+public:
+  Session(tcp::socket socket, Recycler& memory)
+    : _socket(std::move(socket))
+    , _reader(_socket, asio::use_future[memory])
+    , _writer(_socket, asio::use_future[memory])
+  {
+    _socket.set_option(tcp::no_delay(true));
+  }
+
+  void start() {
+    auto self = shared_from_this();
+
+    _reader.read().then([=](const const_buffer& body) {
+      // The body is only valid until the next read, so the reply gets a copy.
+      asio::FrameHeader header(buffer_size(body));
+      std::vector<char> reply(asio::frame_header_size + buffer_size(body));
+
+      buffer_copy(buffer(reply), header.with(body));
+      // Keeps the session alive until the reply is written.
+      _writer.write(std::move(reply)).always([self]() {});
+
+      self->start();
+    });
+  }
+
+private:
+  tcp::socket                    _socket;
+  asio::FrameReader<tcp::socket> _reader;
+  asio::WriteQueue<tcp::socket>  _writer;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+class Server {
+public:
+  // The memory of the operations comes from the given recycler. It is shared
+  // by all the sessions, because a session may be gone before the last of
+  // its operations releases its memory.
+  Server(io_service& io_service, short port, Recycler& memory)
+    : _acceptor(io_service, tcp::endpoint(tcp::v4(), port))
+    , _socket(io_service)
+    , _memory(memory)
+  {
+    accept();
+  }
+
+  void accept() {
+    asio::async_accept(_acceptor, _socket).then([=]() {
+      std::make_shared<Session>(std::move(_socket), _memory)->start();
+    }).always([=]() {
+      accept();
+    });
+  }
+
+private:
+  tcp::acceptor _acceptor;
+  tcp::socket   _socket;
+  Recycler&     _memory;
+};
+
+int main(int argc, char** argv) {
+  if (argc != 2) {
+    std::cerr << "Usage: tcp_echo_server <port>\n";
+    return 1;
+  }
+
+  Recycler   memory;     // must outlive the io_service
+  io_service io_service;
+  Server     server(io_service, std::atoi(argv[1]), memory);
+
+  io_service.run();
+  return 0;
+}
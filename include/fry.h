@@ -9,12 +9,17 @@
 #define __FRY_H__
 
 #include "fry/future.h"
+#include "fry/map_concurrent.h"
+#include "fry/parallel.h"
+#include "fry/pipeline.h"
 #include "fry/repeat_until.h"
+#include "fry/thread_pool.h"
 #include "fry/when_all.h"
 #include "fry/when_any.h"
 
 #include "fry/result.h"
 #include "fry/future_result.h"
 #include "fry/when_all_success.h"
+#include "fry/when_all_reduce.h"
 
 #endif // __FRY_H__
\ No newline at end of file
@@ -0,0 +1,422 @@
+//
+// Copyright (c) 2014 Adam Cigánek (adam.ciganek@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef __FRY__ADMISSION_H__
+#define __FRY__ADMISSION_H__
+
+// Admission - load shedding by limiting the number of chains in flight.
+//
+// admit(f) starts the chain returned by f() only if fewer than limit() chains
+// are in flight at the moment. Otherwise it does not call f at all, and fails
+// right away with Overloaded, so nothing queues up behind a backend that is
+// already behind:
+//
+//   Admission<> admission(100);
+//
+//   admission.admit([]() { return backend.call(request); })
+//     .then([](const Reply& reply) { ... })
+//     .then([](Overloaded) { return reply_busy(); });
+//
+// The result is a Future<Result<R, Overloaded>>, where R is what the chain
+// resolves to, so a rejection is handled like any other failure. A chain that
+// resolves to a Result<R, E> already is not nested in another one: if E can be
+// constructed from Overloaded, the result is a Future<Result<R, E>> with the
+// rejection as E(Overloaded), otherwise it is a
+// Future<Result<R, Either<E, Overloaded>>>. A chain is in flight until its
+// future becomes ready (or is dropped).
+//
+// The limit comes from the Limit policy:
+//
+//   FixedLimit    - a constant.
+//   AimdLimit     - grows by one while the limit is being used and the chains
+//                   complete in time, and shrinks by a factor when one takes
+//                   longer than the timeout (additive increase, multiplicative
+//                   decrease).
+//   GradientLimit - follows the ratio of the long-term average latency to the
+//                   latest one: grows while the latency stays put, and shrinks
+//                   when it rises, i.e. when requests start to queue up
+//                   somewhere downstream.
+//
+//   Admission<AimdLimit> admission(AimdLimit::Options{});
+//
+// A policy has limit(), which must be cheap and safe to call from any thread,
+// and update(sample), called whenever an admitted chain completes.
+//
+// admit() can be called from any thread. A rejection is cheap, but not free:
+// f is not called, and the only thing allocated is the ready future that is
+// returned (one shared state, like any future).
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <mutex>
+#include "either.h"
+#include "future.h"
+#include "future_result.h"
+
+namespace fry {
+
+////////////////////////////////////////////////////////////////////////////////
+// The error of a rejected admit().
+struct Overloaded {
+  std::size_t limit;   // the limit at the time of the rejection
+};
+
+// What a Limit policy learns about a completed chain.
+struct AdmissionSample {
+  std::chrono::nanoseconds latency;
+  std::size_t              in_flight;   // including the completed chain
+};
+
+////////////////////////////////////////////////////////////////////////////////
+class FixedLimit {
+public:
+  explicit FixedLimit(std::size_t limit) : _limit(limit) {}
+
+  std::size_t limit() const { return _limit; }
+
+  void update(const AdmissionSample&) {}
+
+private:
+  const std::size_t _limit;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+class AimdLimit {
+public:
+  struct Options {
+    std::size_t              initial = 20;
+    std::size_t              min     = 1;
+    std::size_t              max     = 1000;
+    // A chain slower than this counts as a sign of overload.
+    std::chrono::nanoseconds timeout = std::chrono::milliseconds(100);
+    double                   backoff = 0.9;
+  };
+
+  AimdLimit() : AimdLimit(Options()) {}
+
+  explicit AimdLimit(const Options& options)
+    : _options(options)
+    , _limit(options.initial)
+  {
+    assert(options.min > 0 && options.min <= options.initial);
+    assert(options.initial <= options.max);
+    assert(options.backoff > 0 && options.backoff < 1);
+  }
+
+  std::size_t limit() const {
+    return _limit.load(std::memory_order_relaxed);
+  }
+
+  void update(const AdmissionSample& sample) {
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    auto limit = _limit.load(std::memory_order_relaxed);
+
+    if (sample.latency > _options.timeout) {
+      limit = static_cast<std::size_t>(limit * _options.backoff);
+    } else if (sample.in_flight * 2 >= limit) {
+      // Only grow when the limit is actually what holds the load back.
+      limit = limit + 1;
+    }
+
+    _limit.store( std::max(_options.min, std::min(_options.max, limit))
+                , std::memory_order_relaxed);
+  }
+
+private:
+  const Options            _options;
+  std::mutex               _mutex;
+  std::atomic<std::size_t> _limit;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+class GradientLimit {
+public:
+  struct Options {
+    std::size_t initial   = 20;
+    std::size_t min       = 1;
+    std::size_t max       = 1000;
+    // How much the latency may rise over the long-term average before the
+    // limit starts to shrink.
+    double      tolerance = 1.5;
+    // How far each sample moves the limit towards the new estimate.
+    double      smoothing = 0.2;
+    // Number of samples the long-term average spans.
+    std::size_t window    = 600;
+  };
+
+  GradientLimit() : GradientLimit(Options()) {}
+
+  explicit GradientLimit(const Options& options)
+    : _options(options)
+    , _estimate(options.initial)
+    , _long_latency(0)
+    , _limit(options.initial)
+  {
+    assert(options.min > 0 && options.min <= options.initial);
+    assert(options.initial <= options.max);
+    assert(options.tolerance >= 1);
+    assert(options.smoothing > 0 && options.smoothing <= 1);
+    assert(options.window > 0);
+  }
+
+  std::size_t limit() const {
+    return _limit.load(std::memory_order_relaxed);
+  }
+
+  void update(const AdmissionSample& sample) {
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    double latency = std::max<double>(1, sample.latency.count());
+
+    if (_long_latency == 0) {
+      _long_latency = latency;
+    } else {
+      _long_latency += (latency - _long_latency) / _options.window;
+    }
+
+    // Nothing to learn about the limit while most of it is unused.
+    if (sample.in_flight * 2 < limit()) return;
+
+    auto gradient = std::max(0.5, std::min(1.0, _options.tolerance
+                                              * _long_latency / latency));
+
+    // Leaves room for a few requests to queue, so there is always some
+    // pressure to grow while the latency does not rise.
+    auto target = _estimate * gradient + std::sqrt(_estimate);
+
+    _estimate = _estimate * (1 - _options.smoothing)
+              + target    * _options.smoothing;
+
+    _estimate = std::max<double>(_options.min, std::min<double>(_options.max, _estimate));
+
+    _limit.store( static_cast<std::size_t>(_estimate)
+                , std::memory_order_relaxed);
+  }
+
+private:
+  const Options            _options;
+  std::mutex               _mutex;
+  double                   _estimate;
+  double                   _long_latency;   // in nanoseconds
+  std::atomic<std::size_t> _limit;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+namespace detail { namespace admission {
+
+  // What admit() resolves to for a chain resolving to T: the type, how the
+  // chain's value becomes it, and how a rejection does.
+  template<typename T, typename = void>
+  struct Admitted {
+    typedef Result<T, Overloaded> type;
+
+    static type from(T& value)              { return type(std::move(value)); }
+    static type rejected(Overloaded error)  { return type(error); }
+  };
+
+  template<>
+  struct Admitted<void> {
+    typedef Result<void, Overloaded> type;
+
+    static type from()                      { return type(); }
+    static type rejected(Overloaded error)  { return type(error); }
+  };
+
+  // The error of the chain can hold the rejection itself.
+  template<typename T, typename E>
+  struct Admitted< Result<T, E>
+                 , enable_if<std::is_constructible<E, Overloaded>{}>>
+  {
+    typedef Result<T, E> type;
+
+    static type from(type& result)          { return std::move(result); }
+    static type rejected(Overloaded error)  { return type(E(error)); }
+  };
+
+  // It cannot, so the error becomes either the chain's error or the rejection.
+  template<typename T, typename E>
+  struct Admitted< Result<T, E>
+                 , enable_if<!std::is_constructible<E, Overloaded>{}>>
+  {
+    typedef Either<E, Overloaded> Error;
+    typedef Result<T, Error>      type;
+
+    static type from(Result<T, E>& result) {
+      return result.match(
+        [](T& value) { return type(std::move(value)); },
+        [](E& error) { return type(Error(std::move(error))); });
+    }
+
+    static type rejected(Overloaded error)  { return type(Error(error)); }
+  };
+
+  template<typename E>
+  struct Admitted< Result<void, E>
+                 , enable_if<!std::is_constructible<E, Overloaded>{}>>
+  {
+    typedef Either<E, Overloaded> Error;
+    typedef Result<void, Error>   type;
+
+    static type from(const Result<void, E>& result) {
+      return result.match(
+        []()               { return type(); },
+        [](const E& error) { return type(Error(error)); });
+    }
+
+    static type rejected(Overloaded error)  { return type(Error(error)); }
+  };
+
+  // Continuation of an admitted chain: gives its place in flight back and
+  // passes the value on as a success.
+  template<typename Ticket, typename T>
+  struct Complete {
+    std::shared_ptr<Ticket> ticket;
+
+    typename Admitted<T>::type operator () (T& value) const {
+      ticket->complete();
+      return Admitted<T>::from(value);
+    }
+
+    typename Admitted<T>::type operator () (T&& value) const {
+      return (*this)(value);
+    }
+  };
+
+  template<typename Ticket>
+  struct Complete<Ticket, void> {
+    std::shared_ptr<Ticket> ticket;
+
+    Admitted<void>::type operator () () const {
+      ticket->complete();
+      return Admitted<void>::from();
+    }
+  };
+
+}} // namespace detail::admission
+
+////////////////////////////////////////////////////////////////////////////////
+template<typename Limit = FixedLimit>
+class Admission {
+private:
+  typedef std::chrono::steady_clock Clock;
+
+  template<typename F>
+  using admitted = remove_future<result_of<F>>;
+
+  template<typename F>
+  using Admitted = detail::admission::Admitted<admitted<F>>;
+
+public:
+  // The arguments are passed on to the Limit.
+  template<typename... Args>
+  explicit Admission(Args&&... args)
+    : _limit(std::forward<Args>(args)...)
+    , _in_flight(0)
+    , _num_admitted(0)
+    , _num_rejected(0)
+  {}
+
+  Admission(const Admission&) = delete;
+  Admission& operator = (const Admission&) = delete;
+
+  ~Admission() {
+    assert(_in_flight == 0);
+  }
+
+  template<typename F>
+  Future<typename Admitted<F>::type> admit(F&& fun) {
+    auto in_flight = _in_flight.load(std::memory_order_relaxed);
+
+    do {
+      auto limit = _limit.limit();
+
+      if (in_flight >= limit) {
+        _num_rejected.fetch_add(1, std::memory_order_relaxed);
+        return make_ready_future(Admitted<F>::rejected(Overloaded{ limit }));
+      }
+    } while (!_in_flight.compare_exchange_weak(in_flight, in_flight + 1));
+
+    _num_admitted.fetch_add(1, std::memory_order_relaxed);
+
+    auto ticket = std::make_shared<Ticket>(*this);
+
+    return detail::make_ready_future(fun)
+      .then(Complete<admitted<F>>{ std::move(ticket) });
+  }
+
+  // Number of admitted chains that have not completed yet.
+  std::size_t in_flight() const {
+    return _in_flight.load(std::memory_order_relaxed);
+  }
+
+  std::size_t limit() const {
+    return _limit.limit();
+  }
+
+  std::size_t num_admitted() const {
+    return _num_admitted.load(std::memory_order_relaxed);
+  }
+
+  std::size_t num_rejected() const {
+    return _num_rejected.load(std::memory_order_relaxed);
+  }
+
+  const Limit& policy() const {
+    return _limit;
+  }
+
+private:
+  // Holds a place in flight until the chain completes, or is dropped without
+  // ever completing.
+  struct Ticket {
+    Admission&        admission;
+    Clock::time_point start;
+    bool              done;
+
+    explicit Ticket(Admission& admission)
+      : admission(admission), start(Clock::now()), done(false)
+    {}
+
+    ~Ticket() {
+      complete();
+    }
+
+    void complete() {
+      if (done) return;
+
+      done = true;
+      admission.complete(start);
+    }
+  };
+
+  template<typename T>
+  using Complete = detail::admission::Complete<Ticket, T>;
+
+  void complete(Clock::time_point start) {
+    auto latency = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      Clock::now() - start);
+
+    auto in_flight = _in_flight.fetch_sub(1, std::memory_order_relaxed);
+
+    _limit.update(AdmissionSample{ latency, in_flight });
+  }
+
+private:
+  Limit                    _limit;
+  std::atomic<std::size_t> _in_flight;
+  std::atomic<std::size_t> _num_admitted;
+  std::atomic<std::size_t> _num_rejected;
+};
+
+} // namespace fry
+
+#endif // __FRY__ADMISSION_H__
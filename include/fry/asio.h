@@ -10,12 +10,21 @@
 
 // Glue code between this library and boost::asio
 
+#include <boost/version.hpp>
 #include <boost/asio/async_result.hpp>
-#include <boost/asio/handler_type.hpp>
+#include <boost/asio/read.hpp>
+#include <boost/asio/read_until.hpp>
+#include <boost/asio/write.hpp>
 #include <boost/system/error_code.hpp>
 
+// Boost 1.66 replaced handler_type with the two-parameter async_result.
+#if BOOST_VERSION < 106600
+#include <boost/asio/handler_type.hpp>
+#endif
+
 #include "future.h"
 #include "result.h"
+#include "recycling_allocator.h"
 #include "repeat_until.h"
 
 
@@ -62,55 +71,180 @@ result_of<Action> repeat_until_success(Action&& action) {
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-struct UseFuture {};
+// Completion token that makes asynchronous operations return Futures.
+//
+// use_future[recycler] makes the operation allocate both its own storage and
+// the state of the returned future from the given Recycler, so that a steady
+// stream of operations does not touch the global allocator. The recycler must
+// outlive the io_service (see recycling_allocator.h).
+struct UseFuture {
+  Recycler* recycler;
+
+  UseFuture operator [] (Recycler& recycler) const {
+    return UseFuture{ &recycler };
+  }
+};
+
+constexpr UseFuture use_future{ nullptr };
+
+// Completion token that makes asynchronous operations return Futures whose
+// continuations run inside the given strand (or any other object with
+// dispatch() and running_in_this_thread(), like io_service::strand), instead
+// of on whichever thread happens to complete the operation. When the
+// operation completes inside the strand already, the continuations run right
+// away.
+//
+// use_future_on(strand)[recycler] combines this with the recycling of
+// use_future[recycler].
+template<typename Strand>
+struct UseFutureOn {
+  Strand*   strand;
+  Recycler* recycler;
+
+  UseFutureOn operator [] (Recycler& recycler) const {
+    return UseFutureOn{ strand, &recycler };
+  }
+};
+
+template<typename Strand>
+UseFutureOn<Strand> use_future_on(Strand& strand) {
+  return UseFutureOn<Strand>{ &strand, nullptr };
+}
 
-constexpr UseFuture use_future{};
+// Whether T is one of the above completion tokens.
+template<typename T> struct is_token                 : std::false_type {};
+template<>           struct is_token<UseFuture>      : std::true_type {};
+template<typename S> struct is_token<UseFutureOn<S>> : std::true_type {};
+
+////////////////////////////////////////////////////////////////////////////////
+namespace detail {
+  template<typename T>
+  class HandlerBase {
+  public:
+    // Memory for the asynchronous operation is obtained through both the
+    // associated allocator (Boost 1.66 and later) and the allocation hooks
+    // (earlier versions).
+    typedef RecyclingAllocator<void> allocator_type;
+
+    HandlerBase(UseFuture token)
+      : _recycler(token.recycler)
+      , _promise(std::allocator_arg, allocator_type(token.recycler))
+    {}
+
+    Future<T> get_future() const {
+      return _promise.get_future();
+    }
+
+    allocator_type get_allocator() const {
+      return allocator_type(_recycler);
+    }
+
+    friend void* asio_handler_allocate(std::size_t size, HandlerBase* self) {
+      return RecyclingAllocator<char>(self->_recycler).allocate(size);
+    }
+
+    friend void asio_handler_deallocate( void* pointer, std::size_t size
+                                       , HandlerBase* self)
+    {
+      RecyclingAllocator<char>(self->_recycler).deallocate(
+        static_cast<char*>(pointer), size);
+    }
+
+  protected:
+    Recycler*          _recycler;
+    Promise<Result<T>> _promise;
+  };
+}
 
 ////////////////////////////////////////////////////////////////////////////////
 template<typename T>
-class Handler {
+class Handler : public detail::HandlerBase<T> {
 public:
-  Handler(UseFuture = use_future)
-    : _promise(std::make_shared<Promise<Result<T>>>())
+  Handler(UseFuture token = use_future)
+    : detail::HandlerBase<T>(token)
   {}
 
   void operator () (const boost::system::error_code& error, T value) {
     if (error) {
-      _promise->set_value(Result<T>(error));
+      this->_promise.set_value(Result<T>(error));
     } else {
-      _promise->set_value(Result<T>(value));
+      this->_promise.set_value(Result<T>(std::move(value)));
     }
   }
-
-  Future<T> get_future() const {
-    return _promise->get_future();
-  }
-
-private:
-  std::shared_ptr<Promise<Result<T>>> _promise;
 };
 
 template<>
-class Handler<void> {
+class Handler<void> : public detail::HandlerBase<void> {
 public:
-  Handler(UseFuture = use_future)
-    : _promise(std::make_shared<Promise<Result<void>>>())
+  Handler(UseFuture token = use_future)
+    : detail::HandlerBase<void>(token)
   {}
 
   void operator () (const boost::system::error_code& error) {
     if (error) {
-      _promise->set_value(Result<void>(error));
+      _promise.set_value(Result<void>(error));
     } else {
-      _promise->set_value(Result<void>());
+      _promise.set_value(Result<void>());
     }
   }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Handler that completes inside a strand. Asio runs it through the strand
+// either because the strand is its associated executor (Boost 1.66 and
+// later), or through the invocation hook (earlier versions), the same way it
+// runs handlers wrapped with strand.wrap(). Either way the strand dispatches
+// it, so it runs right away when the operation completes inside the strand
+// already. The allocation hooks are inherited, so the memory still comes from
+// the recycler.
+template<typename T, typename Strand>
+class StrandHandler : public Handler<T> {
+public:
+  typedef Strand executor_type;
+
+  StrandHandler(UseFutureOn<Strand> token)
+    : Handler<T>(UseFuture{ token.recycler })
+    , _strand(token.strand)
+  {}
+
+  executor_type get_executor() const {
+    return *_strand;
+  }
 
-  Future<void> get_future() const {
-    return _promise->get_future();
+#if BOOST_VERSION < 106600
+  template<typename F>
+  friend void asio_handler_invoke(F& fun, StrandHandler* self) {
+    if (self->_strand->running_in_this_thread()) {
+      fun();
+    } else {
+      self->_strand->dispatch(Invoke<F>{ std::move(fun), self->_recycler });
+    }
   }
+#endif
+
+private:
+  // Runs the function without going through the hook again.
+  template<typename F>
+  struct Invoke {
+    F         fun;
+    Recycler* recycler;
+
+    void operator () () { fun(); }
+
+    friend void* asio_handler_allocate(std::size_t size, Invoke* self) {
+      return RecyclingAllocator<char>(self->recycler).allocate(size);
+    }
+
+    friend void asio_handler_deallocate( void* pointer, std::size_t size
+                                       , Invoke* self)
+    {
+      RecyclingAllocator<char>(self->recycler).deallocate(
+        static_cast<char*>(pointer), size);
+    }
+  };
 
 private:
-  std::shared_ptr<Promise<Result<void>>> _promise;
+  Strand* _strand;
 };
 
 }} // namespace fry::asio
@@ -118,6 +252,90 @@ private:
 ////////////////////////////////////////////////////////////////////////////////
 namespace boost { namespace asio {
 
+#if BOOST_VERSION >= 106600
+
+template<typename R, typename T>
+class async_result<::fry::asio::UseFuture, R(boost::system::error_code, T)> {
+public:
+  typedef ::fry::asio::Handler<T>   completion_handler_type;
+  typedef ::fry::asio::Future<T>    return_type;
+
+  explicit async_result(completion_handler_type& h)
+    : _future(h.get_future())
+  {}
+
+  return_type get() {
+    return std::move(_future);
+  }
+
+private:
+
+  return_type _future;
+};
+
+template<typename R>
+class async_result<::fry::asio::UseFuture, R(boost::system::error_code)> {
+public:
+  typedef ::fry::asio::Handler<void> completion_handler_type;
+  typedef ::fry::asio::Future<void>  return_type;
+
+  explicit async_result(completion_handler_type& h)
+    : _future(h.get_future())
+  {}
+
+  return_type get() {
+    return std::move(_future);
+  }
+
+private:
+
+  return_type _future;
+};
+
+template<typename R, typename T, typename Strand>
+class async_result< ::fry::asio::UseFutureOn<Strand>
+                  , R(boost::system::error_code, T)>
+{
+public:
+  typedef ::fry::asio::StrandHandler<T, Strand> completion_handler_type;
+  typedef ::fry::asio::Future<T>                return_type;
+
+  explicit async_result(completion_handler_type& h)
+    : _future(h.get_future())
+  {}
+
+  return_type get() {
+    return std::move(_future);
+  }
+
+private:
+
+  return_type _future;
+};
+
+template<typename R, typename Strand>
+class async_result< ::fry::asio::UseFutureOn<Strand>
+                  , R(boost::system::error_code)>
+{
+public:
+  typedef ::fry::asio::StrandHandler<void, Strand> completion_handler_type;
+  typedef ::fry::asio::Future<void>                return_type;
+
+  explicit async_result(completion_handler_type& h)
+    : _future(h.get_future())
+  {}
+
+  return_type get() {
+    return std::move(_future);
+  }
+
+private:
+
+  return_type _future;
+};
+
+#else
+
 template <typename T>
 class async_result<::fry::asio::Handler<T>> {
 public:
@@ -146,7 +364,108 @@ struct handler_type<::fry::asio::UseFuture, R(boost::system::error_code)> {
   typedef ::fry::asio::Handler<void> type;
 };
 
+template <typename T, typename Strand>
+class async_result<::fry::asio::StrandHandler<T, Strand>>
+  : public async_result<::fry::asio::Handler<T>>
+{
+public:
+  explicit async_result(::fry::asio::StrandHandler<T, Strand>& h)
+    : async_result<::fry::asio::Handler<T>>(h)
+  {}
+};
+
+template<typename R, typename T, typename Strand>
+struct handler_type< ::fry::asio::UseFutureOn<Strand>
+                   , R(boost::system::error_code, T)>
+{
+  typedef ::fry::asio::StrandHandler<T, Strand> type;
+};
+
+template<typename R, typename Strand>
+struct handler_type< ::fry::asio::UseFutureOn<Strand>
+                   , R(boost::system::error_code)>
+{
+  typedef ::fry::asio::StrandHandler<void, Strand> type;
+};
+
+#endif
+
 }} // namespace boost::asio
 
+////////////////////////////////////////////////////////////////////////////////
+// Composed operations returning Futures. The token can be any of use_future,
+// use_future[recycler], use_future_on(strand) and
+// use_future_on(strand)[recycler]. The intermediate operations inherit its
+// allocator and strand.
+namespace fry { namespace asio {
+
+// Reads until the buffers are full.
+template< typename Stream, typename Buffers, typename Token = UseFuture
+        , typename = enable_if<is_token<Token>{}>>
+Future<std::size_t> async_read( Stream&        stream
+                              , const Buffers& buffers
+                              , Token          token = use_future)
+{
+  return boost::asio::async_read(stream, buffers, token);
+}
+
+// Reads until the completion condition is satisfied (for example
+// boost::asio::transfer_at_least(n)).
+template< typename Stream, typename Buffers, typename Condition
+        , typename Token = UseFuture
+        , typename = enable_if<!is_token<Condition>{}>>
+Future<std::size_t> async_read( Stream&        stream
+                              , const Buffers& buffers
+                              , Condition      condition
+                              , Token          token = use_future)
+{
+  return boost::asio::async_read(stream, buffers, condition, token);
+}
+
+// Reads into the streambuf until the completion condition is satisfied.
+template< typename Stream, typename Allocator, typename Condition
+        , typename Token = UseFuture
+        , typename = enable_if<!is_token<Condition>{}>>
+Future<std::size_t> async_read( Stream&                                  stream
+                              , boost::asio::basic_streambuf<Allocator>& buffer
+                              , Condition                                condition
+                              , Token                                    token = use_future)
+{
+  return boost::asio::async_read(stream, buffer, condition, token);
+}
+
+// Reads into the streambuf until it contains the delimiter. The future holds
+// the number of bytes up to and including the delimiter. The streambuf may
+// contain more data after that, which subsequent reads take into account.
+template< typename Stream, typename Allocator, typename Delimiter
+        , typename Token = UseFuture>
+Future<std::size_t> async_read_until( Stream&                                  stream
+                                    , boost::asio::basic_streambuf<Allocator>& buffer
+                                    , const Delimiter&                         delimiter
+                                    , Token                                    token = use_future)
+{
+  return boost::asio::async_read_until(stream, buffer, delimiter, token);
+}
+
+// Writes all of the buffers.
+template<typename Stream, typename Buffers, typename Token = UseFuture>
+Future<std::size_t> async_write( Stream&        stream
+                               , const Buffers& buffers
+                               , Token          token = use_future)
+{
+  return boost::asio::async_write(stream, buffers, token);
+}
+
+// Accepts a connection into the given socket.
+template<typename Acceptor, typename Socket, typename Token = UseFuture>
+Future<void> async_accept( Acceptor& acceptor
+                         , Socket&   socket
+                         , Token     token = use_future)
+{
+  return acceptor.async_accept(socket, token);
+}
+
+}} // namespace fry::asio
+
 
 #endif // __FRY__ASIO_H__
\ No newline at end of file
@@ -0,0 +1,313 @@
+//
+// Copyright (c) 2014 Adam Cigánek (adam.ciganek@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef __FRY__BUFFER_POOL_H__
+#define __FRY__BUFFER_POOL_H__
+
+// BufferPool - hands out fixed-size slabs of memory for I/O buffers.
+//
+// Slab       - reference counted handle to one slab. Copying it is cheap, so
+//              a buffer can be passed on down a chain of continuations
+//              instead of copying the data. When the last handle goes away,
+//              the slab goes back to the free list of the thread that
+//              released it, and the next acquire() on that thread takes it
+//              from there without any locking. Free lists that grow too long
+//              are given back to the pool, where other threads can get them.
+//
+//   BufferPool pool(2048);
+//
+//   auto slab = pool.acquire();
+//   std::memcpy(slab.data(), "hello", 5);
+//
+// The pool keeps all of its slabs, and frees them when it is destroyed, so it
+// must outlive every Slab acquired from it. Like a Recycler, with asio it
+// should be declared before the io_service.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace fry {
+
+class BufferPool;
+
+////////////////////////////////////////////////////////////////////////////////
+class Slab {
+public:
+  Slab() : _header(nullptr) {}
+
+  Slab(const Slab& other) : _header(other._header) {
+    if (_header) _header->refs.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  Slab(Slab&& other) : _header(other._header) {
+    other._header = nullptr;
+  }
+
+  Slab& operator = (Slab other) {
+    std::swap(_header, other._header);
+    return *this;
+  }
+
+  ~Slab() {
+    release();
+  }
+
+  char* data() const {
+    return reinterpret_cast<char*>(_header + 1);
+  }
+
+  std::size_t size() const;
+
+  explicit operator bool () const {
+    return _header != nullptr;
+  }
+
+  std::size_t use_count() const {
+    return _header ? _header->refs.load(std::memory_order_relaxed) : 0;
+  }
+
+private:
+  friend class BufferPool;
+
+  // Followed by the data, aligned like the header itself.
+  struct alignas(std::max_align_t) Header {
+    std::atomic<std::size_t> refs;
+    BufferPool*              pool;
+    Header*                  next;
+  };
+
+  explicit Slab(Header* header) : _header(header) {}
+
+  inline void release();
+
+private:
+  Header* _header;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+class BufferPool {
+public:
+  // Each thread keeps at most `cache_size` free slabs of this pool for
+  // itself.
+  explicit BufferPool(std::size_t slab_size, std::size_t cache_size = 256)
+    : _slab_size(slab_size)
+    , _cache_size(cache_size)
+    , _id(next_id())
+    , _shared(nullptr)
+  {
+    std::lock_guard<std::mutex> lock(registry().mutex);
+    registry().pools[_id] = this;
+  }
+
+  BufferPool(const BufferPool&) = delete;
+  BufferPool& operator = (const BufferPool&) = delete;
+
+  ~BufferPool() {
+    {
+      std::lock_guard<std::mutex> lock(registry().mutex);
+      registry().pools.erase(_id);
+    }
+
+    for (auto slab : _slabs) {
+      slab->~Header();
+      ::operator delete(slab);
+    }
+  }
+
+  Slab acquire() {
+    auto& cache = local_cache();
+
+    if (!cache.head) refill(cache);
+
+    Slab::Header* header;
+
+    if (cache.head) {
+      header     = cache.head;
+      cache.head = header->next;
+      --cache.size;
+    } else {
+      header = allocate();
+    }
+
+    header->refs.store(1, std::memory_order_relaxed);
+    return Slab(header);
+  }
+
+  std::size_t slab_size() const {
+    return _slab_size;
+  }
+
+  // Number of slabs allocated so far, free or in use.
+  std::size_t num_slabs() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _slabs.size();
+  }
+
+private:
+  friend class Slab;
+
+  typedef Slab::Header Header;
+
+  // Free slabs of one pool, owned by one thread.
+  struct Cache {
+    std::uint64_t pool;
+    Header*       head;
+    std::size_t   size;
+  };
+
+  // The free lists of a thread, for the few pools it uses. When a thread
+  // starts using more pools than that, or exits, its lists are given back to
+  // their pools (those that are still alive).
+  struct LocalCaches {
+    static const std::size_t capacity = 4;
+
+    Cache       caches[capacity];
+    std::size_t next_victim;
+
+    LocalCaches() : next_victim(0) {
+      for (auto& cache : caches) cache = Cache{ 0, nullptr, 0 };
+    }
+
+    ~LocalCaches() {
+      for (auto& cache : caches) evict(cache);
+    }
+  };
+
+  struct Registry {
+    std::mutex                            mutex;
+    std::map<std::uint64_t, BufferPool*>  pools;
+  };
+
+  static Registry& registry() {
+    static Registry registry;
+    return registry;
+  }
+
+  static std::uint64_t next_id() {
+    static std::atomic<std::uint64_t> last(0);
+    return ++last;
+  }
+
+  static void evict(Cache& cache) {
+    if (cache.head) {
+      std::lock_guard<std::mutex> lock(registry().mutex);
+      auto i = registry().pools.find(cache.pool);
+
+      if (i != registry().pools.end()) {
+        i->second->give_back(cache.head);
+      }
+    }
+
+    cache = Cache{ 0, nullptr, 0 };
+  }
+
+  Cache& local_cache() {
+    static thread_local LocalCaches local;
+
+    for (auto& cache : local.caches) {
+      if (cache.pool == _id) return cache;
+    }
+
+    auto& cache = local.caches[local.next_victim++ % LocalCaches::capacity];
+
+    evict(cache);
+    cache.pool = _id;
+
+    return cache;
+  }
+
+  // Called when the last reference to a slab of this pool goes away.
+  void recycle(Header* header) {
+    auto& cache = local_cache();
+
+    header->next = cache.head;
+    cache.head   = header;
+    ++cache.size;
+
+    // Keep half, so that a thread that both acquires and releases does not
+    // bounce between the limit and the pool.
+    if (cache.size > _cache_size) {
+      auto link = &cache.head;
+      auto keep = _cache_size / 2;
+
+      for (std::size_t i = 0; i < keep; ++i) link = &(*link)->next;
+
+      give_back(*link);
+      *link      = nullptr;
+      cache.size = keep;
+    }
+  }
+
+  // Takes up to half of a full cache from the slabs given back by other
+  // threads.
+  void refill(Cache& cache) {
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    for (std::size_t i = 0; _shared && i < _cache_size / 2 + 1; ++i) {
+      auto header = _shared;
+      _shared     = header->next;
+
+      header->next = cache.head;
+      cache.head   = header;
+      ++cache.size;
+    }
+  }
+
+  void give_back(Header* list) {
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    while (list) {
+      auto next  = list->next;
+      list->next = _shared;
+      _shared    = list;
+      list       = next;
+    }
+  }
+
+  Header* allocate() {
+    auto header = new (::operator new(sizeof(Header) + _slab_size)) Header;
+
+    header->pool = this;
+    header->next = nullptr;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _slabs.push_back(header);
+
+    return header;
+  }
+
+private:
+  const std::size_t    _slab_size;
+  const std::size_t    _cache_size;
+  const std::uint64_t  _id;
+
+  mutable std::mutex   _mutex;
+  Header*              _shared;
+  std::vector<Header*> _slabs;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+inline std::size_t Slab::size() const {
+  return _header ? _header->pool->slab_size() : 0;
+}
+
+inline void Slab::release() {
+  if (_header && _header->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    _header->pool->recycle(_header);
+  }
+
+  _header = nullptr;
+}
+
+} // namespace fry
+
+#endif // __FRY__BUFFER_POOL_H__
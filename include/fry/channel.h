@@ -0,0 +1,582 @@
+//
+// Copyright (c) 2014 Adam Cigánek (adam.ciganek@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef __FRY__CHANNEL_H__
+#define __FRY__CHANNEL_H__
+
+// Channel - bounded queue between any number of producers and consumers,
+// where waiting for space or for an item returns a future.
+//
+//   Channel<Job> jobs(64);
+//
+//   // producer
+//   jobs.send(std::move(job)).then([]() { /* there was space */ });
+//
+//   // consumer
+//   std::function<void()> work = [&]() {
+//     jobs.receive().then([&](boost::optional<Job> job) {
+//       if (!job) return;   // closed, and everything sent was received
+//       run(*job);
+//       work();
+//     });
+//   };
+//
+// send() resolves once the item is in the channel: right away while there is
+// space, or else once a receiver made some. receive() resolves once there is
+// an item, or with none once the channel is closed and drained.
+//
+// The items are kept in a lock-free ring of `capacity` slots, so while the
+// channel is neither full nor empty, sending and receiving take no lock (and
+// allocate nothing but the ready future). A send or receive that has to wait
+// is queued in an intrusive list of waiters, in order, under a lock. An item
+// sent while receivers are waiting goes directly to the first of them,
+// without passing through the ring, and so does one waiting to be sent when a
+// receiver comes. A capacity of zero makes every send wait for a receiver.
+//
+// close() stops new sends (sending to a closed channel drops the item and
+// resolves right away). Items already in the channel, including those of
+// senders still waiting, are received as usual; after them, receive()
+// resolves with none.
+//
+// select(a, b, ...) receives from whichever of several channels (of the same
+// item type) has an item first, and resolves with its index and the item:
+//
+//   select(urgent, normal).then([](std::pair<std::size_t, boost::optional<Job>> next) {
+//     ...
+//   });
+//
+// The item is taken from one channel only. Channels earlier in the argument
+// list are preferred when several have items already.
+//
+// Futures are resolved on the thread that made them ready (the sender's, the
+// receiver's or the closer's). Waiters still queued when the channel is
+// destroyed are dropped, and their futures never become ready.
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <boost/optional.hpp>
+#include "future.h"
+#include "synchronization.h"
+
+namespace fry {
+
+////////////////////////////////////////////////////////////////////////////////
+namespace detail { namespace channel {
+
+  // Bounded multi-producer, multi-consumer queue. Each slot has a sequence
+  // number telling whether it is free for the push at a given position
+  // (2 * position), or holds the item for the pop at it (2 * position + 1).
+  // Doubled, so that the two never meet even with a single slot.
+  template<typename T>
+  class Ring {
+  public:
+    explicit Ring(std::size_t capacity)
+      : _slots(new Slot[capacity])
+      , _capacity(capacity)
+      , _head(0)
+      , _tail(0)
+    {
+      for (std::size_t i = 0; i < capacity; ++i) {
+        _slots[i].sequence.store(2 * i, std::memory_order_relaxed);
+      }
+    }
+
+    Ring(const Ring&) = delete;
+    Ring& operator = (const Ring&) = delete;
+
+    ~Ring() {
+      boost::optional<T> item;
+      while (try_pop(item));
+    }
+
+    std::size_t capacity() const { return _capacity; }
+
+    std::size_t size() const {
+      auto head = _head.load(std::memory_order_relaxed);
+      auto tail = _tail.load(std::memory_order_relaxed);
+      return tail > head ? tail - head : 0;
+    }
+
+    // Moves the item in, unless the ring is full (and leaves it untouched).
+    bool try_push(T& item) {
+      if (_capacity == 0) return false;
+
+      auto  pos  = _tail.load(std::memory_order_relaxed);
+      Slot* slot;
+
+      for (;;) {
+        slot = &_slots[pos % _capacity];
+
+        auto diff = static_cast<std::intptr_t>(
+          slot->sequence.load(std::memory_order_acquire) - 2 * pos);
+
+        if (diff == 0) {
+          if (_tail.compare_exchange_weak( pos, pos + 1
+                                         , std::memory_order_relaxed))
+          {
+            break;
+          }
+        } else if (diff < 0) {
+          return false;
+        } else {
+          pos = _tail.load(std::memory_order_relaxed);
+        }
+      }
+
+      new (&slot->storage) T(std::move(item));
+      slot->sequence.store(2 * pos + 1, std::memory_order_release);
+
+      return true;
+    }
+
+    bool try_pop(boost::optional<T>& item) {
+      if (_capacity == 0) return false;
+
+      auto  pos  = _head.load(std::memory_order_relaxed);
+      Slot* slot;
+
+      for (;;) {
+        slot = &_slots[pos % _capacity];
+
+        auto diff = static_cast<std::intptr_t>(
+          slot->sequence.load(std::memory_order_acquire) - (2 * pos + 1));
+
+        if (diff == 0) {
+          if (_head.compare_exchange_weak( pos, pos + 1
+                                         , std::memory_order_relaxed))
+          {
+            break;
+          }
+        } else if (diff < 0) {
+          return false;
+        } else {
+          pos = _head.load(std::memory_order_relaxed);
+        }
+      }
+
+      auto value = reinterpret_cast<T*>(&slot->storage);
+
+      item = std::move(*value);
+      value->~T();
+
+      slot->sequence.store(2 * (pos + _capacity), std::memory_order_release);
+
+      return true;
+    }
+
+  private:
+    struct Slot {
+      std::atomic<std::size_t>                                   sequence;
+      typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+    };
+
+    std::unique_ptr<Slot[]>  _slots;
+    const std::size_t        _capacity;
+    char                     _padding0[64];
+    std::atomic<std::size_t> _head;
+    char                     _padding1[64];
+    std::atomic<std::size_t> _tail;
+  };
+
+  //----------------------------------------------------------------------------
+  template<typename T>
+  struct Sender : sync::Waiter {
+    T             item;
+    Promise<void> promise;
+
+    explicit Sender(T&& item) : item(std::move(item)) {}
+
+    void resume() override {
+      auto promise = std::move(this->promise);
+      delete this;
+      promise.set_value();
+    }
+  };
+
+  // Waiting receive(), or one of the channels of a select().
+  template<typename T>
+  struct Receiver : sync::Waiter {
+    boost::optional<T> item;
+
+    // Whether this receiver takes the item about to be given to it. Once it
+    // says yes, it must keep saying yes.
+    virtual bool claim() { return true; }
+
+    // Whether it would say no anyway.
+    virtual bool abandoned() const { return false; }
+  };
+
+  template<typename T>
+  struct Receive : Receiver<T> {
+    Promise<boost::optional<T>> promise;
+
+    void resume() override {
+      auto promise = std::move(this->promise);
+      auto item    = std::move(this->item);
+      delete this;
+      promise.set_value(std::move(item));
+    }
+  };
+
+  template<typename T>
+  struct Selection {
+    typedef std::pair<std::size_t, boost::optional<T>> Value;
+
+    std::atomic<bool> done;
+    Promise<Value>    promise;
+
+    Selection() : done(false) {}
+  };
+
+  template<typename T>
+  struct Select : Receiver<T> {
+    std::shared_ptr<Selection<T>> selection;
+    std::size_t                   index;
+    bool                          claimed;
+
+    Select(std::shared_ptr<Selection<T>> selection, std::size_t index)
+      : selection(std::move(selection)), index(index), claimed(false)
+    {}
+
+    bool claim() override {
+      bool done = false;
+
+      if (!claimed) {
+        claimed = selection->done.compare_exchange_strong(done, true);
+      }
+
+      return claimed;
+    }
+
+    bool abandoned() const override {
+      return !claimed && selection->done.load(std::memory_order_acquire);
+    }
+
+    void resume() override {
+      auto selection = std::move(this->selection);
+      auto value     = typename Selection<T>::Value(index, std::move(this->item));
+      delete this;
+      selection->promise.set_value(std::move(value));
+    }
+  };
+
+  // Intrusive FIFO of waiters.
+  struct Queue {
+    sync::Waiter* head;
+    sync::Waiter* tail;
+
+    Queue() : head(nullptr), tail(nullptr) {}
+
+    void push(sync::Waiter* waiter) {
+      waiter->next = nullptr;
+      (tail ? tail->next : head) = waiter;
+      tail = waiter;
+    }
+
+    sync::Waiter* pop() {
+      auto waiter = head;
+
+      head = waiter->next;
+      if (!head) tail = nullptr;
+
+      return waiter;
+    }
+  };
+}} // namespace detail::channel
+
+////////////////////////////////////////////////////////////////////////////////
+template<typename T>
+class Channel {
+public:
+  explicit Channel(std::size_t capacity)
+    : _ring(capacity)
+    , _closed(false)
+    , _num_senders(0)
+    , _num_receivers(0)
+  {}
+
+  Channel(const Channel&) = delete;
+  Channel& operator = (const Channel&) = delete;
+
+  ~Channel() {
+    while (_senders.head)   delete _senders.pop();
+    while (_receivers.head) delete _receivers.pop();
+  }
+
+  Future<void> send(T&& item) {
+    if (_closed.load(std::memory_order_acquire)) return make_ready_future();
+
+    // Straight into the ring, unless there are receivers to hand the item
+    // to, or senders that came first.
+    if (   _num_receivers.load(std::memory_order_relaxed) == 0
+        && _num_senders.load(std::memory_order_relaxed)   == 0
+        && _ring.try_push(item))
+    {
+      // Either a receiver about to wait sees the item in the ring, or this
+      // sees the receiver. A close() in between may have left receivers
+      // waiting for this item too.
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (   _num_receivers.load(std::memory_order_relaxed) > 0
+          || _closed.load(std::memory_order_relaxed))
+      {
+        pump();
+      }
+
+      return make_ready_future();
+    }
+
+    auto waiter = new detail::channel::Sender<T>(std::move(item));
+    auto result = waiter->promise.get_future();
+
+    detail::sync::Waiter* ready = nullptr;
+
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+
+      if (_closed.load(std::memory_order_relaxed)) {
+        delete waiter;
+        return make_ready_future();
+      }
+
+      _senders.push(waiter);
+      _num_senders.fetch_add(1);
+
+      pump(ready);
+    }
+
+    detail::sync::resume_all(ready);
+
+    return result;
+  }
+
+  Future<void> send(const T& item) {
+    return send(T(item));
+  }
+
+  Future<boost::optional<T>> receive() {
+    boost::optional<T> item;
+
+    if (_ring.try_pop(item)) {
+      // Let a waiting sender into the slot just freed.
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (_num_senders.load(std::memory_order_relaxed) > 0) pump();
+
+      return make_ready_future(std::move(item));
+    }
+
+    auto waiter = new detail::channel::Receive<T>;
+    auto result = waiter->promise.get_future();
+
+    wait(waiter);
+
+    return result;
+  }
+
+  // Stops new sends. Receivers are given what is left, then none.
+  void close() {
+    detail::sync::Waiter* ready = nullptr;
+
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+
+      _closed.store(true, std::memory_order_release);
+      pump(ready);
+    }
+
+    detail::sync::resume_all(ready);
+  }
+
+  bool is_closed() const {
+    return _closed.load(std::memory_order_acquire);
+  }
+
+  std::size_t capacity() const {
+    return _ring.capacity();
+  }
+
+  // Number of items in the ring (not counting those of waiting senders).
+  std::size_t size() const {
+    return _ring.size();
+  }
+
+  std::size_t num_waiting_senders() const {
+    return _num_senders.load(std::memory_order_relaxed);
+  }
+
+  std::size_t num_waiting_receivers() const {
+    return _num_receivers.load(std::memory_order_relaxed);
+  }
+
+private:
+  typedef detail::channel::Receiver<T> Receiver;
+  typedef detail::channel::Sender<T>   Sender;
+
+  // Queues the receiver, and gives it an item if there is one already.
+  void wait(Receiver* waiter) {
+    detail::sync::Waiter* ready = nullptr;
+
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+
+      _receivers.push(waiter);
+
+      // Either a sender that just pushed to the ring sees this receiver, or
+      // the pump below sees its item.
+      _num_receivers.fetch_add(1);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+
+      pump(ready);
+    }
+
+    detail::sync::resume_all(ready);
+  }
+
+  void pump() {
+    detail::sync::Waiter* ready = nullptr;
+
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      pump(ready);
+    }
+
+    detail::sync::resume_all(ready);
+  }
+
+  // Matches the waiters with the items in the ring and with each other.
+  // Those done are pushed to `ready`, to be resumed once the lock is gone.
+  void pump(detail::sync::Waiter*& ready) {
+    auto done = [&](detail::sync::Waiter* waiter) {
+      waiter->next = ready;
+      ready        = waiter;
+    };
+
+    while (_receivers.head) {
+      auto receiver = static_cast<Receiver*>(_receivers.head);
+
+      // A select() that got its item elsewhere.
+      if (receiver->abandoned()) {
+        _receivers.pop();
+        _num_receivers.fetch_sub(1);
+        delete receiver;
+        continue;
+      }
+
+      // A select() commits to this channel only once there is an item. (One
+      // taken by a receive() that did not have to wait, in between, leaves
+      // it waiting for the next item here.)
+      if (_ring.size() == 0 && !_senders.head) break;
+      if (!receiver->claim()) continue;
+
+      if (_ring.try_pop(receiver->item)) {
+        // The sender first in line takes the freed slot.
+        if (_senders.head) {
+          auto sender = static_cast<Sender*>(_senders.head);
+
+          if (_ring.try_push(sender->item)) {
+            _senders.pop();
+            _num_senders.fetch_sub(1);
+            done(sender);
+          }
+        }
+      } else if (_senders.head) {
+        // Nothing in the ring, so straight from sender to receiver.
+        auto sender = static_cast<Sender*>(_senders.pop());
+        _num_senders.fetch_sub(1);
+
+        receiver->item = std::move(sender->item);
+        done(sender);
+      } else {
+        break;
+      }
+
+      _receivers.pop();
+      _num_receivers.fetch_sub(1);
+      done(receiver);
+    }
+
+    // Room freed by receivers that did not have to wait.
+    while (_senders.head) {
+      auto sender = static_cast<Sender*>(_senders.head);
+      if (!_ring.try_push(sender->item)) break;
+
+      _senders.pop();
+      _num_senders.fetch_sub(1);
+      done(sender);
+    }
+
+    // Closed and drained: nothing more is coming to those still waiting. (The
+    // size counts the items still being pushed by a send() that got past the
+    // close, so those are not skipped.)
+    if (   _closed.load(std::memory_order_relaxed)
+        && !_senders.head && _ring.size() == 0)
+    {
+      while (_receivers.head) {
+        auto receiver = static_cast<Receiver*>(_receivers.pop());
+        _num_receivers.fetch_sub(1);
+
+        if (receiver->claim()) {
+          done(receiver);
+        } else {
+          delete receiver;
+        }
+      }
+    }
+  }
+
+  // Queues a waiter of a select(), unless it got an item already.
+  bool select(std::shared_ptr<detail::channel::Selection<T>> selection
+             , std::size_t                                   index)
+  {
+    if (selection->done.load(std::memory_order_acquire)) return false;
+
+    wait(new detail::channel::Select<T>(std::move(selection), index));
+    return true;
+  }
+
+  template<typename U, typename... Channels>
+  friend Future<std::pair<std::size_t, boost::optional<U>>>
+  select(Channel<U>&, Channels&...);
+
+private:
+  detail::channel::Ring<T> _ring;
+  std::atomic<bool>        _closed;
+
+  // Waiters, the first first.
+  std::mutex               _mutex;
+  detail::channel::Queue   _senders;
+  detail::channel::Queue   _receivers;
+  std::atomic<std::size_t> _num_senders;
+  std::atomic<std::size_t> _num_receivers;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Receives from the first of the channels to have an item (or to be closed
+// and drained). Resolves with the index of the channel and the item.
+template<typename T, typename... Channels>
+Future<std::pair<std::size_t, boost::optional<T>>>
+select(Channel<T>& first, Channels&... rest) {
+  Channel<T>* channels[] = { &first, &rest... };
+
+  auto selection = std::make_shared<detail::channel::Selection<T>>();
+  auto result    = selection->promise.get_future();
+
+  for (std::size_t i = 0; i < 1 + sizeof...(rest); ++i) {
+    if (!channels[i]->select(selection, i)) break;
+  }
+
+  return result;
+}
+
+} // namespace fry
+
+#endif // __FRY__CHANNEL_H__
@@ -0,0 +1,394 @@
+//
+// Copyright (c) 2014 Adam Cigánek (adam.ciganek@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef __FRY__CONNECTION_POOL_H__
+#define __FRY__CONNECTION_POOL_H__
+
+// ConnectionPool - connections to backends, opened on demand and reused.
+//
+// acquire(endpoint) returns a future of a Lease on a connection to the
+// endpoint. The connection goes back to the pool when the last copy of the
+// lease is gone:
+//
+//   pool.acquire(backend).then([](const Pool::Lease& lease) {
+//     return asio::async_write(lease.socket(), request, asio::use_future)
+//       .then([lease](std::size_t) { ... });
+//   });
+//
+// The lease must be kept (here by the continuation) for as long as any
+// operation on the connection is in progress.
+//
+// At most Options::max_per_endpoint connections to one endpoint are open at
+// a time. When all of them are leased, acquire() waits, and the waiters get
+// the connections in the order they came as the leases are released. A
+// released connection is handed to the first waiter directly (through the
+// io_service, so that a chain of waiters does not grow the stack), without
+// going through the idle list.
+//
+// A connection that has been idle is checked before it is leased out again
+// (by default whether the peer has not closed it and sent nothing since),
+// and one that fails the check is closed and replaced. Connections idle for
+// longer than Options::idle_timeout are closed (the timer that closes them
+// keeps the io_service busy while there are any idle; clear() closes them all
+// right away). A lease on a connection that
+// broke (the protocol got out of sync, an operation failed) should be
+// discarded, so that it is closed instead of going back to the pool.
+//
+// The pool must be used from one thread (or strand), like the sockets it
+// holds: all of its state, including the queue of waiters, is then only
+// ever touched by one thread at a time and needs no locks. Leases still out
+// when the pool is destroyed close their connections when released, and
+// waiters fail with error::operation_aborted.
+
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <vector>
+#include <errno.h>
+#include <sys/socket.h>
+#include <boost/asio/error.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include "future_result.h"
+#include "asio.h"
+
+namespace fry { namespace asio {
+
+namespace detail {
+  // Whether the connection is still open at the other end and has nothing
+  // unexpected to read.
+  template<typename Socket>
+  bool is_clean(Socket& socket) {
+    if (!socket.is_open()) return false;
+
+    char c;
+    auto result = ::recv( socket.native_handle(), &c, 1
+                        , MSG_PEEK | MSG_DONTWAIT);
+
+    return result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template<typename Protocol = boost::asio::ip::tcp>
+class ConnectionPool {
+public:
+  typedef typename Protocol::socket   Socket;
+  typedef typename Protocol::endpoint Endpoint;
+  typedef std::chrono::steady_clock   Clock;
+
+  struct Options {
+    std::size_t                  max_per_endpoint;
+    Clock::duration              idle_timeout;
+    std::function<bool(Socket&)> check;           // on checkout of an idle one
+
+    Options()
+      : max_per_endpoint(16)
+      , idle_timeout(std::chrono::seconds(30))
+      , check(&detail::is_clean<Socket>)
+    {}
+  };
+
+private:
+  struct Shared;
+  struct Slot;
+
+  // One connection while it is leased.
+  struct Checkout {
+    std::shared_ptr<Shared> shared;
+    Slot*                   slot;
+    std::unique_ptr<Socket> socket;
+    bool                    broken;
+
+    Checkout( std::shared_ptr<Shared> shared, Slot* slot
+            , std::unique_ptr<Socket> socket)
+      : shared(std::move(shared))
+      , slot(slot)
+      , socket(std::move(socket))
+      , broken(false)
+    {}
+
+    ~Checkout() {
+      Shared::release(shared, *slot, std::move(socket), broken);
+    }
+  };
+
+public:
+  // Shared handle to a leased connection.
+  class Lease {
+  public:
+    Socket& socket() const {
+      return *_checkout->socket;
+    }
+
+    Socket* operator -> () const {
+      return _checkout->socket.get();
+    }
+
+    const Endpoint& endpoint() const {
+      return _checkout->slot->endpoint;
+    }
+
+    // Closes the connection instead of returning it to the pool.
+    void discard() const {
+      _checkout->broken = true;
+    }
+
+  private:
+    explicit Lease(std::shared_ptr<Checkout> checkout)
+      : _checkout(std::move(checkout))
+    {}
+
+    friend class ConnectionPool;
+
+  private:
+    std::shared_ptr<Checkout> _checkout;
+  };
+
+private:
+  typedef Promise<Result<Lease>> Waiter;
+
+  struct Idle {
+    std::unique_ptr<Socket> socket;
+    Clock::time_point       since;
+  };
+
+  // Connections to one endpoint.
+  struct Slot {
+    Endpoint           endpoint;
+    std::size_t        num_open;
+    std::vector<Idle>  idle;        // the most recently used at the back
+    std::deque<Waiter> waiters;
+
+    explicit Slot(const Endpoint& endpoint) : endpoint(endpoint), num_open(0) {}
+  };
+
+  struct Shared : std::enable_shared_from_this<Shared> {
+    boost::asio::io_service&   io_service;
+    Options                    options;
+    boost::asio::steady_timer  reaper;
+    bool                       reaping;
+    bool                       closed;
+    std::map<Endpoint, std::unique_ptr<Slot>> slots;
+
+    Shared(boost::asio::io_service& io_service, const Options& options)
+      : io_service(io_service)
+      , options(options)
+      , reaper(io_service)
+      , reaping(false)
+      , closed(false)
+    {}
+
+    Slot& slot(const Endpoint& endpoint) {
+      auto& slot = slots[endpoint];
+      if (!slot) slot.reset(new Slot(endpoint));
+      return *slot;
+    }
+
+    Lease lease(Slot& slot, std::unique_ptr<Socket> socket) {
+      return Lease(std::make_shared<Checkout>( this->shared_from_this(), &slot
+                                             , std::move(socket)));
+    }
+
+    // Opens a new connection (already counted in num_open) for the waiter.
+    void connect(Slot& slot, Waiter waiter) {
+      std::unique_ptr<Socket> socket(new Socket(io_service));
+
+      auto s        = socket.get();
+      auto checkout = std::make_shared<Checkout>( this->shared_from_this(), &slot
+                                                , std::move(socket));
+      auto promise  = std::make_shared<Waiter>(std::move(waiter));
+
+      s->async_connect(slot.endpoint, use_future).then(
+        [checkout, promise](const Result<void>& result) {
+          if (result) {
+            promise->set_value(Result<Lease>(Lease(checkout)));
+          } else {
+            checkout->broken = true;
+            promise->set_value(Result<Lease>(
+              result.match([]() { return boost::system::error_code(); }
+                          , [](const boost::system::error_code& e) { return e; })));
+          }
+        });
+    }
+
+    static void release( const std::shared_ptr<Shared>& shared
+                       , Slot&                          slot
+                       , std::unique_ptr<Socket>        socket
+                       , bool                           broken)
+    {
+      if (shared->closed) return;
+
+      if (broken || !socket->is_open()) {
+        socket.reset();
+        --slot.num_open;
+
+        // Room for a new connection for the first waiter.
+        if (!slot.waiters.empty()) {
+          auto waiter = std::move(slot.waiters.front());
+          slot.waiters.pop_front();
+
+          ++slot.num_open;
+          shared->connect(slot, std::move(waiter));
+        }
+
+        return;
+      }
+
+      if (!slot.waiters.empty()) {
+        auto waiter = std::make_shared<Waiter>(std::move(slot.waiters.front()));
+        slot.waiters.pop_front();
+
+        auto lease = shared->lease(slot, std::move(socket));
+
+        shared->io_service.post([waiter, lease]() {
+          waiter->set_value(Result<Lease>(lease));
+        });
+
+        return;
+      }
+
+      slot.idle.push_back(Idle{ std::move(socket), Clock::now() });
+      shared->start_reaping();
+    }
+
+    void start_reaping() {
+      if (reaping) return;
+      reaping = true;
+
+      std::weak_ptr<Shared> weak = this->shared_from_this();
+
+      reaper.expires_from_now(options.idle_timeout / 2);
+      reaper.async_wait([weak](const boost::system::error_code& error) {
+        auto shared = weak.lock();
+        if (error || !shared) return;
+
+        shared->reaping = false;
+        shared->reap();
+      });
+    }
+
+    void clear() {
+      boost::system::error_code ignored;
+      reaper.cancel(ignored);
+      reaping = false;
+
+      for (auto& entry : slots) {
+        auto& slot = *entry.second;
+
+        slot.num_open -= slot.idle.size();
+        slot.idle.clear();
+      }
+    }
+
+    // Closes the connections idle for longer than the timeout.
+    void reap() {
+      auto limit = Clock::now() - options.idle_timeout;
+      bool any   = false;
+
+      for (auto& entry : slots) {
+        auto& slot = *entry.second;
+        auto  end  = slot.idle.begin();
+
+        // The oldest are at the front.
+        while (end != slot.idle.end() && end->since <= limit) ++end;
+
+        slot.num_open -= end - slot.idle.begin();
+        slot.idle.erase(slot.idle.begin(), end);
+
+        if (!slot.idle.empty()) any = true;
+      }
+
+      if (any) start_reaping();
+    }
+  };
+
+public:
+  explicit ConnectionPool( boost::asio::io_service& io_service
+                         , const Options&           options = Options())
+    : _shared(std::make_shared<Shared>(io_service, options))
+  {}
+
+  ConnectionPool(const ConnectionPool&) = delete;
+  ConnectionPool& operator = (const ConnectionPool&) = delete;
+
+  ~ConnectionPool() {
+    _shared->closed = true;
+    _shared->clear();
+
+    for (auto& entry : _shared->slots) {
+      auto& slot = *entry.second;
+
+      for (auto& waiter : slot.waiters) {
+        waiter.set_value(Result<Lease>(
+          boost::system::error_code(boost::asio::error::operation_aborted)));
+      }
+
+      slot.waiters.clear();
+    }
+  }
+
+  // Leases a connection to the endpoint: an idle one that passes the check,
+  // a new one if there is room, or else the first one released.
+  Future<Lease> acquire(const Endpoint& endpoint) {
+    auto& slot = _shared->slot(endpoint);
+
+    while (!slot.idle.empty()) {
+      auto socket = std::move(slot.idle.back().socket);
+      slot.idle.pop_back();
+
+      if (!_shared->options.check || _shared->options.check(*socket)) {
+        return make_ready_future(_shared->lease(slot, std::move(socket)));
+      }
+
+      --slot.num_open;
+    }
+
+    Waiter waiter;
+    auto   result = waiter.get_future();
+
+    if (slot.num_open < _shared->options.max_per_endpoint) {
+      ++slot.num_open;
+      _shared->connect(slot, std::move(waiter));
+    } else {
+      slot.waiters.push_back(std::move(waiter));
+    }
+
+    return result;
+  }
+
+  // Closes all the idle connections.
+  void clear() {
+    _shared->clear();
+  }
+
+  // Connections to the endpoint, leased or idle (or being opened).
+  std::size_t num_open(const Endpoint& endpoint) const {
+    auto i = _shared->slots.find(endpoint);
+    return i == _shared->slots.end() ? 0 : i->second->num_open;
+  }
+
+  std::size_t num_idle(const Endpoint& endpoint) const {
+    auto i = _shared->slots.find(endpoint);
+    return i == _shared->slots.end() ? 0 : i->second->idle.size();
+  }
+
+  std::size_t num_waiting(const Endpoint& endpoint) const {
+    auto i = _shared->slots.find(endpoint);
+    return i == _shared->slots.end() ? 0 : i->second->waiters.size();
+  }
+
+private:
+  std::shared_ptr<Shared> _shared;
+};
+
+}} // namespace fry::asio
+
+#endif // __FRY__CONNECTION_POOL_H__
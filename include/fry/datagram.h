@@ -0,0 +1,95 @@
+//
+// Copyright (c) 2014 Adam Cigánek (adam.ciganek@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef __FRY__DATAGRAM_H__
+#define __FRY__DATAGRAM_H__
+
+// Datagram - a received datagram that owns its payload (in a slab of a
+//            BufferPool) and knows where it came from. It can be passed on
+//            by value without copying the payload.
+//
+// async_receive_from(socket, pool) receives into a fresh slab, so any number
+// of receives can be pending on one socket at the same time:
+//
+//   for (int i = 0; i < 16; ++i) receive();
+//
+//   void receive() {
+//     asio::async_receive_from(socket, pool).then([=](asio::Datagram d) {
+//       return asio::async_send_to(socket, d, d.sender);
+//     }).always([=]() { receive(); });
+//   }
+
+#include <memory>
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/ip/udp.hpp>
+#include "asio.h"
+#include "buffer_pool.h"
+#include "future_result.h"
+
+namespace fry { namespace asio {
+
+////////////////////////////////////////////////////////////////////////////////
+struct Datagram {
+  Slab                           slab;
+  std::size_t                    size;
+  boost::asio::ip::udp::endpoint sender;
+
+  boost::asio::const_buffer payload() const {
+    return boost::asio::const_buffer(slab.data(), size);
+  }
+};
+
+namespace detail {
+  // Where a pending receive puts the sender.
+  struct PendingDatagram {
+    Slab                           slab;
+    boost::asio::ip::udp::endpoint sender;
+
+    explicit PendingDatagram(Slab slab) : slab(std::move(slab)) {}
+  };
+}
+
+// Receives one datagram into a slab acquired from the pool. Datagrams larger
+// than the slabs are truncated.
+template<typename Socket, typename Token = UseFuture>
+Future<Datagram> async_receive_from( Socket&     socket
+                                   , BufferPool& pool
+                                   , Token       token = use_future)
+{
+  typedef detail::PendingDatagram Pending;
+
+  auto pending = std::allocate_shared<Pending>(
+    RecyclingAllocator<Pending>(token.recycler), pool.acquire());
+
+  return socket.async_receive_from(
+    boost::asio::buffer(pending->slab.data(), pending->slab.size())
+  , pending->sender
+  , token
+  ).then([pending](std::size_t size) {
+    return Datagram{ std::move(pending->slab), size, pending->sender };
+  });
+}
+
+// Sends the payload of the datagram. The datagram (not its payload) is copied
+// into the operation, so the slab stays alive until the send completes.
+template<typename Socket, typename Token = UseFuture>
+Future<std::size_t> async_send_to( Socket&                               socket
+                                 , const Datagram&                       datagram
+                                 , const boost::asio::ip::udp::endpoint& to
+                                 , Token                                 token = use_future)
+{
+  auto slab = datagram.slab;
+
+  return socket.async_send_to(datagram.payload(), to, token).then(
+    [slab](std::size_t size) {
+      return size;
+    });
+}
+
+}} // namespace fry::asio
+
+#endif // __FRY__DATAGRAM_H__
@@ -0,0 +1,152 @@
+//
+// Copyright (c) 2014 Adam Cigánek (adam.ciganek@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef __FRY__FRAME_READER_H__
+#define __FRY__FRAME_READER_H__
+
+// Length-prefixed framing for asio streams. Every frame is a 4 byte
+// big-endian size followed by that many bytes of body.
+//
+// FrameReader - reads frames from a stream. The data is read into a single
+//               streambuf that is reused for the whole life of the reader,
+//               as much as the socket has available at a time, so a burst of
+//               pipelined frames costs one read. The headers are parsed and
+//               the bodies are returned right where they are in the
+//               streambuf, without copying.
+//
+// FrameHeader - encodes the header of a frame, to be written together with
+//               the body as one gather write:
+//
+//   FrameHeader header(body.size());
+//   asio::async_write(socket, header.with(body));
+
+#include <array>
+#include <cstdint>
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/error.hpp>
+#include <boost/asio/streambuf.hpp>
+#include "asio.h"
+#include "future_result.h"
+
+namespace fry { namespace asio {
+
+static const std::size_t frame_header_size = 4;
+
+////////////////////////////////////////////////////////////////////////////////
+class FrameHeader {
+public:
+  explicit FrameHeader(std::size_t size = 0) {
+    _bytes[0] = (unsigned char) (size >> 24);
+    _bytes[1] = (unsigned char) (size >> 16);
+    _bytes[2] = (unsigned char) (size >> 8);
+    _bytes[3] = (unsigned char) (size);
+  }
+
+  boost::asio::const_buffer buffer() const {
+    return boost::asio::buffer(_bytes);
+  }
+
+  // The header followed by the body. The header must stay alive until the
+  // write completes.
+  std::array<boost::asio::const_buffer, 2>
+  with(const boost::asio::const_buffer& body) const {
+    return {{ buffer(), body }};
+  }
+
+private:
+  unsigned char _bytes[frame_header_size];
+};
+
+////////////////////////////////////////////////////////////////////////////////
+template<typename Stream, typename Token = UseFuture>
+class FrameReader {
+public:
+  // Frames larger than max_size fail with error::message_size.
+  explicit FrameReader( Stream&     stream
+                      , Token       token    = use_future
+                      , std::size_t max_size = 1 << 20)
+    : _stream(stream)
+    , _token(token)
+    , _max_size(max_size)
+    , _consumed(0)
+    , _buffer(max_size + frame_header_size)
+  {}
+
+  FrameReader(const FrameReader&) = delete;
+  FrameReader& operator = (const FrameReader&) = delete;
+
+  // Returns a future of the body of the next frame. The body points into the
+  // streambuf of the reader, and stays valid until the next call to read().
+  // Only one read may be pending at a time, and the reader must stay alive
+  // until it completes.
+  Future<boost::asio::const_buffer> read() {
+    _buffer.consume(_consumed);
+    _consumed = 0;
+
+    auto available = _buffer.size();
+
+    if (available < frame_header_size) {
+      return fill(frame_header_size - available);
+    }
+
+    auto size = body_size();
+
+    if (size > _max_size) {
+      return make_ready_future<boost::asio::const_buffer>(
+        boost::system::error_code(boost::asio::error::message_size));
+    }
+
+    if (available < frame_header_size + size) {
+      return fill(frame_header_size + size - available);
+    }
+
+    _consumed = frame_header_size + size;
+    return make_ready_future(
+      boost::asio::const_buffer(data() + frame_header_size, size));
+  }
+
+  // Data that was received after the last frame returned by read().
+  std::size_t buffered() const {
+    return _buffer.size() - _consumed;
+  }
+
+private:
+  const unsigned char* data() const {
+    return boost::asio::buffer_cast<const unsigned char*>(_buffer.data());
+  }
+
+  std::size_t body_size() const {
+    auto bytes = data();
+
+    return (std::size_t(bytes[0]) << 24)
+         | (std::size_t(bytes[1]) << 16)
+         | (std::size_t(bytes[2]) << 8)
+         |  std::size_t(bytes[3]);
+  }
+
+  // Reads at least `needed` more bytes (more, if the stream has them), then
+  // tries again.
+  Future<boost::asio::const_buffer> fill(std::size_t needed) {
+    return asio::async_read( _stream, _buffer
+                           , boost::asio::transfer_at_least(needed)
+                           , _token
+    ).then([this](std::size_t) {
+      return read();
+    });
+  }
+
+private:
+  Stream&                 _stream;
+  Token                   _token;
+  std::size_t             _max_size;
+  std::size_t             _consumed;
+  boost::asio::streambuf  _buffer;
+};
+
+}} // namespace fry::asio
+
+#endif // __FRY__FRAME_READER_H__
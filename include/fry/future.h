@@ -68,6 +68,8 @@ namespace detail {
   using lock_guard = std::lock_guard<std::mutex>;
 
   template<typename> struct State;
+  template<typename> struct Forward;
+  template<typename, typename> struct Dispatch;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -87,6 +89,17 @@ public:
     return _state->set_continuation(fun);
   }
 
+  // Like then(), but the continuation is run through executor.dispatch(),
+  // where the executor is for example an io_service or a strand. So it runs
+  // right away if the executor allows it (e.g. the future becomes ready
+  // inside the strand), and is queued otherwise. The executor must outlive
+  // the future.
+  template<typename Executor, typename F>
+  add_future<result_of<F, T>> then_on(Executor& executor, F&& fun) {
+    return then(detail::Dispatch<Executor, typename std::decay<F>::type>{
+      &executor, std::forward<F>(fun) });
+  }
+
 private:
 
   Future(std::shared_ptr<detail::State<T>> state)
@@ -117,6 +130,12 @@ public:
     : _state(std::make_shared<typename detail::State<T>>())
   {}
 
+  // Allocates the shared state using the given allocator.
+  template<typename Alloc>
+  Promise(std::allocator_arg_t, const Alloc& alloc)
+    : _state(std::allocate_shared<typename detail::State<T>>(alloc))
+  {}
+
   Promise(const Promise<T>&) = delete;
   Promise<T>& operator = (const Promise<T>&) = delete;
 
@@ -139,15 +158,11 @@ public:
     _state->set_value(std::forward<U>(values)...);
   }
 
+  // Resolves this promise with the value of the given future, once it becomes
+  // ready.
   void set_value(Future<T>&& future) {
-    detail::lock_guard lock1(_state->mutex);
-    detail::lock_guard lock2(future._state->mutex);
-
-    if (future._state->is_ready()) {
-      _state->move_value_from(*future._state);
-    } else {
-      _state->swap(*future._state);
-    }
+    assert(_state);
+    future.then(detail::Forward<T>{ _state });
   }
 
 private:
@@ -198,7 +213,8 @@ namespace detail {
   }
 
   template<typename F, typename... Args>
-  void set_value(Promise<void>& promise, F&& fun, Args&&... args) {
+  enable_if<is_void<result_of<F, Args...>>{}>
+  set_value(Promise<void>& promise, F&& fun, Args&&... args) {
     fun(std::forward<Args>(args)...);
     promise.set_value();
   }
@@ -272,6 +288,55 @@ namespace detail {
     storage.reset(static_cast<CB*>(new C(std::forward<F>(fun))));
     return static_cast<C&>(*storage).get_future();
   }
+
+  //----------------------------------------------------------------------------
+  // Continuation that calls fun through executor.dispatch(). Returns a future
+  // of the result of fun. The arguments are moved into the dispatched
+  // handler (the same way Forward moves them), because the value of a future
+  // is of no further use after its continuation runs.
+  template<typename Executor, typename F>
+  struct Dispatch {
+    Executor* executor;
+    mutable F fun;
+
+    template<typename C>
+    struct Invoke {
+      std::shared_ptr<C> continuation;
+
+      template<typename... A>
+      void operator () (A&... args) const {
+        (*continuation)(std::move(args)...);
+      }
+    };
+
+    // Executors may require the handler to be copyable, so the arguments are
+    // kept behind a shared pointer.
+    template<typename B>
+    struct Handler {
+      std::shared_ptr<B> bound;
+
+      void operator () () const {
+        (*bound)();
+      }
+    };
+
+    template< typename... A
+            , typename R = result_of<F, typename std::decay<A>::type...>>
+    add_future<R> operator () (A&&... args) const {
+      using C = Continuation<F, typename std::decay<A>::type...>;
+
+      auto continuation = std::make_shared<C>(std::move(fun));
+      auto result       = continuation->get_future();
+
+      auto bound = std::bind( Invoke<C>{ std::move(continuation) }
+                            , std::move(args)...);
+
+      executor->dispatch(Handler<decltype(bound)>{
+        std::make_shared<decltype(bound)>(std::move(bound)) });
+
+      return result;
+    }
+  };
 } // namespace detail
 
 
@@ -285,11 +350,6 @@ namespace detail {
     boost::optional<T>                            value;
     std::unique_ptr<detail::ContinuationBase<T&>> continuation;
 
-    void swap(State<T>& other) {
-      std::swap(value,        other.value);
-      std::swap(continuation, other.continuation);
-    }
-
     bool is_ready() const {
       return (bool) value;
     }
@@ -304,13 +364,6 @@ namespace detail {
       run_continuation();
     }
 
-    void move_value_from(State& other) {
-      assert(other.value);
-
-      value = std::move(other.value);
-      run_continuation();
-    }
-
     template<typename F>
     add_future<result_of<F, T>> set_continuation(F&& fun) {
       detail::lock_guard lock(mutex);
@@ -342,11 +395,6 @@ namespace detail {
 
     State() : ready(false) {}
 
-    void swap(State<void>& other) {
-      std::swap(ready,        other.ready);
-      std::swap(continuation, other.continuation);
-    }
-
     bool is_ready() const {
       return ready;
     }
@@ -356,13 +404,6 @@ namespace detail {
       run_continuation();
     }
 
-    void move_value_from(State& other) {
-      assert(other.ready);
-
-      ready = other.ready;
-      run_continuation();
-    }
-
     template<typename F>
     add_future<result_of<F>> set_continuation(F&& fun) {
       detail::lock_guard lock(mutex);
@@ -383,6 +424,36 @@ namespace detail {
     }
   };
 
+  ////////////////////////////////////////////////////////////////////////////////
+  // Continuation that resolves the given state with the value it is called
+  // with. Used to resolve a promise with the value of another future. The
+  // overloads for lvalue and rvalue make it callable for the purpose of
+  // deducing the result type, while taking the value by non-const reference
+  // at runtime, so it can be moved.
+  template<typename T>
+  struct Forward {
+    std::shared_ptr<State<T>> state;
+
+    void operator () (T& value) {
+      detail::lock_guard lock(state->mutex);
+      state->set_value(std::move(value));
+    }
+
+    void operator () (T&& value) {
+      (*this)(value);
+    }
+  };
+
+  template<>
+  struct Forward<void> {
+    std::shared_ptr<State<void>> state;
+
+    void operator () () {
+      detail::lock_guard lock(state->mutex);
+      state->set_value();
+    }
+  };
+
 } // namespace detail
 
 
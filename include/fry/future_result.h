@@ -164,6 +164,17 @@ public:
     return _then(detail::Always<F>{ std::forward<F>(fun) });
   }
 
+  // Like then(), but runs the continuation through executor.dispatch(). See
+  // Future<T>::then_on.
+  template<typename Executor, typename F>
+  auto then_on(Executor& executor, F&& fun)
+  -> decltype(std::declval<This>().then(
+       detail::Dispatch<Executor, typename std::decay<F>::type>{ &executor, fun }))
+  {
+    return then(detail::Dispatch<Executor, typename std::decay<F>::type>{
+      &executor, std::forward<F>(fun) });
+  }
+
 private:
 
   Future(std::shared_ptr<State> state)
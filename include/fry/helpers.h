@@ -8,6 +8,7 @@
 #ifndef __FRY__HELPERS_H__
 #define __FRY__HELPERS_H__
 
+#include <iterator>
 #include <tuple>
 #include <type_traits>
 
@@ -73,6 +74,15 @@ namespace internal {
 template<typename T>
 using replace_void = typename internal::replace_void<T>::type;
 
+////////////////////////////////////////////////////////////////////////////////
+namespace detail {
+  // Type of the elements of the range R.
+  template<typename R>
+  using value_type = typename std::iterator_traits<
+                       decltype(std::begin(std::declval<R>()))
+                     >::value_type;
+}
+
 } // namespace fry
 
 #endif // __FRY__HELPERS_H__
\ No newline at end of file
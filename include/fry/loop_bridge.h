@@ -0,0 +1,342 @@
+//
+// Copyright (c) 2014 Adam Cigánek (adam.ciganek@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef __FRY__LOOP_BRIDGE_H__
+#define __FRY__LOOP_BRIDGE_H__
+
+// LoopBridge - runs functions posted from any thread on an io_service, with
+// one wakeup for many of them (Linux only).
+//
+// io_service::post wakes the loop for every function. The bridge instead
+// pushes the functions onto a lock-free list, and only the push that finds
+// the list empty signals an eventfd the loop waits for. The loop then takes
+// the whole list at once and runs it. So when other threads produce results
+// faster than the loop wakes up, they all come in with a single wakeup.
+//
+// The bridge is an executor, so continuations can be sent to the loop with
+// then_on:
+//
+//   pool.submit(compute).then_on(bridge, [](const Result& result) {
+//     // runs on the loop
+//   });
+//
+// offload(pool, f) is a shortcut that runs f on the pool and resolves the
+// returned future on the loop:
+//
+//   bridge.offload(pool, compute).then([](const Result& result) {
+//     // runs on the loop
+//   });
+//
+// Each function is kept in a node taken from a Recycler of the bridge, and an
+// offloaded function is kept in a single node from the pool to the loop, so
+// once the free lists are warmed up, posting does not reach the global
+// allocator (the future offload() returns is allocated, as any).
+//
+// Functions still queued when the bridge is destroyed are dropped.
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <errno.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+#include <boost/optional.hpp>
+#include <boost/system/system_error.hpp>
+#include "future.h"
+#include "recycling_allocator.h"
+
+namespace fry { namespace asio {
+
+namespace detail { namespace bridge {
+  struct Node {
+    Node* next;
+
+    virtual ~Node() {}
+    virtual void run() = 0;
+
+    // Destroys the node and gives its memory back to the recycler.
+    virtual void dispose(Recycler& recycler) = 0;
+  };
+
+  template<typename Derived>
+  struct RecycledNode : Node {
+    void dispose(Recycler& recycler) override {
+      auto self = static_cast<Derived*>(this);
+
+      self->~Derived();
+      recycler.deallocate(self, sizeof(Derived));
+    }
+  };
+
+  template<typename T, typename... Args>
+  T* make_node(Recycler& recycler, Args&&... args) {
+    auto memory = recycler.allocate(sizeof(T));
+
+    try {
+      return new (memory) T(std::forward<Args>(args)...);
+    } catch (...) {
+      recycler.deallocate(memory, sizeof(T));
+      throw;
+    }
+  }
+
+  template<typename F>
+  struct Task : RecycledNode<Task<F>> {
+    F fun;
+
+    template<typename G>
+    explicit Task(G&& fun) : fun(std::forward<G>(fun)) {}
+
+    void run() override { fun(); }
+  };
+
+  // Function run on a pool (compute), whose result is delivered on the loop
+  // (run).
+  template<typename R, typename F>
+  struct Offload : RecycledNode<Offload<R, F>> {
+    F                  fun;
+    Promise<R>         promise;
+    boost::optional<R> value;
+
+    template<typename G>
+    explicit Offload(G&& fun) : fun(std::forward<G>(fun)) {}
+
+    void compute()      { value = fun(); }
+    void run() override { promise.set_value(std::move(*value)); }
+  };
+
+  template<typename F>
+  struct Offload<void, F> : RecycledNode<Offload<void, F>> {
+    F             fun;
+    Promise<void> promise;
+
+    template<typename G>
+    explicit Offload(G&& fun) : fun(std::forward<G>(fun)) {}
+
+    void compute()      { fun(); }
+    void run() override { promise.set_value(); }
+  };
+
+  inline int make_eventfd() {
+    int fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    if (fd < 0) {
+      throw boost::system::system_error(
+        errno, boost::system::system_category(), "eventfd");
+    }
+
+    return fd;
+  }
+
+  // Shared with the pending wait, which may outlive the bridge.
+  struct State {
+    Recycler                              recycler;
+    boost::asio::posix::stream_descriptor descriptor;
+    std::atomic<Node*>                    head;
+    std::atomic<std::size_t>              num_posts;
+    std::atomic<std::size_t>              num_wakeups;
+    std::atomic<bool>                     closed;
+
+    explicit State(boost::asio::io_service& io_service)
+      : descriptor(io_service, make_eventfd())
+      , head(nullptr)
+      , num_posts(0)
+      , num_wakeups(0)
+      , closed(false)
+    {}
+
+    ~State() {
+      for (auto node = take(); node;) {
+        auto next = node->next;
+        node->dispose(recycler);
+        node = next;
+      }
+    }
+
+    static const State*& current() {
+      static thread_local const State* current = nullptr;
+      return current;
+    }
+
+    void push(Node* node) {
+      num_posts.fetch_add(1, std::memory_order_relaxed);
+
+      auto old = head.load(std::memory_order_relaxed);
+
+      do {
+        node->next = old;
+      } while (!head.compare_exchange_weak( old, node
+                                          , std::memory_order_release
+                                          , std::memory_order_relaxed));
+
+      // Whoever finds the list empty wakes the loop, the others ride along.
+      if (!old) {
+        std::uint64_t one = 1;
+        while (::write(descriptor.native_handle(), &one, sizeof(one)) < 0 && errno == EINTR);
+      }
+    }
+
+    // Takes the whole list, oldest first.
+    Node* take() {
+      Node* list = head.exchange(nullptr, std::memory_order_acquire);
+      Node* result = nullptr;
+
+      while (list) {
+        auto next  = list->next;
+        list->next = result;
+        result     = list;
+        list       = next;
+      }
+
+      return result;
+    }
+
+    void drain() {
+      // Reset the eventfd before taking the list, so that a push that comes
+      // after the take signals again.
+      std::uint64_t count;
+      while (::read(descriptor.native_handle(), &count, sizeof(count)) < 0 && errno == EINTR);
+
+      auto node = take();
+      if (node) num_wakeups.fetch_add(1, std::memory_order_relaxed);
+
+      auto previous = current();
+      current() = this;
+
+      while (node) {
+        auto next = node->next;
+        node->run();
+        node->dispose(recycler);
+        node = next;
+      }
+
+      current() = previous;
+    }
+  };
+
+  // The part of an offload run on the pool. Owns the node until it is handed
+  // to the loop, so a pool that drops the function does not leak it.
+  template<typename O>
+  struct Compute {
+    std::shared_ptr<State> state;
+    O*                     node;
+
+    Compute(std::shared_ptr<State> state, O* node)
+      : state(std::move(state))
+      , node(node)
+    {}
+
+    Compute(Compute&& other)
+      : state(std::move(other.state))
+      , node(other.node)
+    {
+      other.node = nullptr;
+    }
+
+    ~Compute() {
+      if (node) node->dispose(state->recycler);
+    }
+
+    void operator () () {
+      node->compute();
+
+      auto done = node;
+      node = nullptr;
+      state->push(done);
+    }
+  };
+
+  inline void wait(const std::shared_ptr<State>& state) {
+    state->descriptor.async_wait(
+      boost::asio::posix::stream_descriptor::wait_read,
+      [state](const boost::system::error_code& error) {
+        if (error || state->closed) return;
+
+        state->drain();
+        wait(state);
+      });
+  }
+}} // namespace detail::bridge
+
+////////////////////////////////////////////////////////////////////////////////
+class LoopBridge {
+public:
+  explicit LoopBridge(boost::asio::io_service& io_service)
+    : _state(std::make_shared<detail::bridge::State>(io_service))
+  {
+    detail::bridge::wait(_state);
+  }
+
+  LoopBridge(const LoopBridge&) = delete;
+  LoopBridge& operator = (const LoopBridge&) = delete;
+
+  ~LoopBridge() {
+    _state->closed = true;
+
+    boost::system::error_code ignored;
+    _state->descriptor.cancel(ignored);
+  }
+
+  // Runs fun() on the loop. Can be called from any thread.
+  template<typename F>
+  void post(F&& fun) {
+    typedef detail::bridge::Task<typename std::decay<F>::type> T;
+
+    _state->push(detail::bridge::make_node<T>( _state->recycler
+                                             , std::forward<F>(fun)));
+  }
+
+  // Runs fun() right away when called from a function the bridge is running,
+  // otherwise like post().
+  template<typename F>
+  void dispatch(F&& fun) {
+    if (running_in_this_thread()) {
+      fun();
+    } else {
+      post(std::forward<F>(fun));
+    }
+  }
+
+  bool running_in_this_thread() const {
+    return detail::bridge::State::current() == _state.get();
+  }
+
+  // Runs fun() on the pool (anything with post(), like ThreadPool), and
+  // resolves the returned future with its result on the loop.
+  template<typename Pool, typename F>
+  fry::Future<result_of<F>> offload(Pool& pool, F&& fun) {
+    typedef detail::bridge::Offload< result_of<F>
+                                   , typename std::decay<F>::type> O;
+
+    auto node   = detail::bridge::make_node<O>( _state->recycler
+                                          , std::forward<F>(fun));
+    auto result = node->promise.get_future();
+
+    pool.post(detail::bridge::Compute<O>(_state, node));
+
+    return result;
+  }
+
+  // Number of functions posted so far.
+  std::size_t num_posts() const {
+    return _state->num_posts.load(std::memory_order_relaxed);
+  }
+
+  // Number of times the loop woke up to run them.
+  std::size_t num_wakeups() const {
+    return _state->num_wakeups.load(std::memory_order_relaxed);
+  }
+
+private:
+  std::shared_ptr<detail::bridge::State> _state;
+};
+
+}} // namespace fry::asio
+
+#endif // __FRY__LOOP_BRIDGE_H__
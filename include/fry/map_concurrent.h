@@ -0,0 +1,343 @@
+//
+// Copyright (c) 2014 Adam Cigánek (adam.ciganek@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef __FRY__MAP_CONCURRENT_H__
+#define __FRY__MAP_CONCURRENT_H__
+
+// map_concurrent - calls the given future-returning function on each element
+//                  of a range, with at most `limit` of the returned futures
+//                  pending at any time. Returns a future of the vector of the
+//                  results, in the order of the elements.
+//
+// map_concurrent_unordered - like map_concurrent, but the results are in the
+//                            order in which they became ready.
+//
+// map_concurrent_success - like map_concurrent, but for functions returning
+//                          futures of Results. Becomes failure as soon as ANY
+//                          of the futures becomes failure, and no further
+//                          elements are started after that. (To collect all
+//                          the errors instead, use map_concurrent, which gives
+//                          a vector of the Results.)
+//
+// for_each_concurrent - like map_concurrent, but discards the results.
+//
+// Whenever one of the pending futures becomes ready, the next element is
+// started right away from within its continuation. All the bookkeeping lives
+// in a single object allocated once per call. The range must stay alive (and
+// unmodified) until the returned future becomes ready.
+
+#include <vector>
+#include <boost/optional.hpp>
+#include "future_result.h"
+
+namespace fry {
+
+namespace detail { namespace concurrent {
+  //----------------------------------------------------------------------------
+  // Collectors store the results of the individual futures and produce the
+  // final output. They are always accessed with the window mutex locked.
+  // Once failed() returns true, no more elements are started.
+
+  // Results in the order of the elements.
+  template<typename R>
+  class Ordered {
+  public:
+    typedef std::vector<R> Output;
+
+    explicit Ordered(std::size_t size) : _slots(size) {}
+
+    void store(std::size_t index, R& value) {
+      _slots[index] = std::move(value);
+    }
+
+    bool failed() const { return false; }
+
+    Output take() {
+      Output output;
+      output.reserve(_slots.size());
+
+      for (auto& slot : _slots) {
+        output.push_back(std::move(*slot));
+      }
+
+      return output;
+    }
+
+  private:
+    std::vector<boost::optional<R>> _slots;
+  };
+
+  // Results in the order in which they became ready.
+  template<typename R>
+  class Unordered {
+  public:
+    typedef std::vector<R> Output;
+
+    explicit Unordered(std::size_t size) {
+      _values.reserve(size);
+    }
+
+    void store(std::size_t, R& value) {
+      _values.push_back(std::move(value));
+    }
+
+    bool failed() const { return false; }
+
+    Output take() {
+      return std::move(_values);
+    }
+
+  private:
+    Output _values;
+  };
+
+  // Results in the order of the elements, or the first error.
+  template<typename T, typename E>
+  class OrderedSuccess {
+  public:
+    typedef Result<std::vector<T>, E> Output;
+
+    explicit OrderedSuccess(std::size_t size) : _slots(size) {}
+
+    void store(std::size_t index, Result<T, E>& result) {
+      if (!_error) {
+        result.match(
+            [&](T& value) { _slots[index] = std::move(value); }
+          , [&](E& error) { _error = std::move(error); }
+        );
+      }
+    }
+
+    bool failed() const { return (bool) _error; }
+
+    Output take() {
+      if (_error) {
+        return Output(std::move(*_error));
+      }
+
+      std::vector<T> values;
+      values.reserve(_slots.size());
+
+      for (auto& slot : _slots) {
+        values.push_back(std::move(*slot));
+      }
+
+      return Output(std::move(values));
+    }
+
+  private:
+    std::vector<boost::optional<T>> _slots;
+    boost::optional<E>              _error;
+  };
+
+  // Discards the results.
+  class Ignore {
+  public:
+    typedef void Output;
+
+    explicit Ignore(std::size_t) {}
+
+    template<typename R>
+    void store(std::size_t, R&) {}
+    void store(std::size_t)     {}
+
+    bool failed() const { return false; }
+  };
+
+  //----------------------------------------------------------------------------
+  template<typename Output>
+  struct Resolver {
+    template<typename C>
+    static void resolve(Promise<Output>& promise, C& collector) {
+      promise.set_value(collector.take());
+    }
+  };
+
+  template<>
+  struct Resolver<void> {
+    template<typename C>
+    static void resolve(Promise<void>& promise, C&) {
+      promise.set_value();
+    }
+  };
+
+  //----------------------------------------------------------------------------
+  // The overloads for lvalue and rvalue make this callable for the purpose of
+  // deducing the result type, while taking the value by non-const reference
+  // at runtime, so it can be moved into the collector.
+  template<typename W, typename R>
+  struct Completion {
+    std::shared_ptr<W> window;
+    std::size_t        index;
+
+    void operator () (R& value)  { window->complete(index, value); }
+    void operator () (R&& value) { window->complete(index, value); }
+  };
+
+  template<typename W>
+  struct Completion<W, void> {
+    std::shared_ptr<W> window;
+    std::size_t        index;
+
+    void operator () () { window->complete(index); }
+  };
+
+  //----------------------------------------------------------------------------
+  template<typename Iterator, typename Fun, typename Collector>
+  class Window
+    : public std::enable_shared_from_this<Window<Iterator, Fun, Collector>>
+  {
+  public:
+    typedef typename Collector::Output Output;
+
+    Window(Iterator first, Iterator last, std::size_t limit, Fun fun)
+      : _next(first)
+      , _last(last)
+      , _index(0)
+      , _limit(limit > 0 ? limit : 1)
+      , _num_pending(0)
+      , _pumping(false)
+      , _finished(false)
+      , _fun(std::move(fun))
+      , _collector(std::distance(first, last))
+    {}
+
+    Future<Output> start() {
+      auto result = _promise.get_future();
+      pump();
+      return result;
+    }
+
+    template<typename... R>
+    void complete(std::size_t index, R&... value) {
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        --_num_pending;
+
+        if (!_finished) {
+          _collector.store(index, value...);
+        }
+      }
+
+      pump();
+    }
+
+  private:
+    // Starts elements until the limit is reached. If the futures returned by
+    // the function are already ready, their continuations run inside this
+    // loop, so only the outermost call does the actual work and the nested
+    // ones return immediately. That keeps the stack from growing with the
+    // number of elements.
+    void pump() {
+      using R = future_type<result_of<Fun, decltype(*_next)>>;
+
+      std::unique_lock<std::mutex> lock(_mutex);
+
+      if (_pumping) return;
+      _pumping = true;
+
+      while (  !_collector.failed()
+            && _next != _last
+            && _num_pending < _limit)
+      {
+        auto& element = *_next;
+        auto  index   = _index;
+
+        ++_next;
+        ++_index;
+        ++_num_pending;
+
+        lock.unlock();
+        _fun(element).then(Completion<Window, R>{ this->shared_from_this(), index });
+        lock.lock();
+      }
+
+      _pumping = false;
+
+      if (  _finished
+         || (  !_collector.failed()
+            && (_next != _last || _num_pending > 0)))
+      {
+        return;
+      }
+
+      _finished = true;
+      lock.unlock();
+
+      Resolver<Output>::resolve(_promise, _collector);
+    }
+
+  private:
+    std::mutex      _mutex;
+    Iterator        _next;
+    Iterator        _last;
+    std::size_t     _index;
+    std::size_t     _limit;
+    std::size_t     _num_pending;
+    bool            _pumping;
+    bool            _finished;
+    Fun             _fun;
+    Collector       _collector;
+    Promise<Output> _promise;
+  };
+
+  //----------------------------------------------------------------------------
+  template<typename Collector, typename Range, typename Fun>
+  Future<typename Collector::Output>
+  start(Range& range, std::size_t limit, Fun&& fun) {
+    using W = Window< decltype(std::begin(range))
+                    , typename std::decay<Fun>::type
+                    , Collector>;
+
+    return std::make_shared<W>( std::begin(range), std::end(range)
+                              , limit, std::forward<Fun>(fun))->start();
+  }
+
+  template<typename Range, typename Fun>
+  using result_type = future_type<
+                        result_of<Fun, decltype(*std::begin(std::declval<Range&>()))>>;
+}} // namespace detail::concurrent
+
+////////////////////////////////////////////////////////////////////////////////
+template<typename Range, typename Fun>
+Future<std::vector<detail::concurrent::result_type<Range, Fun>>>
+map_concurrent(Range& range, std::size_t limit, Fun&& fun) {
+  using R = detail::concurrent::result_type<Range, Fun>;
+
+  return detail::concurrent::start<detail::concurrent::Ordered<R>>(
+    range, limit, std::forward<Fun>(fun));
+}
+
+template<typename Range, typename Fun>
+Future<std::vector<detail::concurrent::result_type<Range, Fun>>>
+map_concurrent_unordered(Range& range, std::size_t limit, Fun&& fun) {
+  using R = detail::concurrent::result_type<Range, Fun>;
+
+  return detail::concurrent::start<detail::concurrent::Unordered<R>>(
+    range, limit, std::forward<Fun>(fun));
+}
+
+template< typename Range, typename Fun
+        , typename R = detail::concurrent::result_type<Range, Fun>>
+Future<Result< std::vector<typename R::value_type>
+             , typename R::error_type>>
+map_concurrent_success(Range& range, std::size_t limit, Fun&& fun) {
+  using C = detail::concurrent::OrderedSuccess< typename R::value_type
+                                              , typename R::error_type>;
+
+  return detail::concurrent::start<C>(range, limit, std::forward<Fun>(fun));
+}
+
+template<typename Range, typename Fun>
+Future<void> for_each_concurrent(Range& range, std::size_t limit, Fun&& fun) {
+  return detail::concurrent::start<detail::concurrent::Ignore>(
+    range, limit, std::forward<Fun>(fun));
+}
+
+} // namespace fry
+
+#endif // __FRY__MAP_CONCURRENT_H__
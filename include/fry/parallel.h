@@ -0,0 +1,359 @@
+//
+// Copyright (c) 2014 Adam Cigánek (adam.ciganek@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef __FRY__PARALLEL_H__
+#define __FRY__PARALLEL_H__
+
+// parallel_for    - calls fun(element) on each element of a range.
+// parallel_reduce - folds the elements of a range into an accumulator.
+// parallel_sort   - sorts a range.
+//
+// All of them run on a ThreadPool and return a future that becomes ready when
+// the work is done, so they compose with then, when_all, etc. like any other
+// asynchronous operation. No thread ever blocks waiting for a part of the
+// work: the work is split in halves recursively, one half is forked to the
+// pool (where idle workers can steal it) and the other is processed by the
+// current task. Whichever part finishes last continues with the join.
+//
+// `grain` is the number of elements below which a range is no longer split.
+// Zero adapts the splitting to the load instead: a range is processed in small
+// chunks, and before each chunk the rest of it is split in half only if the
+// pool is short of work (fewer tasks are queued than there are workers). So a
+// busy pool gets few large pieces, and a pool with idle workers gets as many
+// pieces as it takes to keep them busy.
+//
+// The ranges must have random access iterators, and must stay alive until the
+// returned future becomes ready.
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <vector>
+#include <boost/optional.hpp>
+#include "thread_pool.h"
+
+namespace fry {
+
+namespace detail { namespace parallel {
+  //----------------------------------------------------------------------------
+  // With a fixed grain, ranges larger than `size` are always split. Otherwise,
+  // `size` is the chunk processed between the checks for whether to split.
+  struct Grain {
+    std::size_t size;
+    bool        fixed;
+  };
+
+  inline Grain grain(const ThreadPool& pool, std::size_t size, std::size_t grain) {
+    if (grain > 0) return Grain{ grain, true };
+
+    auto chunks = 64 * pool.size();
+    return Grain{ std::max<std::size_t>(1, size / chunks), false };
+  }
+
+  inline bool should_split(const ThreadPool& pool, const Grain& grain, std::size_t size) {
+    return size > grain.size && (grain.fixed || pool.num_queued() < pool.size());
+  }
+
+  //----------------------------------------------------------------------------
+  // Returns a future that becomes ready when both input futures become ready.
+  struct Join {
+    std::atomic<int> num_pending;
+    Promise<void>    promise;
+
+    Join() : num_pending(2) {}
+
+    void operator () () {
+      if (--num_pending == 0) promise.set_value();
+    }
+  };
+
+  inline Future<void> join(Future<void>&& a, Future<void>&& b) {
+    auto state  = std::make_shared<Join>();
+    auto result = state->promise.get_future();
+
+    a.then([state]() { (*state)(); });
+    b.then([state]() { (*state)(); });
+
+    return result;
+  }
+
+  //----------------------------------------------------------------------------
+  // Processes [first, last) in place, calling leaf(first, last) on one piece
+  // at a time. Before each piece, the rest of the range may be split (see
+  // should_split), in which case fork(mid, last) is called with its right half.
+  // The left halves stay here, so the pieces forked later lie further left.
+  template<typename Iterator, typename Leaf, typename Fork>
+  void split( ThreadPool& pool, Iterator first, Iterator last
+            , const Grain& grain, Leaf&& leaf, Fork&& fork)
+  {
+    while (first != last) {
+      auto size = std::size_t(last - first);
+
+      if (should_split(pool, grain, size)) {
+        auto mid = first + size / 2;
+
+        fork(mid, last);
+        last = mid;
+      } else {
+        auto end = grain.fixed ? last : first + std::min(size, grain.size);
+
+        leaf(first, end);
+        first = end;
+      }
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  template<typename Fun>
+  struct ForState {
+    Fun                      fun;
+    std::atomic<std::size_t> num_remaining;
+    Promise<void>            promise;
+
+    ForState(Fun fun, std::size_t size)
+      : fun(std::move(fun)), num_remaining(size) {}
+  };
+
+  // Every piece reports the number of elements it processed, and the one that
+  // brings the number of remaining elements to zero resolves the promise.
+  template<typename Iterator, typename State>
+  void for_each( ThreadPool& pool, Iterator first, Iterator last
+               , const Grain& grain, const std::shared_ptr<State>& state)
+  {
+    auto leaf = [&](Iterator first, Iterator last) {
+      auto size = std::size_t(last - first);
+
+      for (; first != last; ++first) state->fun(*first);
+
+      if (state->num_remaining.fetch_sub(size) == size) {
+        state->promise.set_value();
+      }
+    };
+
+    auto fork = [&](Iterator mid, Iterator last) {
+      pool.post([=, &pool]() { for_each(pool, mid, last, grain, state); });
+    };
+
+    split(pool, first, last, grain, leaf, fork);
+  }
+
+  //----------------------------------------------------------------------------
+  template<typename Acc, typename Op, typename Merge>
+  struct ReduceState {
+    Acc   identity;
+    Op    op;
+    Merge merge;
+
+    ReduceState(Acc identity, Op op, Merge merge)
+      : identity(std::move(identity))
+      , op(std::move(op))
+      , merge(std::move(merge))
+    {}
+  };
+
+  // Merges the accumulators of two adjacent pieces, left one first, when both
+  // are ready.
+  template<typename Acc, typename State>
+  struct ReduceJoin {
+    std::shared_ptr<State>  state;
+    std::mutex              mutex;
+    boost::optional<Acc>    left;
+    boost::optional<Acc>    right;
+    Promise<Acc>            promise;
+
+    explicit ReduceJoin(std::shared_ptr<State> state) : state(std::move(state)) {}
+
+    void set(boost::optional<Acc> ReduceJoin::*side, Acc& acc) {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->*side = std::move(acc);
+        if (!left || !right) return;
+      }
+
+      promise.set_value(state->merge(std::move(*left), std::move(*right)));
+    }
+
+    // The overloads for lvalue and rvalue make Side callable for the purpose of
+    // deducing the result type, while taking the value by non-const reference
+    // at runtime, so it can be moved.
+    struct Side {
+      std::shared_ptr<ReduceJoin>      join;
+      boost::optional<Acc> ReduceJoin::*side;
+
+      void operator () (Acc& acc)  { join->set(side, acc); }
+      void operator () (Acc&& acc) { join->set(side, acc); }
+    };
+  };
+
+  template<typename Acc, typename State>
+  Future<Acc> join( Future<Acc>&& left, Future<Acc>&& right
+                  , const std::shared_ptr<State>& state)
+  {
+    typedef ReduceJoin<Acc, State> J;
+
+    auto join   = std::make_shared<J>(state);
+    auto result = join->promise.get_future();
+
+    left.then(typename J::Side{ join, &J::left });
+    right.then(typename J::Side{ join, &J::right });
+
+    return result;
+  }
+
+  // Merges the futures in [first, last) into acc, one after another.
+  template<typename Acc, typename Iterator, typename State>
+  Future<Acc> join( Future<Acc>&& acc, Iterator first, Iterator last
+                  , const std::shared_ptr<State>& state)
+  {
+    if (first == last) return std::move(acc);
+
+    auto next = first;
+    return join(join(std::move(acc), std::move(*first), state), ++next, last, state);
+  }
+
+  // Folds the part of the range that stays here into one accumulator, and
+  // merges the accumulators of the forked parts into it from left to right, so
+  // merge only needs to be associative.
+  template<typename Acc, typename Iterator, typename State>
+  Future<Acc> reduce( ThreadPool& pool, Iterator first, Iterator last
+                    , const Grain& grain, const std::shared_ptr<State>& state)
+  {
+    Acc                      acc = state->identity;
+    std::vector<Future<Acc>> forked;
+
+    auto leaf = [&](Iterator first, Iterator last) {
+      for (; first != last; ++first) acc = state->op(std::move(acc), *first);
+    };
+
+    auto fork = [&](Iterator mid, Iterator last) {
+      forked.push_back(pool.submit([=, &pool]() {
+        return reduce<Acc>(pool, mid, last, grain, state);
+      }));
+    };
+
+    split(pool, first, last, grain, leaf, fork);
+
+    return join( ::fry::make_ready_future(std::move(acc))
+               , forked.rbegin(), forked.rend(), state);
+  }
+
+  //----------------------------------------------------------------------------
+  template<typename Iterator, typename Compare>
+  Future<void> sort( ThreadPool& pool, Iterator first, Iterator last
+                   , const Grain& grain, Compare compare)
+  {
+    if (!should_split(pool, grain, std::size_t(last - first))) {
+      std::sort(first, last, compare);
+      return ::fry::make_ready_future();
+    }
+
+    auto mid = first + (last - first) / 2;
+
+    auto right = pool.submit([=, &pool]() {
+      return sort(pool, mid, last, grain, compare);
+    });
+
+    auto left = sort(pool, first, mid, grain, compare);
+
+    return join(std::move(left), std::move(right)).then([=]() {
+      std::inplace_merge(first, mid, last, compare);
+    });
+  }
+}} // namespace detail::parallel
+
+////////////////////////////////////////////////////////////////////////////////
+template<typename Range, typename Fun>
+Future<void> parallel_for( ThreadPool& pool, Range& range, std::size_t grain
+                         , Fun&& fun)
+{
+  using State = detail::parallel::ForState<typename std::decay<Fun>::type>;
+
+  auto first = std::begin(range);
+  auto last  = std::end(range);
+  auto size  = std::size_t(last - first);
+
+  if (size == 0) return make_ready_future();
+
+  auto state  = std::make_shared<State>(std::forward<Fun>(fun), size);
+  auto result = state->promise.get_future();
+  auto g      = detail::parallel::grain(pool, size, grain);
+
+  pool.post([=, &pool]() {
+    detail::parallel::for_each(pool, first, last, g, state);
+  });
+
+  return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Folds the elements using acc = op(std::move(acc), element) into one
+// accumulator per piece, and combines the accumulators of adjacent pieces using
+// acc = merge(std::move(left), std::move(right)), in the order of the range.
+// Every piece starts with a copy of identity, so it must be a neutral element
+// of merge, and merge must be associative (but need not be commutative).
+template<typename Range, typename Acc, typename Op, typename Merge>
+Future<typename std::decay<Acc>::type>
+parallel_reduce( ThreadPool& pool, Range& range, std::size_t grain
+               , Acc&& identity, Op&& op, Merge&& merge)
+{
+  using A     = typename std::decay<Acc>::type;
+  using State = detail::parallel::ReduceState< A
+                                             , typename std::decay<Op>::type
+                                             , typename std::decay<Merge>::type>;
+
+  auto first = std::begin(range);
+  auto last  = std::end(range);
+  auto size  = std::size_t(last - first);
+
+  if (size == 0) return make_ready_future(A(std::forward<Acc>(identity)));
+
+  auto state = std::make_shared<State>( std::forward<Acc>(identity)
+                                      , std::forward<Op>(op)
+                                      , std::forward<Merge>(merge));
+  auto g     = detail::parallel::grain(pool, size, grain);
+
+  return pool.submit([=, &pool]() {
+    return detail::parallel::reduce<A>(pool, first, last, g, state);
+  });
+}
+
+// Same as above, using op also to combine the accumulators.
+template<typename Range, typename Acc, typename Op>
+Future<typename std::decay<Acc>::type>
+parallel_reduce( ThreadPool& pool, Range& range, std::size_t grain
+               , Acc&& identity, Op&& op)
+{
+  auto merge = op;
+  return parallel_reduce( pool, range, grain, std::forward<Acc>(identity)
+                        , std::forward<Op>(op), std::move(merge));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Sorts the pieces in parallel and merges them as both halves of each split
+// become sorted.
+template<typename Range, typename Compare>
+Future<void> parallel_sort( ThreadPool& pool, Range& range, std::size_t grain
+                          , Compare compare)
+{
+  auto first = std::begin(range);
+  auto last  = std::end(range);
+  auto g     = detail::parallel::grain(pool, std::size_t(last - first), grain);
+
+  return pool.submit([=, &pool]() {
+    return detail::parallel::sort(pool, first, last, g, compare);
+  });
+}
+
+template<typename Range>
+Future<void> parallel_sort(ThreadPool& pool, Range& range, std::size_t grain = 0) {
+  using T = typename std::decay<decltype(*std::begin(range))>::type;
+  return parallel_sort(pool, range, grain, std::less<T>());
+}
+
+} // namespace fry
+
+#endif // __FRY__PARALLEL_H__
@@ -0,0 +1,298 @@
+//
+// Copyright (c) 2014 Adam Cigánek (adam.ciganek@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef __FRY__PENDING_TABLE_H__
+#define __FRY__PENDING_TABLE_H__
+
+// PendingTable - matches responses to requests by id.
+//
+// expect(id, timeout) returns a future of the response with the given id.
+// fulfil(id, value) resolves it when the response arrives. expire() fails
+// the futures whose deadline has passed with std::errc::timed_out; it has to
+// be called periodically (from a timer, for example).
+//
+//   PendingTable<std::uint64_t, Response> pending(1 << 20);
+//
+//   pending.expect(id, std::chrono::seconds(1)).then([](const Response& r) {
+//     ...
+//   });
+//   send(request);
+//
+//   // When a response arrives:
+//   pending.fulfil(response.id, response);
+//
+// The table is split into shards, each one an open addressing hash table
+// (linear probing) with its own mutex, so threads working with different ids
+// rarely contend. The slots are allocated up front, for the capacity given
+// to the constructor, and the states of the futures come from a recycler of
+// the shard, so once it is warmed up, neither expect nor fulfil touches the
+// global allocator. The futures are resolved outside of the lock, so their
+// continuations may use the table. Because of the recycling, the table must
+// outlive the futures it returned.
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <vector>
+#include <boost/optional.hpp>
+#include "future_result.h"
+#include "recycling_allocator.h"
+
+namespace fry {
+
+////////////////////////////////////////////////////////////////////////////////
+template<typename Id, typename T, typename Hash = std::hash<Id>>
+class PendingTable {
+public:
+  typedef std::chrono::steady_clock     Clock;
+  typedef Result<T, std::error_code>    Value;
+
+  // Room for (at least) `capacity` pending ids, in `num_shards` shards
+  // (rounded up to a power of two).
+  explicit PendingTable( std::size_t capacity
+                       , std::size_t num_shards = 16
+                       , Hash        hash       = Hash())
+    : _hash(hash)
+    , _shard_bits(bits_for(num_shards))
+    , _shards(std::size_t(1) << _shard_bits)
+  {
+    // The ids are not spread over the shards exactly evenly, so each shard
+    // gets twice its share, and is full at 3/4 of that, to keep the probes
+    // short.
+    auto per_shard = (capacity + _shards.size() - 1) / _shards.size();
+    auto slots     = std::size_t(1) << bits_for(2 * std::max<std::size_t>(per_shard, 2));
+
+    for (auto& shard : _shards) {
+      shard.slots.resize(slots);
+      shard.limit = slots - slots / 4;
+    }
+  }
+
+  PendingTable(const PendingTable&) = delete;
+  PendingTable& operator = (const PendingTable&) = delete;
+
+  // Returns a future of the value the id will be fulfilled with. Fails with
+  // std::errc::timed_out once the deadline passes (and expire() is called),
+  // with std::errc::file_exists if the id is pending already, and with
+  // std::errc::no_buffer_space if its shard is full.
+  Future<Value> expect(const Id& id, Clock::time_point deadline) {
+    auto  hash  = mix(_hash(id));
+    auto& shard = shard_for(hash);
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    if (shard.size == shard.limit) {
+      return failure(std::errc::no_buffer_space);
+    }
+
+    auto index = shard.home(hash);
+
+    for (; shard.slots[index].used; index = shard.next(index)) {
+      if (shard.slots[index].hash == hash && shard.slots[index].id == id) {
+        return failure(std::errc::file_exists);
+      }
+    }
+
+    auto& slot = shard.slots[index];
+
+    slot.used     = true;
+    slot.hash     = hash;
+    slot.id       = id;
+    slot.deadline = deadline;
+    slot.promise  = Promise<Value>( std::allocator_arg
+                                  , RecyclingAllocator<void>(&shard.memory));
+
+    ++shard.size;
+    if (deadline < shard.earliest) shard.earliest = deadline;
+
+    return slot.promise->get_future();
+  }
+
+  Future<Value> expect(const Id& id, Clock::duration timeout) {
+    return expect(id, Clock::now() + timeout);
+  }
+
+  // Resolves the future of the id with the value. Returns false if the id is
+  // not pending (it was never expected, was fulfilled already or expired).
+  template<typename U>
+  bool fulfil(const Id& id, U&& value) {
+    auto promise = take(id);
+    if (!promise) return false;
+
+    promise->set_value(Value(std::forward<U>(value)));
+    return true;
+  }
+
+  // Fails the future of the id with the error. Returns false if the id is not
+  // pending.
+  bool fail(const Id& id, const std::error_code& error) {
+    auto promise = take(id);
+    if (!promise) return false;
+
+    promise->set_value(Value(error));
+    return true;
+  }
+
+  // Fails the futures whose deadline is earlier than `now`. Returns how many.
+  std::size_t expire(Clock::time_point now = Clock::now()) {
+    std::size_t                 result = 0;
+    std::vector<Promise<Value>> expired;
+
+    for (auto& shard : _shards) {
+      {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        if (shard.earliest > now) continue;
+
+        auto earliest = Clock::time_point::max();
+
+        // Erasing shifts later entries back, so the slot is checked again
+        // after that.
+        for (std::size_t i = 0; i < shard.slots.size();) {
+          auto& slot = shard.slots[i];
+
+          if (slot.used && slot.deadline <= now) {
+            expired.push_back(std::move(*slot.promise));
+            shard.erase(i);
+          } else {
+            if (slot.used && slot.deadline < earliest) earliest = slot.deadline;
+            ++i;
+          }
+        }
+
+        shard.earliest = earliest;
+      }
+
+      for (auto& promise : expired) {
+        promise.set_value(Value(std::make_error_code(std::errc::timed_out)));
+      }
+
+      result += expired.size();
+      expired.clear();
+    }
+
+    return result;
+  }
+
+  // Number of pending ids.
+  std::size_t size() const {
+    std::size_t result = 0;
+
+    for (auto& shard : _shards) {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      result += shard.size;
+    }
+
+    return result;
+  }
+
+private:
+  struct Slot {
+    bool                            used;
+    std::size_t                     hash;
+    Id                              id;
+    Clock::time_point               deadline;
+    boost::optional<Promise<Value>> promise;
+
+    Slot() : used(false), hash(0), id() {}
+  };
+
+  struct Shard {
+    mutable std::mutex  mutex;
+    Recycler            memory;
+    std::vector<Slot>   slots;
+    std::size_t         size;
+    std::size_t         limit;
+    Clock::time_point   earliest;
+
+    Shard() : size(0), limit(0), earliest(Clock::time_point::max()) {}
+
+    std::size_t home(std::size_t hash) const {
+      return hash & (slots.size() - 1);
+    }
+
+    std::size_t next(std::size_t index) const {
+      return (index + 1) & (slots.size() - 1);
+    }
+
+    // Removes the entry at the index, moving back the entries after it that
+    // would not be found otherwise (so no tombstones are needed).
+    void erase(std::size_t index) {
+      auto hole = index;
+
+      for (auto i = next(hole); slots[i].used; i = next(i)) {
+        auto h = home(slots[i].hash);
+
+        // Entries whose home lies cyclically in (hole, i] stay.
+        auto stays = hole <= i ? (hole < h && h <= i) : (hole < h || h <= i);
+        if (stays) continue;
+
+        slots[hole] = std::move(slots[i]);
+        hole = i;
+      }
+
+      slots[hole].used = false;
+      slots[hole].promise.reset();
+      --size;
+    }
+  };
+
+  static std::size_t bits_for(std::size_t n) {
+    std::size_t bits = 0;
+    while ((std::size_t(1) << bits) < n) ++bits;
+    return bits;
+  }
+
+  // std::hash of integers is the identity, so the bits are mixed before they
+  // pick the shard and the slot.
+  static std::size_t mix(std::size_t hash) {
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    return hash;
+  }
+
+  Shard& shard_for(std::size_t hash) {
+    static const std::size_t hash_bits = 8 * sizeof(std::size_t);
+    return _shards[_shard_bits ? hash >> (hash_bits - _shard_bits) : 0];
+  }
+
+  static Future<Value> failure(std::errc error) {
+    return make_ready_future(Value(std::make_error_code(error)));
+  }
+
+  boost::optional<Promise<Value>> take(const Id& id) {
+    auto  hash  = mix(_hash(id));
+    auto& shard = shard_for(hash);
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    for (auto i = shard.home(hash); shard.slots[i].used; i = shard.next(i)) {
+      auto& slot = shard.slots[i];
+
+      if (slot.hash == hash && slot.id == id) {
+        boost::optional<Promise<Value>> result(std::move(*slot.promise));
+        shard.erase(i);
+        return result;
+      }
+    }
+
+    return boost::none;
+  }
+
+private:
+  Hash               _hash;
+  std::size_t        _shard_bits;
+  std::vector<Shard> _shards;
+};
+
+} // namespace fry
+
+#endif // __FRY__PENDING_TABLE_H__
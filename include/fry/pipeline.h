@@ -0,0 +1,462 @@
+//
+// Copyright (c) 2014 Adam Cigánek (adam.ciganek@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef __FRY__PIPELINE_H__
+#define __FRY__PIPELINE_H__
+
+// Pipeline - chain of future-returning stages, each processing at most
+//            `parallelism` items at a time and buffering at most `capacity`
+//            items in front of it.
+//
+//   auto pipeline = Pipeline<Packet>(4)
+//     .stage(decode, 4, 64)
+//     .stage(enrich, 16, 64)
+//     .stage(write,  8, 64);
+//
+//   pipeline.push(std::move(packet)).then(...); // ready when admitted
+//   pipeline.close().then(...);                 // ready when drained
+//
+// An item stays in its stage until the next stage admits it, so a full queue
+// downstream stalls the stage in front of it, which in turn stops admitting
+// new items. The future returned by push() is what propagates this back to the
+// producer: it does not become ready until the first stage has room for the
+// item, and then it is true. At most `max_waiting` pushes (the argument of the
+// constructor) wait like this; a push beyond that is rejected: the item is
+// dropped and the future is false right away. So nothing piles up in front of
+// the pipeline, even if the producer does not wait. (Between the stages
+// nothing is ever rejected: a stage waits for the next one to admit an item
+// before it takes another one, so at most `parallelism` items wait in front of
+// the next stage.) Items are moved from stage to stage and never copied.
+//
+// The output of the last stage is discarded.
+
+#include <chrono>
+#include <deque>
+#include <vector>
+#include <boost/optional.hpp>
+#include "future.h"
+
+namespace fry {
+
+////////////////////////////////////////////////////////////////////////////////
+struct StageStats {
+  typedef std::chrono::steady_clock::duration Duration;
+
+  std::size_t queue_depth;      // items waiting in the queue right now
+  std::size_t max_queue_depth;  // most items ever waiting in the queue
+  std::size_t num_blocked;      // items waiting for room in the queue
+  std::size_t num_rejected;     // items dropped because too many were waiting
+  std::size_t num_pending;      // items being processed or waiting to be
+                                // admitted to the next stage
+  std::size_t num_processed;    // items that went through the stage function
+  Duration    total_latency;    // time spent in the stage function
+  Duration    total_stall;      // time spent waiting for the next stage
+
+  Duration mean_latency() const {
+    return num_processed ? total_latency / Duration::rep(num_processed)
+                         : Duration::zero();
+  }
+
+  Duration mean_stall() const {
+    return num_processed ? total_stall / Duration::rep(num_processed)
+                         : Duration::zero();
+  }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+namespace detail { namespace pipeline {
+  typedef std::chrono::steady_clock Clock;
+
+  //----------------------------------------------------------------------------
+  template<typename T>
+  class Inlet {
+  public:
+    virtual ~Inlet() {}
+    // True once the item is admitted, false if it was rejected.
+    virtual Future<bool> push(T&& item) = 0;
+    virtual Future<void> close() = 0;
+  };
+
+  template<typename T>
+  class Outlet {
+  public:
+    virtual ~Outlet() {}
+    virtual void connect(std::shared_ptr<Inlet<T>> next) = 0;
+  };
+
+  template<> class Inlet<void> {};
+  template<> class Outlet<void> {};
+
+  class StageBase {
+  public:
+    virtual ~StageBase() {}
+    virtual StageStats stats() const = 0;
+  };
+
+  //----------------------------------------------------------------------------
+  template<typename In, typename Fun>
+  class Stage : public Inlet<In>
+              , public Outlet<future_type<result_of<Fun, In>>>
+              , public StageBase
+              , public std::enable_shared_from_this<Stage<In, Fun>>
+  {
+  public:
+    typedef future_type<result_of<Fun, In>> Out;
+
+    Stage( Fun         fun
+         , std::size_t parallelism
+         , std::size_t capacity
+         , std::size_t max_blocked)
+      : _fun(std::move(fun))
+      , _parallelism(parallelism > 0 ? parallelism : 1)
+      , _capacity(capacity)
+      , _max_blocked(max_blocked)
+      , _num_pending(0)
+      , _pumping(false)
+      , _closed(false)
+      , _drained(false)
+      , _stats()
+    {}
+
+    void connect(std::shared_ptr<Inlet<Out>> next) {
+      _next = std::move(next);
+    }
+
+    std::size_t parallelism() const {
+      return _parallelism;
+    }
+
+    Future<bool> push(In&& item) override {
+      std::unique_lock<std::mutex> lock(_mutex);
+      assert(!_closed);
+
+      if (_queue.size() < _capacity) {
+        _queue.push_back(std::move(item));
+        _stats.max_queue_depth = std::max( _stats.max_queue_depth
+                                         , _queue.size());
+        lock.unlock();
+
+        pump();
+        return ::fry::make_ready_future(true);
+      } else if (_blocked.size() < _max_blocked) {
+        _blocked.emplace_back(std::move(item), Promise<bool>());
+        auto admitted = _blocked.back().second.get_future();
+        lock.unlock();
+
+        pump();
+        return admitted;
+      } else {
+        ++_stats.num_rejected;
+        return ::fry::make_ready_future(false);
+      }
+    }
+
+    Future<void> close() override {
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _closed = true;
+      }
+
+      pump();
+      return _drained_promise.get_future();
+    }
+
+    StageStats stats() const override {
+      std::lock_guard<std::mutex> lock(_mutex);
+
+      StageStats result   = _stats;
+      result.queue_depth  = _queue.size();
+      result.num_blocked  = _blocked.size();
+      result.num_pending  = _num_pending;
+
+      return result;
+    }
+
+    //--------------------------------------------------------------------------
+    // Called when the stage function is done with an item.
+    template<typename... T>
+    void processed(Clock::time_point start, T&... value) {
+      auto now = Clock::now();
+
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        ++_stats.num_processed;
+        _stats.total_latency += now - start;
+      }
+
+      forward(now, value...);
+    }
+
+    // Called when the next stage admitted the item.
+    void admitted(Clock::time_point start) {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _stats.total_stall += Clock::now() - start;
+    }
+
+    // Called when the item left this stage.
+    void done() {
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        --_num_pending;
+      }
+
+      pump();
+    }
+
+  private:
+    // The overloads for lvalue and rvalue make Processed callable for the
+    // purpose of deducing the result type, while taking the value by non-const
+    // reference at runtime, so it can be moved to the next stage.
+    template<typename R, typename = void> struct Processed;
+    struct Admitted;
+
+    //--------------------------------------------------------------------------
+    // Moves queued items into processing until the parallelism is exhausted.
+    // Like in map_concurrent, nested calls (from continuations of futures that
+    // are already ready) return immediately and leave the work to the
+    // outermost one.
+    void pump() {
+      std::unique_lock<std::mutex> lock(_mutex);
+
+      if (_pumping) return;
+      _pumping = true;
+
+      while (_num_pending < _parallelism) {
+        boost::optional<In>            item;
+        boost::optional<Promise<bool>> admitted;
+
+        if (!_queue.empty()) {
+          item = std::move(_queue.front());
+          _queue.pop_front();
+
+          if (!_blocked.empty()) {
+            _queue.push_back(std::move(_blocked.front().first));
+            admitted = std::move(_blocked.front().second);
+            _blocked.pop_front();
+          }
+        } else if (!_blocked.empty()) {
+          item     = std::move(_blocked.front().first);
+          admitted = std::move(_blocked.front().second);
+          _blocked.pop_front();
+        } else {
+          break;
+        }
+
+        ++_num_pending;
+        lock.unlock();
+
+        if (admitted) admitted->set_value(true);
+        process(std::move(*item));
+
+        lock.lock();
+      }
+
+      _pumping = false;
+
+      if (  _drained || !_closed
+         || !_queue.empty() || !_blocked.empty() || _num_pending > 0)
+      {
+        return;
+      }
+
+      _drained = true;
+      lock.unlock();
+
+      propagate_close(std::is_void<Out>());
+    }
+
+    void process(In&& item) {
+      _fun(std::move(item)).then(
+        Processed<Out>{ this->shared_from_this(), Clock::now() });
+    }
+
+    //--------------------------------------------------------------------------
+    template<typename T>
+    void forward(Clock::time_point start, T& value) {
+      if (_next) {
+        _next->push(std::move(value)).then(
+          Admitted{ this->shared_from_this(), start });
+      } else {
+        done();
+      }
+    }
+
+    void forward(Clock::time_point) {
+      done();
+    }
+
+    //--------------------------------------------------------------------------
+    void propagate_close(std::false_type) {
+      if (_next) {
+        _next->close().then(Drained{ this->shared_from_this() });
+      } else {
+        _drained_promise.set_value();
+      }
+    }
+
+    void propagate_close(std::true_type) {
+      _drained_promise.set_value();
+    }
+
+    struct Drained {
+      std::shared_ptr<Stage> stage;
+
+      void operator () () {
+        stage->_drained_promise.set_value();
+      }
+    };
+
+  private:
+    mutable std::mutex                       _mutex;
+    Fun                                      _fun;
+    std::size_t                              _parallelism;
+    std::size_t                              _capacity;
+    std::size_t                              _max_blocked;
+    std::deque<In>                           _queue;
+    std::deque<std::pair<In, Promise<bool>>> _blocked;
+    std::size_t                              _num_pending;
+    bool                                     _pumping;
+    bool                                     _closed;
+    bool                                     _drained;
+    Promise<void>                            _drained_promise;
+    std::shared_ptr<Inlet<Out>>              _next;
+    StageStats                               _stats;
+  };
+
+  //----------------------------------------------------------------------------
+  template<typename In, typename Fun>
+  template<typename R, typename>
+  struct Stage<In, Fun>::Processed {
+    std::shared_ptr<Stage> stage;
+    Clock::time_point      start;
+
+    void operator () (R& value)  { stage->processed(start, value); }
+    void operator () (R&& value) { stage->processed(start, value); }
+  };
+
+  template<typename In, typename Fun>
+  template<typename Dummy>
+  struct Stage<In, Fun>::Processed<void, Dummy> {
+    std::shared_ptr<Stage> stage;
+    Clock::time_point      start;
+
+    void operator () () { stage->processed(start); }
+  };
+
+  template<typename In, typename Fun>
+  struct Stage<In, Fun>::Admitted {
+    std::shared_ptr<Stage> stage;
+    Clock::time_point      start;
+
+    // Always true, as the next stage has room for all the items this one can
+    // have pending.
+    void operator () (bool) {
+      stage->admitted(start);
+      stage->done();
+    }
+  };
+}} // namespace detail::pipeline
+
+////////////////////////////////////////////////////////////////////////////////
+template<typename In, typename Out = In>
+class Pipeline {
+public:
+  // At most `max_waiting` pushes wait for the first stage to have room, the
+  // ones beyond that are rejected.
+  explicit Pipeline(std::size_t max_waiting = 1)
+    : _max_waiting(max_waiting)
+    , _tail_parallelism(0)
+  {}
+
+  // Appends a stage calling fun(Out&&) -> Future<R> on every item coming out
+  // of the current last stage, with at most `parallelism` calls pending and at
+  // most `capacity` items queued in front of it.
+  template<typename Fun>
+  Pipeline<In, future_type<result_of<Fun, Out>>>
+  stage(Fun&& fun, std::size_t parallelism = 1, std::size_t capacity = 0) {
+    static_assert(!is_void<Out>{}, "cannot append a stage after a stage with no output");
+
+    using S = detail::pipeline::Stage<Out, typename std::decay<Fun>::type>;
+
+    // Only the first stage rejects items. In front of the others wait at most
+    // the items pending in the stage before.
+    auto stage = std::make_shared<S>( std::forward<Fun>(fun)
+                                    , parallelism
+                                    , capacity
+                                    , _tail ? _tail_parallelism : _max_waiting);
+
+    Pipeline<In, future_type<result_of<Fun, Out>>> result(_max_waiting);
+    result._head             = attach(stage, std::is_same<In, Out>());
+    result._tail             = stage;
+    result._tail_parallelism = stage->parallelism();
+    result._stages           = _stages;
+    result._stages.push_back(stage);
+
+    return result;
+  }
+
+  // Returns a future that becomes true when the first stage admits the item,
+  // or false right away when the item is rejected because `max_waiting`
+  // pushes are waiting already.
+  Future<bool> push(In item) {
+    assert(_head);
+    return _head->push(std::move(item));
+  }
+
+  // Stops accepting new items. Returns a future that becomes ready when all
+  // the stages have been drained.
+  Future<void> close() {
+    assert(_head);
+    return _head->close();
+  }
+
+  // Statistics of each stage, in order.
+  std::vector<StageStats> stats() const {
+    std::vector<StageStats> result;
+    result.reserve(_stages.size());
+
+    for (auto& stage : _stages) {
+      result.push_back(stage->stats());
+    }
+
+    return result;
+  }
+
+private:
+
+  template<typename S>
+  std::shared_ptr<detail::pipeline::Inlet<In>>
+  attach(const std::shared_ptr<S>& stage, std::true_type) {
+    if (_tail) {
+      _tail->connect(stage);
+      return _head;
+    } else {
+      return stage;
+    }
+  }
+
+  template<typename S>
+  std::shared_ptr<detail::pipeline::Inlet<In>>
+  attach(const std::shared_ptr<S>& stage, std::false_type) {
+    _tail->connect(stage);
+    return _head;
+  }
+
+private:
+
+  std::size_t                                               _max_waiting;
+  std::size_t                                               _tail_parallelism;
+  std::shared_ptr<detail::pipeline::Inlet<In>>              _head;
+  std::shared_ptr<detail::pipeline::Outlet<Out>>            _tail;
+  std::vector<std::shared_ptr<detail::pipeline::StageBase>> _stages;
+
+  template<typename, typename> friend class Pipeline;
+};
+
+} // namespace fry
+
+#endif // __FRY__PIPELINE_H__
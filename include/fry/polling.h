@@ -0,0 +1,152 @@
+//
+// Copyright (c) 2014 Adam Cigánek (adam.ciganek@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef __FRY__POLLING_H__
+#define __FRY__POLLING_H__
+
+// run_polling - runs an io_service by polling it instead of sleeping in
+// epoll_wait, trading a core for latency.
+//
+// io_service::run() blocks in the kernel whenever nothing is ready, and every
+// wakeup then pays for the trip back. run_polling() keeps calling poll(),
+// which runs whatever is ready (handlers, completed operations, and so the
+// continuations of the futures they resolve) without blocking. Once nothing
+// has been ready for a while it backs off according to the policy: first it
+// spins, then it spins while yielding the CPU to other threads between the
+// polls, and then (unless the policy says not to) it blocks in run_one()
+// until the next event.
+//
+//   auto stats = asio::run_polling(io_service, asio::PollingPolicy(
+//     std::chrono::microseconds(200)));
+//
+// Like run(), it returns when the io_service is stopped or runs out of work.
+// The returned stats say how the time was spent, which is what the policy
+// is tuned by: a loop that is mostly spinning with little busy time burns a
+// core for nothing, and a loop that blocks a lot could spin a bit longer.
+//
+// The network stack can busy poll too. With asio::busy_poll set on a socket,
+// a receive on the socket that finds nothing polls the device queue for the
+// given number of microseconds (raising it above the net.core.busy_read
+// sysctl needs CAP_NET_ADMIN):
+//
+//   socket.set_option(asio::busy_poll(50));
+
+#include <chrono>
+#include <cstddef>
+#include <thread>
+#include <sys/socket.h>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/socket_base.hpp>
+
+namespace fry { namespace asio {
+
+#ifdef SO_BUSY_POLL
+// Socket option with the number of microseconds to busy poll for on receive.
+typedef boost::asio::detail::socket_option::integer<SOL_SOCKET, SO_BUSY_POLL>
+        busy_poll;
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+// How long run_polling keeps polling after the last time something was ready.
+struct PollingPolicy {
+  std::chrono::nanoseconds spin;   // polling back to back
+  std::chrono::nanoseconds yield;  // then polling with a yield in between
+  bool                     block;  // then blocking until the next event
+
+  explicit PollingPolicy(
+      std::chrono::nanoseconds spin  = std::chrono::microseconds(50)
+    , std::chrono::nanoseconds yield = std::chrono::nanoseconds(0)
+    , bool                     block = true)
+    : spin(spin), yield(yield), block(block)
+  {}
+
+  // Never blocks.
+  static PollingPolicy busy() {
+    return PollingPolicy( std::chrono::nanoseconds::max()
+                        , std::chrono::nanoseconds(0)
+                        , false);
+  }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Where run_polling spent its time.
+struct PollingStats {
+  std::chrono::nanoseconds busy;      // running handlers
+  std::chrono::nanoseconds idle;      // polling (and yielding) with nothing ready
+  std::chrono::nanoseconds blocked;   // in run_one(), with the handler it ran
+  std::size_t              num_handlers;
+  std::size_t              num_empty_polls;
+  std::size_t              num_blocks;
+
+  PollingStats()
+    : busy(0), idle(0), blocked(0)
+    , num_handlers(0), num_empty_polls(0), num_blocks(0)
+  {}
+
+  // Fraction of the time spent running handlers, blocked time excluded.
+  double utilization() const {
+    auto total = busy + idle;
+    return total.count() > 0 ? double(busy.count()) / total.count() : 0.0;
+  }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+inline PollingStats run_polling( boost::asio::io_service& io_service
+                               , const PollingPolicy&     policy = PollingPolicy())
+{
+  typedef std::chrono::steady_clock Clock;
+
+  PollingStats stats;
+
+  auto now  = Clock::now();
+  auto last = now;            // when something was last ready
+
+  while (!io_service.stopped()) {
+    auto n     = io_service.poll();
+    auto after = Clock::now();
+
+    if (n > 0) {
+      stats.busy         += after - now;
+      stats.num_handlers += n;
+      now = last = after;
+      continue;
+    }
+
+    stats.idle += after - now;
+    ++stats.num_empty_polls;
+    now = after;
+
+    auto waited = now - last;
+
+    if (waited < policy.spin) continue;
+
+    if (waited - policy.spin < policy.yield) {
+      std::this_thread::yield();
+
+      after       = Clock::now();
+      stats.idle += after - now;
+      now         = after;
+      continue;
+    }
+
+    if (!policy.block) continue;
+
+    n     = io_service.run_one();
+    after = Clock::now();
+
+    stats.blocked      += after - now;
+    stats.num_handlers += n;
+    ++stats.num_blocks;
+    now = last = after;
+  }
+
+  return stats;
+}
+
+}} // namespace fry::asio
+
+#endif // __FRY__POLLING_H__
@@ -0,0 +1,255 @@
+//
+// Copyright (c) 2014 Adam Cigánek (adam.ciganek@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef __FRY__RATE_LIMITER_H__
+#define __FRY__RATE_LIMITER_H__
+
+// RateLimiter - token bucket that resolves futures instead of sleeping.
+//
+// The bucket holds up to `burst` tokens and refills at `rate` tokens per
+// second. acquire(n) takes n tokens and returns a ready future when they are
+// there, or else a future resolved once the bucket has refilled enough:
+//
+//   RateLimiter<Reactor> limiter(reactor, 1000, 100);   // 1000/s, bursts of 100
+//
+//   limiter.acquire().then([]() { return backend.call(...); });
+//
+// Requests are granted in the order they came. A request that has to wait
+// puts the bucket in debt for the tokens it takes, so the time it may go is
+// known right away, and those times only grow along the queue. A single
+// timer (on the scheduler, for the first request in the queue) resolves all
+// the requests whose time has come whenever it fires, so there is neither a
+// thread nor a timer per waiting request. The timer fires at most once per
+// `resolution`, so at high rates it resolves many requests at once (each
+// still no sooner than its time).
+//
+// A limiter can have a parent, whose tokens are taken as well. For example a
+// per-tenant limiter with the global one as its parent:
+//
+//   RateLimiter<Reactor> global(reactor, 100000, 1000);
+//   RateLimiter<Reactor> tenant(global, 1000, 100);
+//
+//   tenant.acquire();   // waits for the tenant's tokens, then the global ones
+//
+// The scheduler is anything that has sleep_until(time_point) returning a
+// future, and dispatch(f) that runs f where sleep_until() can be called, such
+// as a Reactor, or asio::Sleeper for an io_service. acquire() can be called
+// from any thread; the futures are resolved on the scheduler's thread (or
+// right away, on the calling one). Requests still waiting when the limiter is
+// destroyed are dropped and their futures never become ready. A parent must
+// outlive its children.
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "future.h"
+
+namespace fry {
+
+////////////////////////////////////////////////////////////////////////////////
+template<typename Scheduler>
+class RateLimiter {
+public:
+  typedef std::chrono::steady_clock Clock;
+
+  // rate is in tokens per second, burst is the size of the bucket (and the
+  // most that a single acquire() may ask for without waiting).
+  RateLimiter( Scheduler&      scheduler
+             , double          rate
+             , double          burst
+             , Clock::duration resolution = std::chrono::milliseconds(1))
+    : _shared(std::make_shared<Shared>(scheduler, rate, burst, resolution))
+    , _parent(nullptr)
+  {}
+
+  RateLimiter( RateLimiter&    parent
+             , double          rate
+             , double          burst
+             , Clock::duration resolution = std::chrono::milliseconds(1))
+    : _shared(std::make_shared<Shared>( parent._shared->scheduler
+                                      , rate, burst, resolution))
+    , _parent(&parent)
+  {}
+
+  RateLimiter(const RateLimiter&) = delete;
+  RateLimiter& operator = (const RateLimiter&) = delete;
+
+  ~RateLimiter() {
+    std::lock_guard<std::mutex> lock(_shared->mutex);
+    _shared->waiters.clear();
+  }
+
+  Future<void> acquire(double tokens = 1) {
+    auto result = _shared->acquire(_shared, tokens);
+    if (!_parent) return result;
+
+    auto parent = _parent;
+    return result.then([parent, tokens]() { return parent->acquire(tokens); });
+  }
+
+  // Takes the tokens only if there are enough right away, here and in all
+  // the parents.
+  bool try_acquire(double tokens = 1) {
+    if (!_shared->try_acquire(tokens)) return false;
+    if (!_parent || _parent->try_acquire(tokens)) return true;
+
+    _shared->give_back(tokens);
+    return false;
+  }
+
+  std::size_t num_waiting() const {
+    std::lock_guard<std::mutex> lock(_shared->mutex);
+    return _shared->waiters.size();
+  }
+
+private:
+  struct Waiter {
+    Clock::time_point deadline;
+    Promise<void>     promise;
+  };
+
+  struct Shared {
+    Scheduler&          scheduler;
+    const double        rate;       // tokens per nanosecond
+    const double        burst;
+    Clock::duration     resolution;
+
+    mutable std::mutex  mutex;
+    double              tokens;     // negative when in debt to the waiters
+    Clock::time_point   updated;
+    bool                armed;
+    std::deque<Waiter>  waiters;
+
+    Shared( Scheduler&      scheduler
+          , double          rate
+          , double          burst
+          , Clock::duration resolution)
+      : scheduler(scheduler)
+      , rate(rate / 1e9)
+      , burst(burst)
+      , resolution(resolution)
+      , tokens(burst)
+      , updated(Clock::now())
+      , armed(false)
+    {
+      assert(rate > 0 && burst > 0);
+    }
+
+    void refill(Clock::time_point now) {
+      auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        now - updated).count();
+
+      tokens  = std::min(burst, tokens + elapsed * rate);
+      updated = now;
+    }
+
+    static Future<void> acquire( const std::shared_ptr<Shared>& self
+                               , double                         tokens)
+    {
+      std::unique_lock<std::mutex> lock(self->mutex);
+
+      auto now = Clock::now();
+      self->refill(now);
+
+      if (self->waiters.empty() && self->tokens >= tokens) {
+        self->tokens -= tokens;
+        return make_ready_future();
+      }
+
+      // Goes when the debt up to and including this request is paid off.
+      self->tokens -= tokens;
+
+      auto wait = std::chrono::nanoseconds(
+        static_cast<std::chrono::nanoseconds::rep>(-self->tokens / self->rate));
+
+      self->waiters.push_back(Waiter{ now + wait, Promise<void>() });
+      auto result = self->waiters.back().promise.get_future();
+
+      // The timer is already set for the first waiter otherwise.
+      if (!self->armed) {
+        self->armed = true;
+
+        auto deadline = self->waiters.front().deadline;
+        lock.unlock();
+
+        arm(self, deadline);
+      }
+
+      return result;
+    }
+
+    bool try_acquire(double n) {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      refill(Clock::now());
+
+      if (!waiters.empty() || tokens < n) return false;
+
+      tokens -= n;
+      return true;
+    }
+
+    void give_back(double n) {
+      std::lock_guard<std::mutex> lock(mutex);
+      tokens = std::min(burst, tokens + n);
+    }
+
+    static void arm( const std::shared_ptr<Shared>& self
+                   , Clock::time_point              deadline)
+    {
+      std::weak_ptr<Shared> weak = self;
+      auto& scheduler = self->scheduler;
+
+      deadline = std::max(deadline, Clock::now() + self->resolution);
+
+      scheduler.dispatch([weak, &scheduler, deadline]() {
+        scheduler.sleep_until(deadline).then([weak]() {
+          if (auto self = weak.lock()) expire(self);
+        });
+      });
+    }
+
+    // Resolves the waiters whose time has come, and waits for the next one.
+    static void expire(const std::shared_ptr<Shared>& self) {
+      std::vector<Promise<void>> ready;
+      Clock::time_point          next;
+      bool                       more;
+
+      {
+        std::lock_guard<std::mutex> lock(self->mutex);
+
+        auto now = Clock::now();
+
+        while (!self->waiters.empty() && self->waiters.front().deadline <= now) {
+          ready.push_back(std::move(self->waiters.front().promise));
+          self->waiters.pop_front();
+        }
+
+        more        = !self->waiters.empty();
+        self->armed = more;
+
+        if (more) next = self->waiters.front().deadline;
+      }
+
+      if (more) arm(self, next);
+
+      for (auto& promise : ready) promise.set_value();
+    }
+  };
+
+private:
+  std::shared_ptr<Shared> _shared;
+  RateLimiter*            _parent;
+};
+
+} // namespace fry
+
+#endif // __FRY__RATE_LIMITER_H__
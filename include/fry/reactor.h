@@ -0,0 +1,472 @@
+//
+// Copyright (c) 2014 Adam Cigánek (adam.ciganek@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef __FRY__REACTOR_H__
+#define __FRY__REACTOR_H__
+
+// Reactor - small event loop on epoll, for programs that do not need (or
+// want) Boost.Asio (Linux only).
+//
+// It does not do any I/O itself. It tells when a file descriptor is ready,
+// and the caller does the non-blocking system calls:
+//
+//   void receive(Reactor& reactor, int fd) {
+//     while (::recv(fd, ...) >= 0) { ... }
+//
+//     if (errno == EAGAIN) {
+//       reactor.readable(fd).then([&reactor, fd]() { receive(reactor, fd); });
+//     }
+//   }
+//
+// readable(fd) and writable(fd) - resolved when the descriptor becomes ready
+//                                 (or fails, or hangs up, so the next system
+//                                 call reports why).
+// sleep_for(d), sleep_until(t)  - resolved when the time comes (all timers
+//                                 share one timerfd).
+// post(f)                       - runs f on the loop. Can be called from any
+//                                 thread (with one eventfd wakeup for all the
+//                                 functions posted while the loop is busy).
+//
+// A descriptor is added to the epoll set, edge triggered, the first time it
+// is waited for, and stays there until remove(fd), which must be called
+// before the descriptor is closed. The reactor remembers edges that nobody
+// waited for, so readable() right after a system call failed with EAGAIN
+// does not miss data that arrived in between (it may resolve when there is
+// nothing to read, though, and the call fails with EAGAIN again).
+//
+// run() takes up to max_events events per epoll_wait and resolves all of
+// them, the expired timers and the posted functions before waiting again.
+// The futures are resolved, and so their continuations run, on the thread
+// that calls run(). Apart from post() and stop(), a reactor must only be
+// used from that thread.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <system_error>
+#include <vector>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include "future.h"
+
+namespace fry {
+
+namespace detail { namespace reactor {
+  struct Task {
+    Task* next;
+
+    virtual ~Task() {}
+    virtual void run() = 0;
+  };
+
+  template<typename F>
+  struct Function : Task {
+    F fun;
+
+    template<typename G>
+    explicit Function(G&& fun) : fun(std::forward<G>(fun)) {}
+
+    void run() override { fun(); }
+  };
+
+  // Waiters for one descriptor, and the edges that came while there were
+  // none.
+  struct Watch {
+    bool                       added;
+    bool                       readable;
+    bool                       writable;
+    std::vector<Promise<void>> readers;
+    std::vector<Promise<void>> writers;
+
+    Watch() : added(false), readable(false), writable(false) {}
+  };
+
+  template<typename Clock>
+  struct Timer {
+    typename Clock::time_point deadline;
+    std::uint64_t              sequence;
+    Promise<void>              promise;
+
+    // Earliest first in a max-heap, and in the order of creation when equal.
+    bool operator < (const Timer& other) const {
+      return deadline > other.deadline
+          || (deadline == other.deadline && sequence > other.sequence);
+    }
+  };
+
+  inline void check(int result, const char* what) {
+    if (result < 0) throw std::system_error(errno, std::system_category(), what);
+  }
+
+  inline void resolve_all(std::vector<Promise<void>>& promises) {
+    // The continuations may wait on the same descriptor again, adding to the
+    // same vector.
+    std::vector<Promise<void>> ready;
+    ready.swap(promises);
+
+    for (auto& promise : ready) promise.set_value();
+  }
+}} // namespace detail::reactor
+
+////////////////////////////////////////////////////////////////////////////////
+class Reactor {
+public:
+  typedef std::chrono::steady_clock Clock;
+
+  static const int max_events = 256;
+
+  Reactor()
+    : _epoll(::epoll_create1(EPOLL_CLOEXEC))
+    , _event(::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+    , _timer(::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC))
+    , _posted(nullptr)
+    , _stopped(false)
+    , _armed(Clock::time_point::max())
+    , _sequence(0)
+    , _num_wakeups(0)
+  {
+    detail::reactor::check(_epoll, "epoll_create1");
+    detail::reactor::check(_event, "eventfd");
+    detail::reactor::check(_timer, "timerfd_create");
+
+    add(_event, EPOLLIN);
+    add(_timer, EPOLLIN);
+  }
+
+  Reactor(const Reactor&) = delete;
+  Reactor& operator = (const Reactor&) = delete;
+
+  // Whatever is still pending is dropped, and its futures never become
+  // ready.
+  ~Reactor() {
+    for (auto task = take(); task;) {
+      auto next = task->next;
+      delete task;
+      task = next;
+    }
+
+    ::close(_timer);
+    ::close(_event);
+    ::close(_epoll);
+  }
+
+  //----------------------------------------------------------------------------
+  // Readiness
+
+  Future<void> readable(int fd) {
+    return wait(fd, true);
+  }
+
+  Future<void> writable(int fd) {
+    return wait(fd, false);
+  }
+
+  // Takes the descriptor out of the epoll set. Whoever waits for it is woken.
+  void remove(int fd) {
+    if (fd < 0 || std::size_t(fd) >= _watches.size() || !_watches[fd]) return;
+
+    std::unique_ptr<detail::reactor::Watch> watch(std::move(_watches[fd]));
+
+    if (watch->added) ::epoll_ctl(_epoll, EPOLL_CTL_DEL, fd, nullptr);
+
+    detail::reactor::resolve_all(watch->readers);
+    detail::reactor::resolve_all(watch->writers);
+  }
+
+  //----------------------------------------------------------------------------
+  // Timers
+
+  Future<void> sleep_until(Clock::time_point deadline) {
+    detail::reactor::Timer<Clock> timer = { deadline, _sequence++, Promise<void>() };
+    auto result = timer.promise.get_future();
+
+    _timers.push_back(std::move(timer));
+    std::push_heap(_timers.begin(), _timers.end());
+
+    arm();
+    return result;
+  }
+
+  template<typename Rep, typename Period>
+  Future<void> sleep_for(std::chrono::duration<Rep, Period> duration) {
+    return sleep_until(Clock::now()
+                     + std::chrono::duration_cast<Clock::duration>(duration));
+  }
+
+  //----------------------------------------------------------------------------
+  // Executor
+
+  // Runs fun() on the loop. Can be called from any thread.
+  template<typename F>
+  void post(F&& fun) {
+    typedef detail::reactor::Function<typename std::decay<F>::type> T;
+    push(new T(std::forward<F>(fun)));
+  }
+
+  // Runs fun() right away when called on the loop, otherwise like post().
+  template<typename F>
+  void dispatch(F&& fun) {
+    if (running_in_this_thread()) {
+      fun();
+    } else {
+      post(std::forward<F>(fun));
+    }
+  }
+
+  bool running_in_this_thread() const {
+    return current() == this;
+  }
+
+  //----------------------------------------------------------------------------
+  // Loop
+
+  // Runs the loop until stop().
+  void run() {
+    auto previous = current();
+    current() = this;
+
+    epoll_event events[max_events];
+
+    while (!_stopped.load(std::memory_order_acquire)) {
+      auto n = ::epoll_wait(_epoll, events, max_events, -1);
+
+      if (n < 0) {
+        if (errno == EINTR) continue;
+        break;
+      }
+
+      ++_num_wakeups;
+
+      bool expired = false;
+      bool posted  = false;
+
+      for (int i = 0; i < n; ++i) {
+        auto fd = events[i].data.fd;
+
+        if (fd == _event) {
+          posted = true;
+        } else if (fd == _timer) {
+          expired = true;
+        } else {
+          ready(fd, events[i].events);
+        }
+      }
+
+      if (expired) expire();
+      if (posted)  drain();
+    }
+
+    current() = previous;
+  }
+
+  // Makes run() return once it is done with what it is running now. Can be
+  // called from any thread.
+  void stop() {
+    _stopped.store(true, std::memory_order_release);
+    signal();
+  }
+
+  // Lets run() run again after stop().
+  void restart() {
+    _stopped.store(false, std::memory_order_release);
+  }
+
+  // Number of times epoll_wait returned.
+  std::size_t num_wakeups() const {
+    return _num_wakeups;
+  }
+
+private:
+  typedef detail::reactor::Watch Watch;
+  typedef detail::reactor::Task  Task;
+
+  static const Reactor*& current() {
+    static thread_local const Reactor* current = nullptr;
+    return current;
+  }
+
+  void add(int fd, std::uint32_t events) {
+    epoll_event event;
+    event.events  = events;
+    event.data.u64 = 0;
+    event.data.fd = fd;
+
+    detail::reactor::check(::epoll_ctl(_epoll, EPOLL_CTL_ADD, fd, &event), "epoll_ctl");
+  }
+
+  Watch& watch(int fd) {
+    if (std::size_t(fd) >= _watches.size()) _watches.resize(fd + 1);
+
+    auto& watch = _watches[fd];
+    if (!watch) watch.reset(new Watch);
+
+    return *watch;
+  }
+
+  Future<void> wait(int fd, bool read) {
+    auto& w = watch(fd);
+
+    if (!w.added) {
+      // An edge triggered registration reports the readiness the descriptor
+      // already has, so nothing is lost by adding it only now.
+      add(fd, EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET);
+      w.added = true;
+    }
+
+    auto& flag = read ? w.readable : w.writable;
+
+    if (flag) {
+      flag = false;
+      return make_ready_future();
+    }
+
+    auto& waiters = read ? w.readers : w.writers;
+
+    waiters.emplace_back();
+    return waiters.back().get_future();
+  }
+
+  void ready(int fd, std::uint32_t events) {
+    if (std::size_t(fd) >= _watches.size() || !_watches[fd]) return;
+
+    auto& w = *_watches[fd];
+
+    if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+      if (w.readers.empty()) {
+        w.readable = true;
+      } else {
+        detail::reactor::resolve_all(w.readers);
+      }
+    }
+
+    // The continuations of the readers may have removed the descriptor.
+    if (std::size_t(fd) >= _watches.size() || _watches[fd].get() != &w) return;
+
+    if (events & (EPOLLOUT | EPOLLHUP | EPOLLERR)) {
+      if (w.writers.empty()) {
+        w.writable = true;
+      } else {
+        detail::reactor::resolve_all(w.writers);
+      }
+    }
+  }
+
+  // Sets the timerfd to the earliest deadline, if it changed.
+  void arm() {
+    auto deadline = _timers.empty() ? Clock::time_point::max()
+                                    : _timers.front().deadline;
+
+    if (deadline == _armed) return;
+    _armed = deadline;
+
+    itimerspec spec = {};
+
+    if (deadline != Clock::time_point::max()) {
+      auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                  deadline.time_since_epoch()).count();
+
+      // Zero would disarm the timer.
+      if (ns <= 0) ns = 1;
+
+      spec.it_value.tv_sec  = ns / 1000000000;
+      spec.it_value.tv_nsec = ns % 1000000000;
+    }
+
+    ::timerfd_settime(_timer, TFD_TIMER_ABSTIME, &spec, nullptr);
+  }
+
+  void expire() {
+    std::uint64_t count;
+    while (::read(_timer, &count, sizeof(count)) < 0 && errno == EINTR);
+
+    // Anything the continuations schedule goes after these.
+    auto now = Clock::now();
+
+    std::vector<Promise<void>> ready;
+
+    while (!_timers.empty() && _timers.front().deadline <= now) {
+      std::pop_heap(_timers.begin(), _timers.end());
+      ready.push_back(std::move(_timers.back().promise));
+      _timers.pop_back();
+    }
+
+    _armed = Clock::time_point::min();
+    arm();
+
+    for (auto& promise : ready) promise.set_value();
+  }
+
+  void signal() {
+    std::uint64_t one = 1;
+    while (::write(_event, &one, sizeof(one)) < 0 && errno == EINTR);
+  }
+
+  void push(Task* task) {
+    auto old = _posted.load(std::memory_order_relaxed);
+
+    do {
+      task->next = old;
+    } while (!_posted.compare_exchange_weak( old, task
+                                           , std::memory_order_release
+                                           , std::memory_order_relaxed));
+
+    // Only the push onto an empty list needs to wake the loop.
+    if (!old) signal();
+  }
+
+  // Takes all the posted tasks, oldest first.
+  Task* take() {
+    Task* list   = _posted.exchange(nullptr, std::memory_order_acquire);
+    Task* result = nullptr;
+
+    while (list) {
+      auto next  = list->next;
+      list->next = result;
+      result     = list;
+      list       = next;
+    }
+
+    return result;
+  }
+
+  void drain() {
+    std::uint64_t count;
+    while (::read(_event, &count, sizeof(count)) < 0 && errno == EINTR);
+
+    for (auto task = take(); task;) {
+      auto next = task->next;
+      task->run();
+      delete task;
+      task = next;
+    }
+  }
+
+private:
+  int                                 _epoll;
+  int                                 _event;
+  int                                 _timer;
+
+  std::vector<std::unique_ptr<Watch>> _watches;   // by descriptor
+
+  std::atomic<Task*>                  _posted;
+  std::atomic<bool>                   _stopped;
+
+  std::vector<detail::reactor::Timer<Clock>> _timers;    // heap
+  Clock::time_point                          _armed;
+  std::uint64_t                              _sequence;
+
+  std::size_t                         _num_wakeups;
+};
+
+} // namespace fry
+
+#endif // __FRY__REACTOR_H__
@@ -0,0 +1,147 @@
+//
+// Copyright (c) 2014 Adam Cigánek (adam.ciganek@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef __FRY__RECYCLING_ALLOCATOR_H__
+#define __FRY__RECYCLING_ALLOCATOR_H__
+
+// Recycler - keeps freed blocks of memory in free lists (one per size class)
+//            and hands them out again. A steady stream of allocations of the
+//            same few sizes (like the states of futures and the operations of
+//            a socket) is then served without reaching the global allocator
+//            once the lists are warmed up.
+//
+// RecyclingAllocator - standard allocator that allocates from a Recycler. A
+//                      default constructed one uses the global allocator.
+//
+// Blocks larger than Recycler::max_size always go to the global allocator.
+// The Recycler must outlive everything allocated from it. With asio, that
+// includes operations that are still pending when their owner is destroyed
+// (they are released together with the io_service), so a Recycler should be
+// declared before the io_service, not inside objects that may die while an
+// operation is in flight.
+
+#include <cstddef>
+#include <mutex>
+#include <new>
+
+namespace fry {
+
+////////////////////////////////////////////////////////////////////////////////
+class Recycler {
+public:
+  static const std::size_t granularity = 16;
+  static const std::size_t max_size    = 1024;
+
+  Recycler() {
+    for (auto& list : _free) list = nullptr;
+  }
+
+  Recycler(const Recycler&) = delete;
+  Recycler& operator = (const Recycler&) = delete;
+
+  ~Recycler() {
+    for (auto list : _free) {
+      while (list) {
+        auto next = list->next;
+        ::operator delete(list);
+        list = next;
+      }
+    }
+  }
+
+  void* allocate(std::size_t size) {
+    if (size > max_size) return ::operator new(size);
+
+    auto index = size_class(size);
+
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+
+      if (auto block = _free[index]) {
+        _free[index] = block->next;
+        return block;
+      }
+    }
+
+    return ::operator new((index + 1) * granularity);
+  }
+
+  void deallocate(void* pointer, std::size_t size) {
+    if (size > max_size) return ::operator delete(pointer);
+
+    auto index = size_class(size);
+    auto block = static_cast<Block*>(pointer);
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    block->next  = _free[index];
+    _free[index] = block;
+  }
+
+private:
+  struct Block {
+    Block* next;
+  };
+
+  static std::size_t size_class(std::size_t size) {
+    return size > 0 ? (size - 1) / granularity : 0;
+  }
+
+private:
+  std::mutex _mutex;
+  Block*     _free[max_size / granularity];
+};
+
+////////////////////////////////////////////////////////////////////////////////
+template<typename T>
+class RecyclingAllocator {
+public:
+  typedef T value_type;
+
+  RecyclingAllocator() : _recycler(nullptr) {}
+  RecyclingAllocator(Recycler* recycler) : _recycler(recycler) {}
+
+  template<typename U>
+  RecyclingAllocator(const RecyclingAllocator<U>& other)
+    : _recycler(other.recycler())
+  {}
+
+  T* allocate(std::size_t n) {
+    auto size = n * sizeof(T);
+
+    return static_cast<T*>(
+      _recycler ? _recycler->allocate(size) : ::operator new(size));
+  }
+
+  void deallocate(T* pointer, std::size_t n) {
+    if (_recycler) {
+      _recycler->deallocate(pointer, n * sizeof(T));
+    } else {
+      ::operator delete(pointer);
+    }
+  }
+
+  Recycler* recycler() const {
+    return _recycler;
+  }
+
+private:
+  Recycler* _recycler;
+};
+
+template<typename T, typename U>
+bool operator == (const RecyclingAllocator<T>& a, const RecyclingAllocator<U>& b) {
+  return a.recycler() == b.recycler();
+}
+
+template<typename T, typename U>
+bool operator != (const RecyclingAllocator<T>& a, const RecyclingAllocator<U>& b) {
+  return a.recycler() != b.recycler();
+}
+
+} // namespace fry
+
+#endif // __FRY__RECYCLING_ALLOCATOR_H__
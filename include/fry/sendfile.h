@@ -0,0 +1,195 @@
+//
+// Copyright (c) 2014 Adam Cigánek (adam.ciganek@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef __FRY__SENDFILE_H__
+#define __FRY__SENDFILE_H__
+
+// Zero-copy transfers from files to stream sockets (Linux only).
+//
+// async_sendfile - sends a range of a file with sendfile(2).
+// async_splice   - sends a range of a file with splice(2), through a pipe.
+//
+// In both cases the data goes from the page cache to the socket without being
+// copied to user space. The transfer waits for the socket with async_wait and
+// then moves as much as the socket takes, until the whole range is sent, so
+// partial writes and EAGAIN never reach the caller. The future holds the
+// number of bytes sent, which is always the requested length. If the file
+// ends sooner, the future fails with error::eof.
+//
+//   asio::async_sendfile(socket, fd, 0, size).then([](std::size_t) {
+//     ...
+//   });
+//
+// The file descriptor must stay open until the future becomes ready. No other
+// write to the socket may be in progress at the same time. The socket is put
+// into non-blocking mode (which asio's own operations do not mind, but
+// synchronous writes do).
+
+#include <memory>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <unistd.h>
+#include <boost/asio/error.hpp>
+#include "asio.h"
+#include "future_result.h"
+
+namespace fry { namespace asio {
+
+namespace detail {
+  inline boost::system::error_code last_error() {
+    return boost::system::error_code(errno, boost::system::system_category());
+  }
+
+  inline bool again(int error) {
+    return error == EAGAIN || error == EWOULDBLOCK;
+  }
+
+  // The remaining part of a transfer.
+  struct Transfer {
+    int         file;
+    off_t       offset;
+    std::size_t remaining;
+    std::size_t sent;
+  };
+
+  template<typename Socket, typename Token>
+  Future<std::size_t> sendfile(Socket& socket, Transfer transfer, Token token) {
+    return socket.async_wait(Socket::wait_write, token).then(
+      [&socket, transfer, token]() {
+        auto rest = transfer;
+
+        while (rest.remaining > 0) {
+          auto result = ::sendfile( socket.native_handle(), rest.file
+                                  , &rest.offset, rest.remaining);
+
+          if (result > 0) {
+            rest.remaining -= result;
+            rest.sent      += result;
+          } else if (result == 0) {
+            return make_ready_future<std::size_t>(
+              boost::system::error_code(boost::asio::error::eof));
+          } else if (again(errno)) {
+            return sendfile(socket, rest, token);
+          } else if (errno != EINTR) {
+            return make_ready_future<std::size_t>(last_error());
+          }
+        }
+
+        return make_ready_future(rest.sent);
+      });
+  }
+
+  // Pipe between the file and the socket, and how much is in it.
+  struct Pipe {
+    int         read_end;
+    int         write_end;
+    std::size_t size;
+
+    Pipe() : read_end(-1), write_end(-1), size(0) {}
+
+    ~Pipe() {
+      if (read_end  >= 0) ::close(read_end);
+      if (write_end >= 0) ::close(write_end);
+    }
+
+    bool open() {
+      int ends[2];
+      if (::pipe2(ends, O_NONBLOCK | O_CLOEXEC) < 0) return false;
+
+      read_end  = ends[0];
+      write_end = ends[1];
+      return true;
+    }
+  };
+
+  template<typename Socket, typename Token>
+  Future<std::size_t> splice( Socket&               socket
+                            , Transfer              transfer
+                            , std::shared_ptr<Pipe> pipe
+                            , Token                 token)
+  {
+    return socket.async_wait(Socket::wait_write, token).then(
+      [&socket, transfer, pipe, token]() {
+        auto rest = transfer;
+
+        while (rest.remaining > 0 || pipe->size > 0) {
+          // Fill the pipe from the file (never blocks), then drain it into
+          // the socket.
+          if (pipe->size == 0) {
+            auto result = ::splice( rest.file, &rest.offset
+                                  , pipe->write_end, nullptr
+                                  , rest.remaining
+                                  , SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+
+            if (result == 0) {
+              return make_ready_future<std::size_t>(
+                boost::system::error_code(boost::asio::error::eof));
+            } else if (result < 0) {
+              if (errno == EINTR) continue;
+              return make_ready_future<std::size_t>(last_error());
+            }
+
+            pipe->size     += result;
+            rest.remaining -= result;
+          }
+
+          auto result = ::splice( pipe->read_end, nullptr
+                                , socket.native_handle(), nullptr
+                                , pipe->size
+                                , SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+
+          if (result > 0) {
+            pipe->size -= result;
+            rest.sent  += result;
+          } else if (result < 0 && again(errno)) {
+            return splice(socket, rest, pipe, token);
+          } else if (result < 0 && errno != EINTR) {
+            return make_ready_future<std::size_t>(last_error());
+          }
+        }
+
+        return make_ready_future(rest.sent);
+      });
+  }
+} // namespace detail
+
+// Sends `length` bytes of the file, starting at `offset`, with sendfile(2).
+template<typename Socket, typename Token = UseFuture>
+Future<std::size_t> async_sendfile( Socket&     socket
+                                  , int         file
+                                  , off_t       offset
+                                  , std::size_t length
+                                  , Token       token = use_future)
+{
+  socket.native_non_blocking(true);
+  return detail::sendfile(socket, detail::Transfer{ file, offset, length, 0 }, token);
+}
+
+// Sends `length` bytes of the file, starting at `offset`, with splice(2)
+// through a pipe created for the transfer.
+template<typename Socket, typename Token = UseFuture>
+Future<std::size_t> async_splice( Socket&     socket
+                                , int         file
+                                , off_t       offset
+                                , std::size_t length
+                                , Token       token = use_future)
+{
+  auto pipe = std::make_shared<detail::Pipe>();
+
+  if (!pipe->open()) {
+    return make_ready_future<std::size_t>(detail::last_error());
+  }
+
+  socket.native_non_blocking(true);
+  return detail::splice( socket, detail::Transfer{ file, offset, length, 0 }
+                       , pipe, token);
+}
+
+}} // namespace fry::asio
+
+#endif // __FRY__SENDFILE_H__
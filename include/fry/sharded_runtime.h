@@ -0,0 +1,638 @@
+//
+// Copyright (c) 2014 Adam Cigánek (adam.ciganek@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef __FRY__SHARDED_RUNTIME_H__
+#define __FRY__SHARDED_RUNTIME_H__
+
+// ShardedRuntime - one single threaded io_service per core (Linux only).
+//
+// Every shard has its own thread (pinned to a core by default), its own
+// io_service and its own Recycler, and shares nothing with the other shards.
+// A server runs one copy of itself in every shard, each with its own socket
+// bound to the same port with asio::reuse_port, and the kernel spreads the
+// traffic between them:
+//
+//   ShardedRuntime runtime;
+//
+//   runtime.start([](ShardedRuntime::Shard& shard) {
+//     return std::make_shared<Server>(shard.io_service(), port);
+//   });
+//
+//   runtime.join();
+//
+// Whatever the function passed to start() returns is kept alive while the
+// shard runs.
+//
+// submit_to(shard, fun) runs fun on another shard and resolves the returned
+// future on the calling one. Every ordered pair of shards has its own single
+// producer, single consumer ring, so sending a call takes no locks. The call
+// is allocated from the Recycler of the calling shard and comes back to it
+// with the result, so memory never moves between shards. A shard whose ring
+// to another one is full keeps the calls in a backlog and sends them as the
+// ring drains, in order. Like with LoopBridge, a shard is woken (through an
+// eventfd) only when it might be asleep, and then runs everything that has
+// arrived.
+//
+// Called from a thread that is not a shard (or from the target shard itself),
+// submit_to posts fun to the io_service of the target and resolves the future
+// there.
+//
+// If fun returns a future, it may be resolved on any thread (a ThreadPool,
+// say). The result still goes back to the calling shard from the target one.
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+#include <boost/asio/socket_base.hpp>
+#include <boost/optional.hpp>
+#include "future.h"
+#include "recycling_allocator.h"
+
+namespace fry {
+
+namespace asio {
+  // Socket option letting several sockets bind the same address, with the
+  // kernel balancing the incoming connections or datagrams between them.
+  typedef boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>
+          reuse_port;
+}
+
+namespace detail { namespace shard {
+  // Message between shards. It runs on the receiving shard and decides
+  // itself what happens to it afterwards.
+  struct Node {
+    virtual ~Node() {}
+    virtual void run() = 0;
+    virtual void destroy() = 0;
+  };
+
+  // Bounded single producer, single consumer queue.
+  class Ring {
+  public:
+    explicit Ring(std::size_t capacity)
+      : _slots(capacity), _mask(capacity - 1), _head(0), _tail(0)
+    {}
+
+    std::size_t capacity() const { return _slots.size(); }
+
+    bool push(Node* node) {
+      auto tail = _tail.load(std::memory_order_relaxed);
+      if (tail - _head.load(std::memory_order_acquire) == _slots.size()) {
+        return false;
+      }
+
+      _slots[tail & _mask] = node;
+      _tail.store(tail + 1, std::memory_order_release);
+      return true;
+    }
+
+    Node* pop() {
+      auto head = _head.load(std::memory_order_relaxed);
+      if (head == _tail.load(std::memory_order_acquire)) return nullptr;
+
+      auto node = _slots[head & _mask];
+      _head.store(head + 1, std::memory_order_release);
+      return node;
+    }
+
+  private:
+    std::vector<Node*>       _slots;
+    std::size_t              _mask;
+    char                     _padding0[64];
+    std::atomic<std::size_t> _head;
+    char                     _padding1[64];
+    std::atomic<std::size_t> _tail;
+  };
+
+  // The result of a call, kept until it is delivered.
+  template<typename T>
+  struct Value {
+    boost::optional<T> value;
+
+    template<typename F, typename K>
+    void compute(F& fun, K done) {
+      value = fun();
+      done();
+    }
+
+    template<typename F, typename K>
+    void compute_async(F& fun, K done) {
+      fun().then(Store<K>{ this, std::move(done) });
+    }
+
+    void resolve(Promise<T>& promise) {
+      promise.set_value(std::move(*value));
+    }
+
+    // Moves the result in. The overloads for lvalue and rvalue make it
+    // callable for the purpose of deducing the result type, while the
+    // continuation gets the value by non-const reference at runtime.
+    template<typename K>
+    struct Store {
+      Value* self;
+      K      done;
+
+      void operator () (T& result)  { store(result); }
+      void operator () (T&& result) { store(result); }
+
+      void store(T& result) {
+        self->value = std::move(result);
+        done();
+      }
+    };
+  };
+
+  template<>
+  struct Value<void> {
+    template<typename F, typename K>
+    void compute(F& fun, K done) {
+      fun();
+      done();
+    }
+
+    template<typename F, typename K>
+    void compute_async(F& fun, K done) {
+      fun().then([done]() { done(); });
+    }
+
+    void resolve(Promise<void>& promise) {
+      promise.set_value();
+    }
+  };
+
+  inline std::size_t round_up_to_power_of_two(std::size_t n) {
+    std::size_t result = 1;
+    while (result < n) result <<= 1;
+    return result;
+  }
+}} // namespace detail::shard
+
+////////////////////////////////////////////////////////////////////////////////
+class ShardedRuntime {
+public:
+  class Shard;
+
+  // The shard of the calling thread, or null.
+  static Shard* current() {
+    return current_shard();
+  }
+
+  // Zero shards means one per core. The rings between the shards hold
+  // ring_size calls each (rounded up to a power of two).
+  explicit ShardedRuntime( std::size_t num_shards = default_size()
+                         , bool        pin        = true
+                         , std::size_t ring_size  = 1024);
+
+  ShardedRuntime(const ShardedRuntime&) = delete;
+  ShardedRuntime& operator = (const ShardedRuntime&) = delete;
+
+  // Stops and joins the shards. Calls that are still on their way are
+  // dropped, with their futures never becoming ready.
+  ~ShardedRuntime();
+
+  std::size_t size() const {
+    return _shards.size();
+  }
+
+  Shard& shard(std::size_t index) {
+    return *_shards[index];
+  }
+
+  // Starts the shards. Each one calls setup(shard) on its own thread, keeps
+  // the result alive and runs its io_service until stop().
+  template<typename F>
+  void start(F setup);
+
+  // Stops the io_services of all the shards. Can be called from any thread,
+  // including a shard.
+  void stop();
+
+  // Waits until all the shards have stopped.
+  void join() {
+    for (auto& thread : _threads) {
+      if (thread.joinable()) thread.join();
+    }
+  }
+
+  // Runs fun() on the given shard, and resolves the returned future with its
+  // result on the calling shard.
+  template<typename F>
+  add_future<result_of<F>> submit_to(std::size_t target, F&& fun);
+
+private:
+  static std::size_t default_size() {
+    auto n = std::thread::hardware_concurrency();
+    return n > 0 ? n : 1;
+  }
+
+  static Shard*& current_shard() {
+    static thread_local Shard* current = nullptr;
+    return current;
+  }
+
+  // Pins the calling thread to the index-th of the CPUs it may run on.
+  static void pin(std::size_t index) {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (::sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return;
+
+    auto count = CPU_COUNT(&allowed);
+    if (count == 0) return;
+
+    auto nth = int(index % count);
+
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+      if (CPU_ISSET(cpu, &allowed) && nth-- == 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set);
+        return;
+      }
+    }
+  }
+
+  template<typename F>
+  static void run(Shard& shard, F& setup, std::true_type);
+
+  template<typename F>
+  static void run(Shard& shard, F& setup, std::false_type);
+
+  template<typename T, typename F> class Call;
+
+private:
+  bool                                   _pin;
+
+  // Outlive all of the shards, because what is left in the io_service of
+  // one shard when it is destroyed may have been allocated by another.
+  std::vector<std::unique_ptr<Recycler>> _memory;
+  std::vector<std::unique_ptr<Shard>>    _shards;
+  std::vector<std::thread>               _threads;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+class ShardedRuntime::Shard {
+public:
+  Shard(const Shard&) = delete;
+  Shard& operator = (const Shard&) = delete;
+
+  std::size_t index() const {
+    return _index;
+  }
+
+  ShardedRuntime& runtime() {
+    return _runtime;
+  }
+
+  boost::asio::io_service& io_service() {
+    return _io_service;
+  }
+
+  // Allocator local to the shard.
+  Recycler& memory() {
+    return _memory;
+  }
+
+private:
+  friend class ShardedRuntime;
+  template<typename, typename> friend class ShardedRuntime::Call;
+
+  typedef detail::shard::Node Node;
+  typedef detail::shard::Ring Ring;
+
+  Shard( ShardedRuntime& runtime
+       , std::size_t     index
+       , std::size_t     num_shards
+       , std::size_t     ring_size
+       , Recycler&       memory)
+    : _runtime(runtime)
+    , _index(index)
+    , _memory(memory)
+    , _descriptor(_io_service, ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+    , _signalled(false)
+    , _stopped(false)
+    , _backlog(num_shards)
+    , _flushing(false)
+  {
+    _inbox.reserve(num_shards);
+
+    for (std::size_t i = 0; i < num_shards; ++i) {
+      _inbox.emplace_back(i == index ? nullptr : new Ring(ring_size));
+    }
+
+    wait();
+  }
+
+  void stop() {
+    _stopped = true;
+    _io_service.stop();
+  }
+
+  // Runs fun on this shard through the io_service.
+  template<typename F>
+  add_future<result_of<F>> post(F&& fun) {
+    using C = fry::detail::Continuation<remove_reference<F>>;
+
+    auto task   = std::make_shared<C>(std::forward<F>(fun));
+    auto result = task->get_future();
+
+    _io_service.post([task]() { (*task)(); });
+    return result;
+  }
+
+  // Sends fun to the target shard through the ring between the two.
+  template<typename F>
+  add_future<result_of<F>> call(Shard& target, F&& fun) {
+    typedef remove_future<result_of<F>>              T;
+    typedef Call<T, typename std::decay<F>::type>    C;
+
+    RecyclingAllocator<C> allocator(&_memory);
+
+    auto node   = new (allocator.allocate(1)) C(*this, target, std::forward<F>(fun));
+    auto result = node->get_future();
+
+    send(target, node);
+    return result;
+  }
+
+  // Called on this shard only.
+  void send(Shard& target, Node* node) {
+    auto& backlog = _backlog[target._index];
+
+    if (backlog.empty() && target._inbox[_index]->push(node)) {
+      target.signal();
+      return;
+    }
+
+    backlog.push_back(node);
+    schedule_flush();
+  }
+
+  void schedule_flush() {
+    if (_flushing) return;
+    _flushing = true;
+
+    _io_service.post([this]() {
+      _flushing = false;
+      flush();
+    });
+  }
+
+  // Moves what fits from the backlogs to the rings.
+  void flush() {
+    bool pending = false;
+
+    for (std::size_t i = 0; i < _backlog.size(); ++i) {
+      auto& backlog = _backlog[i];
+      if (backlog.empty()) continue;
+
+      auto& target = *_runtime._shards[i];
+      auto& ring   = *target._inbox[_index];
+      bool  pushed = false;
+
+      while (!backlog.empty() && ring.push(backlog.front())) {
+        backlog.pop_front();
+        pushed = true;
+      }
+
+      if (pushed) target.signal();
+      if (!backlog.empty()) pending = true;
+    }
+
+    if (pending) schedule_flush();
+  }
+
+  // Wakes the shard, unless it has been woken already and has not started
+  // draining yet.
+  void signal() {
+    if (!_signalled.exchange(true)) {
+      std::uint64_t one = 1;
+      while (::write(_descriptor.native_handle(), &one, sizeof(one)) < 0 && errno == EINTR);
+    }
+  }
+
+  void wait() {
+    _descriptor.async_wait(
+      boost::asio::posix::stream_descriptor::wait_read,
+      [this](const boost::system::error_code& error) {
+        if (error || _stopped) return;
+
+        drain();
+        wait();
+      });
+  }
+
+  void drain() {
+    std::uint64_t count;
+    while (::read(_descriptor.native_handle(), &count, sizeof(count)) < 0 && errno == EINTR);
+
+    // Clear the flag before looking into the rings, so that anything pushed
+    // after the look signals again.
+    _signalled.exchange(false);
+
+    bool more = false;
+
+    // Take at most a ring's worth from each, so that a busy sender does not
+    // keep the shard from its own work.
+    for (auto& ring : _inbox) {
+      if (!ring) continue;
+
+      for (std::size_t n = ring->capacity(); n > 0; --n) {
+        auto node = ring->pop();
+        if (!node) break;
+
+        node->run();
+        if (n == 1) more = true;
+      }
+    }
+
+    if (more) signal();
+  }
+
+  // Destroys the calls still in the rings and backlogs. Only after all the
+  // shards have stopped.
+  void discard() {
+    for (auto& ring : _inbox) {
+      if (!ring) continue;
+      while (auto node = ring->pop()) node->destroy();
+    }
+
+    for (auto& backlog : _backlog) {
+      for (auto node : backlog) node->destroy();
+      backlog.clear();
+    }
+  }
+
+private:
+  ShardedRuntime&                       _runtime;
+  std::size_t                           _index;
+  Recycler&                             _memory;
+  boost::asio::io_service               _io_service;
+  boost::asio::posix::stream_descriptor _descriptor;
+  std::atomic<bool>                     _signalled;
+  std::atomic<bool>                     _stopped;
+
+  // _inbox[i] is the ring from shard i, _backlog[i] holds what did not fit
+  // into the ring to shard i.
+  std::vector<std::unique_ptr<Ring>>    _inbox;
+  std::vector<std::deque<Node*>>        _backlog;
+  bool                                  _flushing;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Call that goes to the target shard, runs there, and comes back with the
+// result to be resolved where it came from.
+template<typename T, typename F>
+class ShardedRuntime::Call : public detail::shard::Node {
+public:
+  template<typename G>
+  Call(Shard& origin, Shard& target, G&& fun)
+    : _origin(origin)
+    , _target(target)
+    , _fun(std::forward<G>(fun))
+    , _promise(std::allocator_arg, RecyclingAllocator<Call>(&origin._memory))
+    , _returned(false)
+  {}
+
+  Future<T> get_future() {
+    return _promise.get_future();
+  }
+
+  void run() override {
+    if (_returned) {
+      _value.resolve(_promise);
+      destroy();
+      return;
+    }
+
+    // A future returned by fun may be resolved on any thread, but only the
+    // target shard may send to the origin, so from elsewhere the call goes
+    // back through the io_service of the target first.
+    auto done = [this]() {
+      _returned = true;
+
+      if (current() == &_target) {
+        _target.send(_origin, this);
+      } else {
+        _target._io_service.post([this]() { _target.send(_origin, this); });
+      }
+    };
+
+    compute(done, is_future<result_of<F>>());
+  }
+
+  void destroy() override {
+    RecyclingAllocator<Call> allocator(&_origin._memory);
+
+    this->~Call();
+    allocator.deallocate(this, 1);
+  }
+
+private:
+  template<typename K>
+  void compute(K done, std::false_type) {
+    _value.compute(_fun, done);
+  }
+
+  template<typename K>
+  void compute(K done, std::true_type) {
+    _value.compute_async(_fun, done);
+  }
+
+private:
+  Shard&                      _origin;
+  Shard&                      _target;
+  F                           _fun;
+  Promise<T>                  _promise;
+  detail::shard::Value<T>     _value;
+  bool                        _returned;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+inline ShardedRuntime::ShardedRuntime( std::size_t num_shards
+                                     , bool        pin
+                                     , std::size_t ring_size)
+  : _pin(pin)
+{
+  num_shards = num_shards > 0 ? num_shards : default_size();
+  ring_size  = detail::shard::round_up_to_power_of_two(ring_size);
+
+  _memory.reserve(num_shards);
+  _shards.reserve(num_shards);
+
+  for (std::size_t i = 0; i < num_shards; ++i) {
+    _memory.emplace_back(new Recycler);
+    _shards.emplace_back(new Shard(*this, i, num_shards, ring_size, *_memory[i]));
+  }
+}
+
+inline ShardedRuntime::~ShardedRuntime() {
+  stop();
+  join();
+
+  for (auto& shard : _shards) shard->discard();
+}
+
+inline void ShardedRuntime::stop() {
+  for (auto& shard : _shards) shard->stop();
+}
+
+template<typename F>
+void ShardedRuntime::start(F setup) {
+  _threads.reserve(_shards.size());
+
+  for (auto& shard : _shards) {
+    auto s = shard.get();
+    _threads.emplace_back([this, s, setup]() mutable {
+      current_shard() = s;
+      if (_pin) pin(s->index());
+
+      run(*s, setup, std::is_void<result_of<F, Shard&>>());
+
+      current_shard() = nullptr;
+    });
+  }
+}
+
+template<typename F>
+add_future<result_of<F>> ShardedRuntime::submit_to(std::size_t target, F&& fun) {
+  auto origin = current();
+  auto& to    = shard(target);
+
+  if (!origin || &origin->runtime() != this || origin == &to) {
+    return to.post(std::forward<F>(fun));
+  }
+
+  return origin->call(to, std::forward<F>(fun));
+}
+
+template<typename F>
+void ShardedRuntime::run(Shard& shard, F& setup, std::true_type) {
+  setup(shard);
+  shard.io_service().run();
+}
+
+template<typename F>
+void ShardedRuntime::run(Shard& shard, F& setup, std::false_type) {
+  auto keep = setup(shard);
+  shard.io_service().run();
+}
+
+} // namespace fry
+
+#endif // __FRY__SHARDED_RUNTIME_H__
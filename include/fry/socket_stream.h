@@ -0,0 +1,85 @@
+//
+// Copyright (c) 2014 Adam Cigánek (adam.ciganek@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef __FRY__SOCKET_STREAM_H__
+#define __FRY__SOCKET_STREAM_H__
+
+// read_stream - AsyncStream of the data read from an asio stream (such as a
+//               tcp::socket), one chunk at a time.
+//
+// Each chunk is as much as was available at once, up to the size of a slab of
+// the pool, and points into that slab, so it is not copied on its way down
+// the stream. A read is only made when the next chunk is pulled, so a slow
+// consumer leaves the data in the socket, and the sender is held back by TCP
+// flow control.
+//
+//   asio::read_stream(socket, pool)
+//     .for_each([&](const asio::Result<asio::Chunk>& chunk) {
+//       ...
+//     });
+//
+// The stream ends when the peer closes the connection. A read that fails
+// otherwise is the last element of the stream, as a failed Result. The stream
+// (and every stream made from it) must not outlive the socket.
+
+#include <memory>
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/error.hpp>
+#include <boost/optional.hpp>
+#include "asio.h"
+#include "buffer_pool.h"
+#include "future_result.h"
+#include "stream.h"
+
+namespace fry { namespace asio {
+
+////////////////////////////////////////////////////////////////////////////////
+struct Chunk {
+  Slab        slab;
+  std::size_t size;
+
+  boost::asio::const_buffer data() const {
+    return boost::asio::const_buffer(slab.data(), size);
+  }
+};
+
+template<typename Stream, typename Token = UseFuture>
+AsyncStream<Result<Chunk>> read_stream( Stream&     stream
+                                      , BufferPool& pool
+                                      , Token       token = use_future)
+{
+  typedef boost::optional<Result<Chunk>> Item;
+
+  auto  ended   = std::make_shared<bool>(false);
+  auto* socket  = &stream;
+  auto* buffers = &pool;
+
+  return generate([=]() -> ::fry::Future<Item> {
+    if (*ended) return ::fry::make_ready_future(Item());
+
+    auto slab = buffers->acquire();
+
+    return socket->async_read_some(
+      boost::asio::buffer(slab.data(), slab.size()), token
+    ).then([slab, ended](const Result<std::size_t>& result) {
+      return result.match(
+        [&](std::size_t size) {
+          return Item(Result<Chunk>(Chunk{ slab, size }));
+        },
+        [&](const boost::system::error_code& error) {
+          *ended = true;
+
+          if (error == boost::asio::error::eof) return Item();
+          return Item(Result<Chunk>(error));
+        });
+    });
+  });
+}
+
+}} // namespace fry::asio
+
+#endif // __FRY__SOCKET_STREAM_H__
@@ -0,0 +1,821 @@
+//
+// Copyright (c) 2014 Adam Cigánek (adam.ciganek@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef __FRY__STREAM_H__
+#define __FRY__STREAM_H__
+
+// AsyncStream - sequence of values that become available over time.
+//
+// next() returns a future of the next value, or of none once the stream has
+// ended. Values are pulled: nothing is produced until it is asked for, and
+// next() may be called again only once the future of the previous call is
+// ready. So a slow consumer holds the producer back without any extra
+// bookkeeping.
+//
+// A stream comes from a function returning the next value (or a future of
+// it), called once per next(), for example a cursor:
+//
+//   auto rows = generate([cursor]() { return cursor->fetch(); });
+//
+// or from a producer that pushes the values into a Channel:
+//
+//   auto channel = std::make_shared<Channel<Packet>>(16);
+//   auto packets = from_channel(channel);
+//
+//   channel->send(std::move(packet)).then(...);   // ready once there is credit
+//
+// where the capacity of the channel is the credit of the producer: it may run
+// ahead of the consumer by that many values, and then each send() waits until
+// the consumer pulls one out.
+//
+// The operators return a new stream over the values of this one:
+//
+//   map(f)              - f(value), or the value of the future f(value) returns.
+//   filter(p)           - the values for which p(value) is true.
+//   take(n)             - the first n values.
+//   buffer(n)           - the same values, but with up to n of them read ahead
+//                         (none for n = 0).
+//   batch(n)            - vectors of n values (the last one maybe fewer).
+//   batch(n, timeout, scheduler)
+//                       - vectors of up to n values, each given out at latest
+//                         timeout after its first value came. The scheduler
+//                         is anything with sleep_until() and dispatch(), like
+//                         for RateLimiter.
+//
+//   rows.filter(is_active).map(to_json).batch(100, milliseconds(10), reactor);
+//
+// Once an operator was called on a stream, only the stream it returned may be
+// used. The operators never copy the values.
+//
+// poll(item) takes the next value without a future, if it is there right away
+// (from a generator returning plain values, or read ahead by buffer()). Such
+// values go through map (with f returning a plain value), filter, take, buffer
+// and batch, and into for_each, without any allocation per value. Otherwise a
+// value costs what futures cost: the future next() returns, the continuation
+// that passes it on at every stage that has to wait for it, and for filter, one
+// promise per next(). Either way, values that are ready right away are passed
+// on in a loop, not by recursion.
+//
+// for_each(f) pulls all the values through f (which may return a Future<void>
+// to be waited for before the next value), and returns a future that is ready
+// once the stream has ended.
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <boost/optional.hpp>
+#include "channel.h"
+#include "future.h"
+
+namespace fry {
+
+template<typename T> class AsyncStream;
+
+////////////////////////////////////////////////////////////////////////////////
+namespace detail { namespace stream {
+  typedef std::chrono::steady_clock Clock;
+
+  template<typename T>
+  struct Source {
+    virtual ~Source() {}
+    virtual Future<boost::optional<T>> next() = 0;
+
+    // Sets item to the next value (or to none at the end) and returns true, if
+    // it is there right away. Otherwise returns false, and next() is to be
+    // used instead.
+    virtual bool poll(boost::optional<T>&) { return false; }
+  };
+
+  // Runs a step, unless it is running already (on this or another thread), in
+  // which case it is run once more right after. So a step that causes itself
+  // to be run again, synchronously, loops instead of recursing.
+  class Trampoline {
+  public:
+    Trampoline() : _pending(0) {}
+
+    template<typename F>
+    void run(F&& step) {
+      if (_pending.fetch_add(1, std::memory_order_acq_rel) != 0) return;
+
+      do {
+        step();
+      } while (_pending.fetch_sub(1, std::memory_order_acq_rel) != 1);
+    }
+
+  private:
+    std::atomic<std::size_t> _pending;
+  };
+
+  // Continuation that passes the item (taken by reference or by value) to a
+  // member function of the node.
+  template<typename Node, typename Item, typename R, R (Node::*Method)(Item&)>
+  struct Bind {
+    std::shared_ptr<Node> node;
+
+    R operator () (Item& item)  const { return ((*node).*Method)(item); }
+    R operator () (Item&& item) const { return ((*node).*Method)(item); }
+  };
+
+  //----------------------------------------------------------------------------
+  template<typename T, typename F, bool = is_future<result_of<F>>{}>
+  class Generate : public Source<T> {
+  public:
+    explicit Generate(F fun) : _fun(std::move(fun)) {}
+
+    Future<boost::optional<T>> next() override {
+      return ::fry::detail::make_ready_future(_fun);
+    }
+
+    bool poll(boost::optional<T>& item) override {
+      item = _fun();
+      return true;
+    }
+
+  private:
+    F _fun;
+  };
+
+  // Generating futures.
+  template<typename T, typename F>
+  class Generate<T, F, true> : public Source<T> {
+  public:
+    explicit Generate(F fun) : _fun(std::move(fun)) {}
+
+    Future<boost::optional<T>> next() override {
+      return _fun();
+    }
+
+  private:
+    F _fun;
+  };
+
+  //----------------------------------------------------------------------------
+  template<typename T, typename F, typename R = result_of<F, T>
+          , bool = is_future<R>{}>
+  class Map : public Source<R>
+            , public std::enable_shared_from_this<Map<T, F, R, false>>
+  {
+  public:
+    Map(std::shared_ptr<Source<T>> upstream, F fun)
+      : _upstream(std::move(upstream)), _fun(std::move(fun))
+    {}
+
+    Future<boost::optional<R>> next() override {
+      boost::optional<T> item;
+
+      if (_upstream->poll(item)) {
+        return ::fry::make_ready_future(apply(item));
+      }
+
+      return _upstream->next().then(Apply{ this->shared_from_this() });
+    }
+
+    bool poll(boost::optional<R>& result) override {
+      boost::optional<T> item;
+      if (!_upstream->poll(item)) return false;
+
+      result = apply(item);
+      return true;
+    }
+
+  private:
+    boost::optional<R> apply(boost::optional<T>& item) {
+      if (!item) return boost::none;
+      return boost::optional<R>(_fun(std::move(*item)));
+    }
+
+    typedef Bind< Map, boost::optional<T>, boost::optional<R>
+                , &Map::apply> Apply;
+
+  private:
+    std::shared_ptr<Source<T>> _upstream;
+    F                          _fun;
+  };
+
+  // Mapping to a future.
+  template<typename T, typename F, typename R>
+  class Map<T, F, R, true> : public Source<future_type<R>>
+                           , public std::enable_shared_from_this<Map<T, F, R, true>>
+  {
+    typedef future_type<R> U;
+
+  public:
+    Map(std::shared_ptr<Source<T>> upstream, F fun)
+      : _upstream(std::move(upstream)), _fun(std::move(fun))
+    {}
+
+    Future<boost::optional<U>> next() override {
+      boost::optional<T> item;
+
+      if (_upstream->poll(item)) return apply(item);
+      return _upstream->next().then(Apply{ this->shared_from_this() });
+    }
+
+  private:
+    struct Wrap {
+      boost::optional<U> operator () (U& value)  const { return std::move(value); }
+      boost::optional<U> operator () (U&& value) const { return std::move(value); }
+    };
+
+    Future<boost::optional<U>> apply(boost::optional<T>& item) {
+      if (!item) return ::fry::make_ready_future(boost::optional<U>());
+      return _fun(std::move(*item)).then(Wrap());
+    }
+
+    typedef Bind< Map, boost::optional<T>, Future<boost::optional<U>>
+                , &Map::apply> Apply;
+
+  private:
+    std::shared_ptr<Source<T>> _upstream;
+    F                          _fun;
+  };
+
+  //----------------------------------------------------------------------------
+  template<typename T, typename P>
+  class Filter : public Source<T>
+               , public std::enable_shared_from_this<Filter<T, P>>
+  {
+  public:
+    Filter(std::shared_ptr<Source<T>> upstream, P predicate)
+      : _upstream(std::move(upstream)), _predicate(std::move(predicate))
+    {}
+
+    Future<boost::optional<T>> next() override {
+      boost::optional<T> item;
+
+      if (poll(item)) return ::fry::make_ready_future(std::move(item));
+
+      _promise = Promise<boost::optional<T>>();
+      auto result = _promise.get_future();
+
+      pull();
+
+      return result;
+    }
+
+    bool poll(boost::optional<T>& item) override {
+      while (_upstream->poll(item)) {
+        if (!item || _predicate(*item)) return true;
+      }
+
+      return false;
+    }
+
+  private:
+    void pull() {
+      _trampoline.run([this]() {
+        boost::optional<T> item;
+
+        if (poll(item)) {
+          resolve(item);
+        } else {
+          _upstream->next().then(Receive{ this->shared_from_this() });
+        }
+      });
+    }
+
+    void receive(boost::optional<T>& item) {
+      if (item && !_predicate(*item)) return pull();
+      resolve(item);
+    }
+
+    void resolve(boost::optional<T>& item) {
+      auto promise = std::move(_promise);
+      promise.set_value(std::move(item));
+    }
+
+    typedef Bind<Filter, boost::optional<T>, void, &Filter::receive> Receive;
+
+  private:
+    std::shared_ptr<Source<T>> _upstream;
+    P                          _predicate;
+    Trampoline                 _trampoline;
+    Promise<boost::optional<T>> _promise;
+  };
+
+  //----------------------------------------------------------------------------
+  template<typename T>
+  class Take : public Source<T> {
+  public:
+    Take(std::shared_ptr<Source<T>> upstream, std::size_t count)
+      : _upstream(std::move(upstream)), _left(count)
+    {}
+
+    Future<boost::optional<T>> next() override {
+      if (_left == 0) return ::fry::make_ready_future(boost::optional<T>());
+
+      --_left;
+      return _upstream->next();
+    }
+
+    bool poll(boost::optional<T>& item) override {
+      if (_left == 0) {
+        item = boost::none;
+        return true;
+      }
+
+      if (!_upstream->poll(item)) return false;
+
+      --_left;
+      return true;
+    }
+
+  private:
+    std::shared_ptr<Source<T>> _upstream;
+    std::size_t                _left;
+  };
+
+  //----------------------------------------------------------------------------
+  template<typename T>
+  class Buffer : public Source<T>
+               , public std::enable_shared_from_this<Buffer<T>>
+  {
+  public:
+    Buffer(std::shared_ptr<Source<T>> upstream, std::size_t size)
+      : _upstream(std::move(upstream))
+      , _size(size)
+      , _ended(false)
+      , _requesting(false)
+      , _waiting(false)
+    {
+      assert(size > 0);
+    }
+
+    Future<boost::optional<T>> next() override {
+      Promise<boost::optional<T>> promise;
+      boost::optional<T>          item;
+      bool                        ready  = true;
+      auto                        result = promise.get_future();
+
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        if (!_items.empty()) {
+          item = std::move(_items.front());
+          _items.pop_front();
+        } else if (!_ended) {
+          _promise = std::move(promise);
+          _waiting = true;
+          ready    = false;
+        }
+      }
+
+      if (ready) promise.set_value(std::move(item));
+
+      fill();
+      return result;
+    }
+
+    bool poll(boost::optional<T>& item) override {
+      fill();
+
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        if (!_items.empty()) {
+          item = std::move(_items.front());
+          _items.pop_front();
+        } else if (_ended) {
+          item = boost::none;
+        } else {
+          return false;
+        }
+      }
+
+      fill();
+      return true;
+    }
+
+  private:
+    // Reads ahead, one value at a time, until the buffer is full.
+    void fill() {
+      _trampoline.run([this]() {
+        {
+          std::lock_guard<std::mutex> lock(_mutex);
+
+          if (_requesting || _ended || _items.size() >= _size) return;
+          _requesting = true;
+        }
+
+        boost::optional<T> item;
+
+        if (_upstream->poll(item)) {
+          receive(item);
+        } else {
+          _upstream->next().then(Receive{ this->shared_from_this() });
+        }
+      });
+    }
+
+    void receive(boost::optional<T>& item) {
+      std::unique_lock<std::mutex> lock(_mutex);
+
+      _requesting = false;
+      if (!item) _ended = true;
+
+      if (_waiting) {
+        _waiting = false;
+
+        auto promise = std::move(_promise);
+        lock.unlock();
+
+        promise.set_value(std::move(item));
+      } else {
+        if (item) _items.push_back(std::move(*item));
+        lock.unlock();
+      }
+
+      fill();
+    }
+
+    typedef Bind<Buffer, boost::optional<T>, void, &Buffer::receive> Receive;
+
+  private:
+    std::shared_ptr<Source<T>>  _upstream;
+    const std::size_t           _size;
+    Trampoline                  _trampoline;
+
+    std::mutex                  _mutex;
+    std::deque<T>               _items;
+    bool                        _ended;
+    bool                        _requesting;
+    bool                        _waiting;
+    Promise<boost::optional<T>> _promise;
+  };
+
+  //----------------------------------------------------------------------------
+  // Scheduler of a batch without a timeout. Never used.
+  struct NoScheduler {
+    template<typename F> void dispatch(F&&) {}
+
+    Future<void> sleep_until(Clock::time_point) {
+      return ::fry::make_ready_future();
+    }
+  };
+
+  template<typename T, typename Scheduler>
+  class Batch : public Source<std::vector<T>>
+              , public std::enable_shared_from_this<Batch<T, Scheduler>>
+  {
+    typedef std::vector<T>            Values;
+    typedef boost::optional<Values>   Item;
+
+  public:
+    Batch( std::shared_ptr<Source<T>> upstream
+         , std::size_t                size
+         , Clock::duration            timeout
+         , Scheduler*                 scheduler)
+      : _upstream(std::move(upstream))
+      , _size(size)
+      , _timeout(timeout)
+      , _scheduler(scheduler)
+      , _ended(false)
+      , _requesting(false)
+      , _waiting(false)
+      , _due(false)
+      , _generation(0)
+    {
+      assert(size > 0);
+    }
+
+    Future<Item> next() override {
+      Promise<Item> promise;
+      Item          batch;
+      bool          ready  = true;
+      auto          result = promise.get_future();
+
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        if (!_values.empty() && (_values.size() >= _size || _due || _ended)) {
+          batch = take();
+        } else if (!_ended) {
+          _promise = std::move(promise);
+          _waiting = true;
+          ready    = false;
+        }
+      }
+
+      if (ready) promise.set_value(std::move(batch));
+
+      fill();
+      return result;
+    }
+
+    bool poll(Item& batch) override {
+      fill();
+
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        if (!_values.empty() && (_values.size() >= _size || _due || _ended)) {
+          batch = take();
+        } else if (_ended) {
+          batch = boost::none;
+        } else {
+          return false;
+        }
+      }
+
+      fill();
+      return true;
+    }
+
+  private:
+    // The values collected so far, as one batch. Called under the lock.
+    Item take() {
+      Item result(std::move(_values));
+
+      _values.clear();
+      _due = false;
+      ++_generation;
+
+      return result;
+    }
+
+    // Collects values until the batch is full.
+    void fill() {
+      _trampoline.run([this]() {
+        {
+          std::lock_guard<std::mutex> lock(_mutex);
+
+          if (_requesting || _ended || _values.size() >= _size) return;
+          _requesting = true;
+        }
+
+        boost::optional<T> item;
+
+        if (_upstream->poll(item)) {
+          receive(item);
+        } else {
+          _upstream->next().then(Receive{ this->shared_from_this() });
+        }
+      });
+    }
+
+    void receive(boost::optional<T>& item) {
+      std::unique_lock<std::mutex> lock(_mutex);
+
+      bool arm = false;
+
+      _requesting = false;
+
+      if (item) {
+        _values.push_back(std::move(*item));
+        arm = _values.size() == 1 && _values.size() < _size && _scheduler;
+      } else {
+        _ended = true;
+      }
+
+      auto generation = _generation;
+
+      if (_waiting && (_values.size() >= _size || _ended)) {
+        _waiting = false;
+
+        auto promise = std::move(_promise);
+        auto batch   = _values.empty() ? Item() : take();
+        lock.unlock();
+
+        if (arm) this->arm(generation);
+        promise.set_value(std::move(batch));
+      } else {
+        lock.unlock();
+        if (arm) this->arm(generation);
+      }
+
+      fill();
+    }
+
+    typedef Bind<Batch, boost::optional<T>, void, &Batch::receive> Receive;
+
+    void arm(std::size_t generation) {
+      std::weak_ptr<Batch> weak      = this->shared_from_this();
+      auto&                scheduler = *_scheduler;
+      auto                 deadline  = Clock::now() + _timeout;
+
+      scheduler.dispatch([weak, &scheduler, deadline, generation]() {
+        scheduler.sleep_until(deadline).then([weak, generation]() {
+          if (auto self = weak.lock()) self->expire(generation);
+        });
+      });
+    }
+
+    // The batch of the given generation is due, if it was not given out yet.
+    void expire(std::size_t generation) {
+      Promise<Item> promise;
+      Item          batch;
+
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        if (generation != _generation || _values.empty()) return;
+
+        if (!_waiting) {
+          _due = true;
+          return;
+        }
+
+        _waiting = false;
+        promise  = std::move(_promise);
+        batch    = take();
+      }
+
+      promise.set_value(std::move(batch));
+
+      fill();
+    }
+
+  private:
+    std::shared_ptr<Source<T>> _upstream;
+    const std::size_t          _size;
+    const Clock::duration      _timeout;
+    Scheduler*                 _scheduler;
+    Trampoline                 _trampoline;
+
+    std::mutex                 _mutex;
+    Values                     _values;
+    bool                       _ended;
+    bool                       _requesting;
+    bool                       _waiting;
+    bool                       _due;
+    std::size_t                _generation;
+    Promise<Item>              _promise;
+  };
+
+  //----------------------------------------------------------------------------
+  template<typename T, typename F>
+  class ForEach : public std::enable_shared_from_this<ForEach<T, F>> {
+  public:
+    ForEach(std::shared_ptr<Source<T>> upstream, F fun)
+      : _upstream(std::move(upstream)), _fun(std::move(fun))
+    {}
+
+    Future<void> start() {
+      auto result = _done.get_future();
+      pull();
+      return result;
+    }
+
+  private:
+    struct Continue {
+      std::shared_ptr<ForEach> self;
+      void operator () () const { self->pull(); }
+    };
+
+    void pull() {
+      _trampoline.run([this]() {
+        boost::optional<T> item;
+
+        while (_upstream->poll(item)) {
+          if (!deliver(item)) return;
+        }
+
+        _upstream->next().then(Receive{ this->shared_from_this() });
+      });
+    }
+
+    void receive(boost::optional<T>& item) {
+      if (deliver(item)) pull();
+    }
+
+    // Passes the item to fun. Returns whether the next one may be pulled right
+    // away.
+    bool deliver(boost::optional<T>& item) {
+      if (!item) {
+        _done.set_value();
+        return false;
+      }
+
+      return call(item, is_future<result_of<F, T>>());
+    }
+
+    bool call(boost::optional<T>& item, std::false_type) {
+      _fun(std::move(*item));
+      return true;
+    }
+
+    bool call(boost::optional<T>& item, std::true_type) {
+      _fun(std::move(*item)).then(Continue{ this->shared_from_this() });
+      return false;
+    }
+
+    typedef Bind<ForEach, boost::optional<T>, void, &ForEach::receive> Receive;
+
+  private:
+    std::shared_ptr<Source<T>> _upstream;
+    F                          _fun;
+    Trampoline                 _trampoline;
+    Promise<void>              _done;
+  };
+}} // namespace detail::stream
+
+////////////////////////////////////////////////////////////////////////////////
+template<typename T>
+class AsyncStream {
+public:
+  typedef T                  value_type;
+  typedef boost::optional<T> Item;
+
+  explicit AsyncStream(std::shared_ptr<detail::stream::Source<T>> source)
+    : _source(std::move(source))
+  {}
+
+  // Only once the future of the previous call is ready.
+  Future<Item> next() {
+    return _source->next();
+  }
+
+  // Takes the next value (or none at the end), if it is there right away,
+  // without a future. Returns false if it is not, and next() is to be used.
+  bool poll(Item& item) {
+    return _source->poll(item);
+  }
+
+  template<typename F>
+  AsyncStream<remove_future<result_of<F, T>>> map(F fun) const {
+    typedef detail::stream::Map<T, F> Map;
+    return AsyncStream<remove_future<result_of<F, T>>>(
+      std::make_shared<Map>(_source, std::move(fun)));
+  }
+
+  template<typename P>
+  AsyncStream<T> filter(P predicate) const {
+    return AsyncStream<T>(std::make_shared<detail::stream::Filter<T, P>>(
+      _source, std::move(predicate)));
+  }
+
+  AsyncStream<T> take(std::size_t count) const {
+    return AsyncStream<T>(std::make_shared<detail::stream::Take<T>>(
+      _source, count));
+  }
+
+  // A buffer of size 0 reads nothing ahead, so the stream is passed through.
+  AsyncStream<T> buffer(std::size_t size) const {
+    if (size == 0) return *this;
+
+    return AsyncStream<T>(std::make_shared<detail::stream::Buffer<T>>(
+      _source, size));
+  }
+
+  AsyncStream<std::vector<T>> batch(std::size_t size) const {
+    typedef detail::stream::NoScheduler               Scheduler;
+    typedef detail::stream::Batch<T, Scheduler>       Batch;
+
+    return AsyncStream<std::vector<T>>(std::make_shared<Batch>(
+      _source, size, detail::stream::Clock::duration::max(), nullptr));
+  }
+
+  template<typename Rep, typename Period, typename Scheduler>
+  AsyncStream<std::vector<T>> batch( std::size_t                        size
+                                   , std::chrono::duration<Rep, Period> timeout
+                                   , Scheduler&                         scheduler) const
+  {
+    typedef detail::stream::Batch<T, Scheduler> Batch;
+
+    return AsyncStream<std::vector<T>>(std::make_shared<Batch>(
+        _source, size
+      , std::chrono::duration_cast<detail::stream::Clock::duration>(timeout)
+      , &scheduler));
+  }
+
+  // f(value) returns void or Future<void>.
+  template<typename F>
+  Future<void> for_each(F fun) const {
+    typedef detail::stream::ForEach<T, F> ForEach;
+    return std::make_shared<ForEach>(_source, std::move(fun))->start();
+  }
+
+private:
+  std::shared_ptr<detail::stream::Source<T>> _source;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Stream of the values fun() returns, until it returns none. fun returns
+// boost::optional<T>, or a future of it.
+template<typename F>
+AsyncStream<typename remove_future<result_of<F>>::value_type>
+generate(F fun) {
+  typedef typename remove_future<result_of<F>>::value_type T;
+
+  return AsyncStream<T>(std::make_shared<detail::stream::Generate<T, F>>(
+    std::move(fun)));
+}
+
+// Stream of the values sent to the channel, until it is closed and drained.
+template<typename T>
+AsyncStream<T> from_channel(std::shared_ptr<Channel<T>> channel) {
+  return generate([channel]() { return channel->receive(); });
+}
+
+} // namespace fry
+
+#endif // __FRY__STREAM_H__
@@ -0,0 +1,500 @@
+//
+// Copyright (c) 2014 Adam Cigánek (adam.ciganek@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef __FRY__SYNCHRONIZATION_H__
+#define __FRY__SYNCHRONIZATION_H__
+
+// Synchronization primitives for continuations: instead of blocking the
+// thread, waiting returns a future.
+//
+// AsyncMutex - lock() returns a future of a Guard, which holds the mutex
+// until it (and every copy of it) is gone:
+//
+//   mutex.lock().then([&](const AsyncMutex::Guard& guard) {
+//     // exclusive access, until the end of this continuation...
+//     return write(data).then([guard]() {
+//       // ...or, with a copy of the guard, until here.
+//     });
+//   });
+//
+// AsyncSemaphore - acquire(n) resolves once n permits are available and
+// takes them; release(n) gives them back.
+//
+// AsyncLatch - wait() resolves once count_down() was called count times.
+//
+// AsyncBarrier - arrive_and_wait() resolves once all count participants
+// arrived, then the barrier is ready for the next round.
+//
+// Taking an available mutex or permits is a single compare-and-swap, without
+// allocation and without a lock. Waiters are queued in first-come,
+// first-served order, in an intrusive list of nodes that hold their promises.
+// Releasing hands the resource over to the first waiter directly, resolving
+// its future on the releasing thread (use then_on() to continue elsewhere).
+// A waiter resumed while another one is being resumed on the same thread is
+// resumed after it, so a long line of waiters that each take and release
+// right away does not nest.
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <mutex>
+#include "future.h"
+
+namespace fry {
+
+////////////////////////////////////////////////////////////////////////////////
+namespace detail { namespace sync {
+  // Node of an intrusive list of waiters.
+  struct Waiter {
+    Waiter* next;
+
+    Waiter() : next(nullptr) {}
+    virtual ~Waiter() {}
+
+    // Resolves the future of the waiter and deletes it.
+    virtual void resume() = 0;
+  };
+
+  // Waiter for a Future<void>.
+  struct Signal : Waiter {
+    Promise<void> promise;
+    std::size_t   count;
+
+    explicit Signal(std::size_t count = 0) : count(count) {}
+
+    void resume() override {
+      auto promise = std::move(this->promise);
+      delete this;
+      promise.set_value();
+    }
+  };
+
+  // Resumes the waiter, unless another waiter is being resumed on this thread
+  // already, in which case it is resumed right after that one.
+  inline void resume(Waiter* waiter) {
+    struct Queue {
+      bool    running;
+      Waiter* head;
+      Waiter* tail;
+    };
+
+    static thread_local Queue queue = { false, nullptr, nullptr };
+
+    waiter->next = nullptr;
+
+    if (queue.running) {
+      (queue.tail ? queue.tail->next : queue.head) = waiter;
+      queue.tail = waiter;
+      return;
+    }
+
+    queue.running = true;
+    waiter->resume();
+
+    while (queue.head) {
+      auto next  = queue.head;
+      queue.head = next->next;
+      if (!queue.head) queue.tail = nullptr;
+
+      next->resume();
+    }
+
+    queue.running = false;
+  }
+
+  // Resumes the waiters of a list pushed to at the front, in the order they
+  // were pushed.
+  inline void resume_all(Waiter* stack) {
+    Waiter* list = nullptr;
+
+    while (stack) {
+      auto next   = stack->next;
+      stack->next = list;
+      list        = stack;
+      stack       = next;
+    }
+
+    while (list) {
+      auto next = list->next;
+      resume(list);
+      list = next;
+    }
+  }
+
+  // Pushes the waiter to the front of the list, unless the list is closed
+  // (its head is the given marker). Returns false if it is.
+  inline bool push( std::atomic<Waiter*>& list, Waiter* waiter
+                  , Waiter* closed = nullptr)
+  {
+    auto head = list.load(std::memory_order_acquire);
+
+    do {
+      if (closed && head == closed) return false;
+      waiter->next = head;
+    } while (!list.compare_exchange_weak( head, waiter
+                                        , std::memory_order_acq_rel
+                                        , std::memory_order_acquire));
+
+    return true;
+  }
+}} // namespace detail::sync
+
+////////////////////////////////////////////////////////////////////////////////
+class AsyncMutex {
+public:
+  // Shared hold of the mutex. Copies hold it too; it is unlocked when the
+  // last of them is destroyed or unlocked.
+  class Guard {
+  public:
+    Guard(const Guard& other) : _mutex(other._mutex) {
+      if (_mutex) _mutex->_holders.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    Guard(Guard&& other) : _mutex(other._mutex) {
+      other._mutex = nullptr;
+    }
+
+    ~Guard() {
+      unlock();
+    }
+
+    Guard& operator = (Guard other) {
+      std::swap(_mutex, other._mutex);
+      return *this;
+    }
+
+    // Gives up this hold before the guard is destroyed.
+    void unlock() {
+      if (_mutex && _mutex->_holders.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        _mutex->unlock();
+      }
+
+      _mutex = nullptr;
+    }
+
+    bool owns_lock() const {
+      return _mutex != nullptr;
+    }
+
+  private:
+    explicit Guard(AsyncMutex* mutex) : _mutex(mutex) {}
+
+    friend class AsyncMutex;
+
+  private:
+    AsyncMutex* _mutex;
+  };
+
+  AsyncMutex()
+    : _state(unlocked())
+    , _waiters(nullptr)
+    , _holders(0)
+  {}
+
+  AsyncMutex(const AsyncMutex&) = delete;
+  AsyncMutex& operator = (const AsyncMutex&) = delete;
+
+  ~AsyncMutex() {
+    assert(_state.load() == unlocked());
+  }
+
+  Future<Guard> lock() {
+    auto state = unlocked();
+
+    if (_state.compare_exchange_strong( state, nullptr
+                                      , std::memory_order_acquire
+                                      , std::memory_order_relaxed))
+    {
+      return make_ready_future(adopt());
+    }
+
+    auto waiter = new LockWaiter(this);
+    auto result = waiter->promise.get_future();
+
+    for (;;) {
+      if (state == unlocked()) {
+        if (_state.compare_exchange_weak( state, nullptr
+                                        , std::memory_order_acquire
+                                        , std::memory_order_relaxed))
+        {
+          detail::sync::resume(waiter);
+          break;
+        }
+      } else {
+        waiter->next = state;
+
+        if (_state.compare_exchange_weak( state, waiter
+                                        , std::memory_order_release
+                                        , std::memory_order_relaxed))
+        {
+          break;
+        }
+      }
+    }
+
+    return result;
+  }
+
+  bool is_locked() const {
+    return _state.load(std::memory_order_relaxed) != unlocked();
+  }
+
+private:
+  typedef detail::sync::Waiter Waiter;
+
+  struct LockWaiter : Waiter {
+    AsyncMutex*    mutex;
+    Promise<Guard> promise;
+
+    explicit LockWaiter(AsyncMutex* mutex) : mutex(mutex) {}
+
+    void resume() override {
+      auto mutex   = this->mutex;
+      auto promise = std::move(this->promise);
+      delete this;
+      promise.set_value(mutex->adopt());
+    }
+  };
+
+  // Any address that is not a waiter.
+  Waiter* unlocked() const {
+    return reinterpret_cast<Waiter*>(const_cast<AsyncMutex*>(this));
+  }
+
+  Guard adopt() {
+    _holders.store(1, std::memory_order_relaxed);
+    return Guard(this);
+  }
+
+  // Called by the holder. Hands the mutex over to the first waiter, if any.
+  void unlock() {
+    if (!_waiters) {
+      Waiter* state = nullptr;
+
+      if (_state.compare_exchange_strong( state, unlocked()
+                                        , std::memory_order_release
+                                        , std::memory_order_relaxed))
+      {
+        return;
+      }
+
+      // Waiters came since the last unlock. Take them all, in the order they
+      // came.
+      auto stack = _state.exchange(nullptr, std::memory_order_acquire);
+
+      while (stack) {
+        auto next   = stack->next;
+        stack->next = _waiters;
+        _waiters    = stack;
+        stack       = next;
+      }
+    }
+
+    auto waiter = _waiters;
+    _waiters    = waiter->next;
+
+    detail::sync::resume(waiter);
+  }
+
+private:
+  // unlocked(), nullptr when locked, or else the waiters that came since the
+  // last unlock, the latest first.
+  std::atomic<Waiter*>     _state;
+
+  // Waiters taken from _state, the first first. Owned by the holder.
+  Waiter*                  _waiters;
+  std::atomic<std::size_t> _holders;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Counting semaphore. Waiters are served strictly in order: one waiting for
+// more permits than are available holds up those behind it.
+class AsyncSemaphore {
+public:
+  explicit AsyncSemaphore(std::size_t count)
+    : _count(count)
+    , _num_waiting(0)
+    , _head(nullptr)
+    , _tail(nullptr)
+  {}
+
+  AsyncSemaphore(const AsyncSemaphore&) = delete;
+  AsyncSemaphore& operator = (const AsyncSemaphore&) = delete;
+
+  ~AsyncSemaphore() {
+    assert(_head == nullptr);
+  }
+
+  Future<void> acquire(std::size_t n = 1) {
+    if (_num_waiting.load() == 0 && take(n)) return make_ready_future();
+
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    // Either this sees the permits of a concurrent release(), or the release
+    // sees this waiter.
+    _num_waiting.fetch_add(1);
+
+    if (!_head && take(n)) {
+      _num_waiting.fetch_sub(1);
+      return make_ready_future();
+    }
+
+    auto waiter = new detail::sync::Signal(n);
+    auto result = waiter->promise.get_future();
+
+    (_tail ? _tail->next : _head) = waiter;
+    _tail = waiter;
+
+    return result;
+  }
+
+  bool try_acquire(std::size_t n = 1) {
+    return _num_waiting.load() == 0 && take(n);
+  }
+
+  void release(std::size_t n = 1) {
+    _count.fetch_add(n);
+    if (_num_waiting.load() == 0) return;
+
+    detail::sync::Waiter* ready = nullptr;
+
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+
+      while (_head && take(static_cast<detail::sync::Signal*>(_head)->count)) {
+        auto waiter = _head;
+
+        _head = waiter->next;
+        if (!_head) _tail = nullptr;
+
+        _num_waiting.fetch_sub(1);
+
+        waiter->next = ready;
+        ready        = waiter;
+      }
+    }
+
+    detail::sync::resume_all(ready);
+  }
+
+  std::size_t available() const {
+    return _count.load(std::memory_order_relaxed);
+  }
+
+  std::size_t num_waiting() const {
+    return _num_waiting.load(std::memory_order_relaxed);
+  }
+
+private:
+  bool take(std::size_t n) {
+    auto count = _count.load();
+
+    do {
+      if (count < n) return false;
+    } while (!_count.compare_exchange_weak(count, count - n));
+
+    return true;
+  }
+
+private:
+  std::atomic<std::size_t> _count;
+  std::atomic<std::size_t> _num_waiting;
+
+  // Waiters, the first first.
+  std::mutex               _mutex;
+  detail::sync::Waiter*    _head;
+  detail::sync::Waiter*    _tail;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Single-use countdown: wait() resolves once the count reaches zero.
+class AsyncLatch {
+public:
+  explicit AsyncLatch(std::size_t count)
+    : _count(count)
+    , _waiters(count == 0 ? released() : nullptr)
+  {}
+
+  AsyncLatch(const AsyncLatch&) = delete;
+  AsyncLatch& operator = (const AsyncLatch&) = delete;
+
+  // Must not be called more than count times in total.
+  void count_down(std::size_t n = 1) {
+    if (_count.fetch_sub(n, std::memory_order_acq_rel) == n) {
+      detail::sync::resume_all(
+        _waiters.exchange(released(), std::memory_order_acq_rel));
+    }
+  }
+
+  bool is_ready() const {
+    return _waiters.load(std::memory_order_acquire) == released();
+  }
+
+  Future<void> wait() {
+    if (is_ready()) return make_ready_future();
+
+    auto waiter = new detail::sync::Signal;
+    auto result = waiter->promise.get_future();
+
+    if (!detail::sync::push(_waiters, waiter, released())) {
+      detail::sync::resume(waiter);
+    }
+
+    return result;
+  }
+
+private:
+  detail::sync::Waiter* released() const {
+    return reinterpret_cast<detail::sync::Waiter*>(const_cast<AsyncLatch*>(this));
+  }
+
+private:
+  std::atomic<std::size_t>           _count;
+  std::atomic<detail::sync::Waiter*> _waiters;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Reusable barrier of a fixed number of participants, each of which must wait
+// for a round to complete before arriving for the next one.
+class AsyncBarrier {
+public:
+  explicit AsyncBarrier(std::size_t count)
+    : _count(count)
+    , _remaining(count)
+    , _waiters(nullptr)
+  {
+    assert(count > 0);
+  }
+
+  AsyncBarrier(const AsyncBarrier&) = delete;
+  AsyncBarrier& operator = (const AsyncBarrier&) = delete;
+
+  Future<void> arrive_and_wait() {
+    auto waiter = new detail::sync::Signal;
+    auto result = waiter->promise.get_future();
+
+    // Queued before arriving, so the last to arrive finds everyone.
+    detail::sync::push(_waiters, waiter);
+
+    if (_remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      _remaining.store(_count, std::memory_order_relaxed);
+      detail::sync::resume_all(
+        _waiters.exchange(nullptr, std::memory_order_acq_rel));
+    }
+
+    return result;
+  }
+
+private:
+  const std::size_t                  _count;
+  std::atomic<std::size_t>           _remaining;
+  std::atomic<detail::sync::Waiter*> _waiters;
+};
+
+} // namespace fry
+
+#endif // __FRY__SYNCHRONIZATION_H__
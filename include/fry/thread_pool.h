@@ -0,0 +1,243 @@
+//
+// Copyright (c) 2014 Adam Cigánek (adam.ciganek@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef __FRY__THREAD_POOL_H__
+#define __FRY__THREAD_POOL_H__
+
+// ThreadPool - fixed set of worker threads running submitted tasks.
+//
+// Every worker has its own deque of tasks. Tasks submitted from a worker
+// thread go to the back of that worker's deque and the worker takes them from
+// the back too, so freshly forked work runs while its data is still in cache.
+// Tasks submitted from other threads go to a shared queue. A worker whose
+// deque is empty takes from the shared queue, and after that steals from the
+// front of the other workers' deques, where the oldest (and usually largest)
+// tasks are.
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <thread>
+#include <vector>
+#include "future.h"
+
+namespace fry {
+
+class ThreadPool {
+public:
+
+  explicit ThreadPool(std::size_t num_threads = default_size())
+    : _queues(num_threads > 0 ? num_threads : 1)
+    , _num_tasks(0)
+    , _num_sleeping(0)
+    , _stopping(false)
+  {
+    _threads.reserve(_queues.size());
+
+    for (std::size_t i = 0; i < _queues.size(); ++i) {
+      _threads.emplace_back([this, i]() { run(i); });
+    }
+  }
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator = (const ThreadPool&) = delete;
+
+  // Runs the tasks that are still queued, then joins the threads.
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(_sleep_mutex);
+      _stopping = true;
+    }
+
+    _wakeup.notify_all();
+
+    for (auto& thread : _threads) {
+      thread.join();
+    }
+  }
+
+  std::size_t size() const {
+    return _threads.size();
+  }
+
+  // Number of tasks waiting to be picked up by a worker. Only a hint, as it
+  // changes as soon as it is read.
+  std::size_t num_queued() const {
+    return _num_tasks;
+  }
+
+  // Whether the calling thread is one of the workers of this pool.
+  bool running_in_this_thread() const {
+    return current().pool == this;
+  }
+
+  // Runs fun() on the pool. Returns a future of its result.
+  template<typename F>
+  add_future<result_of<F>> submit(F&& fun) {
+    using C = detail::Continuation<remove_reference<F>>;
+
+    auto task   = new C(std::forward<F>(fun));
+    auto result = task->get_future();
+
+    push(Task(task));
+    return result;
+  }
+
+  // Like submit(), but without the future.
+  template<typename F>
+  void post(F&& fun) {
+    push(Task(new Callable<remove_reference<F>>(std::forward<F>(fun))));
+  }
+
+  // Runs fun() right away when called from a worker of this pool, otherwise
+  // like post(). Makes the pool usable as the executor of Future::then_on.
+  template<typename F>
+  void dispatch(F&& fun) {
+    if (running_in_this_thread()) {
+      fun();
+    } else {
+      post(std::forward<F>(fun));
+    }
+  }
+
+private:
+  typedef std::unique_ptr<detail::ContinuationBase<>> Task;
+
+  template<typename F>
+  class Callable : public detail::ContinuationBase<> {
+  public:
+    template<typename G>
+    explicit Callable(G&& fun) : _fun(std::forward<G>(fun)) {}
+
+    void operator () () override {
+      _fun();
+    }
+
+  private:
+    F _fun;
+  };
+
+  struct Queue {
+    std::mutex       mutex;
+    std::deque<Task> tasks;
+    char             padding[64];
+  };
+
+  struct Current {
+    const ThreadPool* pool;
+    std::size_t       index;
+  };
+
+  static std::size_t default_size() {
+    auto n = std::thread::hardware_concurrency();
+    return n > 0 ? n : 1;
+  }
+
+  static Current& current() {
+    static thread_local Current current = { nullptr, 0 };
+    return current;
+  }
+
+  //----------------------------------------------------------------------------
+  void push(Task task) {
+    auto& current = ThreadPool::current();
+
+    if (current.pool == this) {
+      auto& queue = _queues[current.index];
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      queue.tasks.push_back(std::move(task));
+    } else {
+      std::lock_guard<std::mutex> lock(_shared.mutex);
+      _shared.tasks.push_back(std::move(task));
+    }
+
+    ++_num_tasks;
+
+    // Sleeping workers register themselves before checking _num_tasks, so
+    // either they see the new task, or we see them here.
+    if (_num_sleeping > 0) {
+      { std::lock_guard<std::mutex> lock(_sleep_mutex); }
+      _wakeup.notify_one();
+    }
+  }
+
+  Task pop(std::size_t index) {
+    Task task;
+
+    if (   take_back(_queues[index], task)
+        || take_front(_shared, task))
+    {
+      return task;
+    }
+
+    for (std::size_t i = 1; i < _queues.size(); ++i) {
+      if (take_front(_queues[(index + i) % _queues.size()], task)) {
+        return task;
+      }
+    }
+
+    return task;
+  }
+
+  bool take_back(Queue& queue, Task& task) {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) return false;
+
+    task = std::move(queue.tasks.back());
+    queue.tasks.pop_back();
+    --_num_tasks;
+    return true;
+  }
+
+  bool take_front(Queue& queue, Task& task) {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) return false;
+
+    task = std::move(queue.tasks.front());
+    queue.tasks.pop_front();
+    --_num_tasks;
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  void run(std::size_t index) {
+    current() = Current{ this, index };
+
+    for (;;) {
+      if (auto task = pop(index)) {
+        (*task)();
+        continue;
+      }
+
+      std::unique_lock<std::mutex> lock(_sleep_mutex);
+      ++_num_sleeping;
+
+      _wakeup.wait(lock, [this]() { return _num_tasks > 0 || _stopping; });
+
+      --_num_sleeping;
+
+      if (_stopping && _num_tasks == 0) {
+        break;
+      }
+    }
+  }
+
+private:
+  std::vector<Queue>       _queues;
+  Queue                    _shared;
+  std::vector<std::thread> _threads;
+
+  std::atomic<std::size_t> _num_tasks;
+  std::atomic<std::size_t> _num_sleeping;
+  bool                     _stopping;
+  std::mutex               _sleep_mutex;
+  std::condition_variable  _wakeup;
+};
+
+} // namespace fry
+
+#endif // __FRY__THREAD_POOL_H__
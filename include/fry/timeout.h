@@ -0,0 +1,281 @@
+//
+// Copyright (c) 2014 Adam Cigánek (adam.ciganek@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef __FRY__TIMEOUT_H__
+#define __FRY__TIMEOUT_H__
+
+// Deadlines for asynchronous socket operations.
+//
+// with_timeout(socket, op, timeout) starts the operation by calling op() and
+// arms a timer. If the timer fires first, it cancels the operations on the
+// socket, and the returned future fails with error::timed_out instead of
+// operation_aborted. If the operation completes first, the timer is
+// cancelled:
+//
+//   asio::with_timeout(socket, [&]() {
+//     return socket.async_receive_from(buffer, sender, asio::use_future);
+//   }, std::chrono::seconds(1)).then([](const asio::Result<std::size_t>& result) {
+//     // fails with error::timed_out when nothing came in time
+//   });
+//
+// socket.cancel() cancels all the operations on the socket, not only the one
+// that timed out, so other operations in flight on the same socket fail with
+// operation_aborted too.
+//
+// A TimerPool keeps the timers for reuse, so a steady stream of operations
+// with deadlines does not create and destroy a timer for each:
+//
+//   asio::TimerPool timers(io_service);
+//   asio::with_timeout(socket, op, timeout, timers);
+//
+// Like the socket itself, the deadline must not be used from more than one
+// thread at a time (use a strand when the io_service runs on several).
+//
+// A Sleeper resolves futures after a delay, on pooled timers:
+//
+//   asio::Sleeper sleeper(io_service);
+//   sleeper.sleep_for(std::chrono::milliseconds(10)).then(...);
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <boost/version.hpp>
+#include <boost/asio/error.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include "asio.h"
+#include "future_result.h"
+
+namespace fry { namespace asio {
+
+////////////////////////////////////////////////////////////////////////////////
+// Timers of one io_service, kept for reuse. Timers that are in use when the
+// pool is destroyed are simply destroyed when released.
+class TimerPool {
+private:
+  struct Shared {
+    std::mutex                                              mutex;
+    std::vector<std::unique_ptr<boost::asio::steady_timer>> idle;
+    std::size_t                                             max_idle;
+    bool                                                    closed;
+  };
+
+  struct Release {
+    std::shared_ptr<Shared> shared;
+
+    void operator () (boost::asio::steady_timer* timer) const {
+      std::unique_ptr<boost::asio::steady_timer> owned(timer);
+      if (!shared) return;
+
+      std::lock_guard<std::mutex> lock(shared->mutex);
+
+      if (!shared->closed && shared->idle.size() < shared->max_idle) {
+        shared->idle.push_back(std::move(owned));
+      }
+    }
+  };
+
+public:
+  typedef std::unique_ptr<boost::asio::steady_timer, Release> Timer;
+
+  explicit TimerPool( boost::asio::io_service& io_service
+                    , std::size_t              max_idle = 1024)
+    : _io_service(io_service)
+    , _shared(std::make_shared<Shared>())
+  {
+    _shared->max_idle = max_idle;
+    _shared->closed   = false;
+  }
+
+  TimerPool(const TimerPool&) = delete;
+  TimerPool& operator = (const TimerPool&) = delete;
+
+  ~TimerPool() {
+    std::lock_guard<std::mutex> lock(_shared->mutex);
+    _shared->closed = true;
+    _shared->idle.clear();
+  }
+
+  // A timer that goes back to the pool when released.
+  Timer acquire() {
+    std::unique_ptr<boost::asio::steady_timer> timer;
+
+    {
+      std::lock_guard<std::mutex> lock(_shared->mutex);
+
+      if (!_shared->idle.empty()) {
+        timer = std::move(_shared->idle.back());
+        _shared->idle.pop_back();
+      }
+    }
+
+    if (!timer) timer.reset(new boost::asio::steady_timer(_io_service));
+
+    return Timer(timer.release(), Release{ _shared });
+  }
+
+  // A timer on the given io_service (or executor) that is not pooled.
+  template<typename Context>
+  static Timer unpooled(Context& context) {
+    return Timer(new boost::asio::steady_timer(context), Release());
+  }
+
+  std::size_t num_idle() const {
+    std::lock_guard<std::mutex> lock(_shared->mutex);
+    return _shared->idle.size();
+  }
+
+private:
+  boost::asio::io_service& _io_service;
+  std::shared_ptr<Shared>  _shared;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Sleeping on an io_service: sleep_until() returns a future resolved when the
+// time comes, on a timer from the pool. Together with post() and dispatch(),
+// which forward to the io_service, it serves as the scheduler for things
+// written against a Reactor, like RateLimiter.
+class Sleeper {
+public:
+  typedef std::chrono::steady_clock Clock;
+
+  explicit Sleeper(boost::asio::io_service& io_service)
+    : _io_service(io_service)
+    , _timers(io_service)
+  {}
+
+  // Resolved also if the wait is cancelled (but not if the io_service is
+  // destroyed first).
+  fry::Future<void> sleep_until(Clock::time_point deadline) {
+    auto timer   = std::make_shared<TimerPool::Timer>(_timers.acquire());
+    auto promise = std::make_shared<Promise<void>>();
+
+    (*timer)->expires_at(deadline);
+    (*timer)->async_wait([timer, promise](const boost::system::error_code&) {
+      promise->set_value();
+    });
+
+    return promise->get_future();
+  }
+
+  template<typename Rep, typename Period>
+  fry::Future<void> sleep_for(std::chrono::duration<Rep, Period> duration) {
+    return sleep_until(Clock::now()
+                     + std::chrono::duration_cast<Clock::duration>(duration));
+  }
+
+  template<typename F>
+  void post(F&& fun) {
+    _io_service.post(std::forward<F>(fun));
+  }
+
+  template<typename F>
+  void dispatch(F&& fun) {
+    _io_service.dispatch(std::forward<F>(fun));
+  }
+
+private:
+  boost::asio::io_service& _io_service;
+  TimerPool                _timers;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+namespace detail {
+  // Which of the operation and the timer came first.
+  enum class Race { pending, completed, timed_out };
+
+  struct Deadline {
+    TimerPool::Timer  timer;
+    std::atomic<Race> race;
+
+    explicit Deadline(TimerPool::Timer timer)
+      : timer(std::move(timer)), race(Race::pending)
+    {}
+  };
+
+  // Whether a result is the failure of a cancelled operation.
+  struct IsAborted {
+    template<typename... T>
+    bool operator () (const T&...) const {
+      return false;
+    }
+
+    bool operator () (const boost::system::error_code& error) const {
+      return error == boost::asio::error::operation_aborted;
+    }
+  };
+
+  template<typename Socket, typename Op, typename Duration>
+  result_of<Op> with_timeout( Socket&          socket
+                            , Op&&             op
+                            , Duration         timeout
+                            , TimerPool::Timer timer)
+  {
+    typedef future_type<result_of<Op>> R;
+
+    auto deadline = std::make_shared<Deadline>(std::move(timer));
+
+    deadline->timer->expires_from_now(timeout);
+    deadline->timer->async_wait(
+      [deadline, &socket](const boost::system::error_code& error) {
+        auto pending = Race::pending;
+
+        if (!error && deadline->race.compare_exchange_strong(pending, Race::timed_out)) {
+          boost::system::error_code ignored;
+          socket.cancel(ignored);
+        }
+      });
+
+    return op().then([deadline](const R& result) {
+      auto pending = Race::pending;
+
+      if (deadline->race.compare_exchange_strong(pending, Race::completed)) {
+        boost::system::error_code ignored;
+        deadline->timer->cancel(ignored);
+      } else if (result.match(IsAborted(), IsAborted())) {
+        return R(boost::system::error_code(boost::asio::error::timed_out));
+      }
+
+      return result;
+    });
+  }
+} // namespace detail
+
+// Calls op() (which starts an operation on the socket and returns its future)
+// and fails the operation with error::timed_out if it does not complete
+// within the timeout.
+template<typename Socket, typename Op, typename Rep, typename Period>
+result_of<Op> with_timeout( Socket&                            socket
+                          , Op&&                               op
+                          , std::chrono::duration<Rep, Period> timeout
+                          , TimerPool&                         timers)
+{
+  return detail::with_timeout( socket, std::forward<Op>(op), timeout
+                             , timers.acquire());
+}
+
+// Like the above, with a timer of its own.
+template<typename Socket, typename Op, typename Rep, typename Period>
+result_of<Op> with_timeout( Socket&                            socket
+                          , Op&&                               op
+                          , std::chrono::duration<Rep, Period> timeout)
+{
+#if BOOST_VERSION >= 107000
+  auto context = socket.get_executor();
+#else
+  auto& context = socket.get_io_service();
+#endif
+
+  return detail::with_timeout( socket, std::forward<Op>(op), timeout
+                             , TimerPool::unpooled(context));
+}
+
+}} // namespace fry::asio
+
+#endif // __FRY__TIMEOUT_H__
@@ -0,0 +1,489 @@
+//
+// Copyright (c) 2014 Adam Cigánek (adam.ciganek@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef __FRY__UDP_BATCH_H__
+#define __FRY__UDP_BATCH_H__
+
+// Batched UDP I/O (Linux only).
+//
+// Batch               - a fixed number of datagram slots in one contiguous
+//                       buffer, together with the message headers the kernel
+//                       needs. It is meant to be reused for the whole life of
+//                       a socket, so receiving and sending allocate nothing.
+//
+// async_receive_batch - receives as many datagrams as are available (up to
+//                       the capacity of the batch) with a single recvmmsg.
+//                       The payloads are views into the batch.
+//
+// async_send_batch    - sends the datagrams of a batch with sendmmsg, each to
+//                       its own endpoint. A received batch holds the senders,
+//                       so echoing it back is just sending it.
+//
+// async_send_segmented - sends a buffer as a series of equally sized
+//                       datagrams to one endpoint. Uses UDP generic
+//                       segmentation offload (UDP_SEGMENT) where the headers
+//                       have it, so the whole series costs one syscall and
+//                       one trip through the stack. Falls back to sendmmsg
+//                       where it does not, or where the kernel rejects it.
+//
+//   asio::Batch batch(64);
+//
+//   asio::async_receive_batch(socket, batch).then([&](std::size_t) {
+//     return asio::async_send_batch(socket, batch);
+//   });
+//
+// The operations wait for the socket with async_wait, then do the syscall
+// without blocking, so they work on sockets in either mode and mix with the
+// regular asio operations.
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <sys/socket.h>
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/error.hpp>
+#include <boost/asio/ip/udp.hpp>
+#include "asio.h"
+#include "future_result.h"
+
+namespace fry { namespace asio {
+
+////////////////////////////////////////////////////////////////////////////////
+class Batch {
+public:
+  typedef boost::asio::ip::udp::endpoint Endpoint;
+
+  explicit Batch(std::size_t capacity, std::size_t max_datagram = 2048)
+    : _max_datagram(max_datagram)
+    , _size(0)
+    , _data(capacity * max_datagram)
+    , _headers(capacity)
+    , _iovecs(capacity)
+    , _addresses(capacity)
+  {
+    for (std::size_t i = 0; i < capacity; ++i) {
+      std::memset(&_headers[i], 0, sizeof(_headers[i]));
+
+      _iovecs[i].iov_base = &_data[i * max_datagram];
+      _iovecs[i].iov_len  = 0;
+
+      _headers[i].msg_hdr.msg_name    = &_addresses[i];
+      _headers[i].msg_hdr.msg_iov     = &_iovecs[i];
+      _headers[i].msg_hdr.msg_iovlen  = 1;
+    }
+  }
+
+  // Moving keeps the payloads where they are, so views stay valid.
+  Batch(Batch&&) = default;
+  Batch& operator = (Batch&&) = default;
+
+  Batch(const Batch&) = delete;
+  Batch& operator = (const Batch&) = delete;
+
+  std::size_t capacity()     const { return _headers.size(); }
+  std::size_t max_datagram() const { return _max_datagram; }
+  std::size_t size()         const { return _size; }
+  bool        empty()        const { return _size == 0; }
+  bool        full()         const { return _size == capacity(); }
+
+  void clear() {
+    _size = 0;
+  }
+
+  // The payload of the i-th datagram. Valid until the slot is reused.
+  boost::asio::const_buffer operator [] (std::size_t i) const {
+    return boost::asio::const_buffer(_iovecs[i].iov_base, _iovecs[i].iov_len);
+  }
+
+  // Where the i-th datagram came from or goes to.
+  Endpoint endpoint(std::size_t i) const {
+    Endpoint result;
+    auto     length = _headers[i].msg_hdr.msg_namelen;
+
+    std::memcpy(result.data(), &_addresses[i], length);
+    result.resize(length);
+
+    return result;
+  }
+
+  void set_endpoint(std::size_t i, const Endpoint& endpoint) {
+    std::memcpy(&_addresses[i], endpoint.data(), endpoint.size());
+    _headers[i].msg_hdr.msg_namelen = endpoint.size();
+  }
+
+  // The free space of the next slot, to build a datagram in place. Call
+  // commit() when it is done. The batch must not be full.
+  boost::asio::mutable_buffer prepare() {
+    return boost::asio::mutable_buffer(_iovecs[_size].iov_base, _max_datagram);
+  }
+
+  void commit(std::size_t length, const Endpoint& to) {
+    _iovecs[_size].iov_len = std::min(length, _max_datagram);
+    set_endpoint(_size, to);
+    ++_size;
+  }
+
+  // Copies the payload into the next slot. Returns false if the batch is
+  // full. Payloads longer than max_datagram are truncated.
+  bool push_back(const boost::asio::const_buffer& payload, const Endpoint& to) {
+    if (full()) return false;
+
+    auto length = std::min(boost::asio::buffer_size(payload), _max_datagram);
+
+    std::memcpy( _iovecs[_size].iov_base
+               , boost::asio::buffer_cast<const char*>(payload)
+               , length);
+    commit(length, to);
+
+    return true;
+  }
+
+  // Receives into the batch without blocking, replacing its content. Returns
+  // the number of datagrams. Fails with would_block if there are none.
+  std::size_t receive(int socket, boost::system::error_code& error) {
+    for (std::size_t i = 0; i < capacity(); ++i) {
+      _iovecs[i].iov_len              = _max_datagram;
+      _headers[i].msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+      _headers[i].msg_hdr.msg_flags   = 0;
+    }
+
+    int result;
+
+    do {
+      result = ::recvmmsg(socket, &_headers[0], capacity(), MSG_DONTWAIT, nullptr);
+    } while (result < 0 && errno == EINTR);
+
+    if (result < 0) {
+      error.assign(errno, boost::system::system_category());
+      _size = 0;
+      return 0;
+    }
+
+    error.clear();
+    _size = result;
+
+    for (std::size_t i = 0; i < _size; ++i) {
+      _iovecs[i].iov_len = _headers[i].msg_len;
+    }
+
+    return _size;
+  }
+
+  // Sends the datagrams from `first` on without blocking. Returns how many
+  // were sent, which may be fewer than asked for if the socket buffer fills
+  // up. Fails with would_block if none could be sent.
+  std::size_t send(int socket, std::size_t first, boost::system::error_code& error) {
+    if (first >= _size) {
+      error.clear();
+      return 0;
+    }
+
+    int result;
+
+    do {
+      result = ::sendmmsg(socket, &_headers[first], _size - first, MSG_DONTWAIT);
+    } while (result < 0 && errno == EINTR);
+
+    if (result < 0) {
+      error.assign(errno, boost::system::system_category());
+      return 0;
+    }
+
+    error.clear();
+    return result;
+  }
+
+private:
+  std::size_t                   _max_datagram;
+  std::size_t                   _size;
+  std::vector<char>             _data;
+  std::vector<mmsghdr>          _headers;
+  std::vector<iovec>            _iovecs;
+  std::vector<sockaddr_storage> _addresses;
+};
+
+namespace detail {
+  inline bool would_block(const boost::system::error_code& error) {
+    return error == boost::asio::error::would_block
+        || error == boost::asio::error::try_again;
+  }
+
+  // Waits until the socket is writable, then sends the datagrams from
+  // `first` on. Repeats until all are sent.
+  template<typename Socket, typename Token>
+  Future<std::size_t> send_batch( Socket&     socket
+                                , Batch&      batch
+                                , std::size_t first
+                                , Token       token)
+  {
+    return socket.async_wait(Socket::wait_write, token).then(
+      [&socket, &batch, first, token]() {
+        boost::system::error_code error;
+        auto next = first + batch.send(socket.native_handle(), first, error);
+
+        if (error && !would_block(error)) {
+          return make_ready_future<std::size_t>(error);
+        }
+
+        if (next < batch.size()) {
+          return send_batch(socket, batch, next, token);
+        }
+
+        return make_ready_future(next);
+      });
+  }
+
+  // Kernel limits for a single GSO send.
+  static const std::size_t max_segments = 64;
+  static const std::size_t max_bytes    = 65507;
+
+  // Sends the segments of `bytes` as separate datagrams with one sendmmsg.
+  // Returns the number of bytes sent, or -1 with errno set.
+  inline int send_segments_mmsg( int                                   socket
+                               , const char*                           bytes
+                               , std::size_t                           length
+                               , std::size_t                           segment_size
+                               , const boost::asio::ip::udp::endpoint& to)
+  {
+    iovec   iovs[max_segments];
+    mmsghdr messages[max_segments];
+
+    std::memset(messages, 0, sizeof(messages));
+
+    auto count = std::min(max_segments, (length + segment_size - 1) / segment_size);
+
+    for (std::size_t i = 0; i < count; ++i) {
+      iovs[i].iov_base = const_cast<char*>(bytes + i * segment_size);
+      iovs[i].iov_len  = std::min(segment_size, length - i * segment_size);
+
+      messages[i].msg_hdr.msg_name    = const_cast<sockaddr*>(to.data());
+      messages[i].msg_hdr.msg_namelen = to.size();
+      messages[i].msg_hdr.msg_iov     = &iovs[i];
+      messages[i].msg_hdr.msg_iovlen  = 1;
+    }
+
+    int result;
+
+    do {
+      result = ::sendmmsg(socket, messages, count, MSG_DONTWAIT);
+    } while (result < 0 && errno == EINTR);
+
+    if (result > 0) {
+      result = std::min(length, result * segment_size);
+    }
+
+    return result;
+  }
+
+#ifdef UDP_SEGMENT
+  // Whether UDP_SEGMENT may be used. Cleared the first time the kernel rejects
+  // it (because it is too old, or the device cannot offload the checksums)
+  // while plain datagrams go through.
+  inline std::atomic<bool>& gso_enabled() {
+    static std::atomic<bool> enabled(true);
+    return enabled;
+  }
+
+  inline bool gso_rejected(int error) {
+    return error == EINVAL || error == EIO || error == ENOPROTOOPT
+        || error == EOPNOTSUPP;
+  }
+
+  // Sends the segments of `bytes` with a single sendmsg using UDP_SEGMENT.
+  // Returns the number of bytes sent, or -1 with errno set.
+  inline int send_segments_gso( int                                   socket
+                              , const char*                           bytes
+                              , std::size_t                           length
+                              , std::size_t                           segment_size
+                              , const boost::asio::ip::udp::endpoint& to)
+  {
+    iovec   iov = { const_cast<char*>(bytes), length };
+    msghdr  message;
+    char    control[CMSG_SPACE(sizeof(std::uint16_t))];
+
+    std::memset(&message, 0, sizeof(message));
+    std::memset(control,  0, sizeof(control));
+
+    message.msg_name    = const_cast<sockaddr*>(to.data());
+    message.msg_namelen = to.size();
+    message.msg_iov     = &iov;
+    message.msg_iovlen  = 1;
+
+    message.msg_control    = control;
+    message.msg_controllen = sizeof(control);
+
+    auto header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_UDP;
+    header->cmsg_type  = UDP_SEGMENT;
+    header->cmsg_len   = CMSG_LEN(sizeof(std::uint16_t));
+
+    std::uint16_t size = segment_size;
+    std::memcpy(CMSG_DATA(header), &size, sizeof(size));
+
+    int result;
+
+    do {
+      result = ::sendmsg(socket, &message, MSG_DONTWAIT);
+    } while (result < 0 && errno == EINTR);
+
+    return result;
+  }
+#endif
+
+  // Sends one system call worth of segments of `data`, starting at `offset`.
+  // Returns the number of bytes sent. Uses UDP_SEGMENT when the headers have
+  // it, and falls back to sendmmsg when the kernel rejects it.
+  inline std::size_t send_segments( int                                   socket
+                                  , const boost::asio::const_buffer&      data
+                                  , std::size_t                           offset
+                                  , std::size_t                           segment_size
+                                  , const boost::asio::ip::udp::endpoint& to
+                                  , boost::system::error_code&            error)
+  {
+    assert(segment_size > 0);
+
+    auto bytes     = boost::asio::buffer_cast<const char*>(data) + offset;
+    auto remaining = boost::asio::buffer_size(data) - offset;
+    auto count     = std::min(max_segments, std::max<std::size_t>(1, max_bytes / segment_size));
+    auto length    = std::min(remaining, count * segment_size);
+
+    int result = -1;
+
+#ifdef UDP_SEGMENT
+    // A single segment goes out as a plain datagram.
+    if (length > segment_size && gso_enabled()) {
+      result = send_segments_gso(socket, bytes, length, segment_size, to);
+
+      if (result < 0 && gso_rejected(errno)) {
+        result = send_segments_mmsg(socket, bytes, length, segment_size, to);
+        if (result >= 0) gso_enabled() = false;
+      }
+    } else
+#endif
+    {
+      result = send_segments_mmsg(socket, bytes, length, segment_size, to);
+    }
+
+    if (result < 0) {
+      error.assign(errno, boost::system::system_category());
+      return 0;
+    }
+
+    error.clear();
+    return result;
+  }
+
+  template<typename Socket, typename Token>
+  Future<std::size_t> send_segmented( Socket&                               socket
+                                    , const boost::asio::const_buffer&      data
+                                    , std::size_t                           offset
+                                    , std::size_t                           segment_size
+                                    , const boost::asio::ip::udp::endpoint& to
+                                    , Token                                 token)
+  {
+    return socket.async_wait(Socket::wait_write, token).then(
+      [&socket, data, offset, segment_size, to, token]() {
+        boost::system::error_code error;
+        auto next = offset + send_segments( socket.native_handle()
+                                          , data, offset, segment_size, to
+                                          , error);
+
+        if (error && !would_block(error)) {
+          return make_ready_future<std::size_t>(error);
+        }
+
+        if (next < boost::asio::buffer_size(data)) {
+          return send_segmented(socket, data, next, segment_size, to, token);
+        }
+
+        return make_ready_future(next);
+      });
+  }
+} // namespace detail
+
+// Receives into the batch as many datagrams as are available, at least one.
+// The future holds their number. The batch must stay alive and untouched
+// until the future becomes ready.
+template<typename Socket, typename Token = UseFuture>
+Future<std::size_t> async_receive_batch( Socket& socket
+                                       , Batch&  batch
+                                       , Token   token = use_future)
+{
+  return socket.async_wait(Socket::wait_read, token).then(
+    [&socket, &batch, token]() {
+      boost::system::error_code error;
+      auto size = batch.receive(socket.native_handle(), error);
+
+      // Someone else got the datagrams first.
+      if (detail::would_block(error)) {
+        return asio::async_receive_batch(socket, batch, token);
+      }
+
+      if (error) return make_ready_future<std::size_t>(error);
+
+      return make_ready_future(size);
+    });
+}
+
+// Receives up to n datagrams into a new batch.
+template<typename Socket, typename Token = UseFuture>
+Future<Batch> async_receive_batch( Socket&     socket
+                                 , std::size_t n
+                                 , Token       token = use_future)
+{
+  auto batch = std::make_shared<Batch>(n);
+
+  return asio::async_receive_batch(socket, *batch, token).then(
+    [batch](std::size_t) {
+      return std::move(*batch);
+    });
+}
+
+// Sends all datagrams of the batch, each to its endpoint. The future holds
+// their number. The batch must stay alive and untouched until the future
+// becomes ready.
+template<typename Socket, typename Token = UseFuture>
+Future<std::size_t> async_send_batch( Socket& socket
+                                    , Batch&  batch
+                                    , Token   token = use_future)
+{
+  return detail::send_batch(socket, batch, 0, token);
+}
+
+// Sends the data as datagrams of segment_size bytes each (the last one may be
+// shorter), all to the same endpoint. The future holds the number of bytes.
+// The data must stay valid until the future becomes ready. Fails with
+// invalid_argument if segment_size is 0.
+template<typename Socket, typename Token = UseFuture>
+Future<std::size_t> async_send_segmented( Socket&                                socket
+                                        , const boost::asio::const_buffer&       data
+                                        , std::size_t                            segment_size
+                                        , const boost::asio::ip::udp::endpoint&  to
+                                        , Token                                  token = use_future)
+{
+  if (segment_size == 0) {
+    return make_ready_future<std::size_t>(
+      boost::system::error_code(boost::asio::error::invalid_argument));
+  }
+
+  if (boost::asio::buffer_size(data) == 0) {
+    return make_ready_future(std::size_t(0));
+  }
+
+  return detail::send_segmented(socket, data, 0, segment_size, to, token);
+}
+
+}} // namespace fry::asio
+
+#endif // __FRY__UDP_BATCH_H__
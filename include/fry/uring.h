@@ -0,0 +1,734 @@
+//
+// Copyright (c) 2014 Adam Cigánek (adam.ciganek@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef __FRY__URING_H__
+#define __FRY__URING_H__
+
+// Uring - asynchronous file and socket I/O on io_uring (Linux only).
+//
+// Unlike epoll (which asio uses), io_uring can read and write regular files
+// without blocking. Every operation returns a future of its result:
+//
+//   Uring uring;
+//
+//   uring.read_at(fd, 0, buffer, sizeof(buffer)).then([](std::size_t size) {
+//     ...
+//   });
+//
+//   while (...) uring.wait();
+//
+// The operations are only queued when they are called. They are submitted
+// together, with a single system call, by submit() or wait() (or when the
+// submission queue is full). reap() and wait() take all completions that are
+// there at once, and only then resolve the futures, so the continuations run
+// in the thread that calls them.
+//
+// Buffers and files can be registered with the kernel, which spares it
+// mapping them on every operation: see register_buffers() (and
+// read_fixed()/write_fixed()) and register_files() (and FixedFile).
+//
+// Where io_uring is not available, or lacks any of the operations above
+// (kernels before 5.6, where the operations cannot even be probed for, or when
+// it is disabled), the operations run as plain blocking system calls on a
+// thread pool instead. The futures are still resolved by reap() and wait(), so code
+// using the Uring does not need to care which backend it got.
+//
+// No more operations are handed to the kernel at once than its completion
+// queue holds. Starting one more first waits for one of them to complete
+// (without resolving its future yet), so an operation that may never complete
+// (such as accept) must not fill up the whole queue.
+//
+// A Uring is not thread safe: use it from one thread. It must stay alive
+// until all of its operations complete.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <vector>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include "future_result.h"
+#include "recycling_allocator.h"
+#include "thread_pool.h"
+
+namespace fry {
+
+////////////////////////////////////////////////////////////////////////////////
+// Index of a file registered with Uring::register_files().
+struct FixedFile {
+  unsigned index;
+};
+
+namespace detail { namespace uring {
+  // An operation in flight. Completed with the result the kernel gives:
+  // non-negative on success, -errno on failure.
+  struct Operation {
+    std::size_t size;
+
+    explicit Operation(std::size_t size) : size(size) {}
+    virtual ~Operation() {}
+    virtual void complete(int result) = 0;
+  };
+
+  template<typename T>
+  struct Convert {
+    static T from(int result) { return T(result); }
+  };
+
+  template<typename T>
+  struct Complete : Operation {
+    typedef Result<T, std::error_code> Value;
+
+    Promise<Value> promise;
+
+    Complete() : Operation(sizeof(Complete)) {}
+
+    void complete(int result) override {
+      if (result < 0) {
+        promise.set_value(Value(std::error_code(-result, std::system_category())));
+      } else {
+        promise.set_value(Value(Convert<T>::from(result)));
+      }
+    }
+  };
+
+  template<>
+  struct Complete<void> : Operation {
+    typedef Result<void, std::error_code> Value;
+
+    Promise<Value> promise;
+
+    Complete() : Operation(sizeof(Complete)) {}
+
+    void complete(int result) override {
+      if (result < 0) {
+        promise.set_value(Value(std::error_code(-result, std::system_category())));
+      } else {
+        promise.set_value(Value());
+      }
+    }
+  };
+
+  inline int setup(unsigned entries, io_uring_params* params) {
+    return (int) ::syscall(__NR_io_uring_setup, entries, params);
+  }
+
+  inline int enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int) ::syscall( __NR_io_uring_enter, fd, to_submit, min_complete
+                          , flags, nullptr, 0);
+  }
+
+  inline int register_(int fd, unsigned opcode, const void* arg, unsigned count) {
+    return (int) ::syscall(__NR_io_uring_register, fd, opcode, arg, count);
+  }
+
+  inline int result_of_call(long result) {
+    return result < 0 ? -errno : int(result);
+  }
+
+  // Opcodes used by Uring.
+  const unsigned char opcodes[] = { IORING_OP_READ,       IORING_OP_WRITE
+                                  , IORING_OP_READ_FIXED, IORING_OP_WRITE_FIXED
+                                  , IORING_OP_FSYNC,      IORING_OP_ACCEPT
+                                  , IORING_OP_RECV,       IORING_OP_SEND };
+
+  // Whether the kernel supports all the opcodes. False also if it cannot say
+  // (IORING_REGISTER_PROBE came with 5.6).
+  inline bool probe(int fd) {
+    const unsigned num_ops = 256;
+
+    std::vector<char> buffer( sizeof(io_uring_probe)
+                            + num_ops * sizeof(io_uring_probe_op));
+    auto probe = reinterpret_cast<io_uring_probe*>(&buffer[0]);
+
+    if (register_(fd, IORING_REGISTER_PROBE, probe, num_ops) < 0) return false;
+
+    for (auto opcode : opcodes) {
+      if (  opcode > probe->last_op
+         || !(probe->ops[opcode].flags & IO_URING_OP_SUPPORTED))
+      {
+        return false;
+      }
+    }
+
+    return true;
+  }
+}} // namespace detail::uring
+
+////////////////////////////////////////////////////////////////////////////////
+class Uring {
+public:
+  enum class Backend { automatic, thread_pool };
+
+  template<typename T>
+  using Future = ::fry::Future<Result<T, std::error_code>>;
+
+  // `entries` is the size of the submission queue. `num_threads` is the size
+  // of the pool used when io_uring is not available (or not wanted).
+  explicit Uring( unsigned    entries     = 256
+                , Backend     backend     = Backend::automatic
+                , std::size_t num_threads = 4)
+    : _fd(-1)
+    , _num_threads(num_threads)
+    , _to_submit(0)
+    , _in_flight(0)
+    , _in_ring(0)
+  {
+    std::memset(&_params, 0, sizeof(_params));
+
+    if (backend == Backend::automatic && !setup(entries)) {
+      teardown();
+    }
+  }
+
+  Uring(const Uring&) = delete;
+  Uring& operator = (const Uring&) = delete;
+
+  // Operations still in flight are abandoned: their futures never become
+  // ready.
+  ~Uring() {
+    _pool.reset();
+    teardown();
+
+    for (auto& done : _done)   destroy(done.operation);
+    for (auto& done : _reaped) destroy(done.operation);
+  }
+
+  // Whether the operations go to io_uring (rather than the thread pool).
+  bool native() const {
+    return _fd >= 0;
+  }
+
+  //----------------------------------------------------------------------------
+  // Operations
+
+  // Reads up to `size` bytes at `offset`. The future holds how many were read
+  // (0 at the end of the file).
+  template<typename File>
+  Future<std::size_t> read_at( File file, std::uint64_t offset
+                             , void* data, std::size_t size)
+  {
+    return start<std::size_t>(
+      [&](io_uring_sqe& sqe) {
+        prepare(sqe, IORING_OP_READ, file, data, size, offset);
+      }
+    , [=](int fd) {
+        return detail::uring::result_of_call(::pread(fd, data, size, offset));
+      }
+    , file);
+  }
+
+  // Writes up to `size` bytes at `offset`. The future holds how many were
+  // written.
+  template<typename File>
+  Future<std::size_t> write_at( File file, std::uint64_t offset
+                              , const void* data, std::size_t size)
+  {
+    return start<std::size_t>(
+      [&](io_uring_sqe& sqe) {
+        prepare(sqe, IORING_OP_WRITE, file, data, size, offset);
+      }
+    , [=](int fd) {
+        return detail::uring::result_of_call(::pwrite(fd, data, size, offset));
+      }
+    , file);
+  }
+
+  // Like read_at() and write_at(), but the data must be within the buffer
+  // registered under the given index.
+  template<typename File>
+  Future<std::size_t> read_fixed( File file, std::uint64_t offset
+                                , unsigned buffer_index
+                                , void* data, std::size_t size)
+  {
+    return start<std::size_t>(
+      [&](io_uring_sqe& sqe) {
+        prepare(sqe, IORING_OP_READ_FIXED, file, data, size, offset);
+        sqe.buf_index = buffer_index;
+      }
+    , [=](int fd) {
+        return detail::uring::result_of_call(::pread(fd, data, size, offset));
+      }
+    , file);
+  }
+
+  template<typename File>
+  Future<std::size_t> write_fixed( File file, std::uint64_t offset
+                                 , unsigned buffer_index
+                                 , const void* data, std::size_t size)
+  {
+    return start<std::size_t>(
+      [&](io_uring_sqe& sqe) {
+        prepare(sqe, IORING_OP_WRITE_FIXED, file, data, size, offset);
+        sqe.buf_index = buffer_index;
+      }
+    , [=](int fd) {
+        return detail::uring::result_of_call(::pwrite(fd, data, size, offset));
+      }
+    , file);
+  }
+
+  template<typename File>
+  Future<void> fsync(File file) {
+    return start<void>(
+      [&](io_uring_sqe& sqe) {
+        prepare(sqe, IORING_OP_FSYNC, file, nullptr, 0, 0);
+      }
+    , [](int fd) {
+        return detail::uring::result_of_call(::fsync(fd));
+      }
+    , file);
+  }
+
+  // Accepts a connection on a listening socket. The future holds the socket
+  // of the connection.
+  template<typename File>
+  Future<int> accept(File file) {
+    return start<int>(
+      [&](io_uring_sqe& sqe) {
+        prepare(sqe, IORING_OP_ACCEPT, file, nullptr, 0, 0);
+        sqe.accept_flags = SOCK_CLOEXEC;
+      }
+    , [](int fd) {
+        return detail::uring::result_of_call(
+          ::accept4(fd, nullptr, nullptr, SOCK_CLOEXEC));
+      }
+    , file);
+  }
+
+  // Receives up to `size` bytes. The future holds how many (0 when the peer
+  // closed the connection).
+  template<typename File>
+  Future<std::size_t> recv(File file, void* data, std::size_t size) {
+    return start<std::size_t>(
+      [&](io_uring_sqe& sqe) {
+        prepare(sqe, IORING_OP_RECV, file, data, size, 0);
+      }
+    , [=](int fd) {
+        return detail::uring::result_of_call(::recv(fd, data, size, 0));
+      }
+    , file);
+  }
+
+  // Sends up to `size` bytes. The future holds how many were sent.
+  template<typename File>
+  Future<std::size_t> send(File file, const void* data, std::size_t size) {
+    return start<std::size_t>(
+      [&](io_uring_sqe& sqe) {
+        prepare(sqe, IORING_OP_SEND, file, data, size, 0);
+        sqe.msg_flags = MSG_NOSIGNAL;
+      }
+    , [=](int fd) {
+        return detail::uring::result_of_call(::send(fd, data, size, MSG_NOSIGNAL));
+      }
+    , file);
+  }
+
+  //----------------------------------------------------------------------------
+  // Registration
+
+  // Registers the buffers for read_fixed() and write_fixed(). Replaces the
+  // buffers registered before.
+  std::error_code register_buffers(const std::vector<iovec>& buffers) {
+    if (!native()) return std::error_code();
+
+    detail::uring::register_(_fd, IORING_UNREGISTER_BUFFERS, nullptr, 0);
+
+    return check(detail::uring::register_(
+      _fd, IORING_REGISTER_BUFFERS, buffers.data(), buffers.size()));
+  }
+
+  // Registers the files, so they can be referred to by FixedFile{index}.
+  // Replaces the files registered before.
+  std::error_code register_files(const std::vector<int>& files) {
+    _files = files;
+
+    if (!native()) return std::error_code();
+
+    detail::uring::register_(_fd, IORING_UNREGISTER_FILES, nullptr, 0);
+
+    return check(detail::uring::register_(
+      _fd, IORING_REGISTER_FILES, files.data(), files.size()));
+  }
+
+  //----------------------------------------------------------------------------
+  // Completion
+
+  // Submits the queued operations. Returns how many were submitted.
+  std::size_t submit() {
+    return enter(0);
+  }
+
+  // Resolves the futures of the operations that completed, without waiting.
+  // Returns how many.
+  std::size_t reap() {
+    submit();
+    return complete(collect());
+  }
+
+  // Submits the queued operations, waits until at least one operation
+  // completes (unless none is in flight), and resolves the futures of all
+  // that completed. Returns how many.
+  //
+  // If io_uring_enter fails, the operations not submitted yet complete with
+  // its error. If none is left to fail that way, std::system_error is thrown
+  // instead (by submit() and reap() too), as the operations the kernel has
+  // would never be seen to complete.
+  std::size_t wait() {
+    if (_in_flight == 0) return 0;
+
+    if (native()) {
+      if (_reaped.empty()) enter(1);
+    } else {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _completed.wait(lock, [this]() { return !_done.empty(); });
+    }
+
+    return complete(collect());
+  }
+
+  // Number of operations not completed yet.
+  std::size_t in_flight() const {
+    return _in_flight;
+  }
+
+private:
+  struct Done {
+    detail::uring::Operation* operation;
+    int                       result;
+  };
+
+  //----------------------------------------------------------------------------
+  bool setup(unsigned entries) {
+    _fd = detail::uring::setup(entries, &_params);
+    if (_fd < 0) return false;
+
+    auto sq_size = _params.sq_off.array + _params.sq_entries * sizeof(unsigned);
+    auto cq_size = _params.cq_off.cqes  + _params.cq_entries * sizeof(io_uring_cqe);
+
+    _sq_size = sq_size;
+    _cq_size = cq_size;
+
+    _sq_ring = map(sq_size, IORING_OFF_SQ_RING);
+    _cq_ring = map(cq_size, IORING_OFF_CQ_RING);
+    _sqes    = static_cast<io_uring_sqe*>(
+                 map(_params.sq_entries * sizeof(io_uring_sqe), IORING_OFF_SQES));
+
+    if (!_sq_ring || !_cq_ring || !_sqes) return false;
+    if (!detail::uring::probe(_fd))       return false;
+
+    auto sq = static_cast<char*>(_sq_ring);
+    auto cq = static_cast<char*>(_cq_ring);
+
+    _sq_head  = reinterpret_cast<unsigned*>(sq + _params.sq_off.head);
+    _sq_tail  = reinterpret_cast<unsigned*>(sq + _params.sq_off.tail);
+    _sq_mask  = *reinterpret_cast<unsigned*>(sq + _params.sq_off.ring_mask);
+    _sq_array = reinterpret_cast<unsigned*>(sq + _params.sq_off.array);
+
+    _cq_head  = reinterpret_cast<unsigned*>(cq + _params.cq_off.head);
+    _cq_tail  = reinterpret_cast<unsigned*>(cq + _params.cq_off.tail);
+    _cq_mask  = *reinterpret_cast<unsigned*>(cq + _params.cq_off.ring_mask);
+    _cqes     = reinterpret_cast<io_uring_cqe*>(cq + _params.cq_off.cqes);
+
+    return true;
+  }
+
+  void* map(std::size_t size, off_t offset) {
+    auto result = ::mmap( nullptr, size, PROT_READ | PROT_WRITE
+                        , MAP_SHARED | MAP_POPULATE, _fd, offset);
+    return result == MAP_FAILED ? nullptr : result;
+  }
+
+  void teardown() {
+    if (_fd < 0) return;
+
+    if (_sqes)    ::munmap(_sqes, _params.sq_entries * sizeof(io_uring_sqe));
+    if (_cq_ring) ::munmap(_cq_ring, _cq_size);
+    if (_sq_ring) ::munmap(_sq_ring, _sq_size);
+
+    ::close(_fd);
+    _fd = -1;
+  }
+
+  static std::error_code check(int result) {
+    return result < 0 ? std::error_code(errno, std::system_category())
+                      : std::error_code();
+  }
+
+  //----------------------------------------------------------------------------
+  int descriptor(int fd) const                  { return fd; }
+  int descriptor(const FixedFile& file) const   { return _files[file.index]; }
+
+  static void prepare( io_uring_sqe& sqe, unsigned char opcode, int fd
+                     , const void* data, std::size_t size, std::uint64_t offset)
+  {
+    std::memset(&sqe, 0, sizeof(sqe));
+
+    sqe.opcode = opcode;
+    sqe.fd     = fd;
+    sqe.addr   = reinterpret_cast<std::uintptr_t>(data);
+    sqe.len    = size;
+    sqe.off    = offset;
+  }
+
+  static void prepare( io_uring_sqe& sqe, unsigned char opcode
+                     , const FixedFile& file
+                     , const void* data, std::size_t size, std::uint64_t offset)
+  {
+    prepare(sqe, opcode, int(file.index), data, size, offset);
+    sqe.flags |= IOSQE_FIXED_FILE;
+  }
+
+  // Queues the operation to io_uring (filling its entry with `prepare`), or
+  // runs it on the pool (with `call`, given the file descriptor).
+  template<typename T, typename Prepare, typename Call, typename File>
+  Future<T> start(Prepare&& prepare, Call&& call, const File& file) {
+    typedef detail::uring::Complete<T> C;
+
+    // Before anything is allocated, as it may throw.
+    if (native()) make_room();
+
+    auto operation = new (_memory.allocate(sizeof(C))) C;
+    auto result    = operation->promise.get_future();
+
+    ++_in_flight;
+
+    if (native()) {
+      auto& sqe = next_sqe();
+      prepare(sqe);
+      sqe.user_data = reinterpret_cast<std::uintptr_t>(operation);
+    } else {
+      auto fd = descriptor(file);
+
+      pool().post([this, operation, call, fd]() {
+        auto result = call(fd);
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        _done.push_back(Done{ operation, result });
+        _completed.notify_one();
+      });
+    }
+
+    return result;
+  }
+
+  // Waits for an operation to complete if as many are in the ring as the
+  // completion queue holds. Its completion is put aside, to be resolved by the
+  // next reap() or wait() like the others.
+  void make_room() {
+    if (_in_ring < _params.cq_entries) return;
+
+    if (*_cq_head == __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE)) enter(1);
+
+    auto reaped = take_completions();
+    _reaped.insert(_reaped.end(), reaped.begin(), reaped.end());
+  }
+
+  io_uring_sqe& next_sqe() {
+    auto head = __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE);
+
+    // Make room by handing what is queued to the kernel.
+    if (*_sq_tail - head == _params.sq_entries) submit();
+
+    auto tail  = *_sq_tail;
+    auto index = tail & _sq_mask;
+
+    _sq_array[index] = index;
+    __atomic_store_n(_sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ++_to_submit;
+    ++_in_ring;
+
+    return _sqes[index];
+  }
+
+  // Submits the queued operations, and waits for min_complete of them. When
+  // the completion queue is full (EBUSY), or the kernel is short of resources
+  // until something completes (EAGAIN), the completions are put aside (like
+  // in make_room) and it tries again. Any other error fails the operations
+  // not submitted yet.
+  std::size_t enter(unsigned min_complete) {
+    if (!native() || (_to_submit == 0 && min_complete == 0)) return 0;
+
+    for (;;) {
+      auto flags  = min_complete > 0 ? IORING_ENTER_GETEVENTS : 0u;
+      auto result = detail::uring::enter(_fd, _to_submit, min_complete, flags);
+
+      if (result >= 0) {
+        _to_submit -= std::min<std::size_t>(result, _to_submit);
+        return result;
+      }
+
+      auto error = errno;
+
+      if (error == EINTR) continue;
+
+      if (error != EBUSY && error != EAGAIN) {
+        fail_unsubmitted(error);
+        return 0;
+      }
+
+      auto reaped = take_completions();
+
+      if (reaped.empty()) {
+        // Nothing to make room with, so wait for an operation the kernel has
+        // already. If it has none, waiting would not help.
+        if (_in_ring == unsubmitted()) {
+          fail_unsubmitted(error);
+          return 0;
+        }
+
+        detail::uring::enter(_fd, 0, 1, IORING_ENTER_GETEVENTS);
+        reaped = take_completions();
+      }
+
+      // Those count as the completions waited for.
+      if (!reaped.empty()) min_complete = 0;
+
+      _reaped.insert(_reaped.end(), reaped.begin(), reaped.end());
+
+      if (_to_submit == 0 && min_complete == 0) return 0;
+    }
+  }
+
+  // Number of operations in the submission queue the kernel did not take
+  // yet.
+  unsigned unsubmitted() const {
+    return *_sq_tail - __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE);
+  }
+
+  // Takes the operations the kernel did not take back out of the submission
+  // queue, and completes them with the error (by the next reap() or wait(),
+  // like the others). If there are none, there is nothing to complete, so it
+  // throws instead, for a caller waiting for operations that would otherwise
+  // never complete.
+  void fail_unsubmitted(int error) {
+    auto head = __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE);
+    auto tail = *_sq_tail;
+
+    if (head == tail) {
+      throw std::system_error(error, std::system_category(), "io_uring_enter");
+    }
+
+    for (auto i = head; i != tail; ++i) {
+      auto& sqe = _sqes[_sq_array[i & _sq_mask]];
+      _reaped.push_back(Done{
+        reinterpret_cast<detail::uring::Operation*>(sqe.user_data), -error });
+    }
+
+    __atomic_store_n(_sq_tail, head, __ATOMIC_RELEASE);
+
+    _in_ring   -= tail - head;
+    _to_submit  = 0;
+  }
+
+  // Takes the completions from the completion queue.
+  std::vector<Done> take_completions() {
+    std::vector<Done> result;
+
+    auto head = *_cq_head;
+    auto tail = __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE);
+
+    result.reserve(tail - head);
+
+    for (; head != tail; ++head) {
+      auto& cqe = _cqes[head & _cq_mask];
+      result.push_back(Done{
+        reinterpret_cast<detail::uring::Operation*>(cqe.user_data), cqe.res });
+    }
+
+    __atomic_store_n(_cq_head, tail, __ATOMIC_RELEASE);
+    _in_ring -= result.size();
+
+    return result;
+  }
+
+  // Takes all the completions there are.
+  std::vector<Done> collect() {
+    std::vector<Done> result;
+
+    if (native()) {
+      result.swap(_reaped);
+
+      auto taken = take_completions();
+      result.insert(result.end(), taken.begin(), taken.end());
+    } else {
+      std::lock_guard<std::mutex> lock(_mutex);
+      result.swap(_done);
+    }
+
+    return result;
+  }
+
+  std::size_t complete(const std::vector<Done>& done) {
+    _in_flight -= done.size();
+
+    for (auto& d : done) {
+      d.operation->complete(d.result);
+      destroy(d.operation);
+    }
+
+    return done.size();
+  }
+
+  void destroy(detail::uring::Operation* operation) {
+    auto size = operation->size;
+    operation->~Operation();
+    _memory.deallocate(operation, size);
+  }
+
+  ThreadPool& pool() {
+    if (!_pool) _pool.reset(new ThreadPool(_num_threads));
+    return *_pool;
+  }
+
+private:
+  Recycler                    _memory;
+
+  int                         _fd;
+  io_uring_params             _params;
+  void*                       _sq_ring = nullptr;
+  void*                       _cq_ring = nullptr;
+  std::size_t                 _sq_size = 0;
+  std::size_t                 _cq_size = 0;
+  io_uring_sqe*               _sqes    = nullptr;
+
+  unsigned*                   _sq_head;
+  unsigned*                   _sq_tail;
+  unsigned                    _sq_mask;
+  unsigned*                   _sq_array;
+  unsigned*                   _cq_head;
+  unsigned*                   _cq_tail;
+  unsigned                    _cq_mask;
+  io_uring_cqe*               _cqes;
+
+  std::vector<int>            _files;
+
+  std::size_t                 _num_threads;
+  std::unique_ptr<ThreadPool> _pool;
+  std::mutex                  _mutex;
+  std::condition_variable     _completed;
+  std::vector<Done>           _done;
+  std::vector<Done>           _reaped;
+
+  std::size_t                 _to_submit;
+  std::size_t                 _in_flight;
+  std::size_t                 _in_ring;
+};
+
+} // namespace fry
+
+#endif // __FRY__URING_H__
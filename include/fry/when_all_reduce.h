@@ -0,0 +1,296 @@
+//
+// Copyright (c) 2014 Adam Cigánek (adam.ciganek@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef __FRY__WHEN_ALL_REDUCE_H__
+#define __FRY__WHEN_ALL_REDUCE_H__
+
+// when_all_reduce - folds the values of a range of futures into an accumulator
+//                   as soon as each of them becomes ready. Returns a future
+//                   that becomes ready with the accumulator when all of the
+//                   input futures become ready.
+//
+// when_all_success_reduce - like when_all_reduce, but for futures of Results.
+//                           Becomes failure as soon as ANY of the input
+//                           futures becomes failure.
+//
+// Unlike when_all, the values are never collected, so the memory used does not
+// depend on the number of input futures.
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "future_result.h"
+
+namespace fry {
+
+namespace detail { namespace reduce {
+  //----------------------------------------------------------------------------
+  // Single accumulator guarded by a single mutex.
+  template<typename Acc, typename Op>
+  class Single {
+  public:
+    Single(Acc init, Op op)
+      : _acc(std::move(init))
+      , _op(std::move(op))
+    {}
+
+    template<typename T>
+    void fold(T&& value) {
+      std::lock_guard<std::mutex> guard(_mutex);
+      _acc = _op(std::move(_acc), std::forward<T>(value));
+    }
+
+    Acc take() {
+      std::lock_guard<std::mutex> guard(_mutex);
+      return std::move(_acc);
+    }
+
+  private:
+    std::mutex _mutex;
+    Acc        _acc;
+    Op         _op;
+  };
+
+  //----------------------------------------------------------------------------
+  // One accumulator per shard, each guarded by its own mutex. Values are folded
+  // into the shard picked by the calling thread, so threads resolving the input
+  // futures concurrently do not contend on one lock. The shards are merged
+  // together when all values have arrived.
+  template<typename Acc, typename Op, typename Merge>
+  class Sharded {
+  public:
+    Sharded(Acc identity, Op op, Merge merge)
+      : _shards(num_shards())
+      , _op(std::move(op))
+      , _merge(std::move(merge))
+    {
+      for (auto& shard : _shards) {
+        shard.acc = identity;
+      }
+    }
+
+    template<typename T>
+    void fold(T&& value) {
+      auto& shard = _shards[ std::hash<std::thread::id>()(std::this_thread::get_id())
+                           % _shards.size()];
+
+      std::lock_guard<std::mutex> guard(shard.mutex);
+      shard.acc = _op(std::move(shard.acc), std::forward<T>(value));
+    }
+
+    Acc take() {
+      Acc result = take(_shards[0]);
+
+      for (std::size_t i = 1; i < _shards.size(); ++i) {
+        result = _merge(std::move(result), take(_shards[i]));
+      }
+
+      return result;
+    }
+
+  private:
+    // Padded to a cache line so neighbouring shards do not false-share.
+    struct Shard {
+      std::mutex mutex;
+      Acc        acc;
+      char       padding[64];
+    };
+
+    static std::size_t num_shards() {
+      auto n = std::thread::hardware_concurrency();
+      return n > 0 ? n : 1;
+    }
+
+    static Acc take(Shard& shard) {
+      std::lock_guard<std::mutex> guard(shard.mutex);
+      return std::move(shard.acc);
+    }
+
+  private:
+    std::vector<Shard> _shards;
+    Op                 _op;
+    Merge              _merge;
+  };
+
+  //----------------------------------------------------------------------------
+  // The number of pending futures starts at one, which stands for the loop
+  // that attaches the continuations. That way the output is not resolved
+  // prematurely when the input futures become ready while the loop is still
+  // running, and the size of the range does not have to be known up front.
+  template<typename Accumulator, typename Out>
+  struct State {
+    typedef Out Output;
+
+    Accumulator              accumulator;
+    std::atomic<std::size_t> num_pending;
+    std::atomic<bool>        failed;
+    Promise<Output>          promise;
+
+    template<typename... Args>
+    State(Args&&... args)
+      : accumulator(std::forward<Args>(args)...)
+      , num_pending(1)
+      , failed(false)
+    {}
+
+    Future<Output> get_future() {
+      return promise.get_future();
+    }
+
+    template<typename T>
+    void fold(T&& value) {
+      if (!failed) {
+        accumulator.fold(std::forward<T>(value));
+      }
+
+      arrive();
+    }
+
+    template<typename E>
+    void fail(E&& error) {
+      if (!failed.exchange(true)) {
+        promise.set_value(Output(std::forward<E>(error)));
+      }
+
+      arrive();
+    }
+
+    void expect() {
+      ++num_pending;
+    }
+
+    void arrive() {
+      if (num_pending.fetch_sub(1) == 1 && !failed) {
+        promise.set_value(Output(accumulator.take()));
+      }
+    }
+  };
+
+  //----------------------------------------------------------------------------
+  template<typename S, typename T>
+  struct Continuation {
+    std::shared_ptr<S> state;
+
+    // The value is not needed by anyone else, so it is moved into the fold.
+    void operator () (T& value) {
+      state->fold(std::move(value));
+    }
+
+    void operator () (T&& value) {
+      state->fold(std::move(value));
+    }
+  };
+
+  template<typename S, typename T, typename E>
+  struct Continuation<S, Result<T, E>> {
+    std::shared_ptr<S> state;
+
+    void operator () (Result<T, E>& result) {
+      result.match(
+          [this](T& value) { state->fold(std::move(value)); }
+        , [this](E& error) { state->fail(std::move(error)); }
+      );
+    }
+
+    void operator () (Result<T, E>&& result) {
+      (*this)(result);
+    }
+  };
+
+  //----------------------------------------------------------------------------
+  template<typename S, typename Range>
+  Future<typename S::Output> start(std::shared_ptr<S> state, Range& futures) {
+    using T = future_type<value_type<Range>>;
+
+    auto result = state->get_future();
+
+    for (auto&& future : futures) {
+      state->expect();
+      future.then(Continuation<S, T>{ state });
+    }
+
+    state->arrive();
+    return result;
+  }
+}} // namespace detail::reduce
+
+////////////////////////////////////////////////////////////////////////////////
+// Folds the values of the futures using acc = op(std::move(acc), value),
+// starting from init. The fold is serialized through a single mutex.
+template<typename Range, typename Acc, typename Op>
+Future<typename std::decay<Acc>::type>
+when_all_reduce(Range& futures, Acc&& init, Op&& op) {
+  using A     = typename std::decay<Acc>::type;
+  using State = detail::reduce::State<
+                  detail::reduce::Single<A, typename std::decay<Op>::type>, A>;
+
+  return detail::reduce::start(
+    std::make_shared<State>(std::forward<Acc>(init), std::forward<Op>(op))
+  , futures);
+}
+
+// Folds the values into one accumulator per thread and combines those using
+// acc = merge(std::move(acc), std::move(other)) once all values have arrived.
+// Each accumulator starts as a copy of identity, so identity must be a neutral
+// element of merge (zero for sums, empty histogram, ...).
+template<typename Range, typename Acc, typename Op, typename Merge>
+Future<typename std::decay<Acc>::type>
+when_all_reduce(Range& futures, Acc&& identity, Op&& op, Merge&& merge) {
+  using A     = typename std::decay<Acc>::type;
+  using State = detail::reduce::State<
+                  detail::reduce::Sharded< A
+                                         , typename std::decay<Op>::type
+                                         , typename std::decay<Merge>::type>
+                , A>;
+
+  return detail::reduce::start(
+    std::make_shared<State>( std::forward<Acc>(identity)
+                           , std::forward<Op>(op)
+                           , std::forward<Merge>(merge))
+  , futures);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Range of Future<Result<T, E>>. Values of futures that become ready after the
+// first failure are discarded without being folded.
+template<typename Range, typename Acc, typename Op>
+Future<Result< typename std::decay<Acc>::type
+             , typename future_type<detail::value_type<Range>>::error_type>>
+when_all_success_reduce(Range& futures, Acc&& init, Op&& op) {
+  using A     = typename std::decay<Acc>::type;
+  using E     = typename future_type<detail::value_type<Range>>::error_type;
+  using State = detail::reduce::State<
+                  detail::reduce::Single<A, typename std::decay<Op>::type>
+                , Result<A, E>>;
+
+  return detail::reduce::start(
+    std::make_shared<State>(std::forward<Acc>(init), std::forward<Op>(op))
+  , futures);
+}
+
+template<typename Range, typename Acc, typename Op, typename Merge>
+Future<Result< typename std::decay<Acc>::type
+             , typename future_type<detail::value_type<Range>>::error_type>>
+when_all_success_reduce(Range& futures, Acc&& identity, Op&& op, Merge&& merge) {
+  using A     = typename std::decay<Acc>::type;
+  using E     = typename future_type<detail::value_type<Range>>::error_type;
+  using State = detail::reduce::State<
+                  detail::reduce::Sharded< A
+                                         , typename std::decay<Op>::type
+                                         , typename std::decay<Merge>::type>
+                , Result<A, E>>;
+
+  return detail::reduce::start(
+    std::make_shared<State>( std::forward<Acc>(identity)
+                           , std::forward<Op>(op)
+                           , std::forward<Merge>(merge))
+  , futures);
+}
+
+} // namespace fry
+
+#endif // __FRY__WHEN_ALL_REDUCE_H__
@@ -61,12 +61,6 @@ void assign(Continuation<T>) {};
 
 } // namespace any
 
-//------------------------------------------------------------------------------
-template<typename R>
-using value_type = typename std::iterator_traits<
-                     decltype(std::begin(std::declval<R>()))
-                   >::value_type;
-
 } // namespace detail
 
 ////////////////////////////////////////////////////////////////////////////////
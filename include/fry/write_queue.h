@@ -0,0 +1,183 @@
+//
+// Copyright (c) 2014 Adam Cigánek (adam.ciganek@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef __FRY__WRITE_QUEUE_H__
+#define __FRY__WRITE_QUEUE_H__
+
+// WriteQueue - serializes writes to a stream and coalesces them.
+//
+// Asio allows only one write to a stream at a time. WriteQueue lets any
+// number of writers queue their data at any time (from any thread): the
+// first one starts a write, and everything queued while that write is in
+// flight goes out together in a single gather write after it. So under load
+// the number of syscalls is a fraction of the number of messages.
+//
+// Every call to write() returns its own future, which becomes ready when its
+// bytes have been written (or the write failed). The data is written in the
+// order the calls were made.
+//
+// The queue must stay alive until all the writes complete.
+
+#include <deque>
+#include <mutex>
+#include <vector>
+#include <boost/asio/buffer.hpp>
+#include "asio.h"
+#include "future_result.h"
+
+namespace fry { namespace asio {
+
+template<typename Stream, typename Token = UseFuture>
+class WriteQueue {
+public:
+  explicit WriteQueue(Stream& stream, Token token = use_future)
+    : _stream(stream)
+    , _token(token)
+    , _writing(false)
+    , _num_writes(0)
+    , _num_messages(0)
+  {}
+
+  WriteQueue(const WriteQueue&) = delete;
+  WriteQueue& operator = (const WriteQueue&) = delete;
+
+  // Queues the buffers. They must stay valid until the returned future
+  // becomes ready.
+  template<typename Buffers>
+  Future<std::size_t> write(const Buffers& buffers) {
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    std::size_t size = 0;
+
+    for (auto i = boost::asio::buffer_sequence_begin(buffers);
+         i != boost::asio::buffer_sequence_end(buffers); ++i)
+    {
+      boost::asio::const_buffer buffer(*i);
+      _queued.buffers.push_back(buffer);
+      size += boost::asio::buffer_size(buffer);
+    }
+
+    return enqueue(lock, size);
+  }
+
+  // Queues the data, keeping it until it is written.
+  Future<std::size_t> write(std::vector<char>&& data) {
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    _queued.storage.push_back(std::move(data));
+
+    auto& stored = _queued.storage.back();
+    _queued.buffers.push_back(boost::asio::buffer(stored));
+
+    return enqueue(lock, stored.size());
+  }
+
+  // Number of gather writes started so far.
+  std::size_t num_writes() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _num_writes;
+  }
+
+  // Number of calls to write() so far.
+  std::size_t num_messages() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _num_messages;
+  }
+
+private:
+  struct Entry {
+    std::size_t                  size;
+    Promise<Result<std::size_t>> promise;
+  };
+
+  struct Batch {
+    std::vector<boost::asio::const_buffer> buffers;
+    std::deque<std::vector<char>>          storage;
+    std::vector<Entry>                     entries;
+
+    void clear() {
+      buffers.clear();
+      storage.clear();
+      entries.clear();
+    }
+  };
+
+  Future<std::size_t> enqueue(std::unique_lock<std::mutex>& lock, std::size_t size) {
+    _queued.entries.push_back(Entry{
+      size
+    , Promise<Result<std::size_t>>( std::allocator_arg
+                                  , RecyclingAllocator<void>(_token.recycler))
+    });
+
+    auto result = _queued.entries.back().promise.get_future();
+    ++_num_messages;
+
+    if (!_writing) {
+      _writing = true;
+      start(lock);
+    }
+
+    return result;
+  }
+
+  // Moves the queued data to the batch in flight and writes it.
+  void start(std::unique_lock<std::mutex>& lock) {
+    std::swap(_flight, _queued);
+    ++_num_writes;
+    lock.unlock();
+
+    asio::async_write(_stream, _flight.buffers, _token).then(
+      [this](const Result<std::size_t>& result) {
+        complete(result);
+      });
+  }
+
+  // The writers are notified last, because their continuations may destroy
+  // the queue.
+  void complete(const Result<std::size_t>& result) {
+    std::vector<Entry> entries;
+    entries.swap(_flight.entries);
+    _flight.clear();
+
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+
+      if (_queued.entries.empty()) {
+        _writing = false;
+      } else {
+        start(lock);
+      }
+    }
+
+    result.match(
+        [&](std::size_t) {
+          for (auto& entry : entries) {
+            entry.promise.set_value(Result<std::size_t>(entry.size));
+          }
+        }
+      , [&](const boost::system::error_code& error) {
+          for (auto& entry : entries) {
+            entry.promise.set_value(Result<std::size_t>(error));
+          }
+        }
+    );
+  }
+
+private:
+  mutable std::mutex _mutex;
+  Stream&            _stream;
+  Token              _token;
+  bool               _writing;
+  Batch              _queued;
+  Batch              _flight;
+  std::size_t        _num_writes;
+  std::size_t        _num_messages;
+};
+
+}} // namespace fry::asio
+
+#endif // __FRY__WRITE_QUEUE_H__
@@ -0,0 +1,219 @@
+//
+// Copyright (c) 2014 Adam Cigánek (adam.ciganek@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <boost/test/unit_test.hpp>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "test_helpers.h"
+#include "fry/admission.h"
+
+using namespace std;
+using namespace fry;
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_admission_rejects_over_the_limit) {
+  Admission<> admission(2);
+
+  Promise<int> p0;
+  Promise<int> p1;
+
+  int  value    = 0;
+  int  rejected = 0;
+  bool called   = false;
+
+  admission.admit([&]() { return p0.get_future(); })
+    .then([&](int v) { value = v; });
+
+  admission.admit([&]() { return p1.get_future(); });
+
+  BOOST_CHECK_EQUAL(2u, admission.in_flight());
+
+  admission.admit([&]() { called = true; return 3; })
+    .then([&](Overloaded error) { rejected = error.limit; });
+
+  BOOST_CHECK(!called);
+  BOOST_CHECK_EQUAL(2, rejected);
+  BOOST_CHECK_EQUAL(2u, admission.num_admitted());
+  BOOST_CHECK_EQUAL(1u, admission.num_rejected());
+
+  p0.set_value(1);
+
+  BOOST_CHECK_EQUAL(1, value);
+  BOOST_CHECK_EQUAL(1u, admission.in_flight());
+
+  admission.admit([&]() { return 3; })
+    .then([&](int v) { value = v; });
+
+  BOOST_CHECK_EQUAL(3, value);
+
+  p1.set_value(2);
+
+  BOOST_CHECK_EQUAL(0u, admission.in_flight());
+  BOOST_CHECK_EQUAL(3u, admission.num_admitted());
+}
+
+BOOST_AUTO_TEST_CASE(test_admission_of_void_and_result_chains) {
+  Admission<> admission(1);
+
+  bool done = false;
+
+  admission.admit([]() {})
+    .then([&]() { done = true; });
+
+  BOOST_CHECK(done);
+
+  // The chain's own failure is not nested in another Result. The error type
+  // cannot hold the rejection, so it becomes Either<string, Overloaded>.
+  typedef Either<string, Overloaded> Error;
+
+  Promise<Result<int, string>> promise;
+  string                       error;
+  size_t                       rejected = 0;
+
+  admission.admit([&]() { return promise.get_future(); })
+    .then([&](const Error& e) {
+      e.match([&](const string& e) { error = e; }, [](Overloaded) {});
+    });
+
+  admission.admit([&]() { return promise.get_future(); })
+    .then([&](const Error& e) {
+      e.match([](const string&) {}, [&](Overloaded e) { rejected = e.limit; });
+    });
+
+  BOOST_CHECK_EQUAL(1u, rejected);
+
+  promise.set_value(Result<int, string>(string("failed")));
+  BOOST_CHECK_EQUAL("failed", error);
+  BOOST_CHECK_EQUAL(0u, admission.in_flight());
+}
+
+namespace {
+  // Error type that can hold a rejection.
+  struct Failure {
+    string message;
+
+    Failure(string message) : message(std::move(message)) {}
+    Failure(Overloaded) : message("overloaded") {}
+  };
+}
+
+BOOST_AUTO_TEST_CASE(test_admission_of_result_chains_with_own_overloaded_error) {
+  Admission<> admission(1);
+
+  Promise<Result<int, Failure>> promise;
+  int                           value = 0;
+  vector<string>                errors;
+
+  admission.admit([&]() { return promise.get_future(); })
+    .then([&](int v) { value = v; });
+
+  // Future<Result<int, Failure>>, the same as the chain.
+  Future<Result<int, Failure>> rejected =
+    admission.admit([&]() { return promise.get_future(); });
+
+  rejected.then([&](const Failure& e) { errors.push_back(e.message); });
+
+  BOOST_REQUIRE_EQUAL(1u, errors.size());
+  BOOST_CHECK_EQUAL("overloaded", errors[0]);
+
+  promise.set_value(Result<int, Failure>(7));
+  BOOST_CHECK_EQUAL(7, value);
+}
+
+BOOST_AUTO_TEST_CASE(test_admission_releases_dropped_chains) {
+  Admission<> admission(1);
+
+  {
+    Promise<int> promise;
+    admission.admit([&]() { return promise.get_future(); });
+
+    BOOST_CHECK_EQUAL(1u, admission.in_flight());
+  }
+
+  BOOST_CHECK_EQUAL(0u, admission.in_flight());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_aimd_limit) {
+  AimdLimit::Options options;
+  options.initial = 10;
+  options.timeout = chrono::milliseconds(10);
+  options.backoff = 0.5;
+
+  AimdLimit limit(options);
+
+  // Mostly unused, so no reason to grow.
+  limit.update(AdmissionSample{ chrono::milliseconds(1), 2 });
+  BOOST_CHECK_EQUAL(10u, limit.limit());
+
+  limit.update(AdmissionSample{ chrono::milliseconds(1), 10 });
+  limit.update(AdmissionSample{ chrono::milliseconds(1), 10 });
+  BOOST_CHECK_EQUAL(12u, limit.limit());
+
+  limit.update(AdmissionSample{ chrono::milliseconds(20), 10 });
+  BOOST_CHECK_EQUAL(6u, limit.limit());
+
+  for (int i = 0; i < 10; ++i) {
+    limit.update(AdmissionSample{ chrono::milliseconds(20), 1 });
+  }
+
+  BOOST_CHECK_EQUAL(options.min, limit.limit());
+}
+
+BOOST_AUTO_TEST_CASE(test_gradient_limit) {
+  GradientLimit::Options options;
+  options.initial = 20;
+
+  GradientLimit limit(options);
+
+  // Steady latency with the limit in use: grows.
+  for (int i = 0; i < 50; ++i) {
+    limit.update(AdmissionSample{ chrono::milliseconds(1), limit.limit() });
+  }
+
+  auto grown = limit.limit();
+  BOOST_CHECK_GT(grown, 20u);
+
+  // The latency goes up well over the long-term average: shrinks.
+  for (int i = 0; i < 50; ++i) {
+    limit.update(AdmissionSample{ chrono::milliseconds(10), limit.limit() });
+  }
+
+  BOOST_CHECK_LT(limit.limit(), grown);
+}
+
+BOOST_AUTO_TEST_CASE(test_admission_from_many_threads) {
+  Admission<> admission(4);
+
+  atomic<int> inside(0);
+  atomic<int> max_inside(0);
+
+  vector<thread> threads;
+
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&]() {
+      for (int i = 0; i < 1000; ++i) {
+        admission.admit([&]() {
+          auto n = ++inside;
+
+          auto max = max_inside.load();
+          while (n > max && !max_inside.compare_exchange_weak(max, n));
+
+          --inside;
+        });
+      }
+    });
+  }
+
+  for (auto& thread : threads) thread.join();
+
+  BOOST_CHECK_LE(max_inside.load(), 4);
+  BOOST_CHECK_EQUAL(4000u, admission.num_admitted() + admission.num_rejected());
+  BOOST_CHECK_EQUAL(0u, admission.in_flight());
+}
@@ -0,0 +1,1336 @@
+//
+// Copyright (c) 2014 Adam Cigánek (adam.ciganek@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <boost/test/unit_test.hpp>
+#include <boost/asio.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <algorithm>
+#include <thread>
+
+#include "test_helpers.h"
+#include "fry/future_result.h"
+#include "fry/asio.h"
+#include "fry/connection_pool.h"
+#include "fry/datagram.h"
+#include "fry/frame_reader.h"
+#include "fry/loop_bridge.h"
+#include "fry/polling.h"
+#include "fry/rate_limiter.h"
+#include "fry/sendfile.h"
+#include "fry/socket_stream.h"
+#include "fry/udp_batch.h"
+#include "fry/thread_pool.h"
+#include "fry/timeout.h"
+#include "fry/write_queue.h"
+
+using namespace std;
+using namespace fry;
+using boost::asio::io_service;
+using boost::asio::ip::tcp;
+using boost::asio::ip::udp;
+
+namespace {
+  // Pair of connected UDP sockets on the loopback interface.
+  struct Sockets {
+    udp::socket a;
+    udp::socket b;
+
+    explicit Sockets(io_service& service)
+      : a(service, udp::endpoint(boost::asio::ip::address_v4::loopback(), 0))
+      , b(service, udp::endpoint(boost::asio::ip::address_v4::loopback(), 0))
+    {
+      a.connect(b.local_endpoint());
+      b.connect(a.local_endpoint());
+    }
+  };
+
+  // Pair of connected TCP sockets on the loopback interface.
+  struct Connection {
+    tcp::socket client;
+    tcp::socket server;
+
+    explicit Connection(io_service& service)
+      : client(service)
+      , server(service)
+    {
+      tcp::acceptor acceptor(
+        service, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+
+      bool accepted = false;
+
+      asio::async_accept(acceptor, server).then([&]() {
+        accepted = true;
+      });
+
+      client.connect(acceptor.local_endpoint());
+
+      service.run();
+      service.reset();
+
+      BOOST_REQUIRE(accepted);
+    }
+  };
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_use_future) {
+  io_service service;
+  Sockets    sockets(service);
+  Recycler   recycler;
+
+  char        data[] = "hello";
+  char        buffer[16];
+  std::size_t received = 0;
+
+  sockets.b.async_receive( boost::asio::buffer(buffer)
+                         , asio::use_future[recycler]
+  ).then([&](std::size_t length) {
+    received = length;
+  });
+
+  sockets.a.async_send(boost::asio::buffer(data), asio::use_future);
+
+  service.run();
+
+  BOOST_CHECK_EQUAL(sizeof(data), received);
+  BOOST_CHECK_EQUAL(std::string(data), std::string(buffer));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_use_future_on_strand) {
+  io_service         service;
+  io_service::strand strand(service);
+  Sockets            sockets(service);
+  Recycler           recycler;
+
+  char data[] = "hello";
+  char buffer[16];
+  bool in_strand = false;
+
+  sockets.b.async_receive( boost::asio::buffer(buffer)
+                         , asio::use_future_on(strand)[recycler]
+  ).then([&](std::size_t) {
+    in_strand = strand.running_in_this_thread();
+  });
+
+  sockets.a.async_send(boost::asio::buffer(data), asio::use_future);
+
+  service.run();
+
+  BOOST_CHECK(in_strand);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_use_future_on_strand_serializes_continuations) {
+  const int num_threads  = 4;
+  const int num_sockets  = 4;
+  const int num_messages = 250;
+
+  io_service         service;
+  io_service::strand strand(service);
+
+  std::vector<std::unique_ptr<Sockets>> sockets;
+  for (int i = 0; i < num_sockets; ++i) {
+    sockets.emplace_back(new Sockets(service));
+  }
+
+  char data[] = "x";
+  char buffers[num_sockets][16];
+
+  // Not atomic, protected by the strand.
+  int  num_received = 0;
+  int  num_inside   = 0;
+  bool overlapped   = false;
+
+  // Every socket pair plays ping-pong, so there is one datagram in flight per
+  // pair, and the continuations of the different pairs compete for the
+  // strand.
+  std::function<void(int, int)> receive = [&](int i, int count) {
+    sockets[i]->b.async_receive( boost::asio::buffer(buffers[i])
+                               , asio::use_future_on(strand)
+    ).then([&, i, count](std::size_t) {
+      if (++num_inside > 1) overlapped = true;
+      ++num_received;
+      --num_inside;
+
+      if (count + 1 < num_messages) {
+        receive(i, count + 1);
+        sockets[i]->a.async_send(boost::asio::buffer(data), asio::use_future);
+      }
+    });
+  };
+
+  for (int i = 0; i < num_sockets; ++i) {
+    receive(i, 0);
+    sockets[i]->a.async_send(boost::asio::buffer(data), asio::use_future);
+  }
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < num_threads; ++i) {
+    threads.emplace_back([&]() { service.run(); });
+  }
+
+  for (auto& thread : threads) thread.join();
+
+  BOOST_CHECK(!overlapped);
+  BOOST_CHECK_EQUAL(num_sockets * num_messages, num_received);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_then_on_posts_when_outside_of_strand) {
+  io_service         service;
+  io_service::strand strand(service);
+  Promise<int>       promise;
+
+  int  probe     = 0;
+  bool in_strand = false;
+
+  promise.get_future().then_on(strand, [&](int value) {
+    in_strand = strand.running_in_this_thread();
+    return value * 2;
+  }).then([&](int value) {
+    probe = value;
+  });
+
+  promise.set_value(1000);
+
+  // Not run yet, because we are not inside the strand.
+  BOOST_CHECK_EQUAL(0, probe);
+
+  service.run();
+
+  BOOST_CHECK(in_strand);
+  BOOST_CHECK_EQUAL(2000, probe);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_then_on_dispatches_inside_strand) {
+  io_service         service;
+  io_service::strand strand(service);
+
+  int probe = 0;
+
+  strand.post([&]() {
+    make_ready_future(1000).then_on(strand, [&](int value) {
+      probe = value;
+    });
+
+    // Already run, because we are inside the strand.
+    BOOST_CHECK_EQUAL(1000, probe);
+  });
+
+  service.run();
+
+  BOOST_CHECK_EQUAL(1000, probe);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_then_on_with_void_future) {
+  io_service    service;
+  Promise<void> promise;
+  bool          done = false;
+
+  promise.get_future().then_on(service, [&]() {
+    done = true;
+  });
+
+  promise.set_value();
+  service.run();
+
+  BOOST_CHECK(done);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_then_on_with_future_result) {
+  io_service                  service;
+  io_service::strand          strand(service);
+  Promise<asio::Result<int>>  promise;
+
+  int probe = 0;
+
+  promise.get_future().then_on(strand, [&](int value) {
+    return value + 1;
+  }).then([&](int value) {
+    probe = value;
+  });
+
+  promise.set_value(asio::Result<int>(1000));
+  service.run();
+
+  BOOST_CHECK_EQUAL(1001, probe);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_then_on_moves_the_value) {
+  io_service                   service;
+  Promise<std::unique_ptr<int>> promise;
+
+  int probe = 0;
+
+  promise.get_future().then_on(service, [&](std::unique_ptr<int> value) {
+    probe = *value;
+  });
+
+  promise.set_value(std::unique_ptr<int>(new int(1000)));
+  service.run();
+
+  BOOST_CHECK_EQUAL(1000, probe);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_async_read_and_write) {
+  io_service service;
+  Connection connection(service);
+
+  std::string data = "hello world";
+  char        buffer[11];
+  std::size_t written = 0;
+  std::size_t read    = 0;
+
+  asio::async_write( connection.client
+                   , boost::asio::buffer(data)
+  ).then([&](std::size_t length) {
+    written = length;
+  });
+
+  asio::async_read( connection.server
+                  , boost::asio::buffer(buffer)
+  ).then([&](std::size_t length) {
+    read = length;
+  });
+
+  service.run();
+
+  BOOST_CHECK_EQUAL(data.size(), written);
+  BOOST_CHECK_EQUAL(data.size(), read);
+  BOOST_CHECK_EQUAL(data, std::string(buffer, sizeof(buffer)));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_async_read_until) {
+  io_service             service;
+  Connection             connection(service);
+  boost::asio::streambuf buffer;
+
+  std::string data = "first\nsecond\n";
+  std::string first;
+  std::string second;
+
+  boost::asio::write(connection.client, boost::asio::buffer(data));
+
+  asio::async_read_until(connection.server, buffer, '\n'
+  ).then([&](std::size_t length) {
+    std::istream stream(&buffer);
+    std::getline(stream, first);
+
+    return asio::async_read_until(connection.server, buffer, '\n');
+  }).then([&](std::size_t) {
+    std::istream stream(&buffer);
+    std::getline(stream, second);
+  });
+
+  service.run();
+
+  BOOST_CHECK_EQUAL("first", first);
+  BOOST_CHECK_EQUAL("second", second);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_async_read_on_strand) {
+  io_service         service;
+  io_service::strand strand(service);
+  Recycler           recycler;
+  Connection         connection(service);
+
+  char buffer[4];
+  bool in_strand = false;
+
+  asio::async_read( connection.server
+                  , boost::asio::buffer(buffer)
+                  , asio::use_future_on(strand)[recycler]
+  ).then([&](std::size_t) {
+    in_strand = strand.running_in_this_thread();
+  });
+
+  // Two separate writes, so the read is composed of more than one operation.
+  boost::asio::write(connection.client, boost::asio::buffer("ab", 2));
+  service.poll();
+  boost::asio::write(connection.client, boost::asio::buffer("cd", 2));
+
+  service.run();
+
+  BOOST_CHECK(in_strand);
+  BOOST_CHECK_EQUAL("abcd", std::string(buffer, 4));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+namespace {
+  std::string to_string(const boost::asio::const_buffer& buffer) {
+    return std::string( boost::asio::buffer_cast<const char*>(buffer)
+                      , boost::asio::buffer_size(buffer));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_frame_reader_pipelined) {
+  io_service service;
+  Connection connection(service);
+
+  // Several frames written at once, all arriving in a single read.
+  std::string bodies[] = { "one", "", "three", "four" };
+  std::string data;
+
+  for (auto& body : bodies) {
+    asio::FrameHeader header(body.size());
+    data.append(boost::asio::buffer_cast<const char*>(header.buffer()), 4);
+    data.append(body);
+  }
+
+  boost::asio::write(connection.client, boost::asio::buffer(data));
+
+  asio::FrameReader<tcp::socket> reader(connection.server);
+  std::vector<std::string>       frames;
+
+  std::function<void()> read = [&]() {
+    reader.read().then([&](const boost::asio::const_buffer& body) {
+      frames.push_back(to_string(body));
+      if (frames.size() < 4) read();
+    });
+  };
+
+  read();
+  service.run();
+
+  BOOST_REQUIRE_EQUAL(4u, frames.size());
+
+  for (std::size_t i = 0; i < 4; ++i) {
+    BOOST_CHECK_EQUAL(bodies[i], frames[i]);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_frame_reader_split_frame) {
+  io_service service;
+  Connection connection(service);
+
+  asio::FrameReader<tcp::socket> reader(connection.server);
+  std::string                    frame;
+
+  reader.read().then([&](const boost::asio::const_buffer& body) {
+    frame = to_string(body);
+  });
+
+  std::string       body = "hello world";
+  asio::FrameHeader header(body.size());
+
+  // The header arrives in two pieces, then the body in two pieces.
+  auto bytes = boost::asio::buffer_cast<const char*>(header.buffer());
+
+  boost::asio::write(connection.client, boost::asio::buffer(bytes, 2));
+  service.poll();
+  boost::asio::write(connection.client, boost::asio::buffer(bytes + 2, 2));
+  service.poll();
+  boost::asio::write(connection.client, boost::asio::buffer(body.data(), 5));
+  service.poll();
+
+  BOOST_CHECK(frame.empty());
+
+  boost::asio::write(connection.client, boost::asio::buffer(body.data() + 5, 6));
+  service.run();
+
+  BOOST_CHECK_EQUAL(body, frame);
+}
+
+BOOST_AUTO_TEST_CASE(test_frame_reader_too_large_frame) {
+  io_service service;
+  Connection connection(service);
+
+  asio::FrameReader<tcp::socket> reader(connection.server, asio::use_future, 16);
+  boost::system::error_code      error;
+
+  std::string       body(17, 'x');
+  asio::FrameHeader header(body.size());
+
+  asio::async_write(connection.client, header.with(boost::asio::buffer(body)));
+
+  reader.read().then([&](const boost::system::error_code& e) {
+    error = e;
+  });
+
+  service.run();
+
+  BOOST_CHECK(error == boost::asio::error::message_size);
+}
+
+BOOST_AUTO_TEST_CASE(test_frame_reader_end_of_stream) {
+  io_service service;
+  Connection connection(service);
+
+  asio::FrameReader<tcp::socket> reader(connection.server);
+  boost::system::error_code      error;
+
+  reader.read().then([&](const boost::system::error_code& e) {
+    error = e;
+  });
+
+  connection.client.close();
+  service.run();
+
+  BOOST_CHECK(error == boost::asio::error::eof);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_read_stream) {
+  io_service service;
+  Connection connection(service);
+  BufferPool pool(4);
+
+  std::string received;
+  bool        failed = false;
+  bool        ended  = false;
+
+  asio::read_stream(connection.server, pool)
+    .for_each([&](const asio::Result<asio::Chunk>& chunk) {
+      chunk.match(
+        [&](const asio::Chunk& c) {
+          BOOST_CHECK_LE(c.size, 4u);
+          received.append(boost::asio::buffer_cast<const char*>(c.data()), c.size);
+        },
+        [&](const boost::system::error_code&) { failed = true; });
+    })
+    .then([&]() { ended = true; });
+
+  boost::asio::write(connection.client, boost::asio::buffer("hello world", 11));
+  connection.client.close();
+
+  service.run();
+
+  BOOST_CHECK_EQUAL("hello world", received);
+  BOOST_CHECK(!failed);
+  BOOST_CHECK(ended);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_write_queue_coalesces_writes) {
+  io_service service;
+  Connection connection(service);
+
+  asio::WriteQueue<tcp::socket> queue(connection.client);
+
+  const std::size_t        num_messages = 100;
+  std::vector<std::string> messages;
+  std::vector<std::size_t> written(num_messages, 0);
+  std::string              expected;
+
+  for (std::size_t i = 0; i < num_messages; ++i) {
+    messages.push_back("message " + std::to_string(i) + ";");
+    expected += messages.back();
+  }
+
+  // The first write goes out alone, the rest is queued while it is in flight.
+  for (std::size_t i = 0; i < num_messages; ++i) {
+    queue.write(boost::asio::buffer(messages[i])).then([&, i](std::size_t size) {
+      written[i] = size;
+    });
+  }
+
+  std::string received(expected.size(), '\0');
+
+  asio::async_read(connection.server, boost::asio::buffer(&received[0], received.size()));
+
+  service.run();
+
+  BOOST_CHECK_EQUAL(expected, received);
+  BOOST_CHECK_EQUAL(num_messages, queue.num_messages());
+  BOOST_CHECK_EQUAL(2u, queue.num_writes());
+
+  for (std::size_t i = 0; i < num_messages; ++i) {
+    BOOST_CHECK_EQUAL(messages[i].size(), written[i]);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_write_queue_owned_data) {
+  io_service service;
+  Connection connection(service);
+
+  asio::WriteQueue<tcp::socket> queue(connection.client);
+
+  queue.write(std::vector<char>{ 'a', 'b' });
+  queue.write(std::vector<char>{ 'c' });
+  queue.write(std::vector<char>{ 'd', 'e' });
+
+  char buffer[5];
+  asio::async_read(connection.server, boost::asio::buffer(buffer));
+
+  service.run();
+
+  BOOST_CHECK_EQUAL("abcde", std::string(buffer, 5));
+}
+
+BOOST_AUTO_TEST_CASE(test_write_queue_failure) {
+  io_service service;
+  Connection connection(service);
+
+  asio::WriteQueue<tcp::socket> queue(connection.client);
+  std::size_t                   num_failed = 0;
+
+  connection.client.close();
+
+  for (int i = 0; i < 3; ++i) {
+    queue.write(boost::asio::buffer("x", 1)).then([&](const boost::system::error_code&) {
+      ++num_failed;
+    });
+  }
+
+  service.run();
+
+  BOOST_CHECK_EQUAL(3u, num_failed);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_receive_batch) {
+  io_service service;
+  Sockets sockets(service);
+
+  for (int i = 0; i < 5; ++i) {
+    sockets.a.send(boost::asio::buffer(std::to_string(i)));
+  }
+
+  asio::Batch batch(4);
+  std::size_t received = 0;
+
+  asio::async_receive_batch(sockets.b, batch).then([&](std::size_t size) {
+    received = size;
+  });
+
+  service.run();
+
+  BOOST_REQUIRE_EQUAL(4u, received);
+  BOOST_REQUIRE_EQUAL(4u, batch.size());
+
+  for (std::size_t i = 0; i < batch.size(); ++i) {
+    auto payload = batch[i];
+
+    BOOST_CHECK_EQUAL( std::to_string(i)
+                     , std::string( boost::asio::buffer_cast<const char*>(payload)
+                                  , boost::asio::buffer_size(payload)));
+    BOOST_CHECK(sockets.a.local_endpoint() == batch.endpoint(i));
+  }
+
+  // The one left over comes with the next batch.
+  service.reset();
+
+  asio::async_receive_batch(sockets.b, batch).then([&](std::size_t size) {
+    received = size;
+  });
+
+  service.run();
+
+  BOOST_REQUIRE_EQUAL(1u, received);
+  BOOST_CHECK_EQUAL('4', *boost::asio::buffer_cast<const char*>(batch[0]));
+}
+
+BOOST_AUTO_TEST_CASE(test_receive_new_batch) {
+  io_service service;
+  Sockets sockets(service);
+
+  sockets.a.send(boost::asio::buffer("hello", 5));
+
+  std::size_t size = 0;
+
+  asio::async_receive_batch(sockets.b, 8).then([&](const asio::Batch& batch) {
+    size = boost::asio::buffer_size(batch[0]);
+  });
+
+  service.run();
+
+  BOOST_CHECK_EQUAL(5u, size);
+}
+
+BOOST_AUTO_TEST_CASE(test_send_batch_echo) {
+  io_service service;
+  Sockets sockets(service);
+
+  asio::Batch requests(8);
+  asio::Batch replies(8);
+
+  for (int i = 0; i < 3; ++i) {
+    auto message = "message " + std::to_string(i);
+    requests.push_back(boost::asio::buffer(message), sockets.b.local_endpoint());
+  }
+
+  // Sends the requests from a to b, then b echoes what it received.
+  asio::async_send_batch(sockets.a, requests).then([&](std::size_t) {
+    return asio::async_receive_batch(sockets.b, replies);
+  }).then([&](std::size_t) {
+    return asio::async_send_batch(sockets.b, replies);
+  });
+
+  service.run();
+
+  BOOST_REQUIRE_EQUAL(3u, replies.size());
+
+  char buffer[64];
+
+  for (int i = 0; i < 3; ++i) {
+    auto length = sockets.a.receive(boost::asio::buffer(buffer));
+    BOOST_CHECK_EQUAL("message " + std::to_string(i), std::string(buffer, length));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_send_segmented) {
+  io_service service;
+  Sockets sockets(service);
+
+  std::string data(1000, 'x');
+  std::size_t sent = 0;
+
+  asio::async_send_segmented( sockets.a, boost::asio::buffer(data), 300
+                            , sockets.b.local_endpoint()
+  ).then([&](std::size_t size) {
+    sent = size;
+  });
+
+  service.run();
+
+  BOOST_CHECK_EQUAL(1000u, sent);
+
+  char buffer[1000];
+
+  for (std::size_t expected : { 300, 300, 300, 100 }) {
+    BOOST_CHECK_EQUAL(expected, sockets.b.receive(boost::asio::buffer(buffer)));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_send_segmented_with_zero_segment_size) {
+  io_service service;
+  Sockets sockets(service);
+
+  std::string               data(10, 'x');
+  boost::system::error_code error;
+
+  asio::async_send_segmented( sockets.a, boost::asio::buffer(data), 0
+                            , sockets.b.local_endpoint()
+  ).then([&](const boost::system::error_code& e) {
+    error = e;
+  });
+
+  service.run();
+
+  BOOST_CHECK(error == boost::asio::error::invalid_argument);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_concurrent_receives_into_pool) {
+  BufferPool pool(64);
+  io_service service;
+  Sockets sockets(service);
+
+  std::vector<std::string> received;
+
+  for (int i = 0; i < 3; ++i) {
+    asio::async_receive_from(sockets.b, pool).then([&](const asio::Datagram& datagram) {
+      BOOST_CHECK(sockets.a.local_endpoint() == datagram.sender);
+      received.emplace_back(datagram.slab.data(), datagram.size);
+    });
+  }
+
+  // All three receives are pending, each with its own slab.
+  BOOST_CHECK_EQUAL(3u, pool.num_slabs());
+
+  for (int i = 0; i < 3; ++i) {
+    sockets.a.send(boost::asio::buffer(std::to_string(i)));
+  }
+
+  service.run();
+
+  std::sort(received.begin(), received.end());
+  BOOST_CHECK(std::vector<std::string>({ "0", "1", "2" }) == received);
+}
+
+BOOST_AUTO_TEST_CASE(test_send_received_datagram) {
+  BufferPool pool(64);
+  io_service service;
+  Sockets sockets(service);
+
+  sockets.a.send(boost::asio::buffer("ping", 4));
+
+  asio::async_receive_from(sockets.b, pool).then([&](asio::Datagram datagram) {
+    return asio::async_send_to(sockets.b, datagram, datagram.sender);
+  });
+
+  service.run();
+
+  char buffer[16];
+  auto length = sockets.a.receive(boost::asio::buffer(buffer));
+
+  BOOST_CHECK_EQUAL("ping", std::string(buffer, length));
+
+  // The slab went back to the pool.
+  pool.acquire();
+  BOOST_CHECK_EQUAL(1u, pool.num_slabs());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+namespace {
+  // Temporary file with the given content, removed at the end of the test.
+  struct TempFile {
+    std::string path;
+    int         fd;
+
+    explicit TempFile(const std::string& content)
+      : path("/tmp/fry_asio_test_XXXXXX")
+    {
+      fd = ::mkstemp(&path[0]);
+      BOOST_REQUIRE_EQUAL(ssize_t(content.size()), ::write(fd, content.data(), content.size()));
+    }
+
+    ~TempFile() {
+      ::close(fd);
+      ::unlink(path.c_str());
+    }
+  };
+
+  // Much more than the socket buffers take at once.
+  std::string large_content() {
+    std::string result(4 << 20, '\0');
+    for (std::size_t i = 0; i < result.size(); ++i) result[i] = char(i * 7);
+    return result;
+  }
+
+  template<typename Send>
+  void check_file_transfer(Send send) {
+    io_service service;
+    Connection connection(service);
+
+    auto        content = large_content();
+    TempFile    file(content);
+    std::size_t offset  = 1000;
+    std::size_t sent    = 0;
+    std::string received(content.size() - offset, '\0');
+
+    send(connection.client, file.fd, offset, received.size()).then([&](std::size_t size) {
+      sent = size;
+    });
+
+    asio::async_read(connection.server, boost::asio::buffer(&received[0], received.size()));
+
+    service.run();
+
+    BOOST_CHECK_EQUAL(received.size(), sent);
+    BOOST_CHECK(content.substr(offset) == received);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_sendfile) {
+  check_file_transfer([](tcp::socket& socket, int fd, off_t offset, std::size_t size) {
+    return asio::async_sendfile(socket, fd, offset, size);
+  });
+}
+
+BOOST_AUTO_TEST_CASE(test_splice) {
+  check_file_transfer([](tcp::socket& socket, int fd, off_t offset, std::size_t size) {
+    return asio::async_splice(socket, fd, offset, size);
+  });
+}
+
+BOOST_AUTO_TEST_CASE(test_sendfile_past_end_of_file) {
+  io_service service;
+  Connection connection(service);
+  TempFile   file("short");
+
+  boost::system::error_code sendfile_error;
+  boost::system::error_code splice_error;
+
+  asio::async_sendfile(connection.client, file.fd, 0, 100)
+  .then([&](const boost::system::error_code& error) {
+    sendfile_error = error;
+  });
+
+  service.run();
+  service.reset();
+
+  asio::async_splice(connection.client, file.fd, 0, 100)
+  .then([&](const boost::system::error_code& error) {
+    splice_error = error;
+  });
+
+  service.run();
+
+  BOOST_CHECK(sendfile_error == boost::asio::error::eof);
+  BOOST_CHECK(splice_error   == boost::asio::error::eof);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_loop_bridge_coalesces_wakeups) {
+  io_service       service;
+  asio::LoopBridge bridge(service);
+
+  std::vector<int> order;
+
+  // Posted before the loop runs, so they all come with the first wakeup.
+  std::thread([&]() {
+    for (int i = 0; i < 1000; ++i) {
+      bridge.post([&order, i]() { order.push_back(i); });
+    }
+  }).join();
+
+  bridge.post([&]() { service.stop(); });
+  service.run();
+
+  BOOST_REQUIRE_EQUAL(1000u, order.size());
+  for (int i = 0; i < 1000; ++i) BOOST_CHECK_EQUAL(i, order[i]);
+
+  BOOST_CHECK_EQUAL(1001u, bridge.num_posts());
+  BOOST_CHECK_EQUAL(1u,    bridge.num_wakeups());
+}
+
+BOOST_AUTO_TEST_CASE(test_loop_bridge_from_many_threads) {
+  io_service       service;
+  io_service::work work(service);
+  asio::LoopBridge bridge(service);
+
+  const int num_threads = 4;
+  const int per_thread  = 10000;
+
+  std::thread loop([&]() { service.run(); });
+  auto        loop_id = loop.get_id();
+
+  std::size_t num_run       = 0;
+  bool        on_loop       = true;
+  std::vector<std::thread> threads;
+
+  for (int t = 0; t < num_threads; ++t) {
+    threads.emplace_back([&]() {
+      for (int i = 0; i < per_thread; ++i) {
+        bridge.post([&]() {
+          on_loop = on_loop && std::this_thread::get_id() == loop_id;
+
+          if (++num_run == num_threads * per_thread) service.stop();
+        });
+      }
+    });
+  }
+
+  for (auto& thread : threads) thread.join();
+  loop.join();
+
+  BOOST_CHECK_EQUAL(std::size_t(num_threads * per_thread), num_run);
+  BOOST_CHECK(on_loop);
+  BOOST_CHECK_LE(bridge.num_wakeups(), num_run);
+}
+
+BOOST_AUTO_TEST_CASE(test_loop_bridge_offload) {
+  io_service       service;
+  io_service::work work(service);
+  asio::LoopBridge bridge(service);
+  ThreadPool       pool(2);
+
+  auto loop_id = std::this_thread::get_id();
+
+  std::thread::id computed_on;
+  std::thread::id resolved_on;
+  int             result = 0;
+
+  bridge.offload(pool, [&]() {
+    computed_on = std::this_thread::get_id();
+    return 42;
+  }).then([&](int value) {
+    resolved_on = std::this_thread::get_id();
+    result      = value;
+
+    return bridge.offload(pool, []() {});
+  }).then([&]() {
+    service.stop();
+  });
+
+  service.run();
+
+  BOOST_CHECK_EQUAL(42, result);
+  BOOST_CHECK(computed_on != loop_id);
+  BOOST_CHECK(resolved_on == loop_id);
+}
+
+BOOST_AUTO_TEST_CASE(test_loop_bridge_then_on) {
+  io_service       service;
+  io_service::work work(service);
+  asio::LoopBridge bridge(service);
+  ThreadPool       pool(2);
+
+  std::thread::id resolved_on;
+
+  pool.submit([]() { return 1; }).then_on(bridge, [&](int) {
+    resolved_on = std::this_thread::get_id();
+    service.stop();
+  });
+
+  service.run();
+
+  BOOST_CHECK(resolved_on == std::this_thread::get_id());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_run_polling_runs_until_out_of_work) {
+  io_service service;
+  int        count = 0;
+
+  for (int i = 0; i < 10; ++i) service.post([&]() { ++count; });
+
+  auto stats = asio::run_polling(service);
+
+  BOOST_CHECK_EQUAL(10, count);
+  BOOST_CHECK_EQUAL(10u, stats.num_handlers);
+  BOOST_CHECK(service.stopped());
+}
+
+BOOST_AUTO_TEST_CASE(test_run_polling_busy_never_blocks) {
+  io_service                service;
+  boost::asio::steady_timer timer(service);
+  bool                      fired = false;
+
+  timer.expires_from_now(std::chrono::milliseconds(10));
+  timer.async_wait(asio::use_future).then([&]() { fired = true; });
+
+  auto stats = asio::run_polling(service, asio::PollingPolicy::busy());
+
+  BOOST_CHECK(fired);
+  BOOST_CHECK_EQUAL(0u, stats.num_blocks);
+  BOOST_CHECK_GT(stats.num_empty_polls, 0u);
+  BOOST_CHECK(stats.idle >= std::chrono::milliseconds(5));
+}
+
+BOOST_AUTO_TEST_CASE(test_run_polling_blocks_after_spinning) {
+  io_service                service;
+  boost::asio::steady_timer timer(service);
+  bool                      fired = false;
+
+  timer.expires_from_now(std::chrono::milliseconds(20));
+  timer.async_wait(asio::use_future).then([&]() { fired = true; });
+
+  auto stats = asio::run_polling(service, asio::PollingPolicy(
+    std::chrono::microseconds(100), std::chrono::microseconds(100)));
+
+  BOOST_CHECK(fired);
+  BOOST_CHECK_EQUAL(1u, stats.num_blocks);
+  BOOST_CHECK(stats.idle    <  std::chrono::milliseconds(10));
+  BOOST_CHECK(stats.blocked >= std::chrono::milliseconds(10));
+}
+
+BOOST_AUTO_TEST_CASE(test_run_polling_stop) {
+  io_service       service;
+  io_service::work work(service);
+
+  service.post([&]() { service.stop(); });
+
+  auto stats = asio::run_polling(service, asio::PollingPolicy::busy());
+
+  BOOST_CHECK_EQUAL(1u, stats.num_handlers);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_with_timeout_expires) {
+  io_service      service;
+  asio::TimerPool timers(service);
+  udp::socket     socket(service, udp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+
+  char          data[16];
+  udp::endpoint sender;
+
+  boost::system::error_code result;
+  auto start = std::chrono::steady_clock::now();
+
+  asio::with_timeout(socket, [&]() {
+    return socket.async_receive_from(boost::asio::buffer(data), sender, asio::use_future);
+  }, std::chrono::milliseconds(20), timers).then([&](const boost::system::error_code& error) {
+    result = error;
+  });
+
+  service.run();
+
+  BOOST_CHECK_EQUAL(boost::asio::error::timed_out, result);
+  BOOST_CHECK(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(20));
+  BOOST_CHECK_EQUAL(1u, timers.num_idle());
+}
+
+BOOST_AUTO_TEST_CASE(test_with_timeout_completes_first) {
+  io_service      service;
+  asio::TimerPool timers(service);
+  udp::socket     receiver(service, udp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+  udp::socket     sender(service, udp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+
+  char          data[16];
+  udp::endpoint from;
+  std::size_t   received = 0;
+
+  // Timers are reused, one receive after another.
+  std::function<void(int)> receive = [&](int n) {
+    if (n == 0) return;
+
+    sender.send_to(boost::asio::buffer("hello", 5), receiver.local_endpoint());
+
+    asio::with_timeout(receiver, [&]() {
+      return receiver.async_receive_from(boost::asio::buffer(data), from, asio::use_future);
+    }, std::chrono::seconds(10), timers).then([&, n](std::size_t size) {
+      received += size;
+      receive(n - 1);
+    });
+  };
+
+  auto start = std::chrono::steady_clock::now();
+
+  receive(10);
+  service.run();
+
+  BOOST_CHECK_EQUAL(50u, received);
+  BOOST_CHECK(std::chrono::steady_clock::now() - start < std::chrono::seconds(5));
+
+  // The next receive starts before the cancelled timer of the previous one
+  // gets back to the pool, but no more timers than that are ever created.
+  BOOST_CHECK_LE(timers.num_idle(), 2u);
+}
+
+BOOST_AUTO_TEST_CASE(test_with_timeout_unpooled) {
+  io_service    service;
+  tcp::acceptor acceptor(service, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+  tcp::socket   socket(service);
+
+  boost::system::error_code result;
+
+  asio::with_timeout(acceptor, [&]() {
+    return asio::async_accept(acceptor, socket);
+  }, std::chrono::milliseconds(10)).then([&](const boost::system::error_code& error) {
+    result = error;
+  });
+
+  service.run();
+
+  BOOST_CHECK_EQUAL(boost::asio::error::timed_out, result);
+}
+
+BOOST_AUTO_TEST_CASE(test_sleeper_drives_rate_limiter) {
+  io_service    service;
+  asio::Sleeper sleeper(service);
+
+  RateLimiter<asio::Sleeper> limiter(sleeper, 1000, 1);
+
+  int  num_done = 0;
+  auto start    = std::chrono::steady_clock::now();
+
+  for (int i = 0; i < 20; ++i) {
+    limiter.acquire().then([&]() { ++num_done; });
+  }
+
+  service.run();
+
+  BOOST_CHECK_EQUAL(20, num_done);
+  BOOST_CHECK(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(19));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+namespace {
+  typedef asio::ConnectionPool<> Pool;
+
+  // Accepts connections on the loopback interface and keeps them open.
+  struct Listener {
+    io_service&                               service;
+    tcp::acceptor                             acceptor;
+    tcp::endpoint                             address;
+    std::vector<std::unique_ptr<tcp::socket>> accepted;
+
+    explicit Listener(io_service& service)
+      : service(service)
+      , acceptor(service, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0))
+      , address(acceptor.local_endpoint())
+    {
+      accept();
+    }
+
+    const tcp::endpoint& endpoint() const {
+      return address;
+    }
+
+    // Stops accepting, and closes the idle connections of the pool once the
+    // leases in flight are released.
+    void close(Pool& pool) {
+      acceptor.close();
+
+      service.post([&pool]() { pool.clear(); });
+    }
+
+    void accept() {
+      accepted.emplace_back(new tcp::socket(acceptor.get_executor()));
+
+      asio::async_accept(acceptor, *accepted.back()).then([this]() {
+        accept();
+      });
+    }
+  };
+}
+
+BOOST_AUTO_TEST_CASE(test_connection_pool_reuses_connections) {
+  io_service service;
+  Listener   listener(service);
+  Pool       pool(service);
+
+  tcp::endpoint first;
+  tcp::endpoint second;
+  std::size_t   num_idle = 0;
+
+  pool.acquire(listener.endpoint()).then([&](const Pool::Lease& lease) {
+    first = lease->local_endpoint();
+
+    // After the lease is released.
+    service.post([&]() {
+      num_idle = pool.num_idle(listener.endpoint());
+
+      pool.acquire(listener.endpoint()).then([&](const Pool::Lease& lease) {
+        second = lease->local_endpoint();
+        listener.close(pool);
+      });
+    });
+  });
+
+  service.run();
+
+  BOOST_CHECK_EQUAL(1u, num_idle);
+  BOOST_CHECK_EQUAL(first, second);
+  BOOST_CHECK_EQUAL(1u, listener.accepted.size() - 1);
+}
+
+BOOST_AUTO_TEST_CASE(test_connection_pool_waiters_are_served_in_order) {
+  io_service service;
+  Listener   listener(service);
+
+  Pool::Options options;
+  options.max_per_endpoint = 2;
+
+  Pool pool(service, options);
+
+  std::vector<Pool::Lease> leases;
+  std::vector<int>         order;
+
+  for (int i = 0; i < 6; ++i) {
+    pool.acquire(listener.endpoint()).then([&, i](const Pool::Lease& lease) {
+      order.push_back(i);
+
+      // Held until the next one comes, then released.
+      leases.push_back(lease);
+      if (leases.size() > 1) leases.erase(leases.begin());
+
+      if (order.size() == 6) {
+        leases.clear();
+        listener.close(pool);
+      }
+    });
+  }
+
+  BOOST_CHECK_EQUAL(2u, pool.num_open(listener.endpoint()));
+  BOOST_CHECK_EQUAL(4u, pool.num_waiting(listener.endpoint()));
+
+  service.run();
+
+  BOOST_REQUIRE_EQUAL(6u, order.size());
+  for (int i = 0; i < 6; ++i) BOOST_CHECK_EQUAL(i, order[i]);
+
+  BOOST_CHECK_EQUAL(2u, listener.accepted.size() - 1);
+  BOOST_CHECK_EQUAL(0u, pool.num_waiting(listener.endpoint()));
+}
+
+BOOST_AUTO_TEST_CASE(test_connection_pool_checks_idle_connections) {
+  io_service service;
+  Listener   listener(service);
+  Pool       pool(service);
+
+  tcp::endpoint first;
+  tcp::endpoint second;
+
+  pool.acquire(listener.endpoint()).then([&](const Pool::Lease& lease) {
+    first = lease->local_endpoint();
+
+    // The server closes the connection once it is idle.
+    service.post([&]() {
+      listener.accepted.front()->close();
+
+      // Give the FIN time to arrive.
+      service.post([&]() {
+        pool.acquire(listener.endpoint()).then([&](const Pool::Lease& lease) {
+          second = lease->local_endpoint();
+          BOOST_CHECK_EQUAL(1u, pool.num_open(listener.endpoint()));
+          listener.close(pool);
+        });
+      });
+    });
+  });
+
+  service.run();
+
+  BOOST_CHECK(first != second);
+}
+
+BOOST_AUTO_TEST_CASE(test_connection_pool_discard) {
+  io_service service;
+  Listener   listener(service);
+  Pool       pool(service);
+
+  pool.acquire(listener.endpoint()).then([&](const Pool::Lease& lease) {
+    lease.discard();
+    listener.close(pool);
+  });
+
+  service.run();
+
+  BOOST_CHECK_EQUAL(0u, pool.num_open(listener.endpoint()));
+  BOOST_CHECK_EQUAL(0u, pool.num_idle(listener.endpoint()));
+}
+
+BOOST_AUTO_TEST_CASE(test_connection_pool_reaps_idle_connections) {
+  io_service service;
+  Listener   listener(service);
+
+  Pool::Options options;
+  options.idle_timeout = std::chrono::milliseconds(10);
+
+  Pool pool(service, options);
+
+  pool.acquire(listener.endpoint()).then([&](const Pool::Lease&) {
+    listener.acceptor.close();
+  });
+
+  service.run();
+
+  BOOST_CHECK_EQUAL(0u, pool.num_open(listener.endpoint()));
+  BOOST_CHECK_EQUAL(0u, pool.num_idle(listener.endpoint()));
+}
+
+BOOST_AUTO_TEST_CASE(test_connection_pool_connect_failure) {
+  io_service service;
+
+  Pool::Options options;
+  options.max_per_endpoint = 1;
+
+  Pool pool(service, options);
+
+  // Nobody listens there.
+  tcp::endpoint endpoint;
+  {
+    tcp::acceptor acceptor(service, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+    endpoint = acceptor.local_endpoint();
+  }
+
+  std::vector<boost::system::error_code> errors;
+
+  for (int i = 0; i < 2; ++i) {
+    pool.acquire(endpoint).then([&](const boost::system::error_code& error) {
+      errors.push_back(error);
+    });
+  }
+
+  service.run();
+
+  BOOST_REQUIRE_EQUAL(2u, errors.size());
+  BOOST_CHECK_EQUAL(boost::asio::error::connection_refused, errors[0]);
+  BOOST_CHECK_EQUAL(boost::asio::error::connection_refused, errors[1]);
+  BOOST_CHECK_EQUAL(0u, pool.num_open(endpoint));
+}
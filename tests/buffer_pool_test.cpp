@@ -0,0 +1,102 @@
+//
+// Copyright (c) 2014 Adam Cigánek (adam.ciganek@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <boost/test/unit_test.hpp>
+#include <thread>
+
+#include "test_helpers.h"
+#include "fry/buffer_pool.h"
+
+using namespace std;
+using namespace fry;
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_slab_is_reference_counted) {
+  BufferPool pool(64);
+
+  auto a = pool.acquire();
+
+  BOOST_CHECK_EQUAL(64u, a.size());
+  BOOST_CHECK_EQUAL(1u, a.use_count());
+
+  {
+    auto b = a;
+
+    BOOST_CHECK(a.data() == b.data());
+    BOOST_CHECK_EQUAL(2u, a.use_count());
+  }
+
+  BOOST_CHECK_EQUAL(1u, a.use_count());
+
+  auto c = std::move(a);
+
+  BOOST_CHECK(!a);
+  BOOST_CHECK_EQUAL(1u, c.use_count());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_released_slab_is_reused) {
+  BufferPool pool(64);
+
+  char* data;
+
+  {
+    auto a = pool.acquire();
+    data = a.data();
+  }
+
+  auto b = pool.acquire();
+
+  BOOST_CHECK(data == b.data());
+  BOOST_CHECK_EQUAL(1u, pool.num_slabs());
+
+  auto c = pool.acquire();
+
+  BOOST_CHECK(b.data() != c.data());
+  BOOST_CHECK_EQUAL(2u, pool.num_slabs());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_slabs_released_on_other_thread_come_back) {
+  BufferPool pool(64, 4);
+
+  const std::size_t num_slabs = 100;
+
+  std::vector<Slab> slabs;
+  for (std::size_t i = 0; i < num_slabs; ++i) slabs.push_back(pool.acquire());
+
+  // The other thread keeps a few for itself, gives the rest back to the pool
+  // and the rest of its list when it exits.
+  std::thread([&]() { slabs.clear(); }).join();
+
+  for (std::size_t i = 0; i < num_slabs; ++i) slabs.push_back(pool.acquire());
+
+  BOOST_CHECK_EQUAL(num_slabs, pool.num_slabs());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_many_pools_on_one_thread) {
+  std::vector<std::unique_ptr<BufferPool>> pools;
+
+  for (int i = 0; i < 10; ++i) {
+    pools.emplace_back(new BufferPool(32));
+    pools.back()->acquire();
+  }
+
+  // More pools than a thread keeps lists for: the evicted lists went back to
+  // their pools.
+  for (auto& pool : pools) {
+    pool->acquire();
+    BOOST_CHECK_EQUAL(1u, pool->num_slabs());
+  }
+
+  pools.clear();
+
+  BufferPool pool(32);
+  pool.acquire();
+  BOOST_CHECK_EQUAL(1u, pool.num_slabs());
+}
@@ -0,0 +1,242 @@
+//
+// Copyright (c) 2014 Adam Cigánek (adam.ciganek@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <boost/test/unit_test.hpp>
+#include <future>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "test_helpers.h"
+#include "fry/channel.h"
+
+using namespace std;
+using namespace fry;
+
+typedef boost::optional<int> Item;
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_channel_buffers_up_to_capacity) {
+  Channel<int> channel(2);
+  vector<int>  sent;
+
+  channel.send(0).then([&]() { sent.push_back(0); });
+  channel.send(1).then([&]() { sent.push_back(1); });
+  channel.send(2).then([&]() { sent.push_back(2); });
+
+  BOOST_CHECK_EQUAL(2u, sent.size());
+  BOOST_CHECK_EQUAL(2u, channel.size());
+  BOOST_CHECK_EQUAL(1u, channel.num_waiting_senders());
+
+  vector<int> received;
+
+  for (int i = 0; i < 3; ++i) {
+    channel.receive().then([&](Item item) { received.push_back(*item); });
+  }
+
+  BOOST_CHECK_EQUAL(3u, sent.size());
+
+  BOOST_REQUIRE_EQUAL(3u, received.size());
+  for (int i = 0; i < 3; ++i) BOOST_CHECK_EQUAL(i, received[i]);
+
+  BOOST_CHECK_EQUAL(0u, channel.size());
+  BOOST_CHECK_EQUAL(0u, channel.num_waiting_senders());
+}
+
+BOOST_AUTO_TEST_CASE(test_channel_hands_items_to_waiting_receivers) {
+  Channel<unique_ptr<int>> channel(4);
+  vector<int>              received;
+
+  for (int i = 0; i < 2; ++i) {
+    channel.receive().then([&](const boost::optional<unique_ptr<int>>& item) {
+      received.push_back(**item);
+    });
+  }
+
+  BOOST_CHECK_EQUAL(2u, channel.num_waiting_receivers());
+
+  channel.send(unique_ptr<int>(new int(1)));
+  channel.send(unique_ptr<int>(new int(2)));
+
+  BOOST_REQUIRE_EQUAL(2u, received.size());
+  BOOST_CHECK_EQUAL(1, received[0]);
+  BOOST_CHECK_EQUAL(2, received[1]);
+  BOOST_CHECK_EQUAL(0u, channel.size());
+}
+
+BOOST_AUTO_TEST_CASE(test_channel_without_capacity) {
+  Channel<int> channel(0);
+  bool         sent     = false;
+  int          received = 0;
+
+  channel.send(7).then([&]() { sent = true; });
+  BOOST_CHECK(!sent);
+
+  channel.receive().then([&](Item item) { received = *item; });
+
+  BOOST_CHECK(sent);
+  BOOST_CHECK_EQUAL(7, received);
+}
+
+BOOST_AUTO_TEST_CASE(test_channel_close_drains) {
+  Channel<int> channel(1);
+  vector<Item> received;
+
+  channel.send(1);
+  channel.send(2);
+  channel.close();
+
+  BOOST_CHECK(channel.is_closed());
+
+  // Dropped.
+  bool sent = false;
+  channel.send(3).then([&]() { sent = true; });
+  BOOST_CHECK(sent);
+
+  for (int i = 0; i < 4; ++i) {
+    channel.receive().then([&](Item item) { received.push_back(item); });
+  }
+
+  BOOST_REQUIRE_EQUAL(4u, received.size());
+  BOOST_CHECK_EQUAL(1, *received[0]);
+  BOOST_CHECK_EQUAL(2, *received[1]);
+  BOOST_CHECK(!received[2]);
+  BOOST_CHECK(!received[3]);
+}
+
+BOOST_AUTO_TEST_CASE(test_channel_close_resolves_waiting_receivers) {
+  Channel<int> channel(1);
+  bool         closed = false;
+
+  channel.receive().then([&](Item item) { closed = !item; });
+  BOOST_CHECK(!closed);
+
+  channel.close();
+  BOOST_CHECK(closed);
+}
+
+// A send racing with close() either is dropped, or its item is received
+// before the end, never after.
+BOOST_AUTO_TEST_CASE(test_channel_send_racing_with_close) {
+  for (int round = 0; round < 1000; ++round) {
+    Channel<int> channel(4);
+    vector<Item> received;
+
+    channel.receive().then([&](Item item) { received.push_back(item); });
+
+    thread sender([&]() { channel.send(1); });
+    channel.close();
+    sender.join();
+
+    channel.receive().then([&](Item item) { received.push_back(item); });
+
+    BOOST_REQUIRE_EQUAL(2u, received.size());
+    BOOST_REQUIRE(received[0] || !received[1]);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_select) {
+  Channel<int> a(1);
+  Channel<int> b(1);
+
+  typedef pair<size_t, Item> Selected;
+
+  vector<Selected> selected;
+  auto record = [&](Selected s) { selected.push_back(s); };
+
+  // Ready already: the first channel with an item wins.
+  b.send(20);
+  a.send(10);
+
+  select(a, b).then(record);
+
+  BOOST_REQUIRE_EQUAL(1u, selected.size());
+  BOOST_CHECK_EQUAL(0u, selected[0].first);
+  BOOST_CHECK_EQUAL(10, *selected[0].second);
+
+  select(a, b).then(record);
+
+  BOOST_REQUIRE_EQUAL(2u, selected.size());
+  BOOST_CHECK_EQUAL(1u, selected[1].first);
+  BOOST_CHECK_EQUAL(20, *selected[1].second);
+
+  // Waiting on both: only one item is taken.
+  select(a, b).then(record);
+  BOOST_CHECK_EQUAL(2u, selected.size());
+
+  b.send(21);
+  a.send(11);
+
+  BOOST_REQUIRE_EQUAL(3u, selected.size());
+  BOOST_CHECK_EQUAL(1u, selected[2].first);
+  BOOST_CHECK_EQUAL(21, *selected[2].second);
+
+  BOOST_CHECK_EQUAL(1u, a.size());
+
+  int received = 0;
+  a.receive().then([&](Item item) { received = *item; });
+  BOOST_CHECK_EQUAL(11, received);
+
+  // Closed.
+  select(a, b).then(record);
+  b.close();
+
+  BOOST_REQUIRE_EQUAL(4u, selected.size());
+  BOOST_CHECK_EQUAL(1u, selected[3].first);
+  BOOST_CHECK(!selected[3].second);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_channel_from_many_threads) {
+  const int num_producers = 4;
+  const int num_consumers = 4;
+  const int num_items     = 10000;
+
+  Channel<int>           channel(16);
+  std::atomic<long long> sum(0);
+  std::atomic<int>       count(0);
+
+  vector<thread> consumers;
+
+  for (int c = 0; c < num_consumers; ++c) {
+    consumers.emplace_back([&]() {
+      for (;;) {
+        std::promise<Item> received;
+        channel.receive().then([&](Item item) { received.set_value(item); });
+
+        auto item = received.get_future().get();
+        if (!item) break;
+
+        sum   += *item;
+        count += 1;
+      }
+    });
+  }
+
+  vector<thread> producers;
+
+  for (int p = 0; p < num_producers; ++p) {
+    producers.emplace_back([&, p]() {
+      for (int i = 0; i < num_items; ++i) {
+        std::promise<void> sent;
+        channel.send(p * num_items + i).then([&]() { sent.set_value(); });
+        sent.get_future().wait();
+      }
+    });
+  }
+
+  for (auto& producer : producers) producer.join();
+  channel.close();
+
+  for (auto& consumer : consumers) consumer.join();
+
+  long long n = num_producers * num_items;
+
+  BOOST_CHECK_EQUAL(n, count.load());
+  BOOST_CHECK_EQUAL(n * (n - 1) / 2, sum.load());
+}
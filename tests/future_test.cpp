@@ -153,6 +153,50 @@ BOOST_AUTO_TEST_CASE(test_future_returned_from_a_continuation_is_unwrapped) {
   BOOST_CHECK_EQUAL(4, probe);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_pending_future_returned_from_a_continuation_is_unwrapped) {
+  int probe = 1;
+
+  Promise<int> outer_promise;
+  Promise<int> inner_promise;
+
+  auto future = outer_promise.get_future().then([&](int) {
+    return inner_promise.get_future();
+  });
+
+  // The continuation runs before the next one is attached.
+  outer_promise.set_value(1);
+
+  future.then([&](int i) {
+    probe = i;
+  });
+
+  BOOST_CHECK_EQUAL(1, probe);
+
+  inner_promise.set_value(2);
+  BOOST_CHECK_EQUAL(2, probe);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_pending_void_future_returned_from_a_continuation_is_unwrapped) {
+  int probe = 1;
+
+  Promise<void> outer_promise;
+  Promise<void> inner_promise;
+
+  outer_promise.get_future().then([&]() {
+    return inner_promise.get_future();
+  }).then([&]() {
+    probe = 2;
+  });
+
+  outer_promise.set_value();
+  BOOST_CHECK_EQUAL(1, probe);
+
+  inner_promise.set_value();
+  BOOST_CHECK_EQUAL(2, probe);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 BOOST_AUTO_TEST_CASE(test_make_ready_future) {
   int probe = 1;
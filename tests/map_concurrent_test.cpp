@@ -0,0 +1,168 @@
+//
+// Copyright (c) 2014 Adam Cigánek (adam.ciganek@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <boost/test/unit_test.hpp>
+
+#include "test_helpers.h"
+#include "fry/future.h"
+#include "fry/map_concurrent.h"
+
+using namespace std;
+using namespace fry;
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_map_concurrent_limits_pending_futures) {
+  Locked<bool> called{false};
+
+  std::vector<int>          input{ 1, 2, 3, 4, 5 };
+  std::vector<Promise<int>> promises(input.size());
+  std::size_t               num_started = 0;
+
+  auto future = map_concurrent(input, 2, [&](int value) {
+    ++num_started;
+    return promises[value - 1].get_future();
+  });
+
+  future.then([&](const std::vector<int>& results) {
+    called = true;
+    BOOST_CHECK_EQUAL(5u, results.size());
+
+    for (std::size_t i = 0; i < results.size(); ++i) {
+      BOOST_CHECK_EQUAL(input[i] * 10, results[i]);
+    }
+  });
+
+  BOOST_CHECK_EQUAL(2u, num_started);
+
+  // Resolved out of order, the output is still in the order of the input.
+  promises[1].set_value(20);
+  BOOST_CHECK_EQUAL(3u, num_started);
+
+  promises[0].set_value(10);
+  BOOST_CHECK_EQUAL(4u, num_started);
+
+  promises[3].set_value(40);
+  promises[2].set_value(30);
+  BOOST_CHECK_EQUAL(5u, num_started);
+  BOOST_CHECK(!called);
+
+  promises[4].set_value(50);
+  BOOST_CHECK(called);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_map_concurrent_with_ready_futures) {
+  Locked<bool> called{false};
+
+  // Large enough to overflow the stack if every element recursed.
+  std::vector<int> input(100000, 1);
+
+  map_concurrent(input, 4, [](int value) {
+    return make_ready_future(value + 1);
+  }).then([&](const std::vector<int>& results) {
+    called = true;
+    BOOST_CHECK_EQUAL(input.size(), results.size());
+    BOOST_CHECK_EQUAL(2, results.front());
+    BOOST_CHECK_EQUAL(2, results.back());
+  });
+
+  BOOST_CHECK(called);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_map_concurrent_unordered) {
+  Locked<bool> called{false};
+
+  std::vector<int>          input{ 0, 1 };
+  std::vector<Promise<int>> promises(input.size());
+
+  map_concurrent_unordered(input, 2, [&](int value) {
+    return promises[value].get_future();
+  }).then([&](const std::vector<int>& results) {
+    called = true;
+    BOOST_REQUIRE_EQUAL(2u, results.size());
+    BOOST_CHECK_EQUAL(1000, results[0]);
+    BOOST_CHECK_EQUAL(2000, results[1]);
+  });
+
+  promises[1].set_value(1000);
+  promises[0].set_value(2000);
+
+  BOOST_CHECK(called);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_map_concurrent_success_fails_fast) {
+  typedef Result<int, TestError> R;
+
+  Locked<bool> success_called{false};
+  Locked<bool> failure_called{false};
+
+  std::vector<int>        input{ 0, 1, 2, 3 };
+  std::vector<Promise<R>> promises(input.size());
+  std::size_t             num_started = 0;
+
+  map_concurrent_success(input, 2, [&](int value) {
+    ++num_started;
+    return promises[value].get_future();
+  }).then([&](const std::vector<int>&) {
+    success_called = true;
+  }).then([&](TestError error) {
+    failure_called = true;
+    BOOST_CHECK_EQUAL(error1, error);
+  });
+
+  promises[1].set_value(R(error1));
+
+  BOOST_CHECK(failure_called);
+  BOOST_CHECK_EQUAL(2u, num_started);
+
+  promises[0].set_value(R(1000));
+  BOOST_CHECK_EQUAL(2u, num_started);
+  BOOST_CHECK(!success_called);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_map_concurrent_collects_errors) {
+  typedef Result<int, TestError> R;
+
+  Locked<bool> called{false};
+
+  std::vector<int> input{ 0, 1 };
+
+  map_concurrent(input, 1, [&](int value) {
+    return make_ready_future(value == 0 ? R(1000) : R(error1));
+  }).then([&](const std::vector<R>& results) {
+    called = true;
+    BOOST_REQUIRE_EQUAL(2u, results.size());
+    BOOST_CHECK_EQUAL(R(1000),   results[0]);
+    BOOST_CHECK_EQUAL(R(error1), results[1]);
+  });
+
+  BOOST_CHECK(called);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_for_each_concurrent) {
+  Locked<bool> called{false};
+
+  std::vector<int>           input{ 0, 1, 2 };
+  std::vector<Promise<void>> promises(input.size());
+
+  for_each_concurrent(input, 2, [&](int value) {
+    return promises[value].get_future();
+  }).then([&]() {
+    called = true;
+  });
+
+  promises[0].set_value();
+  promises[1].set_value();
+  BOOST_CHECK(!called);
+
+  promises[2].set_value();
+  BOOST_CHECK(called);
+}
@@ -0,0 +1,144 @@
+//
+// Copyright (c) 2014 Adam Cigánek (adam.ciganek@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <boost/test/unit_test.hpp>
+#include <future>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+
+#include "test_helpers.h"
+#include "fry/future.h"
+#include "fry/parallel.h"
+
+using namespace std;
+using namespace fry;
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_parallel_for) {
+  ThreadPool pool(4);
+  std::promise<void> done;
+
+  std::vector<int> values(10000, 1);
+
+  parallel_for(pool, values, 0, [](int& value) {
+    value *= 2;
+  }).then([&]() {
+    done.set_value();
+  });
+
+  done.get_future().wait();
+
+  BOOST_CHECK(std::all_of(values.begin(), values.end(), [](int value) {
+    return value == 2;
+  }));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_parallel_reduce) {
+  ThreadPool pool(4);
+  std::promise<long> done;
+
+  std::vector<int> values(10000);
+  std::iota(values.begin(), values.end(), 1);
+
+  parallel_reduce(pool, values, 100, 0L, [](long acc, int value) {
+    return acc + value;
+  }, [](long a, long b) {
+    return a + b;
+  }).then([&](long sum) {
+    done.set_value(sum);
+  });
+
+  BOOST_CHECK_EQUAL(50005000L, done.get_future().get());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_parallel_reduce_merges_in_order) {
+  ThreadPool pool(4);
+
+  std::vector<char> values(5000);
+  for (std::size_t i = 0; i < values.size(); ++i) values[i] = 'a' + i % 26;
+
+  std::string expected(values.begin(), values.end());
+
+  // Concatenation is associative but not commutative.
+  for (std::size_t grain : { 0, 7 }) {
+    std::promise<std::string> done;
+
+    parallel_reduce(pool, values, grain, std::string(), [](std::string acc, char c) {
+      acc.push_back(c);
+      return acc;
+    }, [](std::string a, const std::string& b) {
+      return a + b;
+    }).then([&](const std::string& result) {
+      done.set_value(result);
+    });
+
+    BOOST_CHECK(expected == done.get_future().get());
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_parallel_for_with_automatic_grain_spreads_work) {
+  ThreadPool pool(4);
+  std::promise<void> done;
+
+  std::mutex                mutex;
+  std::set<std::thread::id> threads;
+  std::vector<int>          values(200);
+
+  parallel_for(pool, values, 0, [&](int&) {
+    std::this_thread::sleep_for(std::chrono::microseconds(500));
+
+    std::lock_guard<std::mutex> lock(mutex);
+    threads.insert(std::this_thread::get_id());
+  }).then([&]() {
+    done.set_value();
+  });
+
+  done.get_future().wait();
+  BOOST_CHECK(threads.size() > 1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_parallel_reduce_with_empty_range) {
+  ThreadPool pool(2);
+  Locked<bool> called{false};
+
+  std::vector<int> values;
+
+  parallel_reduce(pool, values, 0, 42, [](int acc, int value) {
+    return acc + value;
+  }).then([&](int sum) {
+    called = true;
+    BOOST_CHECK_EQUAL(42, sum);
+  });
+
+  BOOST_CHECK(called);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_parallel_sort) {
+  ThreadPool pool(4);
+  std::promise<void> done;
+
+  std::vector<int> values(100000);
+  std::mt19937 random(1);
+  std::generate(values.begin(), values.end(), random);
+
+  auto expected = values;
+  std::sort(expected.begin(), expected.end());
+
+  parallel_sort(pool, values).then([&]() {
+    done.set_value();
+  });
+
+  done.get_future().wait();
+  BOOST_CHECK(values == expected);
+}
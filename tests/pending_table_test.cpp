@@ -0,0 +1,175 @@
+//
+// Copyright (c) 2014 Adam Cigánek (adam.ciganek@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <boost/test/unit_test.hpp>
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include "test_helpers.h"
+#include "fry/pending_table.h"
+
+using namespace std;
+using namespace fry;
+
+namespace {
+  typedef PendingTable<int, std::string> Table;
+
+  const auto later = std::chrono::seconds(60);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_fulfil) {
+  Table       table(16);
+  std::string result;
+
+  table.expect(1, later).then([&](const std::string& value) {
+    result = value;
+  });
+
+  BOOST_CHECK_EQUAL(1u, table.size());
+  BOOST_CHECK(table.fulfil(1, std::string("one")));
+  BOOST_CHECK_EQUAL("one", result);
+  BOOST_CHECK_EQUAL(0u, table.size());
+
+  // Only once.
+  BOOST_CHECK(!table.fulfil(1, std::string("again")));
+  BOOST_CHECK(!table.fulfil(2, std::string("unknown")));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_duplicate_id) {
+  Table           table(16);
+  std::error_code error;
+
+  table.expect(1, later);
+  table.expect(1, later).then([&](const std::error_code& e) {
+    error = e;
+  });
+
+  BOOST_CHECK(error == std::errc::file_exists);
+  BOOST_CHECK_EQUAL(1u, table.size());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_full) {
+  Table           table(4, 1);
+  std::error_code error;
+  int             size = 0;
+
+  while (!error) {
+    table.expect(size, later).then([&](const std::error_code& e) {
+      error = e;
+    });
+
+    if (!error) ++size;
+  }
+
+  BOOST_CHECK(error == std::errc::no_buffer_space);
+  BOOST_CHECK_GE(size, 4);
+
+  // Room again once one is done.
+  table.fulfil(0, std::string());
+  error = std::error_code();
+
+  table.expect(size, later).then([&](const std::error_code& e) {
+    error = e;
+  });
+
+  BOOST_CHECK(!error);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_expire) {
+  Table table(16);
+  auto  now = Table::Clock::now();
+
+  std::vector<std::error_code> errors(3);
+
+  for (int i = 0; i < 3; ++i) {
+    table.expect(i, now + std::chrono::seconds(i)).then([&, i](const std::error_code& e) {
+      errors[i] = e;
+    });
+  }
+
+  BOOST_CHECK_EQUAL(2u, table.expire(now + std::chrono::milliseconds(1500)));
+
+  BOOST_CHECK(errors[0] == std::errc::timed_out);
+  BOOST_CHECK(errors[1] == std::errc::timed_out);
+  BOOST_CHECK(!errors[2]);
+
+  BOOST_CHECK(!table.fulfil(0, std::string()));
+  BOOST_CHECK(table.fulfil(2, std::string()));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_collisions) {
+  // All ids hash the same, so they all probe the same run of slots, and
+  // removing any of them must keep the others reachable.
+  struct SameHash {
+    std::size_t operator () (int) const { return 0; }
+  };
+
+  PendingTable<int, int, SameHash> table(64, 1);
+  std::vector<int>                 results(32, -1);
+
+  for (int i = 0; i < 32; ++i) {
+    table.expect(i, later).then([&, i](int value) { results[i] = value; });
+  }
+
+  for (int i = 0; i < 32; i += 2)     BOOST_CHECK(table.fulfil(i, i));
+  table.expire(Table::Clock::now());
+  for (int i = 31; i > 0; i -= 2)     BOOST_CHECK(table.fulfil(i, i));
+
+  for (int i = 0; i < 32; ++i) BOOST_CHECK_EQUAL(i, results[i]);
+  BOOST_CHECK_EQUAL(0u, table.size());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_continuation_uses_table) {
+  Table table(16);
+  bool  done = false;
+
+  table.expect(1, later).then([&](const std::string&) {
+    return table.expect(2, later);
+  }).then([&](const std::string& value) {
+    done = value == "two";
+  });
+
+  table.fulfil(1, std::string("one"));
+  table.fulfil(2, std::string("two"));
+
+  BOOST_CHECK(done);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_concurrent) {
+  const int num_threads = 4;
+  const int per_thread  = 10000;
+
+  PendingTable<int, int> table(num_threads * per_thread);
+  std::atomic<int>       sum(0);
+
+  for (int i = 0; i < num_threads * per_thread; ++i) {
+    table.expect(i, later).then([&](int value) { sum += value; });
+  }
+
+  std::vector<std::thread> threads;
+
+  for (int t = 0; t < num_threads; ++t) {
+    threads.emplace_back([&, t]() {
+      for (int i = t * per_thread; i < (t + 1) * per_thread; ++i) {
+        table.fulfil(i, 1);
+      }
+    });
+  }
+
+  for (auto& thread : threads) thread.join();
+
+  BOOST_CHECK_EQUAL(num_threads * per_thread, sum);
+  BOOST_CHECK_EQUAL(0u, table.size());
+}
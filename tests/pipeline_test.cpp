@@ -0,0 +1,136 @@
+//
+// Copyright (c) 2014 Adam Cigánek (adam.ciganek@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <boost/test/unit_test.hpp>
+
+#include "test_helpers.h"
+#include "fry/future.h"
+#include "fry/pipeline.h"
+
+using namespace std;
+using namespace fry;
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_pipeline_passes_items_through_stages) {
+  std::vector<std::string> output;
+
+  auto pipeline = Pipeline<int>()
+    .stage([](int value) {
+      return make_ready_future(value * 2);
+    })
+    .stage([](int value) {
+      return make_ready_future(std::to_string(value));
+    })
+    .stage([&](std::string value) {
+      output.push_back(std::move(value));
+      return make_ready_future();
+    });
+
+  pipeline.push(1);
+  pipeline.push(2);
+  pipeline.push(3);
+
+  BOOST_REQUIRE_EQUAL(3u, output.size());
+  BOOST_CHECK_EQUAL("2", output[0]);
+  BOOST_CHECK_EQUAL("4", output[1]);
+  BOOST_CHECK_EQUAL("6", output[2]);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_pipeline_moves_items) {
+  std::vector<std::unique_ptr<int>> output;
+
+  auto pipeline = Pipeline<std::unique_ptr<int>>()
+    .stage([&](std::unique_ptr<int> value) {
+      output.push_back(std::move(value));
+      return make_ready_future();
+    });
+
+  pipeline.push(std::unique_ptr<int>(new int(42)));
+
+  BOOST_REQUIRE_EQUAL(1u, output.size());
+  BOOST_CHECK_EQUAL(42, *output[0]);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_pipeline_backpressure) {
+  std::vector<Promise<int>>  first(4);
+  std::vector<Promise<void>> second(4);
+
+  auto pipeline = Pipeline<int>(2)
+    .stage([&](int index) { return first[index].get_future(); }, 1, 1)
+    .stage([&](int index) { return second[index].get_future(); }, 1, 1);
+
+  std::vector<bool> admitted(4, false);
+
+  for (int i = 0; i < 4; ++i) {
+    pipeline.push(i).then([&, i](bool ok) { admitted[i] = ok; });
+  }
+
+  // Item 0 is being processed by the first stage, item 1 is queued in front
+  // of it and items 2 and 3 are waiting.
+  BOOST_CHECK(admitted[0]);
+  BOOST_CHECK(admitted[1]);
+  BOOST_CHECK(!admitted[2]);
+  BOOST_CHECK(!admitted[3]);
+
+  // Two pushes are waiting already, so the next one is rejected.
+  boost::optional<bool> rejected;
+  pipeline.push(4).then([&](bool ok) { rejected = ok; });
+
+  BOOST_REQUIRE(rejected);
+  BOOST_CHECK(!*rejected);
+  BOOST_CHECK_EQUAL(1u, pipeline.stats()[0].num_rejected);
+
+  // Item 0 moves to the second stage, item 1 starts processing, item 2 is
+  // admitted to the queue.
+  first[0].set_value(0);
+  BOOST_CHECK(admitted[2]);
+  BOOST_CHECK(!admitted[3]);
+
+  // Item 1 is queued in front of the second stage, item 2 starts processing,
+  // item 3 is admitted.
+  first[1].set_value(1);
+  BOOST_CHECK(admitted[3]);
+
+  // The second stage is full, so item 2 stalls the first stage.
+  first[2].set_value(2);
+
+  auto stats = pipeline.stats();
+  BOOST_REQUIRE_EQUAL(2u, stats.size());
+  BOOST_CHECK_EQUAL(1u, stats[0].num_pending);
+  BOOST_CHECK_EQUAL(1u, stats[0].queue_depth);
+  BOOST_CHECK_EQUAL(3u, stats[0].num_processed);
+  BOOST_CHECK_EQUAL(1u, stats[1].num_pending);
+  BOOST_CHECK_EQUAL(1u, stats[1].queue_depth);
+  BOOST_CHECK_EQUAL(0u, stats[1].num_processed);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_pipeline_close_drains_all_stages) {
+  Locked<bool> drained{false};
+
+  std::vector<Promise<int>>  first(2);
+  std::vector<Promise<void>> second(2);
+
+  auto pipeline = Pipeline<int>()
+    .stage([&](int index) { return first[index].get_future(); }, 2, 2)
+    .stage([&](int index) { return second[index].get_future(); }, 2, 2);
+
+  pipeline.push(0);
+  pipeline.push(1);
+
+  pipeline.close().then([&]() { drained = true; });
+
+  first[0].set_value(0);
+  first[1].set_value(1);
+  second[0].set_value();
+  BOOST_CHECK(!drained);
+
+  second[1].set_value();
+  BOOST_CHECK(drained);
+}
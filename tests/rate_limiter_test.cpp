@@ -0,0 +1,139 @@
+//
+// Copyright (c) 2014 Adam Cigánek (adam.ciganek@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <boost/test/unit_test.hpp>
+#include <thread>
+#include <vector>
+
+#include "test_helpers.h"
+#include "fry/future.h"
+#include "fry/rate_limiter.h"
+#include "fry/reactor.h"
+
+using namespace std;
+using namespace fry;
+
+typedef RateLimiter<Reactor> Limiter;
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_rate_limiter_burst) {
+  Reactor reactor;
+  Limiter limiter(reactor, 100, 5);
+  int     num_done = 0;
+
+  for (int i = 0; i < 6; ++i) {
+    limiter.acquire().then([&]() { ++num_done; });
+  }
+
+  BOOST_CHECK_EQUAL(5, num_done);
+  BOOST_CHECK_EQUAL(1u, limiter.num_waiting());
+  BOOST_CHECK(!limiter.try_acquire());
+}
+
+BOOST_AUTO_TEST_CASE(test_rate_limiter_waits_for_refill) {
+  Reactor reactor;
+  Limiter limiter(reactor, 1000, 1);
+
+  std::vector<int> order;
+  auto             start = Limiter::Clock::now();
+
+  for (int i = 0; i < 50; ++i) {
+    limiter.acquire().then([&, i]() {
+      order.push_back(i);
+      if (order.size() == 50) reactor.stop();
+    });
+  }
+
+  reactor.run();
+
+  auto elapsed = Limiter::Clock::now() - start;
+
+  BOOST_REQUIRE_EQUAL(50u, order.size());
+  for (int i = 0; i < 50; ++i) BOOST_CHECK_EQUAL(i, order[i]);
+
+  // The first goes right away, the rest one per millisecond.
+  BOOST_CHECK(elapsed >= std::chrono::milliseconds(49));
+  BOOST_CHECK(elapsed <  std::chrono::milliseconds(500));
+}
+
+BOOST_AUTO_TEST_CASE(test_rate_limiter_many_tokens) {
+  Reactor reactor;
+  Limiter limiter(reactor, 1000, 10);
+  bool    done = false;
+
+  limiter.acquire(10);
+
+  // Has to wait for the whole bucket to refill.
+  auto start = Limiter::Clock::now();
+
+  limiter.acquire(10).then([&]() {
+    done = true;
+    reactor.stop();
+  });
+
+  BOOST_CHECK(!done);
+  reactor.run();
+
+  BOOST_CHECK(done);
+  BOOST_CHECK(Limiter::Clock::now() - start >= std::chrono::milliseconds(9));
+}
+
+BOOST_AUTO_TEST_CASE(test_rate_limiter_from_other_threads) {
+  Reactor reactor;
+  Limiter limiter(reactor, 10000, 10);
+  int     num_done = 0;
+
+  std::thread([&]() {
+    for (int i = 0; i < 100; ++i) {
+      limiter.acquire().then([&]() {
+        // On the reactor, once the burst is used up.
+        if (++num_done == 100) reactor.post([&]() { reactor.stop(); });
+      });
+    }
+  }).join();
+
+  reactor.run();
+
+  BOOST_CHECK_EQUAL(100, num_done);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_rate_limiter_hierarchy) {
+  Reactor reactor;
+  Limiter global(reactor, 1000, 4);
+  Limiter a(global, 100, 2);
+  Limiter b(global, 100, 2);
+
+  int num_a = 0;
+  int num_b = 0;
+
+  for (int i = 0; i < 3; ++i) {
+    a.acquire().then([&]() { ++num_a; });
+  }
+
+  // The third of a's waits for a, although the global limit has room.
+  BOOST_CHECK_EQUAL(2, num_a);
+  BOOST_CHECK_EQUAL(1u, a.num_waiting());
+  BOOST_CHECK_EQUAL(0u, global.num_waiting());
+
+  for (int i = 0; i < 3; ++i) {
+    b.acquire().then([&]() { ++num_b; });
+  }
+
+  // b's first two take the rest of the global burst, the third waits for b.
+  BOOST_CHECK_EQUAL(2, num_b);
+  BOOST_CHECK(!b.try_acquire());
+
+  reactor.sleep_for(std::chrono::milliseconds(30)).then([&]() {
+    reactor.stop();
+  });
+
+  reactor.run();
+
+  BOOST_CHECK_EQUAL(3, num_a);
+  BOOST_CHECK_EQUAL(3, num_b);
+}
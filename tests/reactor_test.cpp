@@ -0,0 +1,213 @@
+//
+// Copyright (c) 2014 Adam Cigánek (adam.ciganek@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <boost/test/unit_test.hpp>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "test_helpers.h"
+#include "fry/future.h"
+#include "fry/reactor.h"
+#include "fry/thread_pool.h"
+
+using namespace std;
+using namespace fry;
+
+namespace {
+  struct Pipe {
+    int read_end;
+    int write_end;
+
+    Pipe() {
+      int ends[2];
+      BOOST_REQUIRE_EQUAL(0, ::pipe2(ends, O_NONBLOCK | O_CLOEXEC));
+      read_end  = ends[0];
+      write_end = ends[1];
+    }
+
+    ~Pipe() {
+      ::close(read_end);
+      ::close(write_end);
+    }
+
+    void write() {
+      char c = 'x';
+      BOOST_REQUIRE_EQUAL(1, ::write(write_end, &c, 1));
+    }
+  };
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_reactor_post) {
+  Reactor reactor;
+
+  std::vector<int> order;
+  bool             on_loop = true;
+
+  std::thread([&]() {
+    for (int i = 0; i < 100; ++i) {
+      reactor.post([&, i]() {
+        order.push_back(i);
+        on_loop = on_loop && reactor.running_in_this_thread();
+      });
+    }
+
+    reactor.post([&]() { reactor.stop(); });
+  }).join();
+
+  reactor.run();
+
+  BOOST_REQUIRE_EQUAL(100u, order.size());
+  for (int i = 0; i < 100; ++i) BOOST_CHECK_EQUAL(i, order[i]);
+
+  BOOST_CHECK(on_loop);
+  BOOST_CHECK_EQUAL(1u, reactor.num_wakeups());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_reactor_sleep) {
+  Reactor reactor;
+
+  std::vector<int> order;
+  auto             start = Reactor::Clock::now();
+
+  reactor.sleep_for(std::chrono::milliseconds(30)).then([&]() {
+    order.push_back(30);
+    reactor.stop();
+  });
+
+  reactor.sleep_for(std::chrono::milliseconds(10)).then([&]() {
+    order.push_back(10);
+
+    reactor.sleep_for(std::chrono::milliseconds(10)).then([&]() {
+      order.push_back(20);
+    });
+  });
+
+  reactor.sleep_until(start).then([&]() {
+    order.push_back(0);
+  });
+
+  reactor.run();
+
+  BOOST_REQUIRE_EQUAL(4u, order.size());
+  BOOST_CHECK_EQUAL(0,  order[0]);
+  BOOST_CHECK_EQUAL(10, order[1]);
+  BOOST_CHECK_EQUAL(20, order[2]);
+  BOOST_CHECK_EQUAL(30, order[3]);
+
+  BOOST_CHECK(Reactor::Clock::now() - start >= std::chrono::milliseconds(30));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_reactor_readable) {
+  Reactor reactor;
+  Pipe    pipe;
+  int     num_read = 0;
+
+  reactor.readable(pipe.read_end).then([&]() {
+    char c;
+    while (::read(pipe.read_end, &c, 1) == 1) ++num_read;
+
+    reactor.stop();
+  });
+
+  reactor.sleep_for(std::chrono::milliseconds(5)).then([&]() {
+    pipe.write();
+    pipe.write();
+  });
+
+  reactor.run();
+  reactor.remove(pipe.read_end);
+
+  BOOST_CHECK_EQUAL(2, num_read);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Data that comes after the last read but before readable() is not missed.
+BOOST_AUTO_TEST_CASE(test_reactor_readable_remembers_edges) {
+  Reactor reactor;
+  Pipe    pipe;
+  bool    done = false;
+
+  reactor.readable(pipe.read_end).then([&]() {
+    char c;
+    while (::read(pipe.read_end, &c, 1) == 1);
+
+    // Arrives while nobody waits.
+    pipe.write();
+
+    reactor.sleep_for(std::chrono::milliseconds(5)).then([&]() {
+      reactor.readable(pipe.read_end).then([&]() {
+        done = true;
+        reactor.stop();
+      });
+    });
+  });
+
+  pipe.write();
+  reactor.run();
+  reactor.remove(pipe.read_end);
+
+  BOOST_CHECK(done);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_reactor_writable) {
+  Reactor reactor;
+  int     fds[2];
+  bool    done = false;
+
+  BOOST_REQUIRE_EQUAL(0, ::socketpair( AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK
+                                     , 0, fds));
+
+  reactor.writable(fds[0]).then([&]() {
+    done = true;
+    reactor.stop();
+  });
+
+  reactor.run();
+  reactor.remove(fds[0]);
+
+  ::close(fds[0]);
+  ::close(fds[1]);
+
+  BOOST_CHECK(done);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_reactor_remove_wakes_waiters) {
+  Reactor reactor;
+  Pipe    pipe;
+  int     num_woken = 0;
+
+  reactor.readable(pipe.read_end).then([&]() { ++num_woken; });
+  reactor.readable(pipe.read_end).then([&]() { ++num_woken; });
+
+  reactor.remove(pipe.read_end);
+
+  BOOST_CHECK_EQUAL(2, num_woken);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_reactor_then_on) {
+  Reactor    reactor;
+  ThreadPool pool(2);
+  bool       on_loop = false;
+
+  pool.submit([]() { return 1; }).then_on(reactor, [&](int) {
+    on_loop = reactor.running_in_this_thread();
+    reactor.stop();
+  });
+
+  reactor.run();
+
+  BOOST_CHECK(on_loop);
+}
@@ -0,0 +1,58 @@
+//
+// Copyright (c) 2014 Adam Cigánek (adam.ciganek@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <boost/test/unit_test.hpp>
+
+#include "test_helpers.h"
+#include "fry/future.h"
+#include "fry/recycling_allocator.h"
+
+using namespace std;
+using namespace fry;
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_recycler_reuses_blocks_of_the_same_size_class) {
+  Recycler recycler;
+
+  auto a = recycler.allocate(100);
+  recycler.deallocate(a, 100);
+
+  auto b = recycler.allocate(99);
+  BOOST_CHECK_EQUAL(a, b);
+
+  auto c = recycler.allocate(100);
+  BOOST_CHECK_NE(b, c);
+
+  recycler.deallocate(b, 99);
+  recycler.deallocate(c, 100);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_recycler_does_not_keep_large_blocks) {
+  Recycler recycler;
+
+  auto a = recycler.allocate(Recycler::max_size + 1);
+  recycler.deallocate(a, Recycler::max_size + 1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_promise_with_recycling_allocator) {
+  Recycler recycler;
+  int probe = 0;
+
+  {
+    Promise<int> promise(std::allocator_arg, RecyclingAllocator<int>(&recycler));
+
+    promise.get_future().then([&](int value) {
+      probe = value;
+    });
+
+    promise.set_value(1000);
+  }
+
+  BOOST_CHECK_EQUAL(1000, probe);
+}
@@ -0,0 +1,250 @@
+//
+// Copyright (c) 2014 Adam Cigánek (adam.ciganek@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <boost/test/unit_test.hpp>
+#include <atomic>
+#include <future>
+#include <thread>
+#include <vector>
+
+#include "test_helpers.h"
+#include "fry/future.h"
+#include "fry/sharded_runtime.h"
+#include "fry/thread_pool.h"
+
+using namespace std;
+using namespace fry;
+
+typedef ShardedRuntime::Shard Shard;
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_sharded_runtime_start_and_stop) {
+  ShardedRuntime runtime(3);
+  BOOST_CHECK_EQUAL(3u, runtime.size());
+
+  std::atomic<int>      num_started(0);
+  std::vector<Shard*>   seen(3, nullptr);
+  std::vector<thread::id> threads(3);
+
+  runtime.start([&](Shard& shard) {
+    seen[shard.index()]    = ShardedRuntime::current();
+    threads[shard.index()] = this_thread::get_id();
+    ++num_started;
+  });
+
+  while (num_started < 3) this_thread::yield();
+
+  runtime.stop();
+  runtime.join();
+
+  for (std::size_t i = 0; i < 3; ++i) {
+    BOOST_CHECK(seen[i] == &runtime.shard(i));
+    BOOST_CHECK(threads[i] != this_thread::get_id());
+  }
+
+  BOOST_CHECK(threads[0] != threads[1]);
+  BOOST_CHECK(ShardedRuntime::current() == nullptr);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_sharded_runtime_keeps_setup_result) {
+  ShardedRuntime   runtime(2);
+  std::atomic<int> num_alive(0);
+  std::atomic<int> num_started(0);
+
+  struct Guard {
+    std::atomic<int>& count;
+    Guard(std::atomic<int>& count) : count(count) { ++count; }
+    ~Guard() { --count; }
+  };
+
+  runtime.start([&](Shard&) {
+    auto guard = std::make_shared<Guard>(num_alive);
+    ++num_started;
+    return guard;
+  });
+
+  while (num_started < 2) this_thread::yield();
+  BOOST_CHECK_EQUAL(2, num_alive.load());
+
+  runtime.stop();
+  runtime.join();
+
+  BOOST_CHECK_EQUAL(0, num_alive.load());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_sharded_runtime_submit_to) {
+  ShardedRuntime     runtime(2, false);
+  std::promise<void> done;
+
+  thread::id ran_on;
+  thread::id resolved_on;
+  thread::id shard_0;
+  int        result = 0;
+
+  runtime.start([&](Shard& shard) {
+    if (shard.index() != 0) return;
+
+    shard_0 = this_thread::get_id();
+
+    runtime.submit_to(1, [&]() {
+      ran_on = this_thread::get_id();
+      return 42;
+    }).then([&](int value) {
+      resolved_on = this_thread::get_id();
+      result      = value;
+      done.set_value();
+    });
+  });
+
+  done.get_future().wait();
+  runtime.stop();
+  runtime.join();
+
+  BOOST_CHECK_EQUAL(42, result);
+  BOOST_CHECK(ran_on != shard_0);
+  BOOST_CHECK(resolved_on == shard_0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_sharded_runtime_submit_to_flattens_futures) {
+  ShardedRuntime     runtime(3, false);
+  std::promise<int>  done;
+
+  runtime.start([&](Shard& shard) {
+    if (shard.index() != 0) return;
+
+    runtime.submit_to(1, [&]() {
+      return runtime.submit_to(2, []() { return 1000; });
+    }).then([&](int value) {
+      done.set_value(value);
+    });
+  });
+
+  BOOST_CHECK_EQUAL(1000, done.get_future().get());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_sharded_runtime_submit_to_moves_results) {
+  ShardedRuntime    runtime(2, false);
+  std::promise<int> done;
+
+  runtime.start([&](Shard& shard) {
+    if (shard.index() != 0) return;
+
+    runtime.submit_to(1, []() {
+      return make_ready_future(unique_ptr<int>(new int(7)));
+    }).then([&](const unique_ptr<int>& value) {
+      done.set_value(*value);
+    });
+  });
+
+  BOOST_CHECK_EQUAL(7, done.get_future().get());
+
+  runtime.stop();
+  runtime.join();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// The future returned on the target shard is resolved on a thread of the pool,
+// but the result still comes back to the calling shard.
+BOOST_AUTO_TEST_CASE(test_sharded_runtime_submit_to_future_resolved_elsewhere) {
+  const int num_calls = 1000;
+
+  ShardedRuntime     runtime(2, false, 16);
+  ThreadPool         pool(2);
+  std::promise<void> done;
+
+  thread::id       shard_0;
+  std::atomic<int> num_done(0);
+  std::atomic<int> sum(0);
+  std::atomic<int> num_elsewhere(0);
+
+  runtime.start([&](Shard& shard) {
+    if (shard.index() != 0) return;
+
+    shard_0 = this_thread::get_id();
+
+    for (int i = 0; i < num_calls; ++i) {
+      runtime.submit_to(1, [&pool, i]() {
+        return pool.submit([i]() { return i; });
+      }).then([&](int value) {
+        if (this_thread::get_id() != shard_0) ++num_elsewhere;
+
+        sum += value;
+        if (++num_done == num_calls) done.set_value();
+      });
+    }
+  });
+
+  done.get_future().wait();
+  runtime.stop();
+  runtime.join();
+
+  BOOST_CHECK_EQUAL(num_calls * (num_calls - 1) / 2, sum.load());
+  BOOST_CHECK_EQUAL(0, num_elsewhere.load());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_sharded_runtime_submit_to_from_outside) {
+  ShardedRuntime runtime(2, false);
+  runtime.start([](Shard&) {});
+
+  std::promise<Shard*> done;
+
+  runtime.submit_to(1, []() {
+    return ShardedRuntime::current();
+  }).then([&](Shard* shard) {
+    done.set_value(shard);
+  });
+
+  BOOST_CHECK(done.get_future().get() == &runtime.shard(1));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// More calls than fit into the rings, between all pairs of shards at once.
+// The calls from one shard to another run in the order they were sent.
+BOOST_AUTO_TEST_CASE(test_sharded_runtime_many_calls) {
+  const std::size_t num_shards = 3;
+  const int         num_calls  = 10000;
+
+  ShardedRuntime runtime(num_shards, false, 16);
+
+  std::atomic<int>  num_done(0);
+  std::atomic<bool> in_order(true);
+  std::promise<void> done;
+
+  // next[to][from], only touched by the shard `to`.
+  std::vector<std::vector<int>> next(num_shards, std::vector<int>(num_shards, 0));
+
+  auto total = int(num_shards * (num_shards - 1)) * num_calls;
+
+  runtime.start([&](Shard& shard) {
+    auto from = shard.index();
+
+    for (std::size_t to = 0; to < num_shards; ++to) {
+      if (to == from) continue;
+
+      for (int i = 0; i < num_calls; ++i) {
+        runtime.submit_to(to, [&, from, to, i]() {
+          if (next[to][from]++ != i) in_order = false;
+          return i;
+        }).then([&](int) {
+          if (++num_done == total) done.set_value();
+        });
+      }
+    }
+  });
+
+  done.get_future().wait();
+  runtime.stop();
+  runtime.join();
+
+  BOOST_CHECK_EQUAL(total, num_done.load());
+  BOOST_CHECK(in_order);
+}
@@ -0,0 +1,293 @@
+//
+// Copyright (c) 2014 Adam Cigánek (adam.ciganek@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <boost/test/unit_test.hpp>
+#include <atomic>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "test_helpers.h"
+#include "fry/future.h"
+#include "fry/reactor.h"
+#include "fry/stream.h"
+
+using namespace std;
+using namespace fry;
+
+// Counts the allocations, to check the ones made per value.
+static std::atomic<size_t> num_allocations(0);
+
+void* operator new(size_t size) {
+  ++num_allocations;
+  if (void* p = malloc(size ? size : 1)) return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+  free(p);
+}
+
+// Stream of the numbers from 0 to n - 1, counting how many were produced.
+AsyncStream<int> count_to(int n, int& produced) {
+  return generate([n, &produced]() -> boost::optional<int> {
+    if (produced == n) return boost::none;
+    return produced++;
+  });
+}
+
+template<typename T>
+vector<T> collect(AsyncStream<T> stream) {
+  vector<T> result;
+  stream.for_each([&](T value) { result.push_back(std::move(value)); });
+  return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_stream_next) {
+  int  produced = 0;
+  auto stream   = count_to(2, produced);
+
+  vector<boost::optional<int>> values;
+
+  for (int i = 0; i < 3; ++i) {
+    stream.next().then([&](boost::optional<int> value) {
+      values.push_back(value);
+    });
+  }
+
+  BOOST_REQUIRE_EQUAL(3u, values.size());
+  BOOST_CHECK_EQUAL(0, *values[0]);
+  BOOST_CHECK_EQUAL(1, *values[1]);
+  BOOST_CHECK(!values[2]);
+}
+
+BOOST_AUTO_TEST_CASE(test_stream_operators) {
+  int  produced = 0;
+  auto values   = collect(count_to(100, produced)
+                   .filter([](int n) { return n % 2 == 0; })
+                   .map([](int n) { return to_string(n); })
+                   .take(3));
+
+  BOOST_REQUIRE_EQUAL(3u, values.size());
+  BOOST_CHECK_EQUAL("0", values[0]);
+  BOOST_CHECK_EQUAL("2", values[1]);
+  BOOST_CHECK_EQUAL("4", values[2]);
+
+  // Nothing is produced that was not asked for.
+  BOOST_CHECK_EQUAL(5, produced);
+}
+
+BOOST_AUTO_TEST_CASE(test_stream_map_to_future) {
+  Promise<int> promise;
+  int          produced = 0;
+  vector<int>  values;
+
+  auto done = count_to(2, produced)
+    .map([&](int n) {
+      return n == 0 ? promise.get_future() : make_ready_future(n * 10);
+    })
+    .for_each([&](int n) { values.push_back(n); });
+
+  BOOST_CHECK(values.empty());
+  BOOST_CHECK_EQUAL(1, produced);
+
+  bool finished = false;
+  done.then([&]() { finished = true; });
+
+  promise.set_value(-1);
+
+  BOOST_REQUIRE_EQUAL(2u, values.size());
+  BOOST_CHECK_EQUAL(-1, values[0]);
+  BOOST_CHECK_EQUAL(10, values[1]);
+  BOOST_CHECK(finished);
+}
+
+BOOST_AUTO_TEST_CASE(test_stream_moves_values) {
+  int  produced = 0;
+  auto stream   = generate([&]() -> boost::optional<unique_ptr<int>> {
+    if (produced == 3) return boost::none;
+    return unique_ptr<int>(new int(produced++));
+  });
+
+  int sum = 0;
+
+  stream
+    .filter([](const unique_ptr<int>& p) { return *p > 0; })
+    .map([](unique_ptr<int> p) { return std::move(p); })
+    .for_each([&](unique_ptr<int> p) { sum += *p; });
+
+  BOOST_CHECK_EQUAL(3, sum);
+}
+
+BOOST_AUTO_TEST_CASE(test_stream_long_ready_run_does_not_recurse) {
+  int  produced = 0;
+  long sum      = 0;
+
+  count_to(1000000, produced)
+    .filter([](int n) { return n % 1000 == 0; })
+    .for_each([&](int n) { sum += n; });
+
+  BOOST_CHECK_EQUAL(1000000, produced);
+  BOOST_CHECK_EQUAL(499500000L, sum);
+}
+
+BOOST_AUTO_TEST_CASE(test_stream_poll) {
+  int  produced = 0;
+  auto stream   = count_to(5, produced)
+                   .filter([](int n) { return n % 2 == 1; })
+                   .map([](int n) { return n * 10; });
+
+  boost::optional<int> value;
+
+  BOOST_REQUIRE(stream.poll(value));
+  BOOST_CHECK_EQUAL(10, *value);
+  BOOST_REQUIRE(stream.poll(value));
+  BOOST_CHECK_EQUAL(30, *value);
+  BOOST_REQUIRE(stream.poll(value));
+  BOOST_CHECK(!value);
+
+  // Not there right away.
+  Promise<boost::optional<int>> promise;
+  auto waiting = generate([&]() { return promise.get_future(); });
+
+  BOOST_CHECK(!waiting.poll(value));
+}
+
+BOOST_AUTO_TEST_CASE(test_stream_ready_values_do_not_allocate) {
+  int  produced = 0;
+  long sum      = 0;
+
+  auto stream = count_to(10000, produced)
+    .filter([](int n) { return n % 2 == 0; })
+    .map([](int n) { return n / 2; })
+    .take(4000)
+    .buffer(16);
+
+  size_t before = num_allocations;
+  stream.for_each([&](int n) { sum += n; });
+
+  BOOST_CHECK_EQUAL(3999L * 4000 / 2, sum);
+
+  // Nothing per value: only the future for_each returns, and a block of the
+  // buffer's deque now and then.
+  BOOST_CHECK_LT(num_allocations - before, 100u);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_stream_buffer_reads_ahead) {
+  vector<Promise<boost::optional<int>>> promises(5);
+  size_t                                requested = 0;
+
+  auto stream = generate([&]() { return promises[requested++].get_future(); })
+    .buffer(2);
+
+  vector<int> values;
+
+  stream.next().then([&](boost::optional<int> n) { values.push_back(*n); });
+  BOOST_CHECK_EQUAL(1u, requested);
+
+  promises[0].set_value(0);
+  BOOST_CHECK_EQUAL(1u, values.size());
+  BOOST_CHECK_EQUAL(2u, requested);
+
+  promises[1].set_value(1);
+  promises[2].set_value(2);
+
+  // Two read ahead, and no more.
+  BOOST_CHECK_EQUAL(3u, requested);
+
+  stream.next().then([&](boost::optional<int> n) { values.push_back(*n); });
+  stream.next().then([&](boost::optional<int> n) { values.push_back(*n); });
+
+  BOOST_REQUIRE_EQUAL(3u, values.size());
+  BOOST_CHECK_EQUAL(1, values[1]);
+  BOOST_CHECK_EQUAL(2, values[2]);
+  BOOST_CHECK_EQUAL(4u, requested);
+}
+
+BOOST_AUTO_TEST_CASE(test_stream_buffer_of_size_zero_passes_through) {
+  int  produced = 0;
+  auto values   = collect(count_to(3, produced).buffer(0));
+
+  BOOST_REQUIRE_EQUAL(3u, values.size());
+  BOOST_CHECK_EQUAL(2, values[2]);
+}
+
+BOOST_AUTO_TEST_CASE(test_stream_batch) {
+  int  produced = 0;
+  auto batches  = collect(count_to(7, produced).batch(3));
+
+  BOOST_REQUIRE_EQUAL(3u, batches.size());
+  BOOST_CHECK_EQUAL(3u, batches[0].size());
+  BOOST_CHECK_EQUAL(3u, batches[1].size());
+  BOOST_REQUIRE_EQUAL(1u, batches[2].size());
+  BOOST_CHECK_EQUAL(6, batches[2][0]);
+}
+
+BOOST_AUTO_TEST_CASE(test_stream_batch_timeout) {
+  Reactor reactor;
+
+  auto channel = make_shared<Channel<int>>(16);
+  auto batches = from_channel(channel).batch(3, chrono::milliseconds(10), reactor);
+
+  vector<vector<int>> received;
+
+  std::function<void()> receive = [&]() {
+    batches.next().then([&](boost::optional<vector<int>> batch) {
+      if (!batch) return reactor.stop();
+
+      received.push_back(*batch);
+      receive();
+    });
+  };
+
+  receive();
+
+  channel->send(0);
+  channel->send(1);
+
+  // Not full, so it waits for the timeout.
+  BOOST_CHECK(received.empty());
+
+  auto start = Reactor::Clock::now();
+
+  reactor.sleep_for(chrono::milliseconds(50)).then([&]() {
+    channel->send(2);
+    channel->send(3);
+    channel->send(4);
+    channel->send(5);
+    channel->close();
+  });
+
+  reactor.run();
+
+  BOOST_REQUIRE_EQUAL(3u, received.size());
+  BOOST_CHECK_EQUAL(2u, received[0].size());
+  BOOST_CHECK_EQUAL(3u, received[1].size());
+  BOOST_CHECK_EQUAL(1u, received[2].size());
+  BOOST_CHECK(Reactor::Clock::now() - start >= chrono::milliseconds(50));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_stream_from_channel_gives_credit) {
+  auto channel = make_shared<Channel<int>>(2);
+  auto stream  = from_channel(channel);
+  int  sent    = 0;
+
+  for (int i = 0; i < 4; ++i) {
+    channel->send(i).then([&]() { ++sent; });
+  }
+
+  // The producer runs ahead by the two credits only.
+  BOOST_CHECK_EQUAL(2, sent);
+
+  stream.next();
+  BOOST_CHECK_EQUAL(3, sent);
+}
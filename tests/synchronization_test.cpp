@@ -0,0 +1,213 @@
+//
+// Copyright (c) 2014 Adam Cigánek (adam.ciganek@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <boost/test/unit_test.hpp>
+#include <future>
+#include <vector>
+
+#include "test_helpers.h"
+#include "fry/future.h"
+#include "fry/synchronization.h"
+#include "fry/thread_pool.h"
+
+using namespace std;
+using namespace fry;
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_async_mutex_uncontended) {
+  AsyncMutex mutex;
+  bool       locked = false;
+
+  mutex.lock().then([&](const AsyncMutex::Guard& guard) {
+    locked = guard.owns_lock() && mutex.is_locked();
+  });
+
+  BOOST_CHECK(locked);
+  BOOST_CHECK(!mutex.is_locked());
+}
+
+BOOST_AUTO_TEST_CASE(test_async_mutex_hands_over_in_order) {
+  AsyncMutex       mutex;
+  std::vector<int> order;
+
+  std::unique_ptr<AsyncMutex::Guard> held;
+
+  mutex.lock().then([&](const AsyncMutex::Guard& guard) {
+    held.reset(new AsyncMutex::Guard(guard));
+  });
+
+  for (int i = 0; i < 5; ++i) {
+    mutex.lock().then([&, i](const AsyncMutex::Guard&) {
+      order.push_back(i);
+    });
+  }
+
+  BOOST_CHECK(order.empty());
+
+  held.reset();
+
+  BOOST_REQUIRE_EQUAL(5u, order.size());
+  for (int i = 0; i < 5; ++i) BOOST_CHECK_EQUAL(i, order[i]);
+
+  BOOST_CHECK(!mutex.is_locked());
+}
+
+BOOST_AUTO_TEST_CASE(test_async_mutex_guard_copies_hold_the_lock) {
+  AsyncMutex    mutex;
+  Promise<void> written;
+  bool          second = false;
+
+  mutex.lock().then([&](const AsyncMutex::Guard& guard) {
+    return written.get_future().then([guard]() {});
+  });
+
+  mutex.lock().then([&](const AsyncMutex::Guard&) {
+    second = true;
+  });
+
+  BOOST_CHECK(!second);
+
+  written.set_value();
+
+  BOOST_CHECK(second);
+  BOOST_CHECK(!mutex.is_locked());
+}
+
+BOOST_AUTO_TEST_CASE(test_async_mutex_from_many_threads) {
+  AsyncMutex mutex;
+  AsyncLatch done(1000);
+  int        counter = 0;
+
+  // Destroyed first, so the last guard is gone before the mutex.
+  ThreadPool pool(4);
+
+  for (int i = 0; i < 1000; ++i) {
+    pool.post([&]() {
+      mutex.lock().then([&](const AsyncMutex::Guard&) {
+        // Not atomic on purpose.
+        counter = counter + 1;
+        done.count_down();
+      });
+    });
+  }
+
+  std::promise<void> finished;
+  done.wait().then([&]() { finished.set_value(); });
+  finished.get_future().get();
+
+  BOOST_CHECK_EQUAL(1000, counter);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_async_semaphore) {
+  AsyncSemaphore   semaphore(2);
+  std::vector<int> order;
+
+  semaphore.acquire(2).then([&]() { order.push_back(0); });
+
+  // Waits for two, and holds up the one behind it.
+  semaphore.acquire(2).then([&]() { order.push_back(1); });
+  semaphore.acquire(1).then([&]() { order.push_back(2); });
+
+  BOOST_CHECK_EQUAL(1u, order.size());
+  BOOST_CHECK_EQUAL(2u, semaphore.num_waiting());
+  BOOST_CHECK(!semaphore.try_acquire());
+
+  semaphore.release(1);
+  BOOST_CHECK_EQUAL(1u, order.size());
+
+  semaphore.release(1);
+  BOOST_CHECK_EQUAL(2u, order.size());
+
+  semaphore.release(2);
+
+  BOOST_REQUIRE_EQUAL(3u, order.size());
+  BOOST_CHECK_EQUAL(1, order[1]);
+  BOOST_CHECK_EQUAL(2, order[2]);
+  BOOST_CHECK_EQUAL(1u, semaphore.available());
+  BOOST_CHECK_EQUAL(0u, semaphore.num_waiting());
+}
+
+BOOST_AUTO_TEST_CASE(test_async_semaphore_from_many_threads) {
+  AsyncSemaphore   semaphore(3);
+  AsyncLatch       done(1000);
+  std::atomic<int> inside(0);
+  std::atomic<int> max_inside(0);
+
+  ThreadPool pool(4);
+
+  for (int i = 0; i < 1000; ++i) {
+    pool.post([&]() {
+      semaphore.acquire().then([&]() {
+        auto n = ++inside;
+
+        auto max = max_inside.load();
+        while (n > max && !max_inside.compare_exchange_weak(max, n));
+
+        --inside;
+        semaphore.release();
+        done.count_down();
+      });
+    });
+  }
+
+  std::promise<void> finished;
+  done.wait().then([&]() { finished.set_value(); });
+  finished.get_future().get();
+
+  BOOST_CHECK_LE(max_inside.load(), 3);
+  BOOST_CHECK_EQUAL(3u, semaphore.available());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_async_latch) {
+  AsyncLatch latch(2);
+  int        num_done = 0;
+
+  latch.wait().then([&]() { ++num_done; });
+  latch.wait().then([&]() { ++num_done; });
+
+  latch.count_down();
+  BOOST_CHECK_EQUAL(0, num_done);
+  BOOST_CHECK(!latch.is_ready());
+
+  latch.count_down();
+  BOOST_CHECK_EQUAL(2, num_done);
+  BOOST_CHECK(latch.is_ready());
+
+  latch.wait().then([&]() { ++num_done; });
+  BOOST_CHECK_EQUAL(3, num_done);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_async_barrier) {
+  AsyncBarrier     barrier(3);
+  std::vector<int> rounds(3, 0);
+
+  // Every participant goes through the barrier twice.
+  std::function<void(int, int)> participate = [&](int who, int round) {
+    if (round == 2) return;
+
+    barrier.arrive_and_wait().then([&, who, round]() {
+      rounds[who] = round + 1;
+      participate(who, round + 1);
+    });
+  };
+
+  participate(0, 0);
+  participate(1, 0);
+
+  BOOST_CHECK_EQUAL(0, rounds[0] + rounds[1] + rounds[2]);
+
+  participate(2, 0);
+
+  // The third completes the first round, but the second round needs all
+  // three again, and they all arrive from the resumed continuations.
+  BOOST_CHECK_EQUAL(2, rounds[0]);
+  BOOST_CHECK_EQUAL(2, rounds[1]);
+  BOOST_CHECK_EQUAL(2, rounds[2]);
+}
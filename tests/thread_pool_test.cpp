@@ -0,0 +1,90 @@
+//
+// Copyright (c) 2014 Adam Cigánek (adam.ciganek@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <boost/test/unit_test.hpp>
+#include <future>
+
+#include "test_helpers.h"
+#include "fry/future.h"
+#include "fry/thread_pool.h"
+
+using namespace std;
+using namespace fry;
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_thread_pool_submit) {
+  ThreadPool pool(2);
+  std::promise<int> done;
+
+  pool.submit([]() {
+    return 1000;
+  }).then([&](int value) {
+    done.set_value(value);
+  });
+
+  BOOST_CHECK_EQUAL(1000, done.get_future().get());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_thread_pool_submit_flattens_futures) {
+  ThreadPool pool(2);
+  std::promise<int> done;
+
+  pool.submit([&]() {
+    return pool.submit([]() { return 2000; });
+  }).then([&](int value) {
+    done.set_value(value);
+  });
+
+  BOOST_CHECK_EQUAL(2000, done.get_future().get());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_thread_pool_runs_tasks_on_workers) {
+  ThreadPool pool(2);
+  std::promise<bool> done;
+
+  BOOST_CHECK(!pool.running_in_this_thread());
+
+  pool.post([&]() {
+    done.set_value(pool.running_in_this_thread());
+  });
+
+  BOOST_CHECK(done.get_future().get());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_thread_pool_runs_queued_tasks_before_destruction) {
+  Locked<int> counter{0};
+
+  {
+    ThreadPool pool(4);
+
+    for (int i = 0; i < 1000; ++i) {
+      pool.post([&]() {
+        pool.post([&]() { ++counter; });
+      });
+    }
+  }
+
+  BOOST_CHECK_EQUAL(1000, (int) counter);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_thread_pool_as_executor_of_then_on) {
+  ThreadPool pool(2);
+  Promise<int> promise;
+  std::promise<bool> done;
+
+  promise.get_future().then_on(pool, [&](int value) {
+    done.set_value(value == 1000 && pool.running_in_this_thread());
+  });
+
+  promise.set_value(1000);
+
+  BOOST_CHECK(done.get_future().get());
+}
@@ -0,0 +1,195 @@
+//
+// Copyright (c) 2014 Adam Cigánek (adam.ciganek@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <boost/test/unit_test.hpp>
+#include <cstdlib>
+#include <string>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "test_helpers.h"
+#include "fry/uring.h"
+
+using namespace std;
+using namespace fry;
+
+namespace {
+  // Every test runs with both backends.
+  const Uring::Backend backends[] = { Uring::Backend::automatic
+                                    , Uring::Backend::thread_pool };
+
+  // Temporary file, removed at the end of the test.
+  struct TempFile {
+    std::string path;
+    int         fd;
+
+    TempFile() : path("/tmp/fry_uring_test_XXXXXX") {
+      fd = ::mkstemp(&path[0]);
+    }
+
+    ~TempFile() {
+      ::close(fd);
+      ::unlink(path.c_str());
+    }
+  };
+
+  void wait_all(Uring& uring) {
+    while (uring.in_flight() > 0) uring.wait();
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_write_and_read_at) {
+  for (auto backend : backends) {
+    Uring    uring(8, backend);
+    TempFile file;
+
+    std::string data = "hello world";
+    std::size_t written = 0;
+
+    uring.write_at(file.fd, 100, data.data(), data.size()).then([&](std::size_t size) {
+      written = size;
+    });
+
+    wait_all(uring);
+    BOOST_CHECK_EQUAL(data.size(), written);
+
+    char        buffer[64];
+    std::size_t read = 0;
+
+    uring.read_at(file.fd, 106, buffer, sizeof(buffer)).then([&](std::size_t size) {
+      read = size;
+    });
+
+    bool synced = false;
+    uring.fsync(file.fd).then([&]() { synced = true; });
+
+    wait_all(uring);
+
+    BOOST_CHECK_EQUAL("world", std::string(buffer, read));
+    BOOST_CHECK(synced);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_many_operations) {
+  for (auto backend : backends) {
+    // More operations than the submission and completion queues hold.
+    Uring    uring(4, backend);
+    TempFile file;
+
+    const std::size_t num_blocks = 50;
+    std::vector<char> blocks(num_blocks);
+    std::size_t       total = 0;
+
+    for (std::size_t i = 0; i < num_blocks; ++i) {
+      blocks[i] = char('a' + i % 26);
+      uring.write_at(file.fd, i, &blocks[i], 1).then([&](std::size_t size) {
+        total += size;
+      });
+    }
+
+    wait_all(uring);
+    BOOST_CHECK_EQUAL(num_blocks, total);
+
+    std::vector<char> read(num_blocks);
+    BOOST_CHECK_EQUAL(ssize_t(num_blocks), ::pread(file.fd, &read[0], num_blocks, 0));
+    BOOST_CHECK(blocks == read);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_registered_buffers_and_files) {
+  for (auto backend : backends) {
+    Uring    uring(8, backend);
+    TempFile file;
+
+    char buffer[16] = "fixed";
+
+    BOOST_CHECK(!uring.register_buffers({ iovec{ buffer, sizeof(buffer) } }));
+    BOOST_CHECK(!uring.register_files({ file.fd }));
+
+    std::size_t written = 0;
+
+    uring.write_fixed(FixedFile{ 0 }, 0, 0, buffer, 5).then([&](std::size_t size) {
+      written = size;
+    });
+
+    wait_all(uring);
+    BOOST_CHECK_EQUAL(5u, written);
+
+    std::memset(buffer, 0, sizeof(buffer));
+    std::size_t read = 0;
+
+    uring.read_fixed(FixedFile{ 0 }, 0, 0, buffer, sizeof(buffer)).then([&](std::size_t size) {
+      read = size;
+    });
+
+    wait_all(uring);
+    BOOST_CHECK_EQUAL("fixed", std::string(buffer, read));
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_failure) {
+  for (auto backend : backends) {
+    Uring           uring(8, backend);
+    std::error_code error;
+    char            buffer[4];
+
+    uring.read_at(-1, 0, buffer, sizeof(buffer)).then([&](const std::error_code& e) {
+      error = e;
+    });
+
+    wait_all(uring);
+    BOOST_CHECK(error == std::errc::bad_file_descriptor);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_accept_send_recv) {
+  for (auto backend : backends) {
+    Uring uring(8, backend);
+
+    int listener = ::socket(AF_INET, SOCK_STREAM, 0);
+
+    sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family      = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    socklen_t length = sizeof(address);
+    ::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+    ::listen(listener, 1);
+    ::getsockname(listener, reinterpret_cast<sockaddr*>(&address), &length);
+
+    int server = -1;
+    uring.accept(listener).then([&](int fd) { server = fd; });
+    uring.submit();
+
+    int client = ::socket(AF_INET, SOCK_STREAM, 0);
+    BOOST_REQUIRE_EQUAL(0, ::connect(client, reinterpret_cast<sockaddr*>(&address), sizeof(address)));
+
+    wait_all(uring);
+    BOOST_REQUIRE(server >= 0);
+
+    char        buffer[16];
+    std::size_t received = 0;
+
+    uring.recv(server, buffer, sizeof(buffer)).then([&](std::size_t size) {
+      received = size;
+    });
+    uring.send(client, "ping", 4);
+
+    wait_all(uring);
+    BOOST_CHECK_EQUAL("ping", std::string(buffer, received));
+
+    ::close(client);
+    ::close(server);
+    ::close(listener);
+  }
+}
@@ -0,0 +1,165 @@
+//
+// Copyright (c) 2014 Adam Cigánek (adam.ciganek@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <boost/test/unit_test.hpp>
+#include <thread>
+
+#include "test_helpers.h"
+#include "fry/future.h"
+#include "fry/when_all_reduce.h"
+
+using namespace std;
+using namespace fry;
+
+namespace {
+  int add(int acc, int value) { return acc + value; }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_when_all_reduce) {
+  Locked<bool> called{false};
+
+  std::vector<Promise<int>> promises(10);
+  std::vector<Future<int>> futures;
+
+  for (auto& promise : promises) {
+    futures.push_back(promise.get_future());
+  }
+
+  when_all_reduce(futures, 0, add).then([&](int sum) {
+    called = true;
+    BOOST_CHECK_EQUAL(55, sum);
+  });
+
+  int index = 0;
+
+  for (auto& promise : promises) {
+    BOOST_CHECK(!called);
+    promise.set_value(++index);
+  }
+
+  BOOST_CHECK(called);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_when_all_reduce_with_ready_futures) {
+  Locked<bool> called{false};
+
+  std::vector<Future<int>> futures;
+  futures.push_back(make_ready_future(1));
+  futures.push_back(make_ready_future(2));
+
+  when_all_reduce(futures, 0, add).then([&](int sum) {
+    called = true;
+    BOOST_CHECK_EQUAL(3, sum);
+  });
+
+  BOOST_CHECK(called);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_when_all_reduce_with_empty_range) {
+  Locked<bool> called{false};
+
+  std::vector<Future<int>> futures;
+
+  when_all_reduce(futures, 42, add).then([&](int sum) {
+    called = true;
+    BOOST_CHECK_EQUAL(42, sum);
+  });
+
+  BOOST_CHECK(called);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_when_all_reduce_with_merge_across_threads) {
+  const int num_threads = 4;
+  const int per_thread  = 1000;
+
+  Locked<bool> called{false};
+
+  std::vector<Promise<int>> promises(num_threads * per_thread);
+  std::vector<Future<int>> futures;
+
+  for (auto& promise : promises) {
+    futures.push_back(promise.get_future());
+  }
+
+  when_all_reduce(futures, 0, add, add).then([&](int sum) {
+    called = true;
+    BOOST_CHECK_EQUAL(num_threads * per_thread, sum);
+  });
+
+  std::vector<std::thread> threads;
+
+  for (int t = 0; t < num_threads; ++t) {
+    threads.emplace_back([&, t]() {
+      for (int i = 0; i < per_thread; ++i) {
+        promises[t * per_thread + i].set_value(1);
+      }
+    });
+  }
+
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  BOOST_CHECK(called);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_when_all_success_reduce_on_success) {
+  Locked<bool> called{false};
+
+  Promise<Result<int, TestError>> p1;
+  Promise<Result<int, TestError>> p2;
+
+  std::vector<Future<Result<int, TestError>>> futures;
+  futures.push_back(p1.get_future());
+  futures.push_back(p2.get_future());
+
+  when_all_success_reduce(futures, 0, add).then([&](int sum) {
+    called = true;
+    BOOST_CHECK_EQUAL(3000, sum);
+  });
+
+  p1.set_value(Result<int, TestError>(1000));
+  BOOST_CHECK(!called);
+
+  p2.set_value(Result<int, TestError>(2000));
+  BOOST_CHECK(called);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_CASE(test_when_all_success_reduce_on_failure) {
+  Locked<bool> success_called{false};
+  Locked<int>  failure_called{0};
+
+  Promise<Result<int, TestError>> p1;
+  Promise<Result<int, TestError>> p2;
+  Promise<Result<int, TestError>> p3;
+
+  std::vector<Future<Result<int, TestError>>> futures;
+  futures.push_back(p1.get_future());
+  futures.push_back(p2.get_future());
+  futures.push_back(p3.get_future());
+
+  when_all_success_reduce(futures, 0, add, add).then([&](int) {
+    success_called = true;
+  }).then([&](TestError error) {
+    ++failure_called;
+    BOOST_CHECK_EQUAL(error1, error);
+  });
+
+  p1.set_value(Result<int, TestError>(1000));
+  p2.set_value(Result<int, TestError>(error1));
+  BOOST_CHECK_EQUAL(1, (int) failure_called);
+
+  p3.set_value(Result<int, TestError>(error2));
+  BOOST_CHECK(!success_called);
+  BOOST_CHECK_EQUAL(1, (int) failure_called);
+}